@@ -10,10 +10,28 @@
 #include "ofxProperty.h"
 #include "ofxParam.h"
 #include "ofxUtilities.h"
+#include "ofxColorSpace.h"
+#include "ofxPipeline.h"
+#include "ofxToneCurve.h"
+#include "ofxQualifier.h"
+#include "ofxPowerWindow.h"
+#include "ofxBlur.h"
+#include "ofxDetail.h"
+#include "ofxDither.h"
+#include "ofxTemporal.h"
+#include "ofxArena.h"
+#include "ofxThreadPool.h"
+#include "ofxAnalysis.h"
+#include "ofxRenderCache.h"
 
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 // Plugin identifiers
 #define kPluginName "ColorCorrection"
@@ -40,71 +58,699 @@
 #define kParamRGBGainLabel "RGB Gain"
 #define kParamRGBGainHint "Individual gain for Red, Green, Blue channels"
 
+#define kParamSoften "soften"
+#define kParamSoftenLabel "Soften"
+#define kParamSoftenHint "Gaussian blur of the source before the grade, as a standard deviation in pixels"
+
+#define kParamSharpen "sharpen"
+#define kParamSharpenLabel "Sharpen"
+#define kParamSharpenHint "Boosts the finest texture of the source before the grade; negative values smooth it"
+
+#define kParamMidtoneDetail "midtoneDetail"
+#define kParamMidtoneDetailLabel "Midtone Detail"
+#define kParamMidtoneDetailHint "Boosts middle-frequency contrast in the midtones before the grade, leaving shadows and highlights alone; negative values smooth it"
+
+#define kParamTemporalGroup "temporal"
+#define kParamTemporalGroupLabel "Temporal Noise Reduction"
+
+#define kParamTemporalFrames "temporalFrames"
+#define kParamTemporalFramesLabel "Frames"
+#define kParamTemporalFramesHint "Neighboring frames on each side averaged with the current one before the grade; 0 turns it off"
+
+#define kParamTemporalThreshold "temporalThreshold"
+#define kParamTemporalThresholdLabel "Motion Threshold"
+#define kParamTemporalThresholdHint "Difference from the current frame past which a neighboring pixel is treated as motion and ignored"
+
+#define kParamWheelsGroup "colorWheels"
+#define kParamWheelsGroupLabel "Color Wheels"
+
+#define kParamLiftWheel "liftWheel"
+#define kParamLiftWheelLabel "Lift"
+#define kParamLiftWheelHint "Per-channel lift, raises or lowers the shadows while holding white"
+
+#define kParamGammaWheel "gammaWheel"
+#define kParamGammaWheelLabel "Gamma"
+#define kParamGammaWheelHint "Per-channel gamma, values above 1 brighten the midtones"
+
+#define kParamGainWheel "gainWheel"
+#define kParamGainWheelLabel "Gain"
+#define kParamGainWheelHint "Per-channel gain, scales the highlights while holding black"
+
+#define kParamLiftMaster "liftMaster"
+#define kParamLiftMasterLabel "Lift Master"
+#define kParamLiftMasterHint "Lift added to all channels"
+
+#define kParamGammaMaster "gammaMaster"
+#define kParamGammaMasterLabel "Gamma Master"
+#define kParamGammaMasterHint "Gamma applied to all channels"
+
+#define kParamGainMaster "gainMaster"
+#define kParamGainMasterLabel "Gain Master"
+#define kParamGainMasterHint "Gain applied to all channels"
+
+#define kParamCurvesGroup "curves"
+#define kParamCurvesGroupLabel "Curves"
+#define kParamCurvePointsHint "Control points as \"x0 y0 x1 y1 ...\" in [0, 1], joined by a monotone spline"
+
+#define kParamCurveMaster "curveMaster"
+#define kParamCurveMasterLabel "Master Curve"
+
+#define kParamCurveRed "curveRed"
+#define kParamCurveRedLabel "Red Curve"
+
+#define kParamCurveGreen "curveGreen"
+#define kParamCurveGreenLabel "Green Curve"
+
+#define kParamCurveBlue "curveBlue"
+#define kParamCurveBlueLabel "Blue Curve"
+
+#define kParamCurveIdentity "0 0 1 1"
+
+#define kParamQualifierGroup "qualifier"
+#define kParamQualifierGroupLabel "Qualifier"
+
+#define kParamQualifierEnable "qualifierEnable"
+#define kParamQualifierEnableLabel "Enable"
+#define kParamQualifierEnableHint "Limit the grade to the pixels selected by the hue, saturation and luma ranges"
+
+#define kParamQualifierHue "qualifierHue"
+#define kParamQualifierHueLabel "Hue"
+#define kParamQualifierHueHint "Center, width and softness, in turns of the hue circle (0 red, 1/3 green, 2/3 blue); a width of 1 selects every hue"
+
+#define kParamQualifierSaturation "qualifierSaturation"
+#define kParamQualifierSaturationLabel "Saturation"
+#define kParamQualifierSaturationHint "Low, high and softness; a limit of 0 or 1 leaves that side open"
+
+#define kParamQualifierLuma "qualifierLuma"
+#define kParamQualifierLumaLabel "Luma"
+#define kParamQualifierLumaHint "Low, high and softness; a limit of 0 or 1 leaves that side open"
+
+#define kParamQualifierInvert "qualifierInvert"
+#define kParamQualifierInvertLabel "Invert"
+#define kParamQualifierInvertHint "Grade everything except the selection"
+
+#define kParamWindowGroup "window"
+#define kParamWindowGroupLabel "Window"
+
+#define kParamWindowShape "windowShape"
+#define kParamWindowShapeLabel "Shape"
+#define kParamWindowShapeHint "Limit the grade to the inside of a feathered shape"
+
+#define kParamWindowCenter "windowCenter"
+#define kParamWindowCenterLabel "Center"
+#define kParamWindowCenterHint "Center of the shape, as a fraction of the frame"
+
+#define kParamWindowSize "windowSize"
+#define kParamWindowSizeLabel "Size"
+#define kParamWindowSizeHint "Width and height of the shape, as a fraction of the frame"
+
+#define kParamWindowFeather "windowFeather"
+#define kParamWindowFeatherLabel "Feather"
+#define kParamWindowFeatherHint "Width of the soft edge outside the shape, as a fraction of the frame height"
+
+#define kParamWindowPoints "windowPoints"
+#define kParamWindowPointsLabel "Polygon Points"
+#define kParamWindowPointsHint "Polygon corners as \"x0 y0 x1 y1 ...\", in [0, 1] across the box given by the center and size"
+
+#define kParamWindowPointsDefault "0.5 0 1 0.5 0.5 1 0 0.5"
+
+#define kParamWindowInvert "windowInvert"
+#define kParamWindowInvertLabel "Invert"
+#define kParamWindowInvertHint "Grade the outside of the shape instead"
+
+#define kParamInputColorSpace "inputColorSpace"
+#define kParamInputColorSpaceLabel "Input Color Space"
+#define kParamInputColorSpaceHint "Color space the source clip is encoded in"
+
+#define kParamOutputColorSpace "outputColorSpace"
+#define kParamOutputColorSpaceLabel "Output Color Space"
+#define kParamOutputColorSpaceHint "Color space the grade is applied and written in"
+
+#define kParamOutputDither "outputDither"
+#define kParamOutputDitherLabel "Output Dither"
+#define kParamOutputDitherHint "How 8-bit and 16-bit output is rounded to codes; dither breaks up banding in smooth gradients. Float output is not affected"
+
+#define kParamOutputDepth "outputDepth"
+#define kParamOutputDepthLabel "Output Depth"
+#define kParamOutputDepthHint "Bit depth of the output clip; the conversion from the source's depth happens as the grade is written"
+
+#define kParamExtendedRange "extendedRange"
+#define kParamExtendedRangeLabel "Extended Range"
+#define kParamExtendedRangeHint "Keep float output outside 0-1 and let gamma keep the sign of negative values, for scene-linear and HDR grading. 8-bit and 16-bit output is still clamped"
+
+#define kParamRenderCache "renderCache"
+#define kParamRenderCacheLabel "Render Cache"
+#define kParamRenderCacheHint "Keep rendered frames on local disk and serve repeat renders of the same source frame and settings from there. Needs a host that sets image unique identifiers; frames using Temporal NR are not cached"
+
+#define kParamAnalysisGroup "analysis"
+#define kParamAnalysisGroupLabel "Analysis"
+
+#define kParamAnalyzeMethod "analyzeMethod"
+#define kParamAnalyzeMethodLabel "Method"
+#define kParamAnalyzeMethodHint "Gray World neutralizes the frame average; Highlight Percentile neutralizes the brightest 0.5% and brings it to white"
+
+#define kParamAnalyze "analyze"
+#define kParamAnalyzeLabel "Analyze"
+#define kParamAnalyzeHint "Measure every frame of the source clip and key RGB Gain and Gain with the suggested balance"
+
+#define kParamReferenceRender "referenceRender"
+#define kParamReferenceRenderLabel "Reference Render"
+#define kParamReferenceRenderHint "Render with the unfused double-precision path, for validating the fast kernel"
+
 using namespace ofx;
 
+// Curve parameters, master first, in the order they are baked and cached
+static const char* const kCurveParams[] = { kParamCurveMaster, kParamCurveRed, kParamCurveGreen, kParamCurveBlue };
+static const char* const kCurveParamLabels[] = { kParamCurveMasterLabel, kParamCurveRedLabel, kParamCurveGreenLabel, kParamCurveBlueLabel };
+static const int kCurveCount = 4;
+
+// Output Depth options; the first keeps the source's depth
+static const char* const kOutputDepths[] = { nullptr, kOfxBitDepthByte, kOfxBitDepthShort, kOfxBitDepthFloat };
+static const char* const kOutputDepthLabels[] = { "Same as Source", "8-bit", "16-bit", "Float" };
+static const int kOutputDepthCount = 4;
+
+// Parameters render() reads, sampled once per sequence render
+static const char* const kSampledParams[] = {
+    kParamGain, kParamGamma, kParamSaturation, kParamRGBGain,
+    kParamSoften, kParamSharpen, kParamMidtoneDetail, kParamTemporalFrames, kParamTemporalThreshold,
+    kParamLiftWheel, kParamGammaWheel, kParamGainWheel, kParamLiftMaster, kParamGammaMaster, kParamGainMaster,
+    kParamQualifierEnable, kParamQualifierHue, kParamQualifierSaturation, kParamQualifierLuma, kParamQualifierInvert,
+    kParamWindowShape, kParamWindowCenter, kParamWindowSize, kParamWindowFeather, kParamWindowInvert,
+    kParamInputColorSpace, kParamOutputColorSpace, kParamOutputDither, kParamExtendedRange, kParamReferenceRender,
+    kParamCurveMaster, kParamCurveRed, kParamCurveGreen, kParamCurveBlue, kParamRenderCache
+};
+static const int kSampledParamCount = sizeof(kSampledParams) / sizeof(kSampledParams[0]);
+
+// Parameters render() reads besides the sampled ones; with those, they key the render cache
+static const char* const kUnsampledParams[] = { kParamWindowPoints };
+static const int kUnsampledParamCount = sizeof(kUnsampledParams) / sizeof(kUnsampledParams[0]);
+
+/**
+ * @brief Per-instance data, owned through kOfxPropInstanceData
+ *
+ * Caches the last compiled pipeline so tiles of the same frame, and frames
+ * with unchanged parameters, do not rebuild the fused LUTs. During a
+ * sequence render it also holds the parameter samples and the frames kept
+ * for temporal noise reduction.
+ */
+struct ColorCorrectionInstance {
+    std::mutex mutex;
+    std::vector<double> pipelineKey;
+    int pipelineMaxCode;
+    std::shared_ptr<const CompiledPipeline> pipeline;
+    std::string curvePoints[kCurveCount];
+    std::shared_ptr<const std::vector<float> > curveTables[kCurveCount];
+    FrameCache frames;
+    std::shared_ptr<const ParamSampler> samples;
+
+    ColorCorrectionInstance() : pipelineMaxCode(-1) {}
+};
+
+static ColorCorrectionInstance* getInstanceData(OfxImageEffectHandle instance)
+{
+    OfxPropertySetHandle effectProps;
+    gImageEffectSuite->getPropertySet(instance, &effectProps);
+    return (ColorCorrectionInstance*)PropertySet(effectProps).getPointer(kOfxPropInstanceData);
+}
+
+/**
+ * @brief Parameter values sampled for the current sequence render, or null outside one
+ */
+static std::shared_ptr<const ParamSampler> sampledParams(ColorCorrectionInstance* data)
+{
+    if (!data) {
+        return std::shared_ptr<const ParamSampler>();
+    }
+    std::lock_guard<std::mutex> lock(data->mutex);
+    return data->samples;
+}
+
+/**
+ * @brief Fetch the compiled form of a pipeline, compiling it on a cache miss
+ */
+static std::shared_ptr<const CompiledPipeline> compilePipeline(
+    ColorCorrectionInstance* data, const ColorPipeline& pipeline, int maxCode)
+{
+    if (!data) {
+        return std::make_shared<CompiledPipeline>(pipeline, maxCode);
+    }
+
+    std::vector<double> key = pipeline.key();
+    std::lock_guard<std::mutex> lock(data->mutex);
+    if (!data->pipeline || data->pipelineMaxCode != maxCode || data->pipelineKey != key) {
+        OFX_PROFILE_SCOPE(kProbeKernelCompile);
+        data->pipeline = std::make_shared<CompiledPipeline>(pipeline, maxCode);
+        data->pipelineKey.swap(key);
+        data->pipelineMaxCode = maxCode;
+    }
+    return data->pipeline;
+}
+
+/**
+ * @brief Baked table for a curve parameter, re-baked only when its points change
+ *
+ * Returns null for an identity curve so it adds no stage.
+ */
+static std::shared_ptr<const std::vector<float> > bakeCurve(
+    ColorCorrectionInstance* data, int index, const char* text)
+{
+    std::vector<CurvePoint> points = parseCurvePoints(text);
+    if (isIdentityCurve(points)) {
+        return std::shared_ptr<const std::vector<float> >();
+    }
+    if (!data) {
+        return bakeToneCurve(points);
+    }
+
+    std::lock_guard<std::mutex> lock(data->mutex);
+    if (!data->curveTables[index] || data->curvePoints[index] != text) {
+        data->curveTables[index] = bakeToneCurve(points);
+        data->curvePoints[index] = text;
+    }
+    return data->curveTables[index];
+}
+
+/**
+ * @brief Read the qualifier parameters at the reader's time
+ * @return false if the qualifier is disabled
+ */
+static bool readQualifier(const ParamReader& params, Qualifier& qualifier)
+{
+    int enable = 0, invert = 0;
+    params.get(kParamQualifierEnable, enable);
+    if (!enable) {
+        return false;
+    }
+    params.get(kParamQualifierHue, qualifier.hue[0], qualifier.hue[1], qualifier.hue[2]);
+    params.get(kParamQualifierSaturation, qualifier.saturation[0], qualifier.saturation[1], qualifier.saturation[2]);
+    params.get(kParamQualifierLuma, qualifier.luma[0], qualifier.luma[1], qualifier.luma[2]);
+    params.get(kParamQualifierInvert, invert);
+    qualifier.invert = invert != 0;
+    return true;
+}
+
+/**
+ * @brief Read the window parameters at the reader's time, placing the shape on the frame
+ * @param frame Region of definition of the source, in pixels
+ * @return false if no shape is chosen
+ */
+static bool readWindow(const ParamReader& params, const OfxRectI& frame, PowerWindow& window)
+{
+    int shape = kWindowNone, invert = 0;
+    params.get(kParamWindowShape, shape);
+    if (shape <= kWindowNone || shape >= kWindowShapeCount) {
+        return false;
+    }
+
+    double centerX = 0.5, centerY = 0.5, sizeX = 0.5, sizeY = 0.5, feather = 0.0;
+    params.get(kParamWindowCenter, centerX, centerY);
+    params.get(kParamWindowSize, sizeX, sizeY);
+    params.get(kParamWindowFeather, feather);
+    params.get(kParamWindowInvert, invert);
+
+    // Normalized controls to pixels
+    double frameWidth = frame.x2 - frame.x1, frameHeight = frame.y2 - frame.y1;
+    double x = frame.x1 + centerX * frameWidth, y = frame.y1 + centerY * frameHeight;
+    double width = sizeX * frameWidth, height = sizeY * frameHeight;
+    feather *= frameHeight;
+
+    if (shape == kWindowEllipse) {
+        window = PowerWindow::ellipse(x, y, width, height, feather);
+    } else if (shape == kWindowRectangle) {
+        window = PowerWindow::rectangle(x, y, width, height, feather);
+    } else {
+        char* text = nullptr;
+        params.get(kParamWindowPoints, &text);
+        std::vector<WindowPoint> points = parseWindowPoints(text ? text : kParamWindowPointsDefault);
+        for (size_t i = 0; i < points.size(); i++) {
+            points[i].x = x + (points[i].x - 0.5) * width;
+            points[i].y = y + (points[i].y - 0.5) * height;
+        }
+        window = PowerWindow::polygon(points, feather);
+    }
+    window.setInverted(invert != 0);
+    return true;
+}
+
+/**
+ * @brief Describe the grade from the parameters at the reader's time
+ *
+ * Identity stages are left out so they cost nothing. Tone curves are baked
+ * through the instance's curve cache.
+ *
+ * @param frame Region of definition of the source, in pixels, for the power window
+ */
+static void readGrade(ColorCorrectionInstance* data, const ParamReader& params, const OfxRectI& frame,
+                      ColorPipeline& pipeline, PowerWindow& window)
+{
+    double gainValue = 1.0, gammaValue = 1.0, saturationValue = 1.0;
+    double rGain = 1.0, gGain = 1.0, bGain = 1.0;
+    double lift[3], wheelGamma[3], wheelGain[3];
+    double liftMasterValue = 0.0, gammaMasterValue = 1.0, gainMasterValue = 1.0;
+    int inputSpace = kColorSpaceRec709, outputSpace = kColorSpaceRec709;
+    int extendedRange = 0;
+
+    params.get(kParamGain, gainValue);
+    params.get(kParamGamma, gammaValue);
+    params.get(kParamSaturation, saturationValue);
+    params.get(kParamRGBGain, rGain, gGain, bGain);
+    params.get(kParamLiftWheel, lift[0], lift[1], lift[2]);
+    params.get(kParamGammaWheel, wheelGamma[0], wheelGamma[1], wheelGamma[2]);
+    params.get(kParamGainWheel, wheelGain[0], wheelGain[1], wheelGain[2]);
+    params.get(kParamLiftMaster, liftMasterValue);
+    params.get(kParamGammaMaster, gammaMasterValue);
+    params.get(kParamGainMaster, gainMasterValue);
+    params.get(kParamInputColorSpace, inputSpace);
+    params.get(kParamOutputColorSpace, outputSpace);
+    params.get(kParamExtendedRange, extendedRange);
+    bool preserveSign = extendedRange != 0;
+
+    // Describe the grade; identity stages are left out so they cost nothing
+    pipeline.setExtendedRange(preserveSign);
+    pipeline.addConversion((ColorSpace)inputSpace, (ColorSpace)outputSpace);
+
+    // Power window, placed on the source frame; the grade below applies inside it
+    if (readWindow(params, frame, window)) {
+        pipeline.limit();
+    }
+
+    // Secondary: the grade below applies only where the qualifier selects
+    Qualifier qualifier;
+    if (readQualifier(params, qualifier)) {
+        pipeline.qualify(qualifier);
+    }
+
+    if (rGain != 1.0 || gGain != 1.0 || bGain != 1.0) {
+        pipeline.add(PipelineStage::gain(rGain, gGain, bGain));
+    }
+    if (gainValue != 1.0) {
+        pipeline.add(PipelineStage::gain(gainValue, gainValue, gainValue));
+    }
+
+    // Lift/gamma/gain coefficients, combined with the masters once per render
+    bool wheelsActive = false;
+    for (int c = 0; c < 3; c++) {
+        lift[c] += liftMasterValue;
+        wheelGamma[c] *= gammaMasterValue;
+        wheelGain[c] *= gainMasterValue;
+        wheelsActive = wheelsActive || lift[c] != 0.0 || wheelGamma[c] != 1.0 || wheelGain[c] != 1.0;
+    }
+    if (wheelsActive) {
+        pipeline.add(PipelineStage::liftGammaGain(lift, wheelGamma, wheelGain, preserveSign));
+    }
+    if (gammaValue != 1.0) {
+        pipeline.add(PipelineStage::gamma(gammaValue, gammaValue, gammaValue, preserveSign));
+    }
+    if (saturationValue != 1.0) {
+        pipeline.add(PipelineStage::saturation(saturationValue, colorSpaceLuma((ColorSpace)outputSpace)));
+    }
+
+    // Tone curves, baked to tables that fold into the fused curve LUT
+    std::shared_ptr<const std::vector<float> > curveTables[kCurveCount];
+    bool curvesActive = false;
+    for (int i = 0; i < kCurveCount; i++) {
+        char* points = nullptr;
+        params.get(kCurveParams[i], &points);
+        curveTables[i] = bakeCurve(data, i, points ? points : kParamCurveIdentity);
+        curvesActive = curvesActive || curveTables[i];
+    }
+    if (curvesActive) {
+        pipeline.add(PipelineStage::toneCurve(curveTables[0], curveTables[1], curveTables[2], curveTables[3]));
+    }
+}
+
+/**
+ * @brief Horizontal render scale of an action, 1 if the host gave none
+ */
+static double readRenderScale(PropertySet& inArgsProps)
+{
+    double scale[2] = { 1.0, 1.0 };
+    inArgsProps.get(prop::kRenderScale, scale);
+    return scale[0] > 0.0 ? scale[0] : 1.0;
+}
+
 /**
  * @brief Process pixels for color correction
+ *
+ * Double-precision reference: evaluates every pipeline stage per pixel,
+ * without fusion or lookup tables. The fused CompiledPipeline kernel is
+ * validated against this. Detail is added to each pixel as it is read, so
+ * it shares the final write with the stages, as does the conversion to
+ * the output's depth. Integer output is quantized with the same dither
+ * thresholds as the kernel.
  */
-template<typename T>
+template<typename TSrc, typename TDst>
 void processPixels(
-    T* dst, const T* src,
+    TDst* dst, const TSrc* src,
     const OfxRectI& renderWindow,
     int dstRowBytes, int srcRowBytes,
-    double gain, double gamma, double saturation,
-    double rGain, double gGain, double bGain,
-    double maxValue)
+    const ColorPipeline& pipeline,
+    const PowerWindow& window,
+    const DetailPyramid& detail,
+    const DitherPattern& dither,
+    double srcMax, double dstMax)
 {
     int width = renderWindow.x2 - renderWindow.x1;
     int height = renderWindow.y2 - renderWindow.y1;
+    bool windowed = pipeline.isLimited() && window.isActive();
+    bool integer = std::numeric_limits<TDst>::is_integer;
+    bool clampColor = integer || !pipeline.isExtendedRange();
+    double bias = integer ? 0.5 : 0.0;
 
     for (int y = 0; y < height; y++) {
-        T* dstRow = (T*)((char*)dst + y * dstRowBytes);
-        const T* srcRow = (const T*)((const char*)src + y * srcRowBytes);
+        TDst* dstRow = (TDst*)((char*)dst + y * dstRowBytes);
+        const TSrc* srcRow = (const TSrc*)((const char*)src + y * srcRowBytes);
 
         for (int x = 0; x < width; x++) {
             int pixelIndex = x * 4; // RGBA
 
             // Read source pixels and normalize
-            double r = srcRow[pixelIndex + 0] / maxValue;
-            double g = srcRow[pixelIndex + 1] / maxValue;
-            double b = srcRow[pixelIndex + 2] / maxValue;
-            double a = srcRow[pixelIndex + 3] / maxValue;
-
-            // Apply RGB gain
-            r *= rGain;
-            g *= gGain;
-            b *= bGain;
-
-            // Apply overall gain
-            r *= gain;
-            g *= gain;
-            b *= gain;
-
-            // Apply gamma
-            if (gamma != 1.0) {
-                r = std::pow(std::max(0.0, r), gamma);
-                g = std::pow(std::max(0.0, g), gamma);
-                b = std::pow(std::max(0.0, b), gamma);
+            double r = srcRow[pixelIndex + 0] / srcMax;
+            double g = srcRow[pixelIndex + 1] / srcMax;
+            double b = srcRow[pixelIndex + 2] / srcMax;
+            double a = srcRow[pixelIndex + 3] / srcMax;
+
+            // Float samples are limited and non-finite ones read as 0, as in the fast path
+            if (!std::numeric_limits<TSrc>::is_integer) {
+                r = std::isfinite(r) ? std::max(-kMaxFloatSample, std::min(kMaxFloatSample, r)) : 0.0;
+                g = std::isfinite(g) ? std::max(-kMaxFloatSample, std::min(kMaxFloatSample, g)) : 0.0;
+                b = std::isfinite(b) ? std::max(-kMaxFloatSample, std::min(kMaxFloatSample, b)) : 0.0;
+                a = std::isfinite(a) ? std::max(-kMaxFloatSample, std::min(kMaxFloatSample, a)) : 0.0;
             }
 
-            // Apply saturation
-            if (saturation != 1.0) {
-                // Calculate luminance (Rec. 709)
-                double luma = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+            // Sharpening and midtone detail from the frame's pyramid
+            detail.applyPixel(renderWindow.x1 + x, renderWindow.y1 + y, r, g, b);
+
+            // Color space conversion, gain, gamma, saturation
+            double coverage = windowed ? window.coverage(renderWindow.x1 + x, renderWindow.y1 + y) : 1.0;
+            pipeline.apply(r, g, b, coverage);
 
-                // Interpolate between grayscale and color
-                r = luma + saturation * (r - luma);
-                g = luma + saturation * (g - luma);
-                b = luma + saturation * (b - luma);
+            // Clamp and write output, NaN as 0, dithering the color of integer output; extended range
+            // float output keeps the color as it is
+            double threshold = integer ? dither.threshold(renderWindow.x1 + x, renderWindow.y1 + y) : 0.0;
+            if (clampColor) {
+                r = std::min(1.0, std::max(0.0, r));
+                g = std::min(1.0, std::max(0.0, g));
+                b = std::min(1.0, std::max(0.0, b));
             }
+            dstRow[pixelIndex + 0] = (TDst)(r * dstMax + threshold);
+            dstRow[pixelIndex + 1] = (TDst)(g * dstMax + threshold);
+            dstRow[pixelIndex + 2] = (TDst)(b * dstMax + threshold);
+            dstRow[pixelIndex + 3] = (TDst)(std::min(1.0, std::max(0.0, a)) * dstMax + bias);
+        }
+    }
+}
+
+// Pixels per render band: small enough that an abort is seen within about a millisecond
+static const int kBandPixels = 32768;
+
+/**
+ * @brief Largest code of an integer pixel type, 0 for float
+ */
+template<typename T>
+static int maxCodeOf()
+{
+    return std::numeric_limits<T>::is_integer ? (int)std::numeric_limits<T>::max() : 0;
+}
+
+/**
+ * @brief Render one pair of source and output depths, through the fused kernel or the reference path
+ *
+ * The window is split into row bands run on the shared pool, with abort
+ * polled before each band. Each thread's row buffers come from its arena
+ * in arenas, indexed by slot.
+ *
+ * @return false if the host aborted before every band was rendered
+ */
+template<typename TSrc, typename TDst>
+static bool renderPixels(
+    ColorCorrectionInstance* data,
+    TDst* dst, const TSrc* src,
+    const OfxRectI& renderWindow,
+    int dstRowBytes, int srcRowBytes,
+    const ColorPipeline& pipeline,
+    const PowerWindow& window,
+    const DetailPyramid& detail,
+    const DitherPattern& dither,
+    ScratchLease& arenas,
+    bool reference,
+    AbortPoller& abort)
+{
+    const int srcCode = maxCodeOf<TSrc>();
+    const int dstCode = maxCodeOf<TDst>();
+    double srcMax = srcCode > 0 ? (double)srcCode : 1.0;
+    double dstMax = dstCode > 0 ? (double)dstCode : 1.0;
+    std::shared_ptr<const CompiledPipeline> compiled;
+    if (!reference) {
+        compiled = compilePipeline(data, pipeline, srcCode);
+    }
+
+    int width = renderWindow.x2 - renderWindow.x1;
+    int height = renderWindow.y2 - renderWindow.y1;
+    if (width <= 0 || height <= 0) {
+        return true;
+    }
+    int bandRows = std::max(1, kBandPixels / width);
+    int bands = (height + bandRows - 1) / bandRows;
+
+    OFX_PROFILE_SCOPE(reference ? kProbeKernelReference : kProbeKernelRender);
+    return ThreadPool::shared().parallelFor(bands, [&](int index, int slot) {
+        int rowOffset = index * bandRows;
+        OfxRectI band = renderWindow;
+        band.y1 = renderWindow.y1 + rowOffset;
+        band.y2 = std::min(band.y1 + bandRows, renderWindow.y2);
+
+        TDst* bandDst = (TDst*)((char*)dst + (ptrdiff_t)rowOffset * dstRowBytes);
+        const TSrc* bandSrc = (const TSrc*)((const char*)src + (ptrdiff_t)rowOffset * srcRowBytes);
+        if (reference) {
+            processPixels(bandDst, bandSrc, band, dstRowBytes, srcRowBytes, pipeline, window, detail, dither,
+                          srcMax, dstMax);
+        } else {
+            compiled->process(bandDst, bandSrc, band, dstRowBytes, srcRowBytes, srcMax, dstMax,
+                              &window, &detail, &dither, &arenas[slot]);
+        }
+    }, [&abort] { return abort.poll(); });
+}
+
+/**
+ * @brief renderPixels from one source depth, dispatched on the output's depth
+ */
+template<typename TSrc>
+static bool renderToDepth(
+    BitDepth dstDepth,
+    ColorCorrectionInstance* data,
+    void* dst, const TSrc* src,
+    const OfxRectI& renderWindow,
+    int dstRowBytes, int srcRowBytes,
+    const ColorPipeline& pipeline,
+    const PowerWindow& window,
+    const DetailPyramid& detail,
+    const DitherPattern& dither,
+    ScratchLease& arenas,
+    bool reference,
+    AbortPoller& abort)
+{
+    switch (dstDepth) {
+        case kBitDepthByte:
+            return renderPixels(data, (unsigned char*)dst, src, renderWindow, dstRowBytes, srcRowBytes,
+                                pipeline, window, detail, dither, arenas, reference, abort);
+        case kBitDepthShort:
+            return renderPixels(data, (unsigned short*)dst, src, renderWindow, dstRowBytes, srcRowBytes,
+                                pipeline, window, detail, dither, arenas, reference, abort);
+        case kBitDepthFloat:
+            return renderPixels(data, (float*)dst, src, renderWindow, dstRowBytes, srcRowBytes,
+                                pipeline, window, detail, dither, arenas, reference, abort);
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Average the source over region with its neighbors in time, into a buffer from storage
+ *
+ * Neighbors come from the instance's frame cache when it holds them and from
+ * the host otherwise, so a sequential render fetches each frame once as it
+ * enters the range. The current frame is cached for the renders that follow;
+ * its identifier also checks the cache against upstream changes. Neighbors
+ * past the ends of the clip are left out.
+ */
+static bool denoiseTemporal(ColorCorrectionInstance* data, OfxImageClipHandle sourceClip, double time,
+                            double renderScale, int frameCount, double threshold, OfxPropertySetHandle sourceImg,
+                            const FrameView& current, BitDepth depth, const OfxRectI& region,
+                            ScratchArena& storage, void*& denoised, int& denoisedRowBytes,
+                            ScratchLease& threads, ThreadPool& pool, AbortPoller& abort)
+{
+    OfxPropertySetHandle sourceClipProps;
+    gImageEffectSuite->clipGetPropertySet(sourceClip, &sourceClipProps);
+    PropertySet clipProps(sourceClipProps);
+    double range[2] = { time, time };
+    clipProps.get(prop::kFrameRange, range);
+    double firstFrame = range[0], lastFrame = range[1];
+
+    FrameCache localFrames;
+    FrameCache& frames = data ? data->frames : localFrames;
+    frames.setCapacity(2 * frameCount + 2);
+
+    const char* uniqueId = PropertySet(sourceImg).get(prop::kImageUniqueIdentifier);
+    std::string identifier = uniqueId ? uniqueId : "";
+    frames.validate(time, renderScale, identifier);
+    if (!frames.find(time, renderScale, region, depth)) {
+        frames.insert(time, renderScale, identifier, current, depth);
+    }
 
-            // Clamp and write output
-            dstRow[pixelIndex + 0] = (T)(std::min(std::max(r, 0.0), 1.0) * maxValue);
-            dstRow[pixelIndex + 1] = (T)(std::min(std::max(g, 0.0), 1.0) * maxValue);
-            dstRow[pixelIndex + 2] = (T)(std::min(std::max(b, 0.0), 1.0) * maxValue);
-            dstRow[pixelIndex + 3] = (T)(std::min(std::max(a, 0.0), 1.0) * maxValue);
+    // Cached frames stay alive while held here; uncached ones are held as host images
+    std::vector<std::shared_ptr<const FrameCache::Frame> > held;
+    std::vector<OfxPropertySetHandle> images;
+    std::vector<FrameView> neighbors;
+    for (int offset = -frameCount; offset <= frameCount; offset++) {
+        double neighborTime = time + offset;
+        if (offset == 0 || neighborTime < firstFrame || neighborTime > lastFrame) {
+            continue;
         }
+        std::shared_ptr<const FrameCache::Frame> frame = frames.find(neighborTime, renderScale, region, depth);
+        if (!frame) {
+            OfxPropertySetHandle image = nullptr;
+            {
+                OFX_PROFILE_SCOPE(kProbeClipGetImage);
+                if (gImageEffectSuite->clipGetImage(sourceClip, neighborTime, nullptr, &image) != kOfxStatOK) {
+                    continue;
+                }
+            }
+            Image neighbor(image);
+            FrameView view = { neighbor.data(), neighbor.getBounds(), neighbor.getRowBytes() };
+            const char* neighborId = PropertySet(image).get(prop::kImageUniqueIdentifier);
+            bool usable = view.data && neighbor.getPixelDepth() == depth
+                && view.bounds.x2 > view.bounds.x1 && view.bounds.y2 > view.bounds.y1;
+            if (!usable) {
+                gImageEffectSuite->clipReleaseImage(image);
+                continue;
+            }
+            frame = frames.insert(neighborTime, renderScale, neighborId ? neighborId : "", view, depth);
+            if (!frame) {
+                images.push_back(image);
+                neighbors.push_back(view);
+                continue;
+            }
+            gImageEffectSuite->clipReleaseImage(image);
+        }
+        held.push_back(frame);
+        neighbors.push_back(frame->view());
     }
+
+    denoisedRowBytes = (region.x2 - region.x1) * 4 * (int)depth;
+    denoised = storage.allocateBytes((size_t)denoisedRowBytes * (region.y2 - region.y1));
+    bool completed;
+    {
+        OFX_PROFILE_SCOPE(kProbeKernelTemporal);
+        TemporalDenoiser denoiser(threshold);
+        completed = denoiser.apply(current, neighbors, depth, denoised, region, denoisedRowBytes,
+                                   threads, pool, [&abort] { return abort.poll(); });
+    }
+
+    for (size_t i = 0; i < images.size(); i++) {
+        gImageEffectSuite->clipReleaseImage(images[i]);
+    }
+    return completed;
 }
 
 /**
@@ -114,13 +760,9 @@ static OfxStatus render(OfxImageEffectHandle instance, OfxPropertySetHandle inAr
 {
     // Get the render window
     PropertySet inArgsProps(inArgs);
-    OfxRectI renderWindow;
-    renderWindow.x1 = inArgsProps.getInt(kOfxImageEffectPropRenderWindow, 0);
-    renderWindow.y1 = inArgsProps.getInt(kOfxImageEffectPropRenderWindow, 1);
-    renderWindow.x2 = inArgsProps.getInt(kOfxImageEffectPropRenderWindow, 2);
-    renderWindow.y2 = inArgsProps.getInt(kOfxImageEffectPropRenderWindow, 3);
-
-    double time = inArgsProps.getDouble(kOfxPropTime);
+    OfxRectI renderWindow = inArgsProps.getRect(prop::kRenderWindow);
+    double time = inArgsProps.get(prop::kTime);
+    OFX_PROFILE_RENDER_WINDOW(renderWindow.x2 - renderWindow.x1, renderWindow.y2 - renderWindow.y1);
 
     // Get clips
     OfxImageClipHandle sourceClip, outputClip;
@@ -131,74 +773,474 @@ static OfxStatus render(OfxImageEffectHandle instance, OfxPropertySetHandle inAr
 
     // Get images
     OfxPropertySetHandle sourceImg, outputImg;
-    gImageEffectSuite->clipGetImage(sourceClip, time, nullptr, &sourceImg);
-    gImageEffectSuite->clipGetImage(outputClip, time, nullptr, &outputImg);
+    {
+        OFX_PROFILE_SCOPE(kProbeClipGetImage);
+        gImageEffectSuite->clipGetImage(sourceClip, time, nullptr, &sourceImg);
+        gImageEffectSuite->clipGetImage(outputClip, time, nullptr, &outputImg);
+    }
 
-    // Get parameters
+    ColorCorrectionInstance* data = getInstanceData(instance);
+
+    // Get parameters, from the sequence's samples where they cover this frame
     OfxParamSetHandle paramSet;
     gImageEffectSuite->getParamSet(instance, &paramSet);
+    std::shared_ptr<const ParamSampler> samples = sampledParams(data);
+    ParamReader params(paramSet, time, samples.get());
 
-    OfxParamHandle gainParam, gammaParam, saturationParam, rgbGainParam;
-    OfxPropertySetHandle gainParamProps, gammaParamProps, saturationParamProps, rgbGainParamProps;
+    int reference = 0;
+    params.get(kParamReferenceRender, reference);
 
-    gParameterSuite->paramGetHandle(paramSet, kParamGain, &gainParam, &gainParamProps);
-    gParameterSuite->paramGetHandle(paramSet, kParamGamma, &gammaParam, &gammaParamProps);
-    gParameterSuite->paramGetHandle(paramSet, kParamSaturation, &saturationParam, &saturationParamProps);
-    gParameterSuite->paramGetHandle(paramSet, kParamRGBGain, &rgbGainParam, &rgbGainParamProps);
+    double softenValue = 0.0, sharpenValue = 0.0, midtoneDetailValue = 0.0;
+    double renderScale = readRenderScale(inArgsProps);
+    params.get(kParamSoften, softenValue);
+    params.get(kParamSharpen, sharpenValue);
+    params.get(kParamMidtoneDetail, midtoneDetailValue);
 
-    // Get parameter values
-    Param gain(gainParam);
-    Param gamma(gammaParam);
-    Param saturation(saturationParam);
-    Param rgbGain(rgbGainParam);
+    int temporalFrames = 0;
+    double temporalThreshold = 0.0;
+    params.get(kParamTemporalFrames, temporalFrames);
+    params.get(kParamTemporalThreshold, temporalThreshold);
 
-    double gainValue, gammaValue, saturationValue;
-    double rGain, gGain, bGain;
+    int outputDither = kQuantizeNearest;
+    params.get(kParamOutputDither, outputDither);
+    DitherPattern dither((Quantization)outputDither);
 
-    gain.getValueAtTime(time, gainValue);
-    gamma.getValueAtTime(time, gammaValue);
-    saturation.getValueAtTime(time, saturationValue);
-    rgbGain.getValueAtTime(time, rGain, gGain, bGain);
+    int renderCache = 0;
+    params.get(kParamRenderCache, renderCache);
 
     // Get image properties
-    PropertySet srcImgProps(sourceImg);
-    PropertySet dstImgProps(outputImg);
+    Image source(sourceImg), output(outputImg);
+    void* srcData = source.data();
+    void* dstData = output.data();
+    int srcRowBytes = source.getRowBytes();
+    int dstRowBytes = output.getRowBytes();
+    // The output may differ in depth when the host honors the clip preferences; the conversion happens in the
+    // grade's write. Everything before it works at the source's depth.
+    BitDepth depth = (BitDepth)source.getPixelDepth();
+    BitDepth outputDepth = (BitDepth)output.getPixelDepth();
 
-    void* srcData = srcImgProps.getPointer(kOfxImagePropData);
-    void* dstData = dstImgProps.getPointer(kOfxImagePropData);
+    // Address both images at the render window's corner; their bounds may be larger
+    OfxRectI srcBounds = source.getBounds();
+    OfxRectI dstBounds = output.getBounds();
+    int pixelBytes = 4 * (int)depth;
+    void* dstOrigin = (char*)dstData
+        + (ptrdiff_t)(renderWindow.y1 - dstBounds.y1) * dstRowBytes
+        + (ptrdiff_t)(renderWindow.x1 - dstBounds.x1) * 4 * (int)outputDepth;
+    bool renderable = renderWindow.x2 > renderWindow.x1 && renderWindow.y2 > renderWindow.y1;
 
-    int srcRowBytes = srcImgProps.getInt(kOfxImagePropRowBytes);
-    int dstRowBytes = dstImgProps.getInt(kOfxImagePropRowBytes);
+    // Render cache: a window rendered before from the same source frame with the same
+    // parameters is copied from disk. Temporal NR also reads the neighboring frames, whose
+    // identities the key does not cover, and reference renders are for checking the kernel.
+    const char* sourceId = PropertySet(sourceImg).get(prop::kImageUniqueIdentifier);
+    RenderCache* cache = renderCache && !reference && temporalFrames == 0 && renderable && dstData
+        && sourceId && *sourceId ? &RenderCache::shared() : nullptr;
+    RenderCache::Key cacheKey;
+    if (cache) {
+        cacheKey.identifier = sourceId;
+        cacheKey.time = time;
+        cacheKey.window = renderWindow;
+        cacheKey.renderScale = renderScale;
+        cacheKey.sourceDepth = depth;
+        cacheKey.outputDepth = outputDepth;
+        cacheKey.paramHash = params.hash(kUnsampledParams, kUnsampledParamCount,
+                                         params.hash(kSampledParams, kSampledParamCount));
+        bool hit;
+        {
+            OFX_PROFILE_SCOPE(kProbeCacheLoad);
+            hit = cache->load(cacheKey, dstOrigin, dstRowBytes);
+        }
+        if (hit) {
+            OFX_PROFILE_SCOPE(kProbeClipReleaseImage);
+            gImageEffectSuite->clipReleaseImage(sourceImg);
+            gImageEffectSuite->clipReleaseImage(outputImg);
+            return kOfxStatOK;
+        }
+    }
+
+    // Describe the grade, with the power window placed on the source frame
+    OfxRectI frame = PropertySet(sourceImg).getRect(prop::kImageRegionOfDefinition);
+    if (frame.x2 <= frame.x1 || frame.y2 <= frame.y1) {
+        frame = source.getBounds();
+    }
+    ColorPipeline pipeline;
+    PowerWindow window;
+    readGrade(data, params, frame, pipeline, window);
+
+    AbortPoller abort(instance);
+    bool completed = true;
+    ThreadPool& pool = ThreadPool::shared();
 
-    const char* pixelDepth = srcImgProps.getString(kOfxImageEffectPropPixelDepth);
+    // Detail bands, in render pixels, from a pyramid built once for the whole window
+    DetailPyramid detail(sharpenValue, midtoneDetailValue);
+    GaussianBlur blur(softenValue * renderScale);
 
-    // Process based on bit depth
-    if (strcmp(pixelDepth, kOfxBitDepthByte) == 0) {
-        processPixels<unsigned char>(
-            (unsigned char*)dstData, (const unsigned char*)srcData,
-            renderWindow, dstRowBytes, srcRowBytes,
-            gainValue, gammaValue, saturationValue,
-            rGain, gGain, bGain, 255.0);
+    // Frame buffers and pyramid levels in a frame arena, leased first so it is the largest
+    // free one; each thread's line and row buffers in its own
+    ScratchLease frameArena(1);
+    ScratchLease threadArenas(pool.maxParticipants());
+
+    // Temporal noise reduction: average with the neighboring frames into a buffer covering
+    // everything Soften and the detail pyramid read, which the rest then reads
+    if (temporalFrames > 0 && renderable && srcData) {
+        OfxRectI region = detail.expand(renderWindow);
+        if (!blur.isIdentity()) {
+            region = blur.expand(region);
+        }
+        region.x1 = std::max(region.x1, srcBounds.x1);
+        region.y1 = std::max(region.y1, srcBounds.y1);
+        region.x2 = std::min(region.x2, srcBounds.x2);
+        region.y2 = std::min(region.y2, srcBounds.y2);
+        if (region.x2 > region.x1 && region.y2 > region.y1) {
+            FrameView current = { srcData, srcBounds, srcRowBytes };
+            void* denoised = nullptr;
+            int denoisedRowBytes = 0;
+            completed = denoiseTemporal(data, sourceClip, time, renderScale, temporalFrames, temporalThreshold,
+                                        sourceImg, current, depth, region, frameArena[0], denoised,
+                                        denoisedRowBytes, threadArenas, pool, abort);
+            srcData = denoised;
+            srcBounds = region;
+            srcRowBytes = denoisedRowBytes;
+        }
     }
-    else if (strcmp(pixelDepth, kOfxBitDepthShort) == 0) {
-        processPixels<unsigned short>(
-            (unsigned short*)dstData, (const unsigned short*)srcData,
-            renderWindow, dstRowBytes, srcRowBytes,
-            gainValue, gammaValue, saturationValue,
-            rGain, gGain, bGain, 65535.0);
+
+    // Soften: blur the source into a buffer covering the render window and the detail margin,
+    // which the rest then reads
+    if (completed && !blur.isIdentity() && renderable) {
+        OfxRectI softenedBounds = detail.expand(renderWindow);
+        int softenedRowBytes = (softenedBounds.x2 - softenedBounds.x1) * pixelBytes;
+        void* softened = frameArena[0].allocateBytes((size_t)softenedRowBytes * (softenedBounds.y2 - softenedBounds.y1));
+        OFX_PROFILE_SCOPE(kProbeKernelBlur);
+        completed = blur.apply(srcData, srcBounds, srcRowBytes, softened, softenedBounds, softenedRowBytes, depth,
+                               pool, [&abort] { return abort.poll(); });
+        srcData = softened;
+        srcBounds = softenedBounds;
+        srcRowBytes = softenedRowBytes;
     }
-    else if (strcmp(pixelDepth, kOfxBitDepthFloat) == 0) {
-        processPixels<float>(
-            (float*)dstData, (const float*)srcData,
-            renderWindow, dstRowBytes, srcRowBytes,
-            gainValue, gammaValue, saturationValue,
-            rGain, gGain, bGain, 1.0);
+    const void* srcOrigin = (const char*)srcData
+        + (ptrdiff_t)(renderWindow.y1 - srcBounds.y1) * srcRowBytes + (ptrdiff_t)(renderWindow.x1 - srcBounds.x1) * pixelBytes;
+
+    if (completed && detail.isActive() && renderable) {
+        OFX_PROFILE_SCOPE(kProbeKernelDetail);
+        completed = detail.build(srcData, srcBounds, srcRowBytes, depth, renderWindow, frameArena[0], threadArenas,
+                                 pool, [&abort] { return abort.poll(); });
+    }
+
+    // Process based on the source and output bit depths
+    switch (completed ? depth : kBitDepthNone) {
+        case kBitDepthByte:
+            completed = renderToDepth(outputDepth, data, dstOrigin, (const unsigned char*)srcOrigin,
+                renderWindow, dstRowBytes, srcRowBytes,
+                pipeline, window, detail, dither, threadArenas, reference != 0, abort);
+            break;
+        case kBitDepthShort:
+            completed = renderToDepth(outputDepth, data, dstOrigin, (const unsigned short*)srcOrigin,
+                renderWindow, dstRowBytes, srcRowBytes,
+                pipeline, window, detail, dither, threadArenas, reference != 0, abort);
+            break;
+        case kBitDepthFloat:
+            completed = renderToDepth(outputDepth, data, dstOrigin, (const float*)srcOrigin,
+                renderWindow, dstRowBytes, srcRowBytes,
+                pipeline, window, detail, dither, threadArenas, reference != 0, abort);
+            break;
+        default:
+            break;
+    }
+
+    // Keep the finished window; the file is written on the cache's own thread
+    if (cache && completed && (depth == kBitDepthByte || depth == kBitDepthShort || depth == kBitDepthFloat)) {
+        OFX_PROFILE_SCOPE(kProbeCacheStore);
+        cache->store(cacheKey, dstOrigin, dstRowBytes);
     }
 
     // Release images
-    gImageEffectSuite->clipReleaseImage(sourceImg);
-    gImageEffectSuite->clipReleaseImage(outputImg);
+    {
+        OFX_PROFILE_SCOPE(kProbeClipReleaseImage);
+        gImageEffectSuite->clipReleaseImage(sourceImg);
+        gImageEffectSuite->clipReleaseImage(outputImg);
+    }
+
+    // An aborted frame is incomplete; the host must not cache it
+    return completed ? kOfxStatOK : kOfxStatFailed;
+}
+
+/**
+ * @brief Ask for the source margin that Soften and the detail pyramid read around the region of interest
+ */
+static OfxStatus getRegionsOfInterest(OfxImageEffectHandle instance, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+    PropertySet inArgsProps(inArgs);
+    double time = inArgsProps.get(prop::kTime);
+    double renderScale = readRenderScale(inArgsProps);
+
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+    std::shared_ptr<const ParamSampler> samples = sampledParams(getInstanceData(instance));
+    ParamReader params(paramSet, time, samples.get());
+    double softenValue = 0.0, sharpenValue = 0.0, midtoneDetailValue = 0.0;
+    params.get(kParamSoften, softenValue);
+    params.get(kParamSharpen, sharpenValue);
+    params.get(kParamMidtoneDetail, midtoneDetailValue);
+
+    GaussianBlur blur(softenValue * renderScale);
+    DetailPyramid detail(sharpenValue, midtoneDetailValue);
+    if (blur.isIdentity() && !detail.isActive()) {
+        return kOfxStatReplyDefault;
+    }
+
+    // The region is in canonical coordinates, the blur and pyramid radii in pixels at this scale
+    double margin = (blur.radius() + detail.radius()) / renderScale;
+    double region[4] = { 0.0, 0.0, 0.0, 0.0 };
+    inArgsProps.get(prop::kRegionOfInterest, region);
+    region[0] -= margin;
+    region[1] -= margin;
+    region[2] += margin;
+    region[3] += margin;
+    PropertySet(outArgs).setDoubleN(kOfxImageClipPropRoI kOfxImageEffectSimpleSourceClipName, 4, region);
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Ask for the source frames Temporal Noise Reduction averages around the current one
+ */
+static OfxStatus getFramesNeeded(OfxImageEffectHandle instance, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+    double time = PropertySet(inArgs).get(prop::kTime);
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+    std::shared_ptr<const ParamSampler> samples = sampledParams(getInstanceData(instance));
+    int temporalFrames = 0;
+    ParamReader(paramSet, time, samples.get()).get(kParamTemporalFrames, temporalFrames);
+    if (temporalFrames <= 0) {
+        return kOfxStatReplyDefault;
+    }
+
+    double range[2] = { time - temporalFrames, time + temporalFrames };
+    PropertySet(outArgs).setDoubleN(kOfxImageClipPropFrameRange kOfxImageEffectSimpleSourceClipName, 2, range);
+    return kOfxStatOK;
+}
+
+// Sequence renders in progress across all instances; idle scratch arenas are freed when the last ends
+static std::mutex gSequenceMutex;
+static int gSequenceRenders = 0;
+
+/**
+ * @brief Set up once what the first frame of a sequence render would otherwise pay for
+ *
+ * Starts the shared pool, compiles the grade at the first frame, which every
+ * frame reuses unless a grade parameter animates, sizes the frame cache for
+ * temporal noise reduction, and grows a frame arena and the thread arenas to
+ * what a full frame takes. State is sized from the source clip's depth and
+ * region of definition at the first frame; without a depth only the pool
+ * and frame cache are prepared.
+ */
+static OfxStatus beginSequenceRender(OfxImageEffectHandle instance, OfxPropertySetHandle inArgs)
+{
+    {
+        std::lock_guard<std::mutex> lock(gSequenceMutex);
+        gSequenceRenders++;
+    }
+
+    PropertySet inArgsProps(inArgs);
+    double range[2] = { 0.0, 0.0 };
+    inArgsProps.get(prop::kFrameRange, range);
+    double firstFrame = range[0], lastFrame = range[1];
+    double renderScale = readRenderScale(inArgsProps);
+    ThreadPool& pool = ThreadPool::shared();
+    ColorCorrectionInstance* data = getInstanceData(instance);
+
+    // Sample the parameters over the range, so renders of its frames and tiles read arrays instead of the host
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+    std::shared_ptr<const ParamSampler> samples = std::make_shared<ParamSampler>(
+        paramSet, kSampledParams, kSampledParamCount, firstFrame, lastFrame);
+    if (data) {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->samples = samples;
+    }
+
+    ParamReader params(paramSet, firstFrame, samples.get());
+    double softenValue = 0.0, sharpenValue = 0.0, midtoneDetailValue = 0.0;
+    int temporalFrames = 0;
+    params.get(kParamSoften, softenValue);
+    params.get(kParamSharpen, sharpenValue);
+    params.get(kParamMidtoneDetail, midtoneDetailValue);
+    params.get(kParamTemporalFrames, temporalFrames);
+
+    // A dither tile is built on first use; do that here rather than in the first frame
+    int outputDither = kQuantizeNearest;
+    params.get(kParamOutputDither, outputDither);
+    DitherPattern dither((Quantization)outputDither);
+
+    if (data && temporalFrames > 0) {
+        data->frames.setCapacity(2 * temporalFrames + 2);
+    }
+
+    OfxImageClipHandle sourceClip;
+    OfxPropertySetHandle sourceClipProps;
+    gImageEffectSuite->clipGetHandle(instance, kOfxImageEffectSimpleSourceClipName, &sourceClip, &sourceClipProps);
+    BitDepth depth = internBitDepth(PropertySet(sourceClipProps).get(prop::kPixelDepth));
+    OfxRectD bounds;
+    if (depth == kBitDepthNone
+        || gImageEffectSuite->clipGetRegionOfDefinition(sourceClip, firstFrame, &bounds) != kOfxStatOK) {
+        return kOfxStatOK;
+    }
+    OfxRectI frame;
+    frame.x1 = (int)std::floor(bounds.x1 * renderScale);
+    frame.y1 = (int)std::floor(bounds.y1 * renderScale);
+    frame.x2 = (int)std::ceil(bounds.x2 * renderScale);
+    frame.y2 = (int)std::ceil(bounds.y2 * renderScale);
+    if (frame.x2 <= frame.x1 || frame.y2 <= frame.y1) {
+        return kOfxStatOK;
+    }
 
+    ColorPipeline pipeline;
+    PowerWindow window;
+    readGrade(data, params, frame, pipeline, window);
+    compilePipeline(data, pipeline, depth == kBitDepthByte ? 255 : depth == kBitDepthShort ? 65535 : 0);
+
+    // Frame buffers as render() takes them for a full-frame window, each rounded to the arena alignment
+    DetailPyramid detail(sharpenValue, midtoneDetailValue);
+    GaussianBlur blur(softenValue * renderScale);
+    size_t pixelBytes = 4 * (size_t)depth;
+    size_t frameBytes = (size_t)(frame.x2 - frame.x1) * (frame.y2 - frame.y1) * pixelBytes + ScratchArena::kAlignment;
+    size_t scratchBytes = detail.storageBytes(frame);
+    if (temporalFrames > 0) {
+        scratchBytes += frameBytes;
+    }
+    if (!blur.isIdentity()) {
+        OfxRectI softened = detail.expand(frame);
+        scratchBytes += (size_t)(softened.x2 - softened.x1) * (softened.y2 - softened.y1) * pixelBytes
+            + ScratchArena::kAlignment;
+    }
+
+    // Leased in render()'s order, so the frame arena goes back to the free list as the largest
+    ScratchLease frameArena(1);
+    ScratchLease threadArenas(pool.maxParticipants());
+    frameArena[0].reserve(scratchBytes);
+    for (int i = 0; i < threadArenas.size(); i++) {
+        // Room for the float row planes the kernels stage a full-width row in
+        threadArenas[i].reserve((size_t)(frame.x2 - frame.x1 + 2) * 16 * sizeof(float));
+    }
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Drop the sequence's frame copies, and the idle scratch arenas once no sequence render is left
+ *
+ * The compiled grade stays; it is the same cache interactive renders use.
+ */
+static OfxStatus endSequenceRender(OfxImageEffectHandle instance)
+{
+    ColorCorrectionInstance* data = getInstanceData(instance);
+    if (data) {
+        data->frames.clear();
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->samples.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(gSequenceMutex);
+    gSequenceRenders = std::max(gSequenceRenders - 1, 0);
+    if (gSequenceRenders == 0) {
+        ScratchLease::trim();
+    }
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Analyze button: measure each source frame in the clip's range and key rgbGain and gain
+ *
+ * Frames are fetched one at a time on the calling thread, and each frame's
+ * statistics pass is split across the shared pool. Summaries are cached on
+ * disk by image unique identifier, so re-analyzing only measures frames that
+ * changed. Abort is polled between frames; keys written so far are kept.
+ */
+static OfxStatus analyze(OfxImageEffectHandle instance)
+{
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+
+    OfxParamHandle methodParam, inputColorSpaceParam, outputColorSpaceParam, rgbGainParam, gainParam;
+    gParameterSuite->paramGetHandle(paramSet, kParamAnalyzeMethod, &methodParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamInputColorSpace, &inputColorSpaceParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamOutputColorSpace, &outputColorSpaceParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamRGBGain, &rgbGainParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamGain, &gainParam, nullptr);
+
+    int method = kAnalysisGrayWorld;
+    int inputSpace = kColorSpaceRec709, outputSpace = kColorSpaceRec709;
+    Param(methodParam).getValue(method);
+    Param(inputColorSpaceParam).getValue(inputSpace);
+    Param(outputColorSpaceParam).getValue(outputSpace);
+    ColorSpaceConversion conversion((ColorSpace)inputSpace, (ColorSpace)outputSpace);
+
+    OfxImageClipHandle sourceClip;
+    OfxPropertySetHandle sourceClipProps;
+    gImageEffectSuite->clipGetHandle(instance, kOfxImageEffectSimpleSourceClipName, &sourceClip, &sourceClipProps);
+    PropertySet clipProps(sourceClipProps);
+    double range[2] = { 0.0, 0.0 };
+    clipProps.get(prop::kFrameRange, range);
+    double firstFrame = range[0], lastFrame = range[1];
+
+    AnalysisCache cache(AnalysisCache::defaultDirectory());
+    StatisticsOptions options;
+    options.bins = kAnalysisBins;
+
+    Param rgbGain(rgbGainParam);
+    Param gain(gainParam);
+    OfxStatus status = kOfxStatOK;
+
+    gParameterSuite->paramEditBegin(paramSet, kParamAnalyzeLabel);
+    for (double time = firstFrame; time <= lastFrame; time += 1.0) {
+        if (gImageEffectSuite->abort(instance)) {
+            status = kOfxStatFailed;
+            break;
+        }
+
+        OfxPropertySetHandle sourceImg;
+        if (gImageEffectSuite->clipGetImage(sourceClip, time, nullptr, &sourceImg) != kOfxStatOK) {
+            continue;
+        }
+        const char* uniqueId = PropertySet(sourceImg).get(prop::kImageUniqueIdentifier);
+        std::string key = uniqueId ? uniqueId : "";
+
+        FrameAnalysis frame;
+        if (!cache.load(key, frame)) {
+            Image source(sourceImg);
+            frame = summarizeFrame(computeStatistics(source, source.getBounds(), options));
+            cache.store(key, frame);
+        }
+        gImageEffectSuite->clipReleaseImage(sourceImg);
+
+        BalanceSuggestion suggestion = suggestBalance(frame, (AnalysisMethod)method, conversion);
+        rgbGain.setValueAtTime(time, suggestion.rgbGain[0], suggestion.rgbGain[1], suggestion.rgbGain[2]);
+        gain.setValueAtTime(time, suggestion.gain);
+    }
+    gParameterSuite->paramEditEnd(paramSet);
+
+    return status;
+}
+
+/**
+ * @brief React to parameter edits; only the Analyze button needs work
+ */
+static OfxStatus instanceChanged(OfxImageEffectHandle instance, OfxPropertySetHandle inArgs)
+{
+    PropertySet inArgsProps(inArgs);
+    const char* type = inArgsProps.getString(kOfxPropType);
+    const char* name = inArgsProps.getString(kOfxPropName);
+    if (!type || !name || strcmp(type, kOfxTypeParameter) != 0) {
+        return kOfxStatOK;
+    }
+
+    // An edit during a sequence render invalidates the samples; read the host again
+    ColorCorrectionInstance* data = getInstanceData(instance);
+    if (data) {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->samples.reset();
+    }
+    if (strcmp(name, kParamAnalyze) == 0) {
+        return analyze(instance);
+    }
     return kOfxStatOK;
 }
 
@@ -228,7 +1270,8 @@ static OfxStatus describe(OfxImageEffectHandle descriptor)
     // Other properties
     props.setInt(kOfxImageEffectPropSupportsTiles, 1);
     props.setInt(kOfxImageEffectPropSupportsMultiResolution, 1);
-    props.setInt(kOfxImageEffectPropTemporalClipAccess, 0);
+    props.setInt(kOfxImageEffectPropTemporalClipAccess, 1);
+    props.setInt(kOfxImageEffectPropSupportsMultipleClipDepths, 1);
     props.setString(kOfxImageEffectPropRenderThreadSafety, kOfxImageEffectRenderFullySafe);
 
     return kOfxStatOK;
@@ -250,6 +1293,7 @@ static OfxStatus describeInContext(OfxImageEffectHandle descriptor, OfxPropertyS
     PropertySet sourceClipProps(clipProps);
     const char* rgbaComponents[] = { kOfxImageComponentRGBA };
     sourceClipProps.setStringN(kOfxImageClipPropSupportedComponents, 1, rgbaComponents);
+    sourceClipProps.setInt(kOfxImageEffectPropTemporalClipAccess, 1);
 
     // Output clip
     gImageEffectSuite->clipDefine(descriptor, kOfxImageEffectOutputClipName, &clipProps);
@@ -311,6 +1355,403 @@ static OfxStatus describeInContext(OfxImageEffectHandle descriptor, OfxPropertyS
     rgbGainProps.setDouble(kOfxParamPropDisplayMax, 2.0);
     rgbGainProps.setInt(kOfxParamPropAnimates, 1);
 
+    // Soften parameter
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamSoften, &paramProps);
+    PropertySet softenProps(paramProps);
+    softenProps.setString(kOfxPropLabel, kParamSoftenLabel);
+    softenProps.setString(kOfxParamPropHint, kParamSoftenHint);
+    softenProps.setDouble(kOfxParamPropDefault, 0.0);
+    softenProps.setDouble(kOfxParamPropMin, 0.0);
+    softenProps.setDouble(kOfxParamPropMax, 100.0);
+    softenProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    softenProps.setDouble(kOfxParamPropDisplayMax, 20.0);
+    softenProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Sharpen parameter
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamSharpen, &paramProps);
+    PropertySet sharpenProps(paramProps);
+    sharpenProps.setString(kOfxPropLabel, kParamSharpenLabel);
+    sharpenProps.setString(kOfxParamPropHint, kParamSharpenHint);
+    sharpenProps.setDouble(kOfxParamPropDefault, 0.0);
+    sharpenProps.setDouble(kOfxParamPropMin, -1.0);
+    sharpenProps.setDouble(kOfxParamPropMax, 10.0);
+    sharpenProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    sharpenProps.setDouble(kOfxParamPropDisplayMax, 2.0);
+    sharpenProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Midtone detail parameter
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamMidtoneDetail, &paramProps);
+    PropertySet midtoneDetailProps(paramProps);
+    midtoneDetailProps.setString(kOfxPropLabel, kParamMidtoneDetailLabel);
+    midtoneDetailProps.setString(kOfxParamPropHint, kParamMidtoneDetailHint);
+    midtoneDetailProps.setDouble(kOfxParamPropDefault, 0.0);
+    midtoneDetailProps.setDouble(kOfxParamPropMin, -1.0);
+    midtoneDetailProps.setDouble(kOfxParamPropMax, 4.0);
+    midtoneDetailProps.setDouble(kOfxParamPropDisplayMin, -1.0);
+    midtoneDetailProps.setDouble(kOfxParamPropDisplayMax, 1.0);
+    midtoneDetailProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Temporal noise reduction group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamTemporalGroup, &paramProps);
+    PropertySet temporalGroupProps(paramProps);
+    temporalGroupProps.setString(kOfxPropLabel, kParamTemporalGroupLabel);
+    temporalGroupProps.setInt(kOfxParamPropGroupOpen, 0);
+
+    // Fixed over the clip, since it sets the frames requested from the host
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeInteger, kParamTemporalFrames, &paramProps);
+    PropertySet temporalFramesProps(paramProps);
+    temporalFramesProps.setString(kOfxPropLabel, kParamTemporalFramesLabel);
+    temporalFramesProps.setString(kOfxParamPropHint, kParamTemporalFramesHint);
+    temporalFramesProps.setString(kOfxParamPropParent, kParamTemporalGroup);
+    temporalFramesProps.setInt(kOfxParamPropDefault, 0);
+    temporalFramesProps.setInt(kOfxParamPropMin, 0);
+    temporalFramesProps.setInt(kOfxParamPropMax, 4);
+    temporalFramesProps.setInt(kOfxParamPropDisplayMin, 0);
+    temporalFramesProps.setInt(kOfxParamPropDisplayMax, 4);
+    temporalFramesProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamTemporalThreshold, &paramProps);
+    PropertySet temporalThresholdProps(paramProps);
+    temporalThresholdProps.setString(kOfxPropLabel, kParamTemporalThresholdLabel);
+    temporalThresholdProps.setString(kOfxParamPropHint, kParamTemporalThresholdHint);
+    temporalThresholdProps.setString(kOfxParamPropParent, kParamTemporalGroup);
+    temporalThresholdProps.setDouble(kOfxParamPropDefault, 0.05);
+    temporalThresholdProps.setDouble(kOfxParamPropMin, 0.0);
+    temporalThresholdProps.setDouble(kOfxParamPropMax, 1.0);
+    temporalThresholdProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    temporalThresholdProps.setDouble(kOfxParamPropDisplayMax, 0.2);
+    temporalThresholdProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Color wheels group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamWheelsGroup, &paramProps);
+    PropertySet wheelsGroupProps(paramProps);
+    wheelsGroupProps.setString(kOfxPropLabel, kParamWheelsGroupLabel);
+    wheelsGroupProps.setInt(kOfxParamPropGroupOpen, 1);
+
+    // Lift wheel
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeRGB, kParamLiftWheel, &paramProps);
+    PropertySet liftWheelProps(paramProps);
+    liftWheelProps.setString(kOfxPropLabel, kParamLiftWheelLabel);
+    liftWheelProps.setString(kOfxParamPropHint, kParamLiftWheelHint);
+    liftWheelProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    double defaultLift[] = { 0.0, 0.0, 0.0 };
+    liftWheelProps.setDoubleN(kOfxParamPropDefault, 3, defaultLift);
+    liftWheelProps.setDouble(kOfxParamPropMin, -1.0);
+    liftWheelProps.setDouble(kOfxParamPropMax, 1.0);
+    liftWheelProps.setDouble(kOfxParamPropDisplayMin, -0.5);
+    liftWheelProps.setDouble(kOfxParamPropDisplayMax, 0.5);
+    liftWheelProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Gamma wheel
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeRGB, kParamGammaWheel, &paramProps);
+    PropertySet gammaWheelProps(paramProps);
+    gammaWheelProps.setString(kOfxPropLabel, kParamGammaWheelLabel);
+    gammaWheelProps.setString(kOfxParamPropHint, kParamGammaWheelHint);
+    gammaWheelProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    gammaWheelProps.setDoubleN(kOfxParamPropDefault, 3, defaultRGB);
+    gammaWheelProps.setDouble(kOfxParamPropMin, 0.1);
+    gammaWheelProps.setDouble(kOfxParamPropMax, 4.0);
+    gammaWheelProps.setDouble(kOfxParamPropDisplayMin, 0.2);
+    gammaWheelProps.setDouble(kOfxParamPropDisplayMax, 3.0);
+    gammaWheelProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Gain wheel
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeRGB, kParamGainWheel, &paramProps);
+    PropertySet gainWheelProps(paramProps);
+    gainWheelProps.setString(kOfxPropLabel, kParamGainWheelLabel);
+    gainWheelProps.setString(kOfxParamPropHint, kParamGainWheelHint);
+    gainWheelProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    gainWheelProps.setDoubleN(kOfxParamPropDefault, 3, defaultRGB);
+    gainWheelProps.setDouble(kOfxParamPropMin, 0.0);
+    gainWheelProps.setDouble(kOfxParamPropMax, 4.0);
+    gainWheelProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    gainWheelProps.setDouble(kOfxParamPropDisplayMax, 2.0);
+    gainWheelProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Lift master
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamLiftMaster, &paramProps);
+    PropertySet liftMasterProps(paramProps);
+    liftMasterProps.setString(kOfxPropLabel, kParamLiftMasterLabel);
+    liftMasterProps.setString(kOfxParamPropHint, kParamLiftMasterHint);
+    liftMasterProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    liftMasterProps.setDouble(kOfxParamPropDefault, 0.0);
+    liftMasterProps.setDouble(kOfxParamPropMin, -1.0);
+    liftMasterProps.setDouble(kOfxParamPropMax, 1.0);
+    liftMasterProps.setDouble(kOfxParamPropDisplayMin, -0.5);
+    liftMasterProps.setDouble(kOfxParamPropDisplayMax, 0.5);
+    liftMasterProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Gamma master
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamGammaMaster, &paramProps);
+    PropertySet gammaMasterProps(paramProps);
+    gammaMasterProps.setString(kOfxPropLabel, kParamGammaMasterLabel);
+    gammaMasterProps.setString(kOfxParamPropHint, kParamGammaMasterHint);
+    gammaMasterProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    gammaMasterProps.setDouble(kOfxParamPropDefault, 1.0);
+    gammaMasterProps.setDouble(kOfxParamPropMin, 0.1);
+    gammaMasterProps.setDouble(kOfxParamPropMax, 4.0);
+    gammaMasterProps.setDouble(kOfxParamPropDisplayMin, 0.2);
+    gammaMasterProps.setDouble(kOfxParamPropDisplayMax, 3.0);
+    gammaMasterProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Gain master
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamGainMaster, &paramProps);
+    PropertySet gainMasterProps(paramProps);
+    gainMasterProps.setString(kOfxPropLabel, kParamGainMasterLabel);
+    gainMasterProps.setString(kOfxParamPropHint, kParamGainMasterHint);
+    gainMasterProps.setString(kOfxParamPropParent, kParamWheelsGroup);
+    gainMasterProps.setDouble(kOfxParamPropDefault, 1.0);
+    gainMasterProps.setDouble(kOfxParamPropMin, 0.0);
+    gainMasterProps.setDouble(kOfxParamPropMax, 4.0);
+    gainMasterProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    gainMasterProps.setDouble(kOfxParamPropDisplayMax, 2.0);
+    gainMasterProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Curves group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamCurvesGroup, &paramProps);
+    PropertySet curvesGroupProps(paramProps);
+    curvesGroupProps.setString(kOfxPropLabel, kParamCurvesGroupLabel);
+    curvesGroupProps.setInt(kOfxParamPropGroupOpen, 0);
+
+    // Master and per-channel curves, stored as control point strings
+    for (int i = 0; i < kCurveCount; i++) {
+        gParameterSuite->paramDefine(paramSet, kOfxParamTypeCustom, kCurveParams[i], &paramProps);
+        PropertySet curveProps(paramProps);
+        curveProps.setString(kOfxPropLabel, kCurveParamLabels[i]);
+        curveProps.setString(kOfxParamPropHint, kParamCurvePointsHint);
+        curveProps.setString(kOfxParamPropParent, kParamCurvesGroup);
+        curveProps.setString(kOfxParamPropDefault, kParamCurveIdentity);
+        curveProps.setInt(kOfxParamPropAnimates, 0);
+    }
+
+    // Qualifier group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamQualifierGroup, &paramProps);
+    PropertySet qualifierGroupProps(paramProps);
+    qualifierGroupProps.setString(kOfxPropLabel, kParamQualifierGroupLabel);
+    qualifierGroupProps.setInt(kOfxParamPropGroupOpen, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamQualifierEnable, &paramProps);
+    PropertySet qualifierEnableProps(paramProps);
+    qualifierEnableProps.setString(kOfxPropLabel, kParamQualifierEnableLabel);
+    qualifierEnableProps.setString(kOfxParamPropHint, kParamQualifierEnableHint);
+    qualifierEnableProps.setString(kOfxParamPropParent, kParamQualifierGroup);
+    qualifierEnableProps.setInt(kOfxParamPropDefault, 0);
+    qualifierEnableProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Hue, saturation and luma ranges, each as three values ending in a softness
+    const char* const rangeParams[] = { kParamQualifierHue, kParamQualifierSaturation, kParamQualifierLuma };
+    const char* const rangeLabels[] = { kParamQualifierHueLabel, kParamQualifierSaturationLabel, kParamQualifierLumaLabel };
+    const char* const rangeHints[] = { kParamQualifierHueHint, kParamQualifierSaturationHint, kParamQualifierLumaHint };
+    for (int i = 0; i < 3; i++) {
+        gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble3D, rangeParams[i], &paramProps);
+        PropertySet rangeProps(paramProps);
+        rangeProps.setString(kOfxPropLabel, rangeLabels[i]);
+        rangeProps.setString(kOfxParamPropHint, rangeHints[i]);
+        rangeProps.setString(kOfxParamPropParent, kParamQualifierGroup);
+        double defaultRange[] = { 0.0, 1.0, 0.0 };
+        double rangeMin[] = { 0.0, 0.0, 0.0 };
+        double rangeMax[] = { 1.0, 1.0, 0.5 };
+        rangeProps.setDoubleN(kOfxParamPropDefault, 3, defaultRange);
+        rangeProps.setDoubleN(kOfxParamPropMin, 3, rangeMin);
+        rangeProps.setDoubleN(kOfxParamPropMax, 3, rangeMax);
+        rangeProps.setDoubleN(kOfxParamPropDisplayMin, 3, rangeMin);
+        rangeProps.setDoubleN(kOfxParamPropDisplayMax, 3, rangeMax);
+        rangeProps.setInt(kOfxParamPropAnimates, 1);
+    }
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamQualifierInvert, &paramProps);
+    PropertySet qualifierInvertProps(paramProps);
+    qualifierInvertProps.setString(kOfxPropLabel, kParamQualifierInvertLabel);
+    qualifierInvertProps.setString(kOfxParamPropHint, kParamQualifierInvertHint);
+    qualifierInvertProps.setString(kOfxParamPropParent, kParamQualifierGroup);
+    qualifierInvertProps.setInt(kOfxParamPropDefault, 0);
+    qualifierInvertProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Window group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamWindowGroup, &paramProps);
+    PropertySet windowGroupProps(paramProps);
+    windowGroupProps.setString(kOfxPropLabel, kParamWindowGroupLabel);
+    windowGroupProps.setInt(kOfxParamPropGroupOpen, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamWindowShape, &paramProps);
+    PropertySet windowShapeProps(paramProps);
+    windowShapeProps.setString(kOfxPropLabel, kParamWindowShapeLabel);
+    windowShapeProps.setString(kOfxParamPropHint, kParamWindowShapeHint);
+    windowShapeProps.setString(kOfxParamPropParent, kParamWindowGroup);
+    for (int i = 0; i < kWindowShapeCount; i++) {
+        windowShapeProps.setString(kOfxParamPropChoiceOption, windowShapeLabel((WindowShape)i), i);
+    }
+    windowShapeProps.setInt(kOfxParamPropDefault, kWindowNone);
+    windowShapeProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Center and size, normalized to the frame
+    const char* const placementParams[] = { kParamWindowCenter, kParamWindowSize };
+    const char* const placementLabels[] = { kParamWindowCenterLabel, kParamWindowSizeLabel };
+    const char* const placementHints[] = { kParamWindowCenterHint, kParamWindowSizeHint };
+    for (int i = 0; i < 2; i++) {
+        gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble2D, placementParams[i], &paramProps);
+        PropertySet placementProps(paramProps);
+        placementProps.setString(kOfxPropLabel, placementLabels[i]);
+        placementProps.setString(kOfxParamPropHint, placementHints[i]);
+        placementProps.setString(kOfxParamPropParent, kParamWindowGroup);
+        double defaultPlacement[] = { 0.5, 0.5 };
+        double placementMin[] = { i == 0 ? -1.0 : 0.0, i == 0 ? -1.0 : 0.0 };
+        double placementMax[] = { 2.0, 2.0 };
+        double displayMin[] = { 0.0, 0.0 };
+        double displayMax[] = { 1.0, 1.0 };
+        placementProps.setDoubleN(kOfxParamPropDefault, 2, defaultPlacement);
+        placementProps.setDoubleN(kOfxParamPropMin, 2, placementMin);
+        placementProps.setDoubleN(kOfxParamPropMax, 2, placementMax);
+        placementProps.setDoubleN(kOfxParamPropDisplayMin, 2, displayMin);
+        placementProps.setDoubleN(kOfxParamPropDisplayMax, 2, displayMax);
+        placementProps.setInt(kOfxParamPropAnimates, 1);
+    }
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamWindowFeather, &paramProps);
+    PropertySet windowFeatherProps(paramProps);
+    windowFeatherProps.setString(kOfxPropLabel, kParamWindowFeatherLabel);
+    windowFeatherProps.setString(kOfxParamPropHint, kParamWindowFeatherHint);
+    windowFeatherProps.setString(kOfxParamPropParent, kParamWindowGroup);
+    windowFeatherProps.setDouble(kOfxParamPropDefault, 0.05);
+    windowFeatherProps.setDouble(kOfxParamPropMin, 0.0);
+    windowFeatherProps.setDouble(kOfxParamPropMax, 1.0);
+    windowFeatherProps.setDouble(kOfxParamPropDisplayMin, 0.0);
+    windowFeatherProps.setDouble(kOfxParamPropDisplayMax, 0.25);
+    windowFeatherProps.setInt(kOfxParamPropAnimates, 1);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeCustom, kParamWindowPoints, &paramProps);
+    PropertySet windowPointsProps(paramProps);
+    windowPointsProps.setString(kOfxPropLabel, kParamWindowPointsLabel);
+    windowPointsProps.setString(kOfxParamPropHint, kParamWindowPointsHint);
+    windowPointsProps.setString(kOfxParamPropParent, kParamWindowGroup);
+    windowPointsProps.setString(kOfxParamPropDefault, kParamWindowPointsDefault);
+    windowPointsProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamWindowInvert, &paramProps);
+    PropertySet windowInvertProps(paramProps);
+    windowInvertProps.setString(kOfxPropLabel, kParamWindowInvertLabel);
+    windowInvertProps.setString(kOfxParamPropHint, kParamWindowInvertHint);
+    windowInvertProps.setString(kOfxParamPropParent, kParamWindowGroup);
+    windowInvertProps.setInt(kOfxParamPropDefault, 0);
+    windowInvertProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Color space choices, options in ColorSpace order
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamInputColorSpace, &paramProps);
+    PropertySet inputColorSpaceProps(paramProps);
+    inputColorSpaceProps.setString(kOfxPropLabel, kParamInputColorSpaceLabel);
+    inputColorSpaceProps.setString(kOfxParamPropHint, kParamInputColorSpaceHint);
+    for (int i = 0; i < kColorSpaceCount; i++) {
+        inputColorSpaceProps.setString(kOfxParamPropChoiceOption, colorSpaceLabel((ColorSpace)i), i);
+    }
+    inputColorSpaceProps.setInt(kOfxParamPropDefault, kColorSpaceRec709);
+    inputColorSpaceProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamOutputColorSpace, &paramProps);
+    PropertySet outputColorSpaceProps(paramProps);
+    outputColorSpaceProps.setString(kOfxPropLabel, kParamOutputColorSpaceLabel);
+    outputColorSpaceProps.setString(kOfxParamPropHint, kParamOutputColorSpaceHint);
+    for (int i = 0; i < kColorSpaceCount; i++) {
+        outputColorSpaceProps.setString(kOfxParamPropChoiceOption, colorSpaceLabel((ColorSpace)i), i);
+    }
+    outputColorSpaceProps.setInt(kOfxParamPropDefault, kColorSpaceRec709);
+    outputColorSpaceProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamOutputDither, &paramProps);
+    PropertySet outputDitherProps(paramProps);
+    outputDitherProps.setString(kOfxPropLabel, kParamOutputDitherLabel);
+    outputDitherProps.setString(kOfxParamPropHint, kParamOutputDitherHint);
+    for (int i = 0; i < kQuantizationCount; i++) {
+        outputDitherProps.setString(kOfxParamPropChoiceOption, quantizationLabel((Quantization)i), i);
+    }
+    outputDitherProps.setInt(kOfxParamPropDefault, kQuantizeNearest);
+    outputDitherProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamOutputDepth, &paramProps);
+    PropertySet outputDepthProps(paramProps);
+    outputDepthProps.setString(kOfxPropLabel, kParamOutputDepthLabel);
+    outputDepthProps.setString(kOfxParamPropHint, kParamOutputDepthHint);
+    for (int i = 0; i < kOutputDepthCount; i++) {
+        outputDepthProps.setString(kOfxParamPropChoiceOption, kOutputDepthLabels[i], i);
+    }
+    outputDepthProps.setInt(kOfxParamPropDefault, 0);
+    outputDepthProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamExtendedRange, &paramProps);
+    PropertySet extendedRangeProps(paramProps);
+    extendedRangeProps.setString(kOfxPropLabel, kParamExtendedRangeLabel);
+    extendedRangeProps.setString(kOfxParamPropHint, kParamExtendedRangeHint);
+    extendedRangeProps.setInt(kOfxParamPropDefault, 0);
+    extendedRangeProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamRenderCache, &paramProps);
+    PropertySet renderCacheProps(paramProps);
+    renderCacheProps.setString(kOfxPropLabel, kParamRenderCacheLabel);
+    renderCacheProps.setString(kOfxParamPropHint, kParamRenderCacheHint);
+    renderCacheProps.setInt(kOfxParamPropDefault, 0);
+    renderCacheProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Analysis group
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeGroup, kParamAnalysisGroup, &paramProps);
+    PropertySet analysisGroupProps(paramProps);
+    analysisGroupProps.setString(kOfxPropLabel, kParamAnalysisGroupLabel);
+    analysisGroupProps.setInt(kOfxParamPropGroupOpen, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamAnalyzeMethod, &paramProps);
+    PropertySet analyzeMethodProps(paramProps);
+    analyzeMethodProps.setString(kOfxPropLabel, kParamAnalyzeMethodLabel);
+    analyzeMethodProps.setString(kOfxParamPropHint, kParamAnalyzeMethodHint);
+    analyzeMethodProps.setString(kOfxParamPropParent, kParamAnalysisGroup);
+    for (int i = 0; i < kAnalysisMethodCount; i++) {
+        analyzeMethodProps.setString(kOfxParamPropChoiceOption, analysisMethodLabel((AnalysisMethod)i), i);
+    }
+    analyzeMethodProps.setInt(kOfxParamPropDefault, kAnalysisGrayWorld);
+    analyzeMethodProps.setInt(kOfxParamPropAnimates, 0);
+
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypePushButton, kParamAnalyze, &paramProps);
+    PropertySet analyzeProps(paramProps);
+    analyzeProps.setString(kOfxPropLabel, kParamAnalyzeLabel);
+    analyzeProps.setString(kOfxParamPropHint, kParamAnalyzeHint);
+    analyzeProps.setString(kOfxParamPropParent, kParamAnalysisGroup);
+
+    // Reference render switch, hidden from the user interface
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamReferenceRender, &paramProps);
+    PropertySet referenceRenderProps(paramProps);
+    referenceRenderProps.setString(kOfxPropLabel, kParamReferenceRenderLabel);
+    referenceRenderProps.setString(kOfxParamPropHint, kParamReferenceRenderHint);
+    referenceRenderProps.setInt(kOfxParamPropDefault, 0);
+    referenceRenderProps.setInt(kOfxParamPropAnimates, 0);
+    referenceRenderProps.setInt(kOfxParamPropSecret, 1);
+
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Ask for the output depth chosen by Output Depth, or the source's depth
+ *
+ * render() converts between the two in the grade's write, so the host need
+ * not insert a conversion of its own.
+ */
+static OfxStatus getClipPreferences(OfxImageEffectHandle instance, OfxPropertySetHandle outArgs)
+{
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+    int outputDepth = 0;
+    ParamReader(paramSet, 0.0).get(kParamOutputDepth, outputDepth);
+
+    const char* depth = outputDepth > 0 && outputDepth < kOutputDepthCount ? kOutputDepths[outputDepth] : nullptr;
+    if (!depth) {
+        OfxImageClipHandle sourceClip;
+        OfxPropertySetHandle sourceClipProps;
+        if (gImageEffectSuite->clipGetHandle(instance, kOfxImageEffectSimpleSourceClipName,
+                                             &sourceClip, &sourceClipProps) != kOfxStatOK) {
+            return kOfxStatReplyDefault;
+        }
+        depth = PropertySet(sourceClipProps).get(prop::kPixelDepth);
+        if (internBitDepth(depth) == kBitDepthNone) {
+            return kOfxStatReplyDefault;
+        }
+    }
+    PropertySet(outArgs).setString(kOfxImageClipPropDepth kOfxImageEffectOutputClipName, depth);
     return kOfxStatOK;
 }
 
@@ -319,6 +1760,13 @@ static OfxStatus describeInContext(OfxImageEffectHandle descriptor, OfxPropertyS
  */
 static OfxStatus createInstance(OfxImageEffectHandle instance)
 {
+    OfxPropertySetHandle effectProps;
+    gImageEffectSuite->getPropertySet(instance, &effectProps);
+    PropertySet props(effectProps);
+    props.setPointer(kOfxPropInstanceData, new ColorCorrectionInstance());
+
+    // Editing the output depth changes the clip preferences
+    props.setString(kOfxImageEffectInstancePropClipPreferencesSlaveParam, kParamOutputDepth);
     return kOfxStatOK;
 }
 
@@ -327,60 +1775,70 @@ static OfxStatus createInstance(OfxImageEffectHandle instance)
  */
 static OfxStatus destroyInstance(OfxImageEffectHandle instance)
 {
+    delete getInstanceData(instance);
     return kOfxStatOK;
 }
 
 /**
- * @brief Main entry point
+ * @brief Action table, built once when the binary is loaded
  */
-static OfxStatus mainEntry(const char *action, const void *handle, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+static ActionDispatcher makeDispatcher()
 {
-    OfxImageEffectHandle effect = (OfxImageEffectHandle)handle;
+    ActionDispatcher dispatcher;
 
-    if (strcmp(action, kOfxActionLoad) == 0) {
-        return kOfxStatOK;
-    }
-    else if (strcmp(action, kOfxActionUnload) == 0) {
-        return kOfxStatOK;
-    }
-    else if (strcmp(action, kOfxActionDescribe) == 0) {
-        return describe(effect);
-    }
-    else if (strcmp(action, kOfxActionDescribeInContext) == 0) {
-        return describeInContext(effect, inArgs);
-    }
-    else if (strcmp(action, kOfxActionCreateInstance) == 0) {
-        return createInstance(effect);
-    }
-    else if (strcmp(action, kOfxActionDestroyInstance) == 0) {
-        return destroyInstance(effect);
-    }
-    else if (strcmp(action, kOfxImageEffectActionRender) == 0) {
-        return render(effect, inArgs, outArgs);
-    }
-    else if (strcmp(action, kOfxImageEffectActionGetRegionOfDefinition) == 0) {
-        return kOfxStatReplyDefault;
-    }
-    else if (strcmp(action, kOfxImageEffectActionGetRegionsOfInterest) == 0) {
-        return kOfxStatReplyDefault;
-    }
-    else if (strcmp(action, kOfxImageEffectActionGetClipPreferences) == 0) {
-        return kOfxStatOK;
-    }
-    else if (strcmp(action, kOfxImageEffectActionIsIdentity) == 0) {
-        return kOfxStatReplyDefault;
-    }
-    else if (strcmp(action, kOfxActionBeginInstanceEdit) == 0) {
-        return kOfxStatOK;
-    }
-    else if (strcmp(action, kOfxActionEndInstanceEdit) == 0) {
-        return kOfxStatOK;
-    }
-    else if (strcmp(action, kOfxActionInstanceChanged) == 0) {
-        return kOfxStatOK;
-    }
+    dispatcher.setReply(kActionLoad, kOfxStatOK);
+    dispatcher.setReply(kActionUnload, kOfxStatOK);
+    dispatcher.setHandler(kActionDescribe,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return describe(effect);
+        });
+    dispatcher.setHandler(kActionDescribeInContext,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle) {
+            return describeInContext(effect, inArgs);
+        });
+    dispatcher.setHandler(kActionCreateInstance,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return createInstance(effect);
+        });
+    dispatcher.setHandler(kActionDestroyInstance,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return destroyInstance(effect);
+        });
+    dispatcher.setHandler(kActionRender, render);
+    dispatcher.setReply(kActionGetRegionOfDefinition, kOfxStatReplyDefault);
+    dispatcher.setHandler(kActionGetRegionsOfInterest, getRegionsOfInterest);
+    dispatcher.setHandler(kActionGetFramesNeeded, getFramesNeeded);
+    dispatcher.setHandler(kActionBeginSequenceRender,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle) {
+            return beginSequenceRender(effect, inArgs);
+        });
+    dispatcher.setHandler(kActionEndSequenceRender,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return endSequenceRender(effect);
+        });
+    dispatcher.setHandler(kActionGetClipPreferences,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle outArgs) {
+            return getClipPreferences(effect, outArgs);
+        });
+    dispatcher.setReply(kActionIsIdentity, kOfxStatReplyDefault);
+    dispatcher.setReply(kActionBeginInstanceEdit, kOfxStatOK);
+    dispatcher.setReply(kActionEndInstanceEdit, kOfxStatOK);
+    dispatcher.setHandler(kActionInstanceChanged,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle) {
+            return instanceChanged(effect, inArgs);
+        });
+
+    return dispatcher;
+}
 
-    return kOfxStatReplyDefault;
+static const ActionDispatcher gDispatcher = makeDispatcher();
+
+/**
+ * @brief Main entry point
+ */
+static OfxStatus mainEntry(const char *action, const void *handle, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+    return gDispatcher.dispatch(action, handle, inArgs, outArgs);
 }
 
 /**
@@ -0,0 +1,339 @@
+/*
+ * ScopesPlugin.cpp
+ *
+ * Example OFX Scopes Plugin, a companion to ColorCorrection
+ * Renders a waveform, RGB parade or vectorscope of the source clip
+ */
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxProperty.h"
+#include "ofxParam.h"
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+#include "ofxScopes.h"
+
+#include <algorithm>
+#include <functional>
+
+// Plugin identifiers
+#define kPluginName "Scopes"
+#define kPluginGrouping "Color"
+#define kPluginDescription "Waveform, RGB parade and vectorscope of the source clip"
+#define kPluginIdentifier "com.example.ofx.Scopes"
+#define kPluginVersionMajor 1
+#define kPluginVersionMinor 0
+
+// Parameter names
+#define kParamMode "mode"
+#define kParamModeLabel "Scope"
+#define kParamModeHint "Waveform plots luma by column, RGB Parade each channel side by side, Vectorscope Cb against Cr"
+
+#define kParamIntensity "intensity"
+#define kParamIntensityLabel "Intensity"
+#define kParamIntensityHint "Trace brightness"
+
+#define kParamGraticule "graticule"
+#define kParamGraticuleLabel "Graticule"
+#define kParamGraticuleHint "Draw level lines, or the vectorscope's axes and rings"
+
+// Largest trace grid; smaller frames use one cell per pixel
+static const int kTraceColumns = 1024;
+static const int kTraceLevels = 512;
+
+using namespace ofx;
+
+/**
+ * @brief Per-instance data, owned through kOfxPropInstanceData
+ *
+ * Holds the accumulator so its per-thread bins are allocated once, not per
+ * frame. The plugin is instance safe, so one render at a time uses it.
+ */
+struct ScopesInstance {
+    ScopeAccumulator accumulator;
+};
+
+static ScopesInstance* getInstanceData(OfxImageEffectHandle instance)
+{
+    OfxPropertySetHandle effectProps;
+    gImageEffectSuite->getPropertySet(instance, &effectProps);
+    return (ScopesInstance*)PropertySet(effectProps).getPointer(kOfxPropInstanceData);
+}
+
+/**
+ * @brief Main rendering function
+ *
+ * The whole source frame feeds every output pixel, so tiles are not
+ * supported and the trace is built once per frame before it is drawn.
+ */
+static OfxStatus render(OfxImageEffectHandle instance, OfxPropertySetHandle inArgs, OfxPropertySetHandle)
+{
+    // Get the render window
+    PropertySet inArgsProps(inArgs);
+    OfxRectI renderWindow = inArgsProps.getRect(prop::kRenderWindow);
+    double time = inArgsProps.get(prop::kTime);
+    OFX_PROFILE_RENDER_WINDOW(renderWindow.x2 - renderWindow.x1, renderWindow.y2 - renderWindow.y1);
+
+    // Get clips
+    OfxImageClipHandle sourceClip, outputClip;
+    OfxPropertySetHandle sourceClipProps, outputClipProps;
+
+    gImageEffectSuite->clipGetHandle(instance, kOfxImageEffectSimpleSourceClipName, &sourceClip, &sourceClipProps);
+    gImageEffectSuite->clipGetHandle(instance, kOfxImageEffectOutputClipName, &outputClip, &outputClipProps);
+
+    // Get images
+    OfxPropertySetHandle sourceImg, outputImg;
+    {
+        OFX_PROFILE_SCOPE(kProbeClipGetImage);
+        if (gImageEffectSuite->clipGetImage(sourceClip, time, nullptr, &sourceImg) != kOfxStatOK) {
+            return kOfxStatFailed;
+        }
+        if (gImageEffectSuite->clipGetImage(outputClip, time, nullptr, &outputImg) != kOfxStatOK) {
+            gImageEffectSuite->clipReleaseImage(sourceImg);
+            return kOfxStatFailed;
+        }
+    }
+
+    ScopesInstance* data = getInstanceData(instance);
+
+    // Get parameters
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(instance, &paramSet);
+
+    OfxParamHandle modeParam, intensityParam, graticuleParam;
+    gParameterSuite->paramGetHandle(paramSet, kParamMode, &modeParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamIntensity, &intensityParam, nullptr);
+    gParameterSuite->paramGetHandle(paramSet, kParamGraticule, &graticuleParam, nullptr);
+
+    int mode = kScopeWaveform;
+    int graticule = 1;
+    ScopeDisplay display;
+    Param(modeParam).getValue(mode);
+    Param(intensityParam).getValueAtTime(time, display.intensity);
+    Param(graticuleParam).getValue(graticule);
+    display.graticule = graticule != 0;
+
+    Image source(sourceImg);
+    Image output(outputImg);
+    OfxRectI frame = source.getBounds();
+    int columns = std::min(frame.x2 - frame.x1, kTraceColumns);
+    int levels = std::min(frame.y2 - frame.y1, kTraceLevels);
+
+    AbortPoller abort(instance);
+    std::function<bool()> cancelled = [&abort] { return abort.poll(); };
+    bool completed = false;
+    if (data && output.getPixelDepth() == source.getPixelDepth()) {
+        {
+            OFX_PROFILE_SCOPE(kProbeKernelRender);
+            completed = data->accumulator.accumulate((ScopeMode)mode, columns, levels,
+                source.data(), frame, source.getRowBytes(), (BitDepth)source.getPixelDepth(), cancelled);
+        }
+        completed = completed && renderScope(data->accumulator.trace(), display,
+            output.data(), output.getBounds(), output.getRowBytes(), (BitDepth)output.getPixelDepth(),
+            frame, renderWindow, ThreadPool::shared(), cancelled);
+    }
+
+    // Release images
+    {
+        OFX_PROFILE_SCOPE(kProbeClipReleaseImage);
+        gImageEffectSuite->clipReleaseImage(sourceImg);
+        gImageEffectSuite->clipReleaseImage(outputImg);
+    }
+
+    // An aborted frame is incomplete; the host must not cache it
+    return completed ? kOfxStatOK : kOfxStatFailed;
+}
+
+/**
+ * @brief Describe the plugin
+ */
+static OfxStatus describe(OfxImageEffectHandle descriptor)
+{
+    OfxPropertySetHandle effectProps;
+    gImageEffectSuite->getPropertySet(descriptor, &effectProps);
+
+    PropertySet props(effectProps);
+
+    // Plugin properties
+    props.setString(kOfxPropLabel, kPluginName);
+    props.setString(kOfxImageEffectPluginPropGrouping, kPluginGrouping);
+    props.setString(kOfxPropPluginDescription, kPluginDescription);
+
+    // Supported contexts
+    const char* contexts[] = { kOfxImageEffectContextFilter };
+    props.setStringN(kOfxImageEffectPropSupportedContexts, 1, contexts);
+
+    // Supported pixel depths
+    const char* pixelDepths[] = { kOfxBitDepthByte, kOfxBitDepthShort, kOfxBitDepthFloat };
+    props.setStringN(kOfxImageEffectPropSupportedPixelDepths, 3, pixelDepths);
+
+    // Other properties; the accumulator's bins belong to the instance
+    props.setInt(kOfxImageEffectPropSupportsTiles, 0);
+    props.setInt(kOfxImageEffectPropSupportsMultiResolution, 1);
+    props.setInt(kOfxImageEffectPropTemporalClipAccess, 0);
+    props.setString(kOfxImageEffectPropRenderThreadSafety, kOfxImageEffectRenderInstanceSafe);
+
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Describe the plugin in a specific context
+ */
+static OfxStatus describeInContext(OfxImageEffectHandle descriptor, OfxPropertySetHandle)
+{
+    // Define clips
+    OfxPropertySetHandle clipProps;
+    const char* rgbaComponents[] = { kOfxImageComponentRGBA };
+
+    gImageEffectSuite->clipDefine(descriptor, kOfxImageEffectSimpleSourceClipName, &clipProps);
+    PropertySet(clipProps).setStringN(kOfxImageClipPropSupportedComponents, 1, rgbaComponents);
+
+    gImageEffectSuite->clipDefine(descriptor, kOfxImageEffectOutputClipName, &clipProps);
+    PropertySet(clipProps).setStringN(kOfxImageClipPropSupportedComponents, 1, rgbaComponents);
+
+    // Define parameters
+    OfxParamSetHandle paramSet;
+    gImageEffectSuite->getParamSet(descriptor, &paramSet);
+
+    OfxPropertySetHandle paramProps;
+
+    // Scope choice, options in ScopeMode order
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeChoice, kParamMode, &paramProps);
+    PropertySet modeProps(paramProps);
+    modeProps.setString(kOfxPropLabel, kParamModeLabel);
+    modeProps.setString(kOfxParamPropHint, kParamModeHint);
+    for (int i = 0; i < kScopeModeCount; i++) {
+        modeProps.setString(kOfxParamPropChoiceOption, scopeModeLabel((ScopeMode)i), i);
+    }
+    modeProps.setInt(kOfxParamPropDefault, kScopeWaveform);
+    modeProps.setInt(kOfxParamPropAnimates, 0);
+
+    // Intensity parameter
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeDouble, kParamIntensity, &paramProps);
+    PropertySet intensityProps(paramProps);
+    intensityProps.setString(kOfxPropLabel, kParamIntensityLabel);
+    intensityProps.setString(kOfxParamPropHint, kParamIntensityHint);
+    intensityProps.setDouble(kOfxParamPropDefault, 1.0);
+    intensityProps.setDouble(kOfxParamPropMin, 0.1);
+    intensityProps.setDouble(kOfxParamPropMax, 4.0);
+    intensityProps.setDouble(kOfxParamPropDisplayMin, 0.25);
+    intensityProps.setDouble(kOfxParamPropDisplayMax, 2.0);
+    intensityProps.setInt(kOfxParamPropAnimates, 1);
+
+    // Graticule switch
+    gParameterSuite->paramDefine(paramSet, kOfxParamTypeBoolean, kParamGraticule, &paramProps);
+    PropertySet graticuleProps(paramProps);
+    graticuleProps.setString(kOfxPropLabel, kParamGraticuleLabel);
+    graticuleProps.setString(kOfxParamPropHint, kParamGraticuleHint);
+    graticuleProps.setInt(kOfxParamPropDefault, 1);
+    graticuleProps.setInt(kOfxParamPropAnimates, 0);
+
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Create an instance
+ */
+static OfxStatus createInstance(OfxImageEffectHandle instance)
+{
+    OfxPropertySetHandle effectProps;
+    gImageEffectSuite->getPropertySet(instance, &effectProps);
+    PropertySet(effectProps).setPointer(kOfxPropInstanceData, new ScopesInstance());
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Destroy an instance
+ */
+static OfxStatus destroyInstance(OfxImageEffectHandle instance)
+{
+    delete getInstanceData(instance);
+    return kOfxStatOK;
+}
+
+/**
+ * @brief Action table, built once when the binary is loaded
+ */
+static ActionDispatcher makeDispatcher()
+{
+    ActionDispatcher dispatcher;
+
+    dispatcher.setReply(kActionLoad, kOfxStatOK);
+    dispatcher.setReply(kActionUnload, kOfxStatOK);
+    dispatcher.setHandler(kActionDescribe,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return describe(effect);
+        });
+    dispatcher.setHandler(kActionDescribeInContext,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle inArgs, OfxPropertySetHandle) {
+            return describeInContext(effect, inArgs);
+        });
+    dispatcher.setHandler(kActionCreateInstance,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return createInstance(effect);
+        });
+    dispatcher.setHandler(kActionDestroyInstance,
+        [](OfxImageEffectHandle effect, OfxPropertySetHandle, OfxPropertySetHandle) {
+            return destroyInstance(effect);
+        });
+    dispatcher.setHandler(kActionRender, render);
+    dispatcher.setReply(kActionGetRegionOfDefinition, kOfxStatReplyDefault);
+    dispatcher.setReply(kActionGetRegionsOfInterest, kOfxStatReplyDefault);
+    dispatcher.setReply(kActionGetClipPreferences, kOfxStatOK);
+    dispatcher.setReply(kActionIsIdentity, kOfxStatReplyDefault);
+    dispatcher.setReply(kActionBeginInstanceEdit, kOfxStatOK);
+    dispatcher.setReply(kActionEndInstanceEdit, kOfxStatOK);
+    dispatcher.setReply(kActionInstanceChanged, kOfxStatOK);
+
+    return dispatcher;
+}
+
+static const ActionDispatcher gDispatcher = makeDispatcher();
+
+/**
+ * @brief Main entry point
+ */
+static OfxStatus mainEntry(const char *action, const void *handle, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs)
+{
+    return gDispatcher.dispatch(action, handle, inArgs, outArgs);
+}
+
+/**
+ * @brief Set host callback
+ */
+static void setHostFunc(OfxHost *host)
+{
+    initializeSuites(host);
+}
+
+/**
+ * @brief Plugin descriptor
+ */
+static OfxPlugin scopesPlugin = {
+    kOfxImageEffectPluginApi,
+    kOfxImageEffectPluginApiVersion,
+    kPluginIdentifier,
+    kPluginVersionMajor,
+    kPluginVersionMinor,
+    setHostFunc,
+    mainEntry
+};
+
+/**
+ * @brief Number of plugins in this binary
+ */
+OfxExport int OfxGetNumberOfPlugins(void)
+{
+    return 1;
+}
+
+/**
+ * @brief Get the nth plugin
+ */
+OfxExport OfxPlugin *OfxGetPlugin(int nth)
+{
+    if (nth == 0) {
+        return &scopesPlugin;
+    }
+    return nullptr;
+}
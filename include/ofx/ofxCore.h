@@ -45,7 +45,7 @@ Contains the core OFX architectural struct and function definitions.
 #if defined(WIN32) || defined(WIN64)
   #define OfxExport extern __declspec(dllexport)
 #else
-  #define OfxExport extern
+  #define OfxExport extern __attribute__((visibility("default")))
 #endif
 
 /** @brief Blind data structure to manipulate sets of properties through */
@@ -143,6 +143,9 @@ typedef const char *OfxPropertyTypeEnum;
 /** @brief General property, giving the long label of an object */
 #define kOfxPropLongLabel "OfxPropLongLabel"
 
+/** @brief General property, giving a description of a plug-in to the user */
+#define kOfxPropPluginDescription "OfxPropPluginDescription"
+
 /** @brief General property, giving the version of a host or plugin */
 #define kOfxPropVersion "OfxPropVersion"
 
@@ -155,6 +158,15 @@ typedef const char *OfxPropertyTypeEnum;
 /** @brief General property to flag a feature as optional */
 #define kOfxPropIsOptional "OfxPropIsOptional"
 
+/** @brief Pointer property on an effect instance reserved for the plugin's private data */
+#define kOfxPropInstanceData "OfxPropInstanceData"
+
+/** @brief Why an instance changed action was sent */
+#define kOfxPropChangeReason "OfxPropChangeReason"
+
+/** @brief Change reason: the user edited the object in the host's interface */
+#define kOfxChangeUserEdited "OfxChangeUserEdited"
+
 /*@}*/
 
 /** @name Property Suite Function types
@@ -187,6 +187,15 @@ typedef struct OfxImageClipStruct *OfxImageClipHandle;
 /** @brief Property to indicate the region of interest of a clip */
 #define kOfxImageEffectPropRegionOfInterest "OfxImageEffectPropRegionOfInterest"
 
+/** @brief Prefix of the out-argument property carrying an input clip's region of interest, followed by the clip name */
+#define kOfxImageClipPropRoI "OfxImageClipPropRoI_"
+
+/** @brief Prefix of the out-argument property carrying the frame range an input clip needs, followed by the clip name */
+#define kOfxImageClipPropFrameRange "OfxImageClipPropFrameRange_"
+
+/** @brief Prefix of the clip preferences out-argument property carrying a clip's pixel depth, followed by the clip name */
+#define kOfxImageClipPropDepth "OfxImageClipPropDepth_"
+
 /** @brief Property to get the current render scale */
 #define kOfxImageEffectPropRenderScale "OfxImageEffectPropRenderScale"
 
@@ -244,6 +253,9 @@ typedef struct OfxImageClipStruct *OfxImageClipHandle;
 /** @brief Property on effect instance - whether the instance can be interactively rendered */
 #define kOfxImageEffectInstancePropSequentialRender "OfxImageEffectInstancePropSequentialRender"
 
+/** @brief Property on effect instance - parameters whose changes make the host ask for clip preferences again */
+#define kOfxImageEffectInstancePropClipPreferencesSlaveParam "OfxImageEffectInstancePropClipPreferencesSlaveParam"
+
 /*@}*/
 
 /** @name Premultiplication State
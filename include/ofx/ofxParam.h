@@ -35,6 +35,9 @@ typedef struct OfxParamStruct *OfxParamHandle;
 /** @brief Blind declaration of an OFX parameter set */
 typedef struct OfxParamSetStruct *OfxParamSetHandle;
 
+/** @brief kOfxPropType of a parameter, as passed to the instance changed action */
+#define kOfxTypeParameter "OfxTypeParameter"
+
 /** @name Parameter Types
  */
 /*@{*/
@@ -0,0 +1,148 @@
+#include "ofxAnalysis.h"
+#include "ofxCacheFiles.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdint.h>
+
+namespace ofx {
+
+namespace {
+
+const uint32_t kCacheMagic = 0x4146584f;   // "OFXA"
+const uint32_t kCacheVersion = 1;
+
+// Suggestions are kept inside the rgbGain and gain parameter ranges
+const double kMinSuggestedGain = 0.0;
+const double kMaxSuggestedGain = 4.0;
+
+// Channel values below this are treated as black and left ungained
+const double kBlackThreshold = 1e-4;
+
+/**
+ * @brief Fixed part of a cache file; the identifier follows, then the FrameAnalysis
+ */
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bins;
+    uint32_t idLength;
+    double percentile;
+};
+
+double clampGain(double gain) {
+    return std::min(std::max(gain, kMinSuggestedGain), kMaxSuggestedGain);
+}
+
+/**
+ * @brief Per-channel gains that bring rgb to its own average, plus that average
+ */
+double neutralize(const double rgb[3], double gains[3]) {
+    double average = (rgb[0] + rgb[1] + rgb[2]) / 3.0;
+    for (int c = 0; c < 3; c++) {
+        gains[c] = (rgb[c] > kBlackThreshold && average > kBlackThreshold) ? clampGain(average / rgb[c]) : 1.0;
+    }
+    return average;
+}
+
+} // namespace
+
+const char* analysisMethodLabel(AnalysisMethod method) {
+    switch (method) {
+        case kAnalysisGrayWorld: return "Gray World";
+        case kAnalysisHighlight: return "Highlight Percentile";
+        default:                 return "";
+    }
+}
+
+FrameAnalysis summarizeFrame(const ImageStatistics& statistics) {
+    FrameAnalysis frame;
+    for (int c = 0; c < 3; c++) {
+        frame.mean[c] = statistics.channels[c].mean;
+        frame.highlight[c] = statistics.percentile(c, kAnalysisHighlightPercentile);
+    }
+    return frame;
+}
+
+BalanceSuggestion suggestBalance(const FrameAnalysis& frame, AnalysisMethod method,
+                                 const ColorSpaceConversion& conversion) {
+    double rgb[3];
+    const double* source = method == kAnalysisHighlight ? frame.highlight : frame.mean;
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = source[c];
+    }
+    conversion.apply(rgb[0], rgb[1], rgb[2]);
+
+    BalanceSuggestion suggestion;
+    double average = neutralize(rgb, suggestion.rgbGain);
+
+    // Gray world only balances; the highlight method also lifts the white point to 1
+    suggestion.gain = 1.0;
+    if (method == kAnalysisHighlight && average > kBlackThreshold) {
+        suggestion.gain = clampGain(1.0 / average);
+    }
+    return suggestion;
+}
+
+AnalysisCache::AnalysisCache(const std::string& cacheDirectory)
+    : directory(cacheDirectory)
+{
+}
+
+std::string AnalysisCache::defaultDirectory() {
+    return cachefiles::directoryFromEnvironment("OFX_ANALYSIS_CACHE", "ofx-analysis");
+}
+
+std::string AnalysisCache::pathFor(const std::string& uniqueId) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.ofxa", (unsigned long long)cachefiles::hashBytes(uniqueId.data(), uniqueId.size()));
+    return directory + name;
+}
+
+bool AnalysisCache::load(const std::string& uniqueId, FrameAnalysis& frame) const {
+    if (uniqueId.empty()) {
+        return false;
+    }
+    FILE* file = fopen(pathFor(uniqueId).c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    CacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+           && header.magic == kCacheMagic
+           && header.version == kCacheVersion
+           && header.bins == (uint32_t)kAnalysisBins
+           && header.percentile == kAnalysisHighlightPercentile
+           && header.idLength == uniqueId.size();
+    if (ok) {
+        std::string id(header.idLength, '\0');
+        ok = (id.empty() || fread(&id[0], 1, id.size(), file) == id.size())
+          && id == uniqueId
+          && fread(&frame, sizeof(frame), 1, file) == 1;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool AnalysisCache::store(const std::string& uniqueId, const FrameAnalysis& frame) const {
+    if (uniqueId.empty()) {
+        return false;
+    }
+    cachefiles::makeDirectory(directory);
+
+    CacheHeader header;
+    header.magic = kCacheMagic;
+    header.version = kCacheVersion;
+    header.bins = (uint32_t)kAnalysisBins;
+    header.idLength = (uint32_t)uniqueId.size();
+    header.percentile = kAnalysisHighlightPercentile;
+
+    return cachefiles::writeAtomically(pathFor(uniqueId), [&](FILE* file) {
+        return fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(uniqueId.data(), 1, uniqueId.size(), file) == uniqueId.size()
+            && fwrite(&frame, sizeof(frame), 1, file) == 1;
+    });
+}
+
+} // namespace ofx
@@ -0,0 +1,100 @@
+#ifndef _ofxAnalysis_h_
+#define _ofxAnalysis_h_
+
+#include "ofxColorSpace.h"
+#include "ofxStatistics.h"
+
+#include <string>
+
+/**
+ * @file ofxAnalysis.h
+ * @brief Auto balance analysis: per-frame summaries, gain suggestions, disk cache
+ */
+
+namespace ofx {
+
+/**
+ * @brief How suggested gains are derived from a frame
+ */
+enum AnalysisMethod {
+    kAnalysisGrayWorld = 0,    ///< Neutralize the frame average
+    kAnalysisHighlight,        ///< Neutralize and normalize a high percentile (white patch)
+    kAnalysisMethodCount
+};
+
+/**
+ * @brief Display name of a method, in AnalysisMethod order
+ */
+const char* analysisMethodLabel(AnalysisMethod method);
+
+/**
+ * @brief Percentile taken as the frame's white point by kAnalysisHighlight
+ */
+const double kAnalysisHighlightPercentile = 0.995;
+
+/**
+ * @brief Histogram resolution used for analysis
+ */
+const int kAnalysisBins = 1024;
+
+/**
+ * @brief What is kept of one analyzed frame, in the source encoding
+ */
+struct FrameAnalysis {
+    double mean[3];
+    double highlight[3];
+};
+
+/**
+ * @brief Reduce full image statistics to a frame summary
+ */
+FrameAnalysis summarizeFrame(const ImageStatistics& statistics);
+
+/**
+ * @brief Suggested values for the rgbGain and gain parameters
+ */
+struct BalanceSuggestion {
+    double rgbGain[3];
+    double gain;
+};
+
+/**
+ * @brief Derive gains for one frame
+ *
+ * The summary is mapped into the grading space with conversion before the
+ * gains are solved, since rgbGain and gain apply after the conversion. This
+ * maps the mean and percentile values rather than every pixel, which is
+ * exact for the matrix part and close enough for the transfer functions.
+ */
+BalanceSuggestion suggestBalance(const FrameAnalysis& frame, AnalysisMethod method,
+                                 const ColorSpaceConversion& conversion);
+
+/**
+ * @brief Frame summaries on disk, one file per image unique identifier
+ *
+ * Files are written to a temporary name and renamed, so concurrent
+ * analyses or a crash never leave a partial entry behind. Entries from a
+ * different format version or a hash collision fail to load and are
+ * recomputed.
+ */
+class AnalysisCache {
+private:
+    std::string directory;
+
+    std::string pathFor(const std::string& uniqueId) const;
+
+public:
+    explicit AnalysisCache(const std::string& cacheDirectory);
+
+    /**
+     * @brief $OFX_ANALYSIS_CACHE, or an ofx-analysis folder in the temp directory
+     */
+    static std::string defaultDirectory();
+
+    bool load(const std::string& uniqueId, FrameAnalysis& frame) const;
+    bool store(const std::string& uniqueId, const FrameAnalysis& frame) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxAnalysis_h_
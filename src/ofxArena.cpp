@@ -0,0 +1,126 @@
+#include "ofxArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+
+namespace ofx {
+
+namespace {
+
+struct FreeList {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ScratchArena> > arenas;
+};
+
+// Never destroyed, so leases released during static destruction are safe
+FreeList& freeList() {
+    static FreeList* list = new FreeList();
+    return *list;
+}
+
+} // namespace
+
+ScratchArena::ScratchArena(size_t blockBytes)
+    : blockBytes(std::max(blockBytes, (size_t)kAlignment)), current(0), used(0)
+{
+}
+
+void* ScratchArena::allocateBytes(size_t bytes) {
+    bytes = (bytes + kAlignment - 1) & ~(kAlignment - 1);
+
+    // Move on to the first following block with room, or add one
+    while (current < blocks.size() && used + bytes > blocks[current].size) {
+        current++;
+        used = 0;
+    }
+    if (current == blocks.size()) {
+        Block block;
+        block.size = std::max(blockBytes, bytes);
+        block.storage.reset(new char[block.size + kAlignment]);
+        uintptr_t address = (uintptr_t)block.storage.get();
+        block.begin = (char*)((address + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1));
+        blocks.push_back(std::move(block));
+        used = 0;
+    }
+
+    void* pointer = blocks[current].begin + used;
+    used += bytes;
+    return pointer;
+}
+
+ScratchArena::Mark ScratchArena::mark() const {
+    Mark position = { current, used };
+    return position;
+}
+
+void ScratchArena::rewind(const Mark& position) {
+    current = position.block;
+    used = position.used;
+}
+
+void ScratchArena::reset() {
+    current = 0;
+    used = 0;
+}
+
+void ScratchArena::reserve(size_t bytes) {
+    bytes = (bytes + kAlignment - 1) & ~(kAlignment - 1);
+    if (current != 0 || used != 0 || (!blocks.empty() && blocks[0].size >= bytes)) {
+        return;
+    }
+    blocks.clear();
+    char* block = (char*)allocateBytes(bytes);
+    reset();
+
+    // Touch every page now, rather than fault them in during the first frame
+    for (size_t offset = 0; offset < bytes; offset += 4096) {
+        block[offset] = 0;
+    }
+}
+
+size_t ScratchArena::capacity() const {
+    size_t total = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        total += blocks[i].size;
+    }
+    return total;
+}
+
+ScratchLease::ScratchLease(int count) {
+    FreeList& list = freeList();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    for (int i = 0; i < count; i++) {
+        if (list.arenas.empty()) {
+            arenas.push_back(std::unique_ptr<ScratchArena>(new ScratchArena()));
+        } else {
+            // The list is kept in order of capacity; take the largest
+            arenas.push_back(std::move(list.arenas.back()));
+            list.arenas.pop_back();
+        }
+    }
+}
+
+ScratchLease::~ScratchLease() {
+    FreeList& list = freeList();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    for (size_t i = 0; i < arenas.size(); i++) {
+        arenas[i]->reset();
+        size_t capacity = arenas[i]->capacity();
+        std::vector<std::unique_ptr<ScratchArena> >::iterator position = std::upper_bound(
+            list.arenas.begin(), list.arenas.end(), capacity,
+            [](size_t bytes, const std::unique_ptr<ScratchArena>& arena) { return bytes < arena->capacity(); });
+        list.arenas.insert(position, std::move(arenas[i]));
+    }
+}
+
+void ScratchLease::trim() {
+    std::vector<std::unique_ptr<ScratchArena> > idle;
+    {
+        FreeList& list = freeList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        idle.swap(list.arenas);
+    }
+}
+
+} // namespace ofx
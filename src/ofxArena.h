@@ -0,0 +1,131 @@
+#ifndef _ofxArena_h_
+#define _ofxArena_h_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @file ofxArena.h
+ * @brief Bump allocator for per-frame and per-thread scratch buffers
+ */
+
+namespace ofx {
+
+/**
+ * @brief Scratch memory handed out by bumping a pointer, released all at once
+ *
+ * Blocks are kept when the arena is rewound or reset, so a render that
+ * needs the same buffers every frame stops allocating after the first one.
+ * Allocations are aligned for vector loads and are not initialized.
+ */
+class ScratchArena {
+private:
+    struct Block {
+        std::unique_ptr<char[]> storage;
+        char* begin;
+        size_t size;
+    };
+
+    size_t blockBytes;
+    std::vector<Block> blocks;
+    size_t current;   // Block allocations come from
+    size_t used;      // Bytes taken in that block
+
+    ScratchArena(const ScratchArena&);
+    ScratchArena& operator=(const ScratchArena&);
+
+public:
+    static const size_t kAlignment = 64;
+
+    /**
+     * @param blockBytes Size of each block; larger requests get a block of their own
+     */
+    explicit ScratchArena(size_t blockBytes = 1 << 20);
+
+    void* allocateBytes(size_t bytes);
+
+    template<typename T>
+    T* allocate(size_t count) { return (T*)allocateBytes(count * sizeof(T)); }
+
+    /**
+     * @brief Position to rewind() to, freeing everything allocated since
+     */
+    struct Mark {
+        size_t block;
+        size_t used;
+    };
+
+    Mark mark() const;
+    void rewind(const Mark& mark);
+
+    /**
+     * @brief Free every allocation, keeping the blocks
+     */
+    void reset();
+
+    /**
+     * @brief Make the first block hold at least bytes, so a frame's buffers fit in one block
+     *
+     * The block's pages are touched so they are mapped before it is used.
+     * Only valid while nothing is allocated; smaller blocks are freed.
+     */
+    void reserve(size_t bytes);
+
+    /**
+     * @brief Bytes held in blocks, used or not
+     */
+    size_t capacity() const;
+
+    /**
+     * @brief Rewinds the arena to where it was when the scope was opened
+     */
+    class Scope {
+    private:
+        ScratchArena& arena;
+        Mark start;
+
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+
+    public:
+        explicit Scope(ScratchArena& arena) : arena(arena), start(arena.mark()) {}
+        ~Scope() { arena.rewind(start); }
+    };
+};
+
+/**
+ * @brief Arenas borrowed from a process-wide free list for one render
+ *
+ * Size the lease with ThreadPool::maxParticipants() and index it by the
+ * task's slot to give every thread of a job its own arena. On destruction
+ * the arenas are reset and go back to the free list, keeping their blocks
+ * for the next render. The largest free arenas are leased first, so a
+ * render that takes its frame arena before its thread arenas gets the one
+ * the previous frame grew.
+ */
+class ScratchLease {
+private:
+    std::vector<std::unique_ptr<ScratchArena> > arenas;
+
+    ScratchLease(const ScratchLease&);
+    ScratchLease& operator=(const ScratchLease&);
+
+public:
+    explicit ScratchLease(int count = 1);
+    ~ScratchLease();
+
+    int size() const { return (int)arenas.size(); }
+    ScratchArena& operator[](int index) { return *arenas[index]; }
+
+    /**
+     * @brief Free the arenas on the free list, for when a long render ends
+     *
+     * Arenas out on a lease are not affected and return to the list as usual.
+     */
+    static void trim();
+};
+
+} // namespace ofx
+
+#endif // _ofxArena_h_
@@ -0,0 +1,80 @@
+#ifndef _ofxBlur_h_
+#define _ofxBlur_h_
+
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+
+#include <functional>
+#include <vector>
+
+/**
+ * @file ofxBlur.h
+ * @brief Separable Gaussian blur over RGBA images, multithreaded
+ */
+
+namespace ofx {
+
+/**
+ * @brief Gaussian blur of a given standard deviation in pixels
+ *
+ * Runs as a horizontal then a vertical pass. Each pass reads its lines
+ * contiguously and writes them transposed, so the vertical pass also
+ * walks contiguous memory; the intermediate is a float strip of rows, not
+ * a whole frame. Small sigmas use a direct kernel of radius ceil(3 sigma);
+ * larger ones switch to a third-order recursive filter (Young and van
+ * Vliet) whose cost per pixel does not depend on sigma, run over a margin
+ * of ceil(8 sigma).
+ *
+ * Pixels outside the source bounds repeat the nearest edge pixel.
+ */
+class GaussianBlur {
+private:
+    double deviation;
+    int kernelRadius;
+    bool recursiveFilter;
+    std::vector<float> weights;   // Direct kernel, center first
+    float coefficients[4];        // Recursive filter: B, then b1..b3 over b0
+
+public:
+    explicit GaussianBlur(double sigma);
+
+    double sigma() const { return deviation; }
+
+    /**
+     * @brief Source pixels needed on each side of an output pixel
+     */
+    int radius() const { return kernelRadius; }
+
+    bool isIdentity() const { return kernelRadius == 0; }
+    bool isRecursive() const { return recursiveFilter; }
+
+    /**
+     * @brief Region of source needed to blur rect, for GetRegionsOfInterest
+     */
+    OfxRectI expand(const OfxRectI& rect) const;
+
+    /**
+     * @brief Blur one line of interleaved RGBA floats
+     *
+     * @param in length + 2 * radius() pixels: the line with its margin on
+     *           both sides; overwritten by the recursive filter
+     * @param out length pixels
+     */
+    void filterLine(float* in, int length, float* out) const;
+
+    /**
+     * @brief Blur src into the window of dst
+     *
+     * @param src Source image, any bounds; it is read only
+     * @param dst Output pixels for window, the first at (window.x1, window.y1)
+     * @return false if cancelled before every strip was written
+     */
+    bool apply(const void* src, const OfxRectI& srcBounds, int srcRowBytes,
+               void* dst, const OfxRectI& window, int dstRowBytes, BitDepth depth,
+               ThreadPool& pool = ThreadPool::shared(),
+               const std::function<bool()>& cancelled = std::function<bool()>()) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxBlur_h_
@@ -0,0 +1,88 @@
+#include "ofxCacheFiles.h"
+
+#include <cstdlib>
+#include <thread>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace ofx {
+namespace cachefiles {
+
+namespace {
+
+unsigned long processId() {
+#ifdef _WIN32
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+// Unlike rename, replaces an existing target on Windows too
+bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} // namespace
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t h) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+void makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+std::string directoryFromEnvironment(const char* variable, const char* folder) {
+    const char* path = getenv(variable);
+    if (path && *path) {
+        return path;
+    }
+    const char* temp = getenv("TMPDIR");
+    if (!temp || !*temp) {
+        temp = getenv("TEMP");
+    }
+    return std::string(temp && *temp ? temp : "/tmp") + "/" + folder;
+}
+
+bool writeAtomically(const std::string& path, const std::function<bool(FILE*)>& write) {
+    // Thread ids repeat across processes sharing the folder, so the process id comes first
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%lx.%zx.tmp", processId(),
+             std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string temporary = path + suffix;
+
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = write(file);
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || !replaceFile(temporary, path)) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace cachefiles
+} // namespace ofx
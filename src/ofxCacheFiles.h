@@ -0,0 +1,52 @@
+#ifndef _ofxCacheFiles_h_
+#define _ofxCacheFiles_h_
+
+#include <cstdio>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * @file ofxCacheFiles.h
+ * @brief File handling shared by the on-disk analysis and render caches
+ *
+ * Internal to ofxUtilities; the plugins do not include it.
+ */
+
+namespace ofx {
+namespace cachefiles {
+
+const uint64_t kHashSeed = 14695981039346656037ull;
+
+/**
+ * @brief FNV-1a of size bytes, continuing from h
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t h = kHashSeed);
+
+/**
+ * @brief Create the folder at path unless it exists; its parent must
+ */
+void makeDirectory(const std::string& path);
+
+/**
+ * @brief $variable if set, or folder inside $TMPDIR, $TEMP or /tmp
+ */
+std::string directoryFromEnvironment(const char* variable, const char* folder);
+
+/**
+ * @brief Replace the file at path with what write puts in a temporary next to it
+ *
+ * The temporary is renamed into place only once write succeeds and the file
+ * is closed, so readers see the old file or the whole new one. The
+ * temporary is named for the process and thread, so concurrent writers,
+ * including other processes sharing the folder, never write the same one.
+ *
+ * @return false if any step failed; the temporary is removed and path left as it was
+ */
+bool writeAtomically(const std::string& path, const std::function<bool(FILE*)>& write);
+
+} // namespace cachefiles
+} // namespace ofx
+
+#endif // _ofxCacheFiles_h_
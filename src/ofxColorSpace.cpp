@@ -0,0 +1,278 @@
+#include "ofxColorSpace.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ofx {
+
+namespace {
+
+struct Chromaticity {
+    double x, y;
+};
+
+struct ColorSpaceInfo {
+    const char* label;
+    TransferFunction transfer;
+    Chromaticity red, green, blue, white;
+    double luma[3];
+};
+
+const Chromaticity kWhiteD65 = { 0.3127, 0.3290 };
+const Chromaticity kWhiteACES = { 0.32168, 0.33767 };
+
+// Indexed by ColorSpace
+const ColorSpaceInfo kColorSpaces[kColorSpaceCount] = {
+    { "Rec.709 (Gamma 2.4)", kTransferGamma24,
+      { 0.640, 0.330 }, { 0.300, 0.600 }, { 0.150, 0.060 }, kWhiteD65,
+      { 0.2126, 0.7152, 0.0722 } },
+    { "Rec.2020 (Gamma 2.4)", kTransferGamma24,
+      { 0.708, 0.292 }, { 0.170, 0.797 }, { 0.131, 0.046 }, kWhiteD65,
+      { 0.2627, 0.6780, 0.0593 } },
+    { "ACEScg", kTransferLinear,
+      { 0.713, 0.293 }, { 0.165, 0.830 }, { 0.128, 0.044 }, kWhiteACES,
+      { 0.2722287168, 0.6740817658, 0.0536895174 } },
+    { "ACEScct", kTransferACEScct,
+      { 0.713, 0.293 }, { 0.165, 0.830 }, { 0.128, 0.044 }, kWhiteACES,
+      { 0.2722287168, 0.6740817658, 0.0536895174 } },
+    { "DaVinci Wide Gamut / Intermediate", kTransferDaVinciIntermediate,
+      { 0.8000, 0.3130 }, { 0.1682, 0.9877 }, { 0.0790, -0.1155 }, kWhiteD65,
+      { 0.2741185109, 0.8736318959, -0.1477504068 } },
+};
+
+const ColorSpaceInfo& info(ColorSpace space) {
+    if (space < 0 || space >= kColorSpaceCount) {
+        return kColorSpaces[kColorSpaceRec709];
+    }
+    return kColorSpaces[space];
+}
+
+void whiteToXYZ(const Chromaticity& white, double xyz[3]) {
+    xyz[0] = white.x / white.y;
+    xyz[1] = 1.0;
+    xyz[2] = (1.0 - white.x - white.y) / white.y;
+}
+
+Matrix3 bradfordAdaptation(const Chromaticity& from, const Chromaticity& to) {
+    const Matrix3 bradford = { {
+        {  0.8951,  0.2664, -0.1614 },
+        { -0.7502,  1.7135,  0.0367 },
+        {  0.0389, -0.0685,  1.0296 }
+    } };
+
+    double src[3], dst[3];
+    whiteToXYZ(from, src);
+    whiteToXYZ(to, dst);
+    bradford.apply(src[0], src[1], src[2]);
+    bradford.apply(dst[0], dst[1], dst[2]);
+
+    Matrix3 scale = Matrix3::diagonal(dst[0] / src[0], dst[1] / src[1], dst[2] / src[2]);
+    return bradford.inverse() * scale * bradford;
+}
+
+// ACEScct constants (S-2016-001)
+const double kACEScctLinCut = 0.0078125;
+const double kACEScctLogCut = 0.155251141552511;
+const double kACEScctA = 10.5402377416545;
+const double kACEScctB = 0.0729055341958355;
+
+// DaVinci Intermediate constants
+const double kDIA = 0.0075;
+const double kDIB = 7.0;
+const double kDIC = 0.07329248;
+const double kDIM = 10.44426855;
+const double kDILinCut = 0.00262409;
+const double kDILogCut = 0.02740668;
+
+} // namespace
+
+Matrix3 Matrix3::identity() {
+    return diagonal(1.0, 1.0, 1.0);
+}
+
+Matrix3 Matrix3::diagonal(double r, double g, double b) {
+    Matrix3 result = { {
+        { r, 0.0, 0.0 },
+        { 0.0, g, 0.0 },
+        { 0.0, 0.0, b }
+    } };
+    return result;
+}
+
+Matrix3 Matrix3::operator*(const Matrix3& other) const {
+    Matrix3 result;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            result.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j];
+        }
+    }
+    return result;
+}
+
+Matrix3 Matrix3::inverse() const {
+    double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    double det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    double invDet = (det != 0.0) ? 1.0 / det : 0.0;
+
+    Matrix3 result = { {
+        { c00 * invDet, (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet, (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet },
+        { c01 * invDet, (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet, (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet },
+        { c02 * invDet, (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet, (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet }
+    } };
+    return result;
+}
+
+bool Matrix3::isIdentity(double tolerance) const {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double expected = (i == j) ? 1.0 : 0.0;
+            if (std::fabs(m[i][j] - expected) > tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const char* colorSpaceLabel(ColorSpace space) {
+    return info(space).label;
+}
+
+TransferFunction colorSpaceTransfer(ColorSpace space) {
+    return info(space).transfer;
+}
+
+const double* colorSpaceLuma(ColorSpace space) {
+    return info(space).luma;
+}
+
+Matrix3 colorSpaceToXYZ(ColorSpace space) {
+    const ColorSpaceInfo& cs = info(space);
+    const Chromaticity* primaries[3] = { &cs.red, &cs.green, &cs.blue };
+
+    Matrix3 p;
+    for (int i = 0; i < 3; i++) {
+        p.m[0][i] = primaries[i]->x / primaries[i]->y;
+        p.m[1][i] = 1.0;
+        p.m[2][i] = (1.0 - primaries[i]->x - primaries[i]->y) / primaries[i]->y;
+    }
+
+    // Scale the primaries so that RGB(1,1,1) maps to the white point
+    double w[3];
+    whiteToXYZ(cs.white, w);
+    p.inverse().apply(w[0], w[1], w[2]);
+    return p * Matrix3::diagonal(w[0], w[1], w[2]);
+}
+
+Matrix3 colorSpaceConversionMatrix(ColorSpace from, ColorSpace to) {
+    const ColorSpaceInfo& src = info(from);
+    const ColorSpaceInfo& dst = info(to);
+    if (memcmp(&src.red, &dst.red, 4 * sizeof(Chromaticity)) == 0) {
+        return Matrix3::identity();
+    }
+
+    Matrix3 toXYZ = colorSpaceToXYZ(from);
+    Matrix3 fromXYZ = colorSpaceToXYZ(to).inverse();
+    if (memcmp(&src.white, &dst.white, sizeof(Chromaticity)) == 0) {
+        return fromXYZ * toXYZ;
+    }
+    return fromXYZ * bradfordAdaptation(src.white, dst.white) * toXYZ;
+}
+
+double transferToLinear(TransferFunction tf, double value) {
+    switch (tf) {
+        case kTransferGamma24:
+            return (value < 0.0) ? -std::pow(-value, 2.4) : std::pow(value, 2.4);
+        case kTransferACEScct:
+            if (value <= kACEScctLogCut) {
+                return (value - kACEScctB) / kACEScctA;
+            }
+            return std::min(std::pow(2.0, value * 17.52 - 9.72), 65504.0);
+        case kTransferDaVinciIntermediate:
+            if (value <= kDILogCut) {
+                return value / kDIM;
+            }
+            return std::pow(2.0, value / kDIC - kDIB) - kDIA;
+        default:
+            return value;
+    }
+}
+
+double transferFromLinear(TransferFunction tf, double value) {
+    switch (tf) {
+        case kTransferGamma24:
+            return (value < 0.0) ? -std::pow(-value, 1.0 / 2.4) : std::pow(value, 1.0 / 2.4);
+        case kTransferACEScct:
+            if (value <= kACEScctLinCut) {
+                return kACEScctA * value + kACEScctB;
+            }
+            return (std::log2(value) + 9.72) / 17.52;
+        case kTransferDaVinciIntermediate:
+            if (value <= kDILinCut) {
+                return value * kDIM;
+            }
+            return (std::log2(value + kDIA) + kDIB) * kDIC;
+        default:
+            return value;
+    }
+}
+
+// 2^-19, an eighth of a 16-bit code: a gamut matrix that mostly cancels large decoded values keeps the
+// absolute error, so a coarse log decode showed up as tens of codes after it
+const double LogLUT::kRefineTolerance = 1.0 / 524288.0;
+
+namespace {
+
+// Decode and encode tables for every non-linear transfer, built on first use
+struct TransferTables {
+    LogLUT toLinear[kTransferCount];
+    LogLUT fromLinear[kTransferCount];
+
+    struct Decode {
+        TransferFunction tf;
+        double operator()(double x) const { return transferToLinear(tf, x); }
+    };
+
+    struct Encode {
+        TransferFunction tf;
+        double operator()(double x) const { return transferFromLinear(tf, x); }
+    };
+
+    TransferTables() {
+        for (int i = kTransferLinear + 1; i < kTransferCount; i++) {
+            Decode decode = { (TransferFunction)i };
+            Encode encode = { (TransferFunction)i };
+            toLinear[i].build(decode);
+            fromLinear[i].build(encode);
+        }
+    }
+};
+
+const TransferTables& transferTables() {
+    static const TransferTables tables;
+    return tables;
+}
+
+} // namespace
+
+TransferCurve::TransferCurve(TransferFunction tf, bool decode)
+    : transfer(tf), toLinear(decode), lut(nullptr)
+{
+    if (tf != kTransferLinear) {
+        const TransferTables& tables = transferTables();
+        lut = decode ? &tables.toLinear[tf] : &tables.fromLinear[tf];
+    }
+}
+
+ColorSpaceConversion::ColorSpaceConversion(ColorSpace from, ColorSpace to)
+    : decode(colorSpaceTransfer(from), true),
+      encode(colorSpaceTransfer(to), false),
+      primaries(colorSpaceConversionMatrix(from, to))
+{
+    identityMatrix = primaries.isIdentity();
+    identity = (from == to) || (identityMatrix && colorSpaceTransfer(from) == colorSpaceTransfer(to));
+}
+
+} // namespace ofx
@@ -0,0 +1,258 @@
+#ifndef _ofxColorSpace_h_
+#define _ofxColorSpace_h_
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @file ofxColorSpace.h
+ * @brief Color space definitions, primaries matrices and transfer functions
+ */
+
+namespace ofx {
+
+/**
+ * @brief Color spaces selectable on the input and output of a grade
+ *
+ * The order matches the choice parameter options, so the values can be
+ * read straight from a kOfxParamTypeChoice parameter.
+ */
+enum ColorSpace {
+    kColorSpaceRec709 = 0,
+    kColorSpaceRec2020,
+    kColorSpaceACEScg,
+    kColorSpaceACEScct,
+    kColorSpaceDaVinciWG,
+    kColorSpaceCount
+};
+
+/**
+ * @brief Transfer functions (encodings) used by the supported color spaces
+ */
+enum TransferFunction {
+    kTransferLinear = 0,
+    kTransferGamma24,
+    kTransferACEScct,
+    kTransferDaVinciIntermediate,
+    kTransferCount
+};
+
+/**
+ * @brief Row-major 3x3 matrix used for primaries conversions
+ */
+struct Matrix3 {
+    double m[3][3];
+
+    static Matrix3 identity();
+    static Matrix3 diagonal(double r, double g, double b);
+
+    Matrix3 operator*(const Matrix3& other) const;
+    Matrix3 inverse() const;
+    bool isIdentity(double tolerance = 1e-9) const;
+
+    void apply(double& r, double& g, double& b) const {
+        double x = m[0][0] * r + m[0][1] * g + m[0][2] * b;
+        double y = m[1][0] * r + m[1][1] * g + m[1][2] * b;
+        double z = m[2][0] * r + m[2][1] * g + m[2][2] * b;
+        r = x;
+        g = y;
+        b = z;
+    }
+};
+
+/**
+ * @brief Human readable label of a color space, used for choice options
+ */
+const char* colorSpaceLabel(ColorSpace space);
+
+/**
+ * @brief Transfer function a color space is encoded with
+ */
+TransferFunction colorSpaceTransfer(ColorSpace space);
+
+/**
+ * @brief Luma weights (Y row of the RGB to XYZ matrix) of a color space
+ */
+const double* colorSpaceLuma(ColorSpace space);
+
+/**
+ * @brief Linear RGB to CIE XYZ matrix of a color space, relative to its own white
+ */
+Matrix3 colorSpaceToXYZ(ColorSpace space);
+
+/**
+ * @brief Single matrix taking linear RGB in one space to linear RGB in another
+ *
+ * Includes a Bradford chromatic adaptation when the white points differ.
+ */
+Matrix3 colorSpaceConversionMatrix(ColorSpace from, ColorSpace to);
+
+/**
+ * @brief Decode an encoded value to scene linear
+ */
+double transferToLinear(TransferFunction tf, double value);
+
+/**
+ * @brief Encode a scene linear value
+ */
+double transferFromLinear(TransferFunction tf, double value);
+
+/**
+ * @brief Lookup table sampled on a logarithmic grid of positive floats
+ *
+ * Entries are spaced by the top mantissa bits of the IEEE float
+ * representation, so every octave in [2^kMinExponent, 2^kMaxExponent) gets
+ * the same number of samples. Lookups are a bit cast, a shift and a linear
+ * interpolation. Values outside the range must be evaluated by the caller.
+ *
+ * A table is sampled with kMantissaBits first. Where its second differences
+ * show an interpolation error past kRefineTolerance of the value, as with the
+ * exponential of a log decode, it is resampled with kFineMantissaBits,
+ * keeping the samples it already has.
+ */
+class LogLUT {
+public:
+    static const int kMantissaBits = 10;
+    static const int kFineMantissaBits = 12;
+    static const int kMinExponent = -16;
+    static const int kMaxExponent = 16;
+
+private:
+    static const uint32_t kBaseBits = (uint32_t)(127 + kMinExponent) << 23;
+
+    std::vector<float> table;
+    int shift;
+    float fractionScale;
+
+    static float fromBits(uint32_t bits) {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static int sizeFor(int mantissaBits) { return (kMaxExponent - kMinExponent) << mantissaBits; }
+
+    // Largest interpolation error estimated from the second differences of a coarse table, relative to the
+    // value or to 1 below 1. The spacing doubles at each octave's first entry, so those are skipped
+    double interpolationError() const {
+        double worst = 0.0;
+        for (size_t i = 1; i + 1 < table.size(); i++) {
+            if (i % (1u << kMantissaBits) == 0) {
+                continue;
+            }
+            double error = std::fabs((double)table[i - 1] - 2.0 * table[i] + table[i + 1]) * 0.125;
+            worst = std::max(worst, error / std::max(1.0, std::fabs((double)table[i])));
+        }
+        return worst;
+    }
+
+public:
+    // Relative error past which a table is resampled finely
+    static const double kRefineTolerance;
+
+    LogLUT() : shift(23 - kMantissaBits), fractionScale(1.0f / (float)(1u << (23 - kMantissaBits))) {}
+
+    static float minInput() { return fromBits(kBaseBits); }
+    static float maxInput() { return fromBits((uint32_t)(127 + kMaxExponent) << 23); }
+    static bool inRange(float x) { return x >= minInput() && x < maxInput(); }
+
+    template<typename F>
+    void build(const F& fn) {
+        const int coarseShift = 23 - kMantissaBits;
+        table.resize(sizeFor(kMantissaBits) + 1);
+        for (size_t i = 0; i < table.size(); i++) {
+            table[i] = (float)fn((double)fromBits(kBaseBits + ((uint32_t)i << coarseShift)));
+        }
+        shift = coarseShift;
+        if (!(interpolationError() > kRefineTolerance)) {
+            fractionScale = 1.0f / (float)(1u << shift);
+            return;
+        }
+
+        const int fineShift = 23 - kFineMantissaBits;
+        const int ratio = 1 << (coarseShift - fineShift);
+        std::vector<float> fine(sizeFor(kFineMantissaBits) + 1);
+        for (size_t i = 0; i < fine.size(); i++) {
+            fine[i] = i % ratio == 0 ? table[i / ratio]
+                                     : (float)fn((double)fromBits(kBaseBits + ((uint32_t)i << fineShift)));
+        }
+        table.swap(fine);
+        shift = fineShift;
+        fractionScale = 1.0f / (float)(1u << shift);
+    }
+
+    bool empty() const { return table.empty(); }
+
+    // x must satisfy inRange(x)
+    float lookup(float x) const {
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        uint32_t offset = bits - kBaseBits;
+        uint32_t index = offset >> shift;
+        float frac = (float)(offset & ((1u << shift) - 1)) * fractionScale;
+        float a = table[index];
+        return a + frac * (table[index + 1] - a);
+    }
+};
+
+/**
+ * @brief Transfer function backed by a precomputed LogLUT
+ *
+ * The tables are built once per process and shared by all instances.
+ */
+class TransferCurve {
+private:
+    TransferFunction transfer;
+    bool toLinear;
+    const LogLUT* lut;
+
+public:
+    TransferCurve(TransferFunction tf, bool decode);
+
+    bool isIdentity() const { return transfer == kTransferLinear; }
+
+    double apply(double value) const {
+        float x = (float)value;
+        if (lut && LogLUT::inRange(x)) {
+            return lut->lookup(x);
+        }
+        return toLinear ? transferToLinear(transfer, value) : transferFromLinear(transfer, value);
+    }
+};
+
+/**
+ * @brief Conversion between two color spaces: decode, primaries matrix, encode
+ */
+class ColorSpaceConversion {
+private:
+    TransferCurve decode;
+    TransferCurve encode;
+    Matrix3 primaries;
+    bool identityMatrix;
+    bool identity;
+
+public:
+    ColorSpaceConversion(ColorSpace from, ColorSpace to);
+
+    bool isIdentity() const { return identity; }
+    const Matrix3& matrix() const { return primaries; }
+
+    void apply(double& r, double& g, double& b) const {
+        r = decode.apply(r);
+        g = decode.apply(g);
+        b = decode.apply(b);
+        if (!identityMatrix) {
+            primaries.apply(r, g, b);
+        }
+        r = encode.apply(r);
+        g = encode.apply(g);
+        b = encode.apply(b);
+    }
+};
+
+} // namespace ofx
+
+#endif // _ofxColorSpace_h_
@@ -0,0 +1,367 @@
+#include "ofxDetail.h"
+#include "ofxRows.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ofx {
+
+namespace {
+
+using rows::clampIndex;
+using rows::loadPlanes;
+
+// Rows of a level per task
+const int kBandRows = 8;
+
+// Luma weights for the midtone weight; the exact space matters little for a soft mask
+const float kLumaR = 0.2126f;
+const float kLumaG = 0.7152f;
+const float kLumaB = 0.0722f;
+
+int floorShift(int value, int shift) {
+    return value >= 0 ? value >> shift : -((-value + (1 << shift) - 1) >> shift);
+}
+
+/**
+ * @brief Horizontal [1 3 3 1] / 8 with decimation: 2 * n samples in, n out
+ */
+void reduceLine(const float* in, int n, float* out) {
+    if (n <= 0) {
+        return;
+    }
+    const int last = 2 * n - 1;
+    out[0] = 0.5f * in[0] + 0.375f * in[1] + 0.125f * in[std::min(2, last)];
+    for (int j = 1; j < n - 1; j++) {
+        out[j] = 0.125f * (in[2 * j - 1] + in[2 * j + 2]) + 0.375f * (in[2 * j] + in[2 * j + 1]);
+    }
+    if (n > 1) {
+        int j = n - 1;
+        out[j] = 0.125f * in[2 * j - 1] + 0.375f * in[2 * j] + 0.5f * in[last];
+    }
+}
+
+/**
+ * @brief Reduce rows into a level, in parallel bands
+ *
+ * horizontal(row, out, arena) reduces input row across into out, width
+ * samples per plane, clamping row to the input itself. A band reduces each
+ * input row it needs once, then sums them down the columns.
+ */
+bool reduceLevel(int width, int height, float* const planes[3],
+                 const std::function<void(int, float**, ScratchArena&)>& horizontal,
+                 ScratchLease& threads, ThreadPool& pool, const std::function<bool()>& cancelled)
+{
+    const int bands = (height + kBandRows - 1) / kBandRows;
+    ThreadPool::Task task = [&](int index, int slot) {
+        ScratchArena& arena = threads[slot];
+        ScratchArena::Scope scope(arena);
+
+        // Output rows [first, last) read input rows 2 first - 1 to 2 last
+        int first = index * kBandRows;
+        int last = std::min(first + kBandRows, height);
+        int inputs = 2 * (last - first) + 2;
+        float* reduced = arena.allocate<float>((size_t)inputs * 3 * width);
+        for (int r = 0; r < inputs; r++) {
+            float* out[3];
+            for (int c = 0; c < 3; c++) {
+                out[c] = reduced + ((size_t)r * 3 + c) * width;
+            }
+            horizontal(2 * first - 1 + r, out, arena);
+        }
+
+        for (int row = first; row < last; row++) {
+            const float* rows = reduced + (size_t)(2 * (row - first)) * 3 * width;
+            for (int c = 0; c < 3; c++) {
+                const float* a = rows + (size_t)c * width;
+                const float* b = a + (size_t)3 * width;
+                const float* d = b + (size_t)3 * width;
+                const float* e = d + (size_t)3 * width;
+                float* out = planes[c] + (size_t)row * width;
+                for (int i = 0; i < width; i++) {
+                    out[i] = 0.125f * (a[i] + e[i]) + 0.375f * (b[i] + d[i]);
+                }
+            }
+        }
+    };
+
+    if (cancelled) {
+        return pool.parallelFor(bands, task, cancelled);
+    }
+    pool.parallelFor(bands, task);
+    return true;
+}
+
+template<typename In>
+std::function<void(int, float**, ScratchArena&)> sourceRows(const void* src, const OfxRectI& srcBounds, int srcRowBytes,
+                                                            const OfxRectI& region, float scale)
+{
+    return [=](int row, float** out, ScratchArena& arena) {
+        ScratchArena::Scope scope(arena);
+        int count = region.x2 - region.x1;
+        float* line[3];
+        for (int c = 0; c < 3; c++) {
+            line[c] = arena.allocate<float>(count);
+        }
+        int y = clampIndex(region.y1 + row - srcBounds.y1, srcBounds.y2 - srcBounds.y1);
+        const In* srcLine = (const In*)((const char*)src + (ptrdiff_t)y * srcRowBytes);
+        loadPlanes(srcLine, srcBounds.x2 - srcBounds.x1, region.x1 - srcBounds.x1, count, scale, line, 3);
+        for (int c = 0; c < 3; c++) {
+            reduceLine(line[c], count / 2, out[c]);
+        }
+    };
+}
+
+} // namespace
+
+DetailPyramid::DetailPyramid(double sharpen, double midtone)
+    : sharpenAmount(sharpen), midtoneAmount(midtone),
+      topLevel(midtone != 0.0 ? kLevels : 1), levelRadius(0)
+{
+    // Each reduction reaches 1.5 input samples past the center, expansion one top level sample
+    if (isActive()) {
+        levelRadius = (3 * ((1 << topLevel) - 1) + 1) / 2 + (1 << topLevel);
+    }
+    std::memset(levels, 0, sizeof(levels));
+}
+
+OfxRectI DetailPyramid::expand(const OfxRectI& rect) const {
+    OfxRectI expanded = { rect.x1 - levelRadius, rect.y1 - levelRadius, rect.x2 + levelRadius, rect.y2 + levelRadius };
+    return expanded;
+}
+
+// Align the region to the top level, so level samples sit on one grid for the whole frame
+OfxRectI DetailPyramid::alignedRegion(const OfxRectI& window) const {
+    OfxRectI region = expand(window);
+    const int step = 1 << topLevel;
+    region.x1 = floorShift(region.x1, topLevel) * step;
+    region.y1 = floorShift(region.y1, topLevel) * step;
+    region.x2 = -floorShift(-region.x2, topLevel) * step;
+    region.y2 = -floorShift(-region.y2, topLevel) * step;
+    return region;
+}
+
+size_t DetailPyramid::storageBytes(const OfxRectI& window) const {
+    if (!isActive() || window.x2 <= window.x1 || window.y2 <= window.y1) {
+        return 0;
+    }
+    OfxRectI region = alignedRegion(window);
+    size_t bytes = 0;
+    for (int k = 1; k <= topLevel; k++) {
+        size_t plane = (size_t)((region.x2 - region.x1) >> k) * ((region.y2 - region.y1) >> k) * sizeof(float);
+        bytes += 3 * ((plane + ScratchArena::kAlignment - 1) & ~(ScratchArena::kAlignment - 1));
+    }
+    return bytes;
+}
+
+bool DetailPyramid::build(const void* src, const OfxRectI& srcBounds, int srcRowBytes, BitDepth depth,
+                          const OfxRectI& window, ScratchArena& storage, ScratchLease& threads,
+                          ThreadPool& pool, const std::function<bool()>& cancelled)
+{
+    if (!isActive() || window.x2 <= window.x1 || window.y2 <= window.y1
+        || srcBounds.x2 <= srcBounds.x1 || srcBounds.y2 <= srcBounds.y1) {
+        return true;
+    }
+
+    OfxRectI region = alignedRegion(window);
+    for (int k = 1; k <= topLevel; k++) {
+        Level& level = levels[k];
+        level.x1 = floorShift(region.x1, k);
+        level.y1 = floorShift(region.y1, k);
+        level.width = (region.x2 - region.x1) >> k;
+        level.height = (region.y2 - region.y1) >> k;
+        for (int c = 0; c < 3; c++) {
+            level.planes[c] = storage.allocate<float>((size_t)level.width * level.height);
+        }
+    }
+
+    std::function<void(int, float**, ScratchArena&)> rows;
+    switch (depth) {
+        case kBitDepthByte:
+            rows = sourceRows<unsigned char>(src, srcBounds, srcRowBytes, region, 1.0f / 255.0f);
+            break;
+        case kBitDepthShort:
+            rows = sourceRows<unsigned short>(src, srcBounds, srcRowBytes, region, 1.0f / 65535.0f);
+            break;
+        case kBitDepthFloat:
+            rows = sourceRows<float>(src, srcBounds, srcRowBytes, region, 1.0f);
+            break;
+        default:
+            return true;
+    }
+    if (!reduceLevel(levels[1].width, levels[1].height, levels[1].planes, rows, threads, pool, cancelled)) {
+        return false;
+    }
+
+    for (int k = 2; k <= topLevel; k++) {
+        const Level& below = levels[k - 1];
+        rows = [&below](int row, float** out, ScratchArena&) {
+            size_t offset = (size_t)clampIndex(row, below.height) * below.width;
+            for (int c = 0; c < 3; c++) {
+                reduceLine(below.planes[c] + offset, below.width / 2, out[c]);
+            }
+        };
+        if (!reduceLevel(levels[k].width, levels[k].height, levels[k].planes, rows, threads, pool, cancelled)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DetailPyramid::upsampleRow(const Level& level, int shift, int x, int y, int n,
+                                float* out[3], ScratchArena& arena) const
+{
+    // Level sample i is centered on source pixel (i + 0.5) * 2^shift - 0.5
+    const int scale = 1 << shift;
+    const double step = 1.0 / (double)scale;
+    double v = (y + 0.5) * step - 0.5 - level.y1;
+    int j = (int)std::floor(v);
+    float fy = (float)(v - j);
+    int ja = clampIndex(j, level.height);
+    int jb = clampIndex(j + 1, level.height);
+
+    // Blend the two rows over the samples the span touches
+    int origin = x - level.x1 * scale;
+    int i0 = (int)std::floor((origin + 0.5) * step - 0.5);
+    int i1 = (int)std::floor((origin + n - 0.5) * step - 0.5) + 1;
+    int span = i1 - i0 + 1;
+
+    float* rows[3];
+    for (int c = 0; c < 3; c++) {
+        const float* a = level.planes[c] + (size_t)ja * level.width;
+        const float* b = level.planes[c] + (size_t)jb * level.width;
+        float* row = rows[c] = arena.allocate<float>(span);
+        for (int t = 0; t < span; t++) {
+            int i = clampIndex(i0 + t, level.width);
+            row[t] = a[i] + fy * (b[i] - a[i]);
+        }
+    }
+
+    if (shift == 1) {
+        // Even and odd pixels take weights 3/4 and 1/4 of their nearer sample, one sample per pair
+        for (int q = 0; q < 2 && q < n; q++) {
+            int odd = (origin + q) & 1;
+            float fx = odd ? 0.25f : 0.75f;
+            int t0 = floorShift(origin + q, 1) - (odd ? 0 : 1) - i0;
+            int count = (n - q + 1) >> 1;
+            for (int c = 0; c < 3; c++) {
+                const float* row = rows[c] + t0;
+                float* dst = out[c] + q;
+                for (int m = 0; m < count; m++) {
+                    dst[2 * m] = row[m] + fx * (row[m + 1] - row[m]);
+                }
+            }
+        }
+        return;
+    }
+
+    // Between two sample centers lie 2^shift pixels; the k-th of them takes weight (k + 0.5) / 2^shift
+    float weights[1 << kLevels];
+    for (int k = 0; k < scale; k++) {
+        weights[k] = (float)((k + 0.5) * step);
+    }
+    int position = origin - scale / 2;
+    int t = floorShift(position, shift) - i0;
+    int k = position - (t + i0) * scale;
+    for (int p = 0; p < n; t++, k = 0) {
+        int count = std::min(scale - k, n - p);
+        for (int c = 0; c < 3; c++) {
+            const float a = rows[c][t];
+            const float d = rows[c][t + 1] - a;
+            float* dst = out[c] + p;
+            for (int m = 0; m < count; m++) {
+                dst[m] = a + weights[k + m] * d;
+            }
+        }
+        p += count;
+    }
+}
+
+void DetailPyramid::sample(const Level& level, int shift, int x, int y, double out[3]) const {
+    const double step = 1.0 / (double)(1 << shift);
+    double u = (x + 0.5) * step - 0.5 - level.x1;
+    double v = (y + 0.5) * step - 0.5 - level.y1;
+    int i = (int)std::floor(u), j = (int)std::floor(v);
+    double fx = u - i, fy = v - j;
+    int ia = clampIndex(i, level.width), ib = clampIndex(i + 1, level.width);
+    int ja = clampIndex(j, level.height), jb = clampIndex(j + 1, level.height);
+    for (int c = 0; c < 3; c++) {
+        const float* a = level.planes[c] + (size_t)ja * level.width;
+        const float* b = level.planes[c] + (size_t)jb * level.width;
+        double top = a[ia] + fx * (a[ib] - a[ia]);
+        double bottom = b[ia] + fx * (b[ib] - b[ia]);
+        out[c] = top + fy * (bottom - top);
+    }
+}
+
+void DetailPyramid::applyRow(float* r, float* g, float* b, int x, int y, int n, ScratchArena& arena) const {
+    if (!isActive() || n <= 0) {
+        return;
+    }
+    ScratchArena::Scope scope(arena);
+    float* planes[3] = { r, g, b };
+    float* fine[3];
+    for (int c = 0; c < 3; c++) {
+        fine[c] = arena.allocate<float>(n);
+    }
+    upsampleRow(levels[1], 1, x, y, n, fine, arena);
+
+    const float sharpen = (float)sharpenAmount;
+    if (topLevel == 1) {
+        for (int c = 0; c < 3; c++) {
+            float* p = planes[c];
+            const float* f = fine[c];
+            for (int i = 0; i < n; i++) {
+                p[i] += sharpen * (p[i] - f[i]);
+            }
+        }
+        return;
+    }
+
+    float* coarse[3];
+    for (int c = 0; c < 3; c++) {
+        coarse[c] = arena.allocate<float>(n);
+    }
+    upsampleRow(levels[topLevel], topLevel, x, y, n, coarse, arena);
+
+    // Midtone weight from the coarse luma, scaled by the amount
+    const float midtone = (float)midtoneAmount;
+    float* weight = arena.allocate<float>(n);
+    for (int i = 0; i < n; i++) {
+        float l = kLumaR * coarse[0][i] + kLumaG * coarse[1][i] + kLumaB * coarse[2][i];
+        weight[i] = midtone * std::max(4.0f * l * (1.0f - l), 0.0f);
+    }
+
+    for (int c = 0; c < 3; c++) {
+        float* p = planes[c];
+        const float* f = fine[c];
+        const float* k = coarse[c];
+        for (int i = 0; i < n; i++) {
+            p[i] += sharpen * (p[i] - f[i]) + weight[i] * (f[i] - k[i]);
+        }
+    }
+}
+
+void DetailPyramid::applyPixel(int x, int y, double& r, double& g, double& b) const {
+    if (!isActive()) {
+        return;
+    }
+    double fine[3], coarse[3] = { 0.0, 0.0, 0.0 };
+    sample(levels[1], 1, x, y, fine);
+
+    double weight = 0.0;
+    if (topLevel > 1) {
+        sample(levels[topLevel], topLevel, x, y, coarse);
+        double l = kLumaR * coarse[0] + kLumaG * coarse[1] + kLumaB * coarse[2];
+        weight = midtoneAmount * std::max(4.0 * l * (1.0 - l), 0.0);
+    }
+
+    double* values[3] = { &r, &g, &b };
+    for (int c = 0; c < 3; c++) {
+        double v = *values[c];
+        *values[c] = v + sharpenAmount * (v - fine[c]) + weight * (fine[c] - coarse[c]);
+    }
+}
+
+} // namespace ofx
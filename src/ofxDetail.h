@@ -0,0 +1,112 @@
+#ifndef _ofxDetail_h_
+#define _ofxDetail_h_
+
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+#include "ofxArena.h"
+
+#include <functional>
+
+/**
+ * @file ofxDetail.h
+ * @brief Sharpening and midtone detail from a Gaussian pyramid
+ */
+
+namespace ofx {
+
+/**
+ * @brief Low-pass pyramid of a frame, and the detail bands taken from it
+ *
+ * Level k is the source reduced by 2^k, each level filtered from the one
+ * below with a [1 3 3 1] / 8 kernel on both axes and decimated. Bilinear
+ * expansion of a level back to source pixels gives a smooth base at that
+ * scale:
+ *
+ *     x' = x + sharpen * (x - up1) + midtone * w * (up1 - upN)
+ *
+ * where up1 is level 1 and upN the top level. The first band is the finest
+ * one or two pixels of texture; the second covers the middle frequencies,
+ * weighted by w = 4 l (1 - l) of the top level's luma so that shadows and
+ * highlights are left alone. Negative amounts smooth instead.
+ *
+ * The pyramid is built once per render over the render window plus radius()
+ * pixels, aligned to the top level so that every tile of a frame sees the
+ * same level samples. Its levels live in the arena passed to build(), which
+ * must outlive it.
+ */
+class DetailPyramid {
+public:
+    static const int kLevels = 4;
+
+private:
+    struct Level {
+        int x1, y1;          // First sample, in this level's pixel grid
+        int width, height;
+        float* planes[3];
+    };
+
+    double sharpenAmount;
+    double midtoneAmount;
+    int topLevel;            // 1 with sharpening only, else kLevels
+    int levelRadius;
+    Level levels[kLevels + 1];   // levels[0] is unused: the source is read in place
+
+    OfxRectI alignedRegion(const OfxRectI& window) const;
+    void upsampleRow(const Level& level, int shift, int x, int y, int n,
+                     float* out[3], ScratchArena& arena) const;
+    void sample(const Level& level, int shift, int x, int y, double out[3]) const;
+
+public:
+    DetailPyramid(double sharpen, double midtone);
+
+    double sharpen() const { return sharpenAmount; }
+    double midtone() const { return midtoneAmount; }
+    bool isActive() const { return sharpenAmount != 0.0 || midtoneAmount != 0.0; }
+
+    /**
+     * @brief Source pixels read on each side of an output pixel
+     */
+    int radius() const { return levelRadius; }
+
+    /**
+     * @brief Region of source needed for rect, for GetRegionsOfInterest
+     */
+    OfxRectI expand(const OfxRectI& rect) const;
+
+    /**
+     * @brief Bytes build() takes from its storage arena for window
+     */
+    size_t storageBytes(const OfxRectI& window) const;
+
+    /**
+     * @brief Reduce the source around window into the pyramid levels
+     *
+     * Pixels outside srcBounds repeat the nearest edge pixel. Levels are
+     * allocated from storage; each level is split into row bands on the pool,
+     * whose per-thread line buffers come from threads, indexed by slot.
+     *
+     * @param threads At least pool.maxParticipants() arenas
+     * @return false if cancelled before every level was built
+     */
+    bool build(const void* src, const OfxRectI& srcBounds, int srcRowBytes, BitDepth depth,
+               const OfxRectI& window, ScratchArena& storage, ScratchLease& threads,
+               ThreadPool& pool = ThreadPool::shared(),
+               const std::function<bool()>& cancelled = std::function<bool()>());
+
+    /**
+     * @brief Add the detail bands to n normalized pixels of row y starting at x
+     *
+     * r, g and b hold the source pixels and are updated in place; the
+     * expanded levels are staged in arena and released before returning.
+     */
+    void applyRow(float* r, float* g, float* b, int x, int y, int n, ScratchArena& arena) const;
+
+    /**
+     * @brief applyRow for one pixel in double precision, for the reference path
+     */
+    void applyPixel(int x, int y, double& r, double& g, double& b) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxDetail_h_
@@ -0,0 +1,192 @@
+#include "ofxDither.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+namespace ofx {
+
+namespace {
+
+const int kSize = DitherPattern::kTileSize;
+const int kCells = kSize * kSize;
+
+// Rank of a cell to a threshold in (0, 1)
+float rankThreshold(int rank, int count) {
+    return ((float)rank + 0.5f) / (float)count;
+}
+
+std::vector<float> buildNearest() {
+    return std::vector<float>(kCells, 0.5f);
+}
+
+std::vector<float> buildOrdered() {
+    // Bayer index: the bits of x ^ y and y interleaved, lowest coordinate bits most significant
+    const int bits = 3;
+    std::vector<float> tile(kCells);
+    for (int y = 0; y < kSize; y++) {
+        for (int x = 0; x < kSize; x++) {
+            int value = 0;
+            for (int k = 0; k < bits; k++) {
+                int xb = (x >> k) & 1;
+                int yb = (y >> k) & 1;
+                value |= ((xb ^ yb) << (2 * (bits - 1 - k) + 1)) | (yb << (2 * (bits - 1 - k)));
+            }
+            tile[y * kSize + x] = rankThreshold(value, 1 << (2 * bits));
+        }
+    }
+    return tile;
+}
+
+/**
+ * @brief Void-and-cluster (Ulichney 1993) on a torus
+ *
+ * Each set cell spreads a Gaussian of energy; the tightest cluster is the
+ * set cell with the most, the largest void the empty cell with the least.
+ */
+class VoidAndCluster {
+private:
+    std::vector<float> kernel;      // Energy at each wrapped offset
+    std::vector<float> energy;
+    std::vector<char> set;
+
+    // Past the radius the Gaussian is below 1e-4 and left out
+    static const int kRadius = 7;
+
+    void update(int cell, float sign) {
+        int cx = cell % kSize, cy = cell / kSize;
+        for (int dy = -kRadius; dy <= kRadius; dy++) {
+            const float* k = &kernel[(dy & (kSize - 1)) * kSize];
+            float* e = &energy[((cy + dy) & (kSize - 1)) * kSize];
+            for (int dx = -kRadius; dx <= kRadius; dx++) {
+                e[(cx + dx) & (kSize - 1)] += sign * k[dx & (kSize - 1)];
+            }
+        }
+    }
+
+public:
+    VoidAndCluster() : kernel(kCells), energy(kCells, 0.0f), set(kCells, 0) {
+        const double sigma = 1.5;
+        for (int y = 0; y < kSize; y++) {
+            for (int x = 0; x < kSize; x++) {
+                int dx = std::min(x, kSize - x), dy = std::min(y, kSize - y);
+                kernel[y * kSize + x] = (float)std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+            }
+        }
+    }
+
+    bool isSet(int cell) const { return set[cell] != 0; }
+    void insert(int cell) { set[cell] = 1; update(cell, 1.0f); }
+    void remove(int cell) { set[cell] = 0; update(cell, -1.0f); }
+
+    int tightestCluster() const {
+        int best = -1;
+        for (int i = 0; i < kCells; i++) {
+            if (set[i] && (best < 0 || energy[i] > energy[best])) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    int largestVoid() const {
+        int best = -1;
+        for (int i = 0; i < kCells; i++) {
+            if (!set[i] && (best < 0 || energy[i] < energy[best])) {
+                best = i;
+            }
+        }
+        return best;
+    }
+};
+
+std::vector<float> buildBlueNoise() {
+    // Initial pattern: a tenth of the cells, from a fixed seed so the tile never changes
+    VoidAndCluster initial;
+    int ones = 0;
+    uint32_t seed = 1;
+    while (ones < kCells / 10) {
+        seed = seed * 1664525u + 1013904223u;
+        int cell = (int)((seed >> 8) % kCells);
+        if (!initial.isSet(cell)) {
+            initial.insert(cell);
+            ones++;
+        }
+    }
+
+    // Move the tightest cluster into the largest void until that changes nothing
+    for (int i = 0; i < kCells; i++) {
+        int cluster = initial.tightestCluster();
+        initial.remove(cluster);
+        int hole = initial.largestVoid();
+        initial.insert(hole);
+        if (hole == cluster) {
+            break;
+        }
+    }
+
+    // Rank the initial cells by removing clusters, then the rest by filling voids
+    std::vector<int> rank(kCells, 0);
+    VoidAndCluster pattern = initial;
+    for (int r = ones - 1; r >= 0; r--) {
+        int cluster = pattern.tightestCluster();
+        pattern.remove(cluster);
+        rank[cluster] = r;
+    }
+    pattern = initial;
+    for (int r = ones; r < kCells; r++) {
+        int hole = pattern.largestVoid();
+        pattern.insert(hole);
+        rank[hole] = r;
+    }
+
+    std::vector<float> tile(kCells);
+    for (int i = 0; i < kCells; i++) {
+        tile[i] = rankThreshold(rank[i], kCells);
+    }
+    return tile;
+}
+
+const std::vector<float>& patternTile(Quantization mode) {
+    static const std::vector<float> nearest = buildNearest();
+    if (mode == kQuantizeOrdered) {
+        static const std::vector<float> ordered = buildOrdered();
+        return ordered;
+    }
+    if (mode == kQuantizeBlueNoise) {
+        static const std::vector<float> blueNoise = buildBlueNoise();
+        return blueNoise;
+    }
+    return nearest;
+}
+
+} // namespace
+
+const char* quantizationLabel(Quantization mode) {
+    switch (mode) {
+        case kQuantizeNearest:   return "Nearest";
+        case kQuantizeOrdered:   return "Ordered Dither";
+        case kQuantizeBlueNoise: return "Blue Noise Dither";
+        default:                 return "";
+    }
+}
+
+DitherPattern::DitherPattern(Quantization mode)
+    : tile(&patternTile(mode)[0]), quantization(mode >= 0 && mode < kQuantizationCount ? mode : kQuantizeNearest)
+{
+}
+
+void DitherPattern::fillRow(int x, int y, int n, float* out) const {
+    const float* row = tile + (y & (kTileSize - 1)) * kTileSize;
+    int start = x & (kTileSize - 1);
+    while (n > 0) {
+        int count = std::min(kTileSize - start, n);
+        std::copy(row + start, row + start + count, out);
+        out += count;
+        n -= count;
+        start = 0;
+    }
+}
+
+} // namespace ofx
@@ -0,0 +1,65 @@
+#ifndef _ofxDither_h_
+#define _ofxDither_h_
+
+/**
+ * @file ofxDither.h
+ * @brief Rounding and dither patterns for writing integer output
+ */
+
+namespace ofx {
+
+/**
+ * @brief How values are rounded to output codes, in the order of the plugin's choice options
+ */
+enum Quantization {
+    kQuantizeNearest = 0,   ///< Round to the nearest code
+    kQuantizeOrdered,       ///< 8x8 Bayer threshold matrix
+    kQuantizeBlueNoise,     ///< 64x64 void-and-cluster blue noise
+    kQuantizationCount
+};
+
+/**
+ * @brief Display name of a quantization mode
+ */
+const char* quantizationLabel(Quantization mode);
+
+/**
+ * @brief Threshold pattern tiled over the image, added to a scaled value before it is truncated to a code
+ *
+ * Every threshold lies strictly between 0 and 1: a value already on a code
+ * comes back as that code, and one between two codes rounds up with a
+ * probability equal to its distance past the lower one, so gradients
+ * average out to their exact level instead of banding. The nearest mode's
+ * thresholds are all 0.5. Ordered dither repeats its 8x8 matrix across the
+ * tile; blue noise spreads the thresholds with no low-frequency structure.
+ *
+ * The tiles are shared and built on first use; one is 16 KB, so it stays in
+ * L1 while a row is written.
+ */
+class DitherPattern {
+public:
+    static const int kTileSize = 64;
+
+private:
+    const float* tile;     // kTileSize * kTileSize thresholds, row by row
+    Quantization quantization;
+
+public:
+    explicit DitherPattern(Quantization mode = kQuantizeNearest);
+
+    Quantization mode() const { return quantization; }
+    bool isDithered() const { return quantization != kQuantizeNearest; }
+
+    float threshold(int x, int y) const {
+        return tile[(y & (kTileSize - 1)) * kTileSize + (x & (kTileSize - 1))];
+    }
+
+    /**
+     * @brief Thresholds of n pixels of row y starting at x
+     */
+    void fillRow(int x, int y, int n, float* out) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxDither_h_
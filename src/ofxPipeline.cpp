@@ -0,0 +1,520 @@
+#include "ofxPipeline.h"
+
+#include <cmath>
+
+namespace ofx {
+
+CurveFunction CurveFunction::affine(double scale, double offset) {
+    CurveFunction fn = { kAffine, scale, offset, kTransferLinear, std::shared_ptr<const std::vector<float> >() };
+    return fn;
+}
+
+CurveFunction CurveFunction::power(double exponent) {
+    CurveFunction fn = { kPower, exponent, 0.0, kTransferLinear, std::shared_ptr<const std::vector<float> >() };
+    return fn;
+}
+
+CurveFunction CurveFunction::signedPower(double exponent) {
+    CurveFunction fn = { kSignedPower, exponent, 0.0, kTransferLinear, std::shared_ptr<const std::vector<float> >() };
+    return fn;
+}
+
+CurveFunction CurveFunction::decode(TransferFunction tf) {
+    CurveFunction fn = { kDecode, 0.0, 0.0, tf, std::shared_ptr<const std::vector<float> >() };
+    return fn;
+}
+
+CurveFunction CurveFunction::encode(TransferFunction tf) {
+    CurveFunction fn = { kEncode, 0.0, 0.0, tf, std::shared_ptr<const std::vector<float> >() };
+    return fn;
+}
+
+CurveFunction CurveFunction::lookup(const std::shared_ptr<const std::vector<float> >& samples) {
+    CurveFunction fn = { kTable, 0.0, 0.0, kTransferLinear, samples };
+    return fn;
+}
+
+double CurveFunction::apply(double x) const {
+    switch (type) {
+        case kAffine:
+            return a * x + b;
+        case kPower:
+            return std::pow(std::max(0.0, x), a);
+        case kSignedPower:
+            return x < 0.0 ? -std::pow(-x, a) : std::pow(x, a);
+        case kDecode:
+            return transferToLinear(transfer, x);
+        case kEncode:
+            return transferFromLinear(transfer, x);
+        case kTable: {
+            const std::vector<float>& samples = *table;
+            if (samples.size() < 2 || std::isnan(x)) {
+                return x;
+            }
+            double pos = std::min(std::max(x, 0.0), 1.0) * (double)(samples.size() - 1);
+            size_t index = std::min((size_t)pos, samples.size() - 2);
+            double frac = pos - (double)index;
+            return samples[index] + frac * (samples[index + 1] - samples[index]);
+        }
+    }
+    return x;
+}
+
+void CurveFunction::appendKey(std::vector<double>& key) const {
+    key.push_back((double)type);
+    key.push_back(a);
+    key.push_back(b);
+    key.push_back((double)transfer);
+    if (type == kTable) {
+        key.push_back((double)table->size());
+        key.insert(key.end(), table->begin(), table->end());
+    }
+}
+
+PipelineStage::PipelineStage(Type type)
+    : stageType(type), linear(Matrix3::identity())
+{
+}
+
+PipelineStage PipelineStage::gain(double r, double g, double b) {
+    PipelineStage stage(kGain);
+    stage.linear = Matrix3::diagonal(r, g, b);
+    stage.curves[0].push_back(CurveFunction::affine(r, 0.0));
+    stage.curves[1].push_back(CurveFunction::affine(g, 0.0));
+    stage.curves[2].push_back(CurveFunction::affine(b, 0.0));
+    return stage;
+}
+
+namespace {
+
+CurveFunction exponent(double a, bool preserveSign) {
+    return preserveSign ? CurveFunction::signedPower(a) : CurveFunction::power(a);
+}
+
+} // namespace
+
+PipelineStage PipelineStage::gamma(double r, double g, double b, bool preserveSign) {
+    PipelineStage stage(kGamma);
+    stage.curves[0].push_back(exponent(r, preserveSign));
+    stage.curves[1].push_back(exponent(g, preserveSign));
+    stage.curves[2].push_back(exponent(b, preserveSign));
+    return stage;
+}
+
+PipelineStage PipelineStage::liftGammaGain(const double* lift, const double* gamma, const double* gain,
+                                           bool preserveSign)
+{
+    // out = (gain * (x + lift * (1 - x))) ^ (1 / gamma), with the affine part precomputed
+    PipelineStage stage(kCurve);
+    for (int c = 0; c < 3; c++) {
+        double scale = gain[c] * (1.0 - lift[c]);
+        double offset = gain[c] * lift[c];
+        if (scale != 1.0 || offset != 0.0) {
+            stage.curves[c].push_back(CurveFunction::affine(scale, offset));
+        }
+        if (gamma[c] != 1.0) {
+            stage.curves[c].push_back(exponent(1.0 / gamma[c], preserveSign));
+        }
+    }
+    return stage;
+}
+
+PipelineStage PipelineStage::saturation(double saturation, const double* luma) {
+    // out = luma + s * (in - luma), written as a matrix
+    PipelineStage stage(kSaturation);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            stage.linear.m[i][j] = (1.0 - saturation) * luma[j] + ((i == j) ? saturation : 0.0);
+        }
+    }
+    return stage;
+}
+
+PipelineStage PipelineStage::matrix(const Matrix3& m) {
+    PipelineStage stage(kMatrix);
+    stage.linear = m;
+    return stage;
+}
+
+PipelineStage PipelineStage::curve(const CurveFunction& r, const CurveFunction& g, const CurveFunction& b) {
+    PipelineStage stage(kCurve);
+    stage.curves[0].push_back(r);
+    stage.curves[1].push_back(g);
+    stage.curves[2].push_back(b);
+    return stage;
+}
+
+PipelineStage PipelineStage::lut(const std::shared_ptr<const std::vector<float> >& r,
+                                 const std::shared_ptr<const std::vector<float> >& g,
+                                 const std::shared_ptr<const std::vector<float> >& b)
+{
+    PipelineStage stage(kLUT);
+    stage.curves[0].push_back(CurveFunction::lookup(r));
+    stage.curves[1].push_back(CurveFunction::lookup(g));
+    stage.curves[2].push_back(CurveFunction::lookup(b));
+    return stage;
+}
+
+PipelineStage PipelineStage::toneCurve(const std::shared_ptr<const std::vector<float> >& master,
+                                       const std::shared_ptr<const std::vector<float> >& r,
+                                       const std::shared_ptr<const std::vector<float> >& g,
+                                       const std::shared_ptr<const std::vector<float> >& b)
+{
+    PipelineStage stage(kCurve);
+    const std::shared_ptr<const std::vector<float> >* channels[3] = { &r, &g, &b };
+    for (int c = 0; c < 3; c++) {
+        if (master) {
+            stage.curves[c].push_back(CurveFunction::lookup(master));
+        }
+        if (*channels[c]) {
+            stage.curves[c].push_back(CurveFunction::lookup(*channels[c]));
+        }
+    }
+    return stage;
+}
+
+void PipelineStage::apply(double& r, double& g, double& b) const {
+    if (stageType == kSaturation || stageType == kMatrix) {
+        linear.apply(r, g, b);
+        return;
+    }
+
+    double* values[3] = { &r, &g, &b };
+    for (int c = 0; c < 3; c++) {
+        for (size_t i = 0; i < curves[c].size(); i++) {
+            *values[c] = curves[c][i].apply(*values[c]);
+        }
+    }
+}
+
+void PipelineStage::appendKey(std::vector<double>& key) const {
+    key.push_back((double)stageType);
+    for (int i = 0; i < 3; i++) {
+        key.insert(key.end(), linear.m[i], linear.m[i] + 3);
+    }
+    for (int c = 0; c < 3; c++) {
+        key.push_back((double)curves[c].size());
+        for (size_t i = 0; i < curves[c].size(); i++) {
+            curves[c][i].appendKey(key);
+        }
+    }
+}
+
+void ColorPipeline::addConversion(ColorSpace from, ColorSpace to) {
+    ColorSpaceConversion conversion(from, to);
+    if (conversion.isIdentity()) {
+        return;
+    }
+
+    TransferFunction decode = colorSpaceTransfer(from);
+    TransferFunction encode = colorSpaceTransfer(to);
+    if (decode != kTransferLinear) {
+        CurveFunction fn = CurveFunction::decode(decode);
+        add(PipelineStage::curve(fn, fn, fn));
+    }
+    if (!conversion.matrix().isIdentity()) {
+        add(PipelineStage::matrix(conversion.matrix()));
+    }
+    if (encode != kTransferLinear) {
+        CurveFunction fn = CurveFunction::encode(encode);
+        add(PipelineStage::curve(fn, fn, fn));
+    }
+}
+
+void ColorPipeline::limit() {
+    if (limited) {
+        return;
+    }
+    limitStart = stages.size();
+    limited = true;
+}
+
+void ColorPipeline::qualify(const Qualifier& qualifier) {
+    if (qualifier.selectsEverything()) {
+        return;
+    }
+    limit();
+    matte = qualifier;
+    qualified = true;
+}
+
+std::vector<double> ColorPipeline::key() const {
+    std::vector<double> result;
+    for (size_t i = 0; i < stages.size(); i++) {
+        stages[i].appendKey(result);
+    }
+    if (limited) {
+        result.push_back((double)limitStart);
+    }
+    if (qualified) {
+        matte.appendKey(result);
+    }
+    result.push_back(extended ? 1.0 : 0.0);
+    return result;
+}
+
+double CompiledPipeline::FusedOp::evaluate(int c, double x) const {
+    for (size_t i = 0; i < functions[c].size(); i++) {
+        x = functions[c][i].apply(x);
+    }
+    return x;
+}
+
+namespace {
+
+bool isDiagonal(const Matrix3& m) {
+    return m.m[0][1] == 0.0 && m.m[0][2] == 0.0 && m.m[1][0] == 0.0 &&
+           m.m[1][2] == 0.0 && m.m[2][0] == 0.0 && m.m[2][1] == 0.0;
+}
+
+// Intermediate form used while folding stages
+struct FoldedOp {
+    bool isMatrix;
+    Matrix3 matrix;
+    std::vector<CurveFunction> functions[3];
+};
+
+void diagonalToCurve(FoldedOp& op) {
+    op.isMatrix = false;
+    for (int c = 0; c < 3; c++) {
+        if (op.matrix.m[c][c] != 1.0) {
+            op.functions[c].push_back(CurveFunction::affine(op.matrix.m[c][c], 0.0));
+        }
+    }
+}
+
+void appendFunctions(FoldedOp& op, const PipelineStage& stage) {
+    for (int c = 0; c < 3; c++) {
+        const std::vector<CurveFunction>& fns = stage.channel(c);
+        for (size_t i = 0; i < fns.size(); i++) {
+            // Unit gains are no-ops in a curve
+            if (fns[i].type == CurveFunction::kAffine && fns[i].a == 1.0 && fns[i].b == 0.0) {
+                continue;
+            }
+            op.functions[c].push_back(fns[i]);
+        }
+    }
+}
+
+// True if f(-x) == -f(x) for every function of the chain, so the chain is odd as well
+bool isOdd(const std::vector<CurveFunction>& functions) {
+    for (size_t i = 0; i < functions.size(); i++) {
+        const CurveFunction& fn = functions[i];
+        bool odd = (fn.type == CurveFunction::kAffine && fn.b == 0.0)
+            || fn.type == CurveFunction::kSignedPower
+            || ((fn.type == CurveFunction::kDecode || fn.type == CurveFunction::kEncode)
+                && (fn.transfer == kTransferLinear || fn.transfer == kTransferGamma24));
+        if (!odd) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fold stages [first, last); folding never crosses the limit boundary
+std::vector<FoldedOp> fold(const ColorPipeline& pipeline, size_t first, size_t last) {
+    std::vector<FoldedOp> folded;
+
+    for (size_t i = first; i < last; i++) {
+        const PipelineStage& stage = pipeline.stage(i);
+        FoldedOp* back = folded.empty() ? nullptr : &folded.back();
+
+        if (stage.type() == PipelineStage::kGain && back && !back->isMatrix) {
+            // Gain after a curve scales the curve output
+            appendFunctions(*back, stage);
+        } else if (stage.isLinear()) {
+            if (back && back->isMatrix) {
+                back->matrix = stage.matrix() * back->matrix;
+            } else {
+                FoldedOp op;
+                op.isMatrix = true;
+                op.matrix = stage.matrix();
+                folded.push_back(op);
+            }
+        } else {
+            if (back && back->isMatrix && isDiagonal(back->matrix)) {
+                diagonalToCurve(*back);
+            }
+            if (back && !back->isMatrix) {
+                appendFunctions(*back, stage);
+            } else {
+                FoldedOp op;
+                op.isMatrix = false;
+                appendFunctions(op, stage);
+                folded.push_back(op);
+            }
+        }
+    }
+
+    // Drop identity matrices and empty curves, merging the curves around them
+    std::vector<FoldedOp> result;
+    for (size_t i = 0; i < folded.size(); i++) {
+        FoldedOp& op = folded[i];
+        if (op.isMatrix && op.matrix.isIdentity(0.0)) {
+            continue;
+        }
+        if (!op.isMatrix && op.functions[0].empty() && op.functions[1].empty() && op.functions[2].empty()) {
+            continue;
+        }
+        if (!result.empty() && !op.isMatrix && !result.back().isMatrix) {
+            for (int c = 0; c < 3; c++) {
+                result.back().functions[c].insert(result.back().functions[c].end(),
+                                                  op.functions[c].begin(), op.functions[c].end());
+            }
+            continue;
+        }
+        result.push_back(op);
+    }
+    return result;
+}
+
+} // namespace
+
+CompiledPipeline::CompiledPipeline(const ColorPipeline& pipeline, int maxCode)
+    : codeCount(maxCode > 0 ? maxCode + 1 : 0), leadingCodes(false),
+      limited(pipeline.isLimited()), qualified(pipeline.isQualified()), extended(pipeline.isExtendedRange()),
+      limitOp(0),
+      matte(pipeline.qualifier())
+{
+    size_t split = pipeline.limitedStage();
+    std::vector<FoldedOp> folded = fold(pipeline, 0, split);
+    limitOp = folded.size();
+    if (limited) {
+        std::vector<FoldedOp> graded = fold(pipeline, split, pipeline.size());
+        folded.insert(folded.end(), graded.begin(), graded.end());
+    }
+    ops.resize(folded.size());
+
+    // The mask needs the pixel before the limited ops, so they cannot start from the codes
+    leadingCodes = codeCount > 0 && !folded.empty() && !folded[0].isMatrix && !(limited && limitOp == 0);
+
+    for (size_t i = 0; i < folded.size(); i++) {
+        FusedOp& op = ops[i];
+        op.isMatrix = folded[i].isMatrix;
+
+        if (op.isMatrix) {
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    op.m[r][c] = (float)folded[i].matrix.m[r][c];
+                }
+            }
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            op.functions[c] = folded[i].functions[c];
+            op.zeroValue[c] = (float)op.evaluate(c, 0.0);
+            op.odd[c] = isOdd(op.functions[c]);
+            if (op.functions[c].empty()) {
+                continue;
+            }
+
+            struct Evaluate {
+                const FusedOp* op;
+                int channel;
+                double operator()(double x) const { return op->evaluate(channel, x); }
+            } evaluate = { &op, c };
+
+            if (i == 0 && leadingCodes) {
+                // A leading curve on integer input is resolved per code value
+                op.codeLUT[c].resize(codeCount);
+                for (int code = 0; code < codeCount; code++) {
+                    op.codeLUT[c][code] = (float)evaluate((double)code / (double)maxCode);
+                }
+            }
+            // Also kept for rows whose values change after loading, such as with detail
+            op.lut[c].build(evaluate);
+
+            // Extended range looks negative values up by magnitude, in a table of their own unless the curve is odd
+            if (extended && !op.odd[c]) {
+                struct EvaluateNegative {
+                    const FusedOp* op;
+                    int channel;
+                    double operator()(double x) const { return op->evaluate(channel, -x); }
+                } evaluateNegative = { &op, c };
+                op.negativeLut[c].build(evaluateNegative);
+            }
+        }
+    }
+}
+
+void CompiledPipeline::applyMatrix(const FusedOp& op, float* r, float* g, float* b, int n) const {
+    const float m00 = op.m[0][0], m01 = op.m[0][1], m02 = op.m[0][2];
+    const float m10 = op.m[1][0], m11 = op.m[1][1], m12 = op.m[1][2];
+    const float m20 = op.m[2][0], m21 = op.m[2][1], m22 = op.m[2][2];
+
+    for (int x = 0; x < n; x++) {
+        float vr = r[x], vg = g[x], vb = b[x];
+        r[x] = m00 * vr + m01 * vg + m02 * vb;
+        g[x] = m10 * vr + m11 * vg + m12 * vb;
+        b[x] = m20 * vr + m21 * vg + m22 * vb;
+    }
+}
+
+void CompiledPipeline::applyCurve(const FusedOp& op, int c, const float* in, float* out, int n) const {
+    const LogLUT& lut = op.lut[c];
+    const float lo = LogLUT::minInput();
+    const float hi = LogLUT::maxInput();
+    const float top = std::nextafter(hi, 0.0f);
+
+    // Table lookups for the whole row, then patch the few values outside the table range. Extended range
+    // looks up the magnitude and picks the sign's result without a branch, so negative values stay on the
+    // table path; otherwise they are patched
+    int outside = 0;
+    if (!extended) {
+        for (int x = 0; x < n; x++) {
+            float v = in[x];
+            outside += !(v >= lo && v < hi);
+            out[x] = lut.lookup(std::max(lo, std::min(top, v)));    // NaN clamps to top, and is patched below
+        }
+    } else if (op.odd[c]) {
+        for (int x = 0; x < n; x++) {
+            float v = in[x];
+            float a = std::fabs(v);
+            outside += !(a >= lo && a < hi);
+            out[x] = std::copysign(lut.lookup(std::max(lo, std::min(top, a))), v);
+        }
+    } else {
+        const LogLUT& negative = op.negativeLut[c];
+        for (int x = 0; x < n; x++) {
+            float v = in[x];
+            float a = std::fabs(v);
+            float clamped = std::max(lo, std::min(top, a));
+            outside += !(a >= lo && a < hi);
+            float positive = lut.lookup(clamped);
+            float mirrored = negative.lookup(clamped);
+            out[x] = v < 0.0f ? mirrored : positive;
+        }
+    }
+
+    if (outside) {
+        for (int x = 0; x < n; x++) {
+            float v = in[x];
+            float a = extended ? std::fabs(v) : v;
+            if (v == 0.0f) {
+                out[x] = op.zeroValue[c];
+            } else if (!(a >= lo && a < hi)) {
+                out[x] = (float)op.evaluate(c, v);
+            }
+        }
+    }
+}
+
+void CompiledPipeline::runOps(float** planes, size_t firstOp, size_t lastOp, int n) const {
+    for (size_t i = firstOp; i < lastOp; i++) {
+        const FusedOp& op = ops[i];
+        if (op.isMatrix) {
+            applyMatrix(op, planes[0], planes[1], planes[2], n);
+            continue;
+        }
+        for (int c = 0; c < 3; c++) {
+            if (op.functions[c].empty()) {
+                continue;
+            }
+            applyCurve(op, c, planes[c], planes[3], n);
+            std::swap(planes[c], planes[3]);
+        }
+    }
+}
+
+} // namespace ofx
@@ -0,0 +1,545 @@
+#ifndef _ofxPipeline_h_
+#define _ofxPipeline_h_
+
+#include "ofxImageEffect.h"
+#include "ofxColorSpace.h"
+#include "ofxQualifier.h"
+#include "ofxPowerWindow.h"
+#include "ofxDetail.h"
+#include "ofxDither.h"
+#include "ofxArena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @file ofxPipeline.h
+ * @brief Per-pixel color pipeline IR with stage fusion
+ *
+ * A grade is described as a list of stages (gain, gamma, saturation,
+ * matrix, curve, LUT). Compiling the list folds adjacent linear stages into
+ * a single 3x3 matrix and adjacent per-channel stages into a single curve,
+ * baked into lookup tables, so the whole chain runs as one pass over the
+ * image regardless of how many controls are active.
+ */
+
+namespace ofx {
+
+/**
+ * @brief Largest magnitude a float source sample is read as, the largest half float
+ *
+ * Keeps extended range grades of out-of-range material from overflowing
+ * single precision in the fast path where the reference's doubles would not.
+ */
+const double kMaxFloatSample = 65504.0;
+
+/**
+ * @brief Per-channel function primitive, the building block of curve stages
+ */
+struct CurveFunction {
+    enum Type {
+        kAffine,        // a * x + b
+        kPower,         // max(0, x) ^ a
+        kSignedPower,   // sign(x) * |x| ^ a
+        kDecode,        // transfer to linear
+        kEncode,        // linear to transfer
+        kTable          // samples over [0, 1], linearly interpolated
+    };
+
+    Type type;
+    double a, b;
+    TransferFunction transfer;
+    std::shared_ptr<const std::vector<float> > table;
+
+    static CurveFunction affine(double scale, double offset);
+    static CurveFunction power(double exponent);
+    static CurveFunction signedPower(double exponent);
+    static CurveFunction decode(TransferFunction tf);
+    static CurveFunction encode(TransferFunction tf);
+    static CurveFunction lookup(const std::shared_ptr<const std::vector<float> >& samples);
+
+    double apply(double x) const;
+    void appendKey(std::vector<double>& key) const;
+};
+
+/**
+ * @brief One node of the pipeline IR
+ *
+ * Linear stages carry a matrix, per-channel stages carry a list of curve
+ * functions per channel. Gain is both, so it can fold either way.
+ */
+class PipelineStage {
+public:
+    enum Type {
+        kGain,
+        kGamma,
+        kSaturation,
+        kMatrix,
+        kCurve,
+        kLUT
+    };
+
+private:
+    Type stageType;
+    Matrix3 linear;
+    std::vector<CurveFunction> curves[3];
+
+    explicit PipelineStage(Type type);
+
+public:
+    static PipelineStage gain(double r, double g, double b);
+    // With preserveSign, negative values are raised by their magnitude and keep their sign instead of clipping to 0
+    static PipelineStage gamma(double r, double g, double b, bool preserveSign = false);
+    static PipelineStage liftGammaGain(const double* lift, const double* gamma, const double* gain,
+                                       bool preserveSign = false);
+    static PipelineStage saturation(double saturation, const double* luma);
+    static PipelineStage matrix(const Matrix3& m);
+    static PipelineStage curve(const CurveFunction& r, const CurveFunction& g, const CurveFunction& b);
+    static PipelineStage lut(const std::shared_ptr<const std::vector<float> >& r,
+                             const std::shared_ptr<const std::vector<float> >& g,
+                             const std::shared_ptr<const std::vector<float> >& b);
+
+    // Master table applied to every channel, then the channel's own table; null tables are skipped
+    static PipelineStage toneCurve(const std::shared_ptr<const std::vector<float> >& master,
+                                   const std::shared_ptr<const std::vector<float> >& r,
+                                   const std::shared_ptr<const std::vector<float> >& g,
+                                   const std::shared_ptr<const std::vector<float> >& b);
+
+    Type type() const { return stageType; }
+    bool isLinear() const { return stageType == kGain || stageType == kSaturation || stageType == kMatrix; }
+    bool isPerChannel() const { return stageType == kGain || stageType == kGamma || stageType == kCurve || stageType == kLUT; }
+
+    const Matrix3& matrix() const { return linear; }
+    const std::vector<CurveFunction>& channel(int c) const { return curves[c]; }
+
+    void apply(double& r, double& g, double& b) const;
+    void appendKey(std::vector<double>& key) const;
+};
+
+/**
+ * @brief Ordered list of stages describing a grade
+ */
+class ColorPipeline {
+private:
+    std::vector<PipelineStage> stages;
+    Qualifier matte;
+    size_t limitStart;
+    bool limited;
+    bool qualified;
+    bool extended;
+
+public:
+    ColorPipeline() : limitStart(0), limited(false), qualified(false), extended(false) {}
+
+    void add(const PipelineStage& stage) { stages.push_back(stage); }
+
+    // Decode, primaries matrix, encode; nothing is added for an identity conversion
+    void addConversion(ColorSpace from, ColorSpace to);
+
+    /**
+     * @brief Mark the stages added from here on as limited by a mask
+     *
+     * The mask is the qualifier's matte times the window coverage given when
+     * rendering. Later calls keep the first boundary.
+     */
+    void limit();
+
+    /**
+     * @brief Limit the stages added from here on to the qualifier's matte
+     *
+     * The matte is computed from the pixel as the earlier stages leave it, and
+     * the later stages' result is blended back over it by the matte. A
+     * qualifier that selects everything changes nothing and is ignored.
+     */
+    void qualify(const Qualifier& qualifier);
+
+    bool empty() const { return stages.empty(); }
+    size_t size() const { return stages.size(); }
+    const PipelineStage& stage(size_t i) const { return stages[i]; }
+
+    /**
+     * @brief Keep values outside [0, 1] in float output instead of clamping them
+     *
+     * Integer output is always clamped. Stages that can produce negative
+     * values from negative input, such as gamma, should be added with
+     * preserveSign so scene-linear and HDR material survives the grade.
+     */
+    void setExtendedRange(bool extendedRange) { extended = extendedRange; }
+    bool isExtendedRange() const { return extended; }
+
+    bool isLimited() const { return limited; }
+    bool isQualified() const { return qualified; }
+    const Qualifier& qualifier() const { return matte; }
+
+    /**
+     * @brief Index of the first limited stage, or size() if there is none
+     */
+    size_t limitedStage() const { return limited ? limitStart : stages.size(); }
+
+    /**
+     * @brief Evaluate every stage in double precision, without fusion or LUTs
+     *
+     * @param coverage Window coverage of the pixel, scaling the mask of the limited stages
+     */
+    void apply(double& r, double& g, double& b, double coverage = 1.0) const {
+        size_t split = limitedStage();
+        for (size_t i = 0; i < split; i++) {
+            stages[i].apply(r, g, b);
+        }
+        if (split == stages.size()) {
+            return;
+        }
+
+        double m = (qualified ? matte.matte(r, g, b) : 1.0) * coverage;
+        if (m <= 0.0) {
+            return;
+        }
+        double base[3] = { r, g, b };
+        for (size_t i = split; i < stages.size(); i++) {
+            stages[i].apply(r, g, b);
+        }
+        r = base[0] + m * (r - base[0]);
+        g = base[1] + m * (g - base[1]);
+        b = base[2] + m * (b - base[2]);
+    }
+
+    /**
+     * @brief Value signature used to detect that a compiled pipeline can be reused
+     */
+    std::vector<double> key() const;
+};
+
+/**
+ * @brief Fused, LUT-baked form of a ColorPipeline ready for rendering
+ *
+ * Immutable once built, so one instance can be shared between render threads.
+ */
+class CompiledPipeline {
+private:
+    struct FusedOp {
+        bool isMatrix;
+        float m[3][3];
+        std::vector<CurveFunction> functions[3];
+        LogLUT lut[3];
+        LogLUT negativeLut[3];  // Extended range: the curve at -x, unless it is odd
+        bool odd[3];            // f(-x) == -f(x), so negative inputs look up lut by magnitude
+        std::vector<float> codeLUT[3];
+        float zeroValue[3];
+
+        double evaluate(int c, double x) const;
+    };
+
+    // Scratch planes of one row, each at least as wide as the render window
+    struct RowPlanes {
+        float* rgb[4];      // r, g, b and the spare buffer runOps needs
+        float* alpha;
+        float* base[3];     // Pixel before the limited ops, for the blend
+        float* mask;
+        float* coverage;
+        float* thresholds;  // Added before an integer output is truncated
+    };
+
+    std::vector<FusedOp> ops;
+    int codeCount;
+    bool leadingCodes;
+    bool limited;
+    bool qualified;
+    bool extended;
+    size_t limitOp;
+    Qualifier matte;
+
+    void applyMatrix(const FusedOp& op, float* r, float* g, float* b, int n) const;
+    void applyCurve(const FusedOp& op, int c, const float* in, float* out, int n) const;
+
+    // Source sample in normalized units; float samples are limited to kMaxFloatSample, and non-finite ones read
+    // as 0, as a fused matrix would spread them
+    template<typename TSrc>
+    static float toInput(TSrc v, float scale) {
+        const float limit = (float)kMaxFloatSample;
+        float f = (float)v * scale;
+        if (std::numeric_limits<TSrc>::is_integer) {
+            return f;
+        }
+        return std::isfinite(f) ? std::max(-limit, std::min(limit, f)) : 0.0f;
+    }
+
+    // Clamps v to [0, 1], NaN to 0, and scales it; the sum is capped too, as float rounding can carry the top code past outScale
+    static float toOutput(float v, float outScale, float threshold) {
+        return std::min(std::min(1.0f, std::max(0.0f, v)) * outScale + threshold, outScale);
+    }
+
+    // Extended range float output keeps the color unclamped; alpha is clamped either way
+    template<typename TDst>
+    bool clampsColor() const {
+        return std::numeric_limits<TDst>::is_integer || !extended;
+    }
+
+    // Planes: r, g, b and one spare buffer, each at least n floats; runs ops [firstOp, lastOp)
+    void runOps(float** planes, size_t firstOp, size_t lastOp, int n) const;
+
+    // n pixels of one row; x and y locate the first one for the window's coverage and the detail
+    template<typename TSrc, typename TDst>
+    void processSpan(TDst* dst, const TSrc* src, int n,
+                     WindowCoverage coverage, const PowerWindow* window,
+                     const DetailPyramid* detail, int x, int y,
+                     RowPlanes& planes, const float* thresholds,
+                     ScratchArena& arena, float scale, float outScale) const;
+
+public:
+    /**
+     * @param pipeline The stages to fuse
+     * @param maxCode Largest integer code value of the source (255, 65535), or 0 for float
+     */
+    CompiledPipeline(const ColorPipeline& pipeline, int maxCode);
+
+    size_t opCount() const { return ops.size(); }
+
+    /**
+     * @brief Apply the fused chain in one pass: load, run ops per row, clamp and write
+     *
+     * Source and destination may differ in depth: values are loaded from
+     * TSrc scaled by 1 / srcMax and written to TDst scaled by dstMax, so a
+     * depth conversion costs nothing beyond the grade's own pass. The
+     * pipeline must have been compiled for the source's codes.
+     *
+     * With a qualifier, the stages before it run first, the matte is taken
+     * from their result, and the qualified stages are blended back by it in
+     * the same row pass. Rows the matte misses entirely skip those stages.
+     *
+     * With a window, the render window is classified in 64x64 tiles. Runs of
+     * tiles outside it skip the limited stages, a straight copy when nothing
+     * comes before them; runs inside take the unmasked path; only edge runs
+     * evaluate per-pixel coverage.
+     *
+     * With detail, the sharpening and midtone bands are added to each row
+     * as it is loaded, ahead of every stage and of the window, so the detail
+     * and the grade still share one read and one write per pixel.
+     *
+     * Integer output adds the dither pattern's thresholds before truncating;
+     * without a pattern it rounds to the nearest code. Float output is
+     * clamped to [0, 1] too, unless the pipeline is extended range.
+     *
+     * Row buffers come from arena, rewound on return; pass the calling
+     * thread's arena to reuse them between bands, or none for a local one.
+     */
+    template<typename TSrc, typename TDst>
+    void process(TDst* dst, const TSrc* src,
+                 const OfxRectI& renderWindow,
+                 int dstRowBytes, int srcRowBytes,
+                 double srcMax, double dstMax,
+                 const PowerWindow* window = nullptr,
+                 const DetailPyramid* detail = nullptr,
+                 const DitherPattern* dither = nullptr,
+                 ScratchArena* arena = nullptr) const;
+};
+
+template<typename TSrc, typename TDst>
+void CompiledPipeline::processSpan(TDst* dst, const TSrc* src, int n,
+                                   WindowCoverage coverage, const PowerWindow* window,
+                                   const DetailPyramid* detail, int x, int y,
+                                   RowPlanes& rows, const float* thresholds,
+                                   ScratchArena& arena, float scale, float outScale) const
+{
+    const size_t split = limited ? limitOp : ops.size();
+
+    // Alpha is rounded to integer output, never dithered
+    const float bias = std::numeric_limits<TDst>::is_integer ? 0.5f : 0.0f;
+
+    // Outside the window with nothing before the limit, the source passes through, converted to the output's depth
+    if (coverage == kCoverageOutside && split == 0 && !detail) {
+        if (std::is_same<TSrc, TDst>::value && std::numeric_limits<TDst>::is_integer) {
+            std::memcpy(dst, src, (size_t)n * 4 * sizeof(TDst));
+        } else if (clampsColor<TDst>()) {
+            for (int i = 0; i < n; i++) {
+                for (int c = 0; c < 3; c++) {
+                    dst[i * 4 + c] = (TDst)toOutput(toInput(src[i * 4 + c], scale), outScale, thresholds[i]);
+                }
+                dst[i * 4 + 3] = (TDst)toOutput(toInput(src[i * 4 + 3], scale), outScale, bias);
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                for (int c = 0; c < 3; c++) {
+                    dst[i * 4 + c] = (TDst)toInput(src[i * 4 + c], scale);
+                }
+                dst[i * 4 + 3] = (TDst)toOutput(toInput(src[i * 4 + 3], scale), outScale, bias);
+            }
+        }
+        return;
+    }
+
+    float** planes = rows.rgb;
+    float* alpha = rows.alpha;
+    const bool useCodes = leadingCodes && !detail;
+
+    // Load, resolving a leading curve straight from the integer codes unless detail changes the values first
+    for (int c = 0; c < 3; c++) {
+        float* plane = planes[c];
+        if (useCodes && !ops[0].codeLUT[c].empty()) {
+            const float* table = &ops[0].codeLUT[c][0];
+            for (int i = 0; i < n; i++) {
+                plane[i] = table[(int)src[i * 4 + c]];
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                plane[i] = toInput(src[i * 4 + c], scale);
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        alpha[i] = toInput(src[i * 4 + 3], scale);
+    }
+    if (detail) {
+        detail->applyRow(planes[0], planes[1], planes[2], x, y, n, arena);
+    }
+
+    runOps(planes, useCodes ? 1 : 0, split, n);
+
+    if (coverage == kCoverageInside && !qualified) {
+        runOps(planes, split, ops.size(), n);
+    } else if (coverage != kCoverageOutside) {
+        float* mask = rows.mask;
+        if (qualified) {
+            matte.matteRow(planes[0], planes[1], planes[2], mask, n);
+            if (coverage == kCoverageEdge) {
+                window->coverageSpan(x, y, n, rows.coverage);
+                for (int i = 0; i < n; i++) {
+                    mask[i] *= rows.coverage[i];
+                }
+            }
+        } else {
+            window->coverageSpan(x, y, n, mask);
+        }
+
+        float lo = 1.0f, hi = 0.0f;
+        for (int i = 0; i < n; i++) {
+            lo = std::min(lo, mask[i]);
+            hi = std::max(hi, mask[i]);
+        }
+
+        // Nothing selected leaves the span as it is; a full selection needs no blend
+        if (hi > 0.0f) {
+            if (lo < 1.0f) {
+                for (int c = 0; c < 3; c++) {
+                    std::copy(planes[c], planes[c] + n, rows.base[c]);
+                }
+            }
+            runOps(planes, split, ops.size(), n);
+            if (lo < 1.0f) {
+                for (int c = 0; c < 3; c++) {
+                    float* plane = planes[c];
+                    const float* under = rows.base[c];
+                    for (int i = 0; i < n; i++) {
+                        plane[i] = under[i] + mask[i] * (plane[i] - under[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    // Clamp and write output; every threshold is inside (0, 1), so untouched pixels come back exactly
+    const bool clampColor = clampsColor<TDst>();
+    for (int c = 0; c < 3; c++) {
+        const float* plane = planes[c];
+        if (clampColor) {
+            for (int i = 0; i < n; i++) {
+                dst[i * 4 + c] = (TDst)toOutput(plane[i], outScale, thresholds[i]);
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                dst[i * 4 + c] = (TDst)plane[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        dst[i * 4 + 3] = (TDst)toOutput(alpha[i], outScale, bias);
+    }
+}
+
+template<typename TSrc, typename TDst>
+void CompiledPipeline::process(TDst* dst, const TSrc* src,
+                               const OfxRectI& renderWindow,
+                               int dstRowBytes, int srcRowBytes,
+                               double srcMax, double dstMax,
+                               const PowerWindow* window,
+                               const DetailPyramid* detail,
+                               const DitherPattern* dither,
+                               ScratchArena* arena) const
+{
+    int width = renderWindow.x2 - renderWindow.x1;
+    int height = renderWindow.y2 - renderWindow.y1;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    std::unique_ptr<ScratchArena> local;
+    if (!arena) {
+        local.reset(new ScratchArena());
+        arena = local.get();
+    }
+    ScratchArena::Scope scope(*arena);
+    if (detail && !detail->isActive()) {
+        detail = nullptr;
+    }
+
+    RowPlanes rows;
+    for (int c = 0; c < 4; c++) {
+        rows.rgb[c] = arena->allocate<float>(width);
+    }
+    rows.alpha = arena->allocate<float>(width);
+    rows.base[0] = rows.base[1] = rows.base[2] = nullptr;
+    rows.mask = rows.coverage = nullptr;
+    if (limited) {
+        for (int c = 0; c < 3; c++) {
+            rows.base[c] = arena->allocate<float>(width);
+        }
+        rows.mask = arena->allocate<float>(width);
+        rows.coverage = arena->allocate<float>(width);
+    }
+
+    // Float output takes no thresholds; rounding takes 0.5 everywhere, so one fill serves every row
+    const bool integer = std::numeric_limits<TDst>::is_integer;
+    const bool dithered = integer && dither && dither->isDithered();
+    rows.thresholds = arena->allocate<float>(width);
+    std::fill(rows.thresholds, rows.thresholds + width, integer ? 0.5f : 0.0f);
+
+    const float scale = (float)(1.0 / srcMax);
+    const float outScale = (float)dstMax;
+
+    // A window only masks the limited stages; without one every pixel is inside
+    const int tile = 64;
+    const bool windowed = limited && window && window->isActive();
+    std::vector<WindowSpan> spans;
+    WindowSpan whole = { 0, width, kCoverageInside };
+    spans.push_back(whole);
+
+    for (int y = 0; y < height; y++) {
+        TDst* dstRow = (TDst*)((char*)dst + y * dstRowBytes);
+        const TSrc* srcRow = (const TSrc*)((const char*)src + y * srcRowBytes);
+
+        if (dithered) {
+            dither->fillRow(renderWindow.x1, renderWindow.y1 + y, width, rows.thresholds);
+        }
+        if (windowed && y % tile == 0) {
+            OfxRectI band = { renderWindow.x1, renderWindow.y1 + y,
+                              renderWindow.x2, std::min(renderWindow.y1 + y + tile, renderWindow.y2) };
+            window->spans(band, tile, spans);
+        }
+
+        for (size_t s = 0; s < spans.size(); s++) {
+            const WindowSpan& span = spans[s];
+            processSpan(dstRow + span.start * 4, srcRow + span.start * 4, span.count,
+                        span.coverage, window, detail, renderWindow.x1 + span.start, renderWindow.y1 + y,
+                        rows, rows.thresholds + span.start, *arena, scale, outScale);
+        }
+    }
+}
+
+} // namespace ofx
+
+#endif // _ofxPipeline_h_
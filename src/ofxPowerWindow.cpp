@@ -0,0 +1,247 @@
+#include "ofxPowerWindow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace ofx {
+
+namespace {
+
+double smoothstep(double t) {
+    t = t > 0.0 ? (t < 1.0 ? t : 1.0) : 0.0;
+    return t * t * (3.0 - 2.0 * t);
+}
+
+// Coverage from a signed distance, negative inside
+double distanceCoverage(double d, double feather) {
+    if (d <= 0.0) {
+        return 1.0;
+    }
+    if (d >= feather) {
+        return 0.0;
+    }
+    return 1.0 - smoothstep(d / feather);
+}
+
+WindowCoverage flip(WindowCoverage coverage) {
+    return coverage == kCoverageInside ? kCoverageOutside
+         : coverage == kCoverageOutside ? kCoverageInside : kCoverageEdge;
+}
+
+} // namespace
+
+const char* windowShapeLabel(WindowShape shape) {
+    switch (shape) {
+        case kWindowNone:      return "None";
+        case kWindowEllipse:   return "Ellipse";
+        case kWindowRectangle: return "Rectangle";
+        case kWindowPolygon:   return "Polygon";
+        default:               return "";
+    }
+}
+
+std::vector<WindowPoint> parseWindowPoints(const char* text) {
+    std::vector<double> values;
+    const char* p = text ? text : "";
+    while (*p) {
+        char* end = nullptr;
+        double value = strtod(p, &end);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        values.push_back(value);
+        p = end;
+    }
+
+    std::vector<WindowPoint> points;
+    for (size_t i = 0; i + 1 < values.size(); i += 2) {
+        WindowPoint point = { values[i], values[i + 1] };
+        points.push_back(point);
+    }
+    return points;
+}
+
+PowerWindow::PowerWindow()
+    : windowShape(kWindowNone), centerX(0.0), centerY(0.0), halfWidth(0.0), halfHeight(0.0),
+      feather(0.0), inverted(false)
+{
+}
+
+PowerWindow PowerWindow::ellipse(double centerX, double centerY, double width, double height, double feather) {
+    PowerWindow window;
+    window.windowShape = kWindowEllipse;
+    window.centerX = centerX;
+    window.centerY = centerY;
+    window.halfWidth = std::max(0.5 * width, 1e-6);
+    window.halfHeight = std::max(0.5 * height, 1e-6);
+    window.feather = std::max(feather, 0.0);
+    return window;
+}
+
+PowerWindow PowerWindow::rectangle(double centerX, double centerY, double width, double height, double feather) {
+    PowerWindow window = ellipse(centerX, centerY, width, height, feather);
+    window.windowShape = kWindowRectangle;
+    return window;
+}
+
+PowerWindow PowerWindow::polygon(const std::vector<WindowPoint>& points, double feather) {
+    // Fewer than three points enclose nothing, so coverage is 0 everywhere
+    PowerWindow window;
+    window.windowShape = kWindowPolygon;
+    if (points.size() >= 3) {
+        window.points = points;
+    }
+    window.feather = std::max(feather, 0.0);
+    return window;
+}
+
+double PowerWindow::signedDistance(double x, double y) const {
+    if (windowShape == kWindowRectangle) {
+        double qx = std::fabs(x - centerX) - halfWidth;
+        double qy = std::fabs(y - centerY) - halfHeight;
+        double outside = std::sqrt(std::max(qx, 0.0) * std::max(qx, 0.0) + std::max(qy, 0.0) * std::max(qy, 0.0));
+        return outside + std::min(std::max(qx, qy), 0.0);
+    }
+
+    // Polygon: distance to the nearest edge, negative inside by the even-odd rule
+    if (points.empty()) {
+        return 1e30;
+    }
+    double nearest = 1e300;
+    bool inside = false;
+    for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+        const WindowPoint& a = points[j];
+        const WindowPoint& b = points[i];
+        double ex = b.x - a.x, ey = b.y - a.y;
+        double px = x - a.x, py = y - a.y;
+        double lengthSquared = ex * ex + ey * ey;
+        double t = lengthSquared > 0.0 ? std::min(std::max((px * ex + py * ey) / lengthSquared, 0.0), 1.0) : 0.0;
+        double dx = px - t * ex, dy = py - t * ey;
+        nearest = std::min(nearest, dx * dx + dy * dy);
+        if ((a.y > y) != (b.y > y) && x < a.x + (y - a.y) * ex / ey) {
+            inside = !inside;
+        }
+    }
+    double distance = std::sqrt(nearest);
+    return inside ? -distance : distance;
+}
+
+double PowerWindow::shapeCoverage(double x, double y) const {
+    if (windowShape != kWindowEllipse) {
+        return distanceCoverage(signedDistance(x, y), feather);
+    }
+
+    // Blend between the ellipse and the one grown by the feather on both axes
+    double u = x - centerX, v = y - centerY;
+    double inner = std::sqrt((u / halfWidth) * (u / halfWidth) + (v / halfHeight) * (v / halfHeight));
+    if (inner <= 1.0) {
+        return 1.0;
+    }
+    double outerWidth = halfWidth + feather, outerHeight = halfHeight + feather;
+    double outer = std::sqrt((u / outerWidth) * (u / outerWidth) + (v / outerHeight) * (v / outerHeight));
+    if (outer >= 1.0) {
+        return 0.0;
+    }
+    return 1.0 - smoothstep((inner - 1.0) / (inner - outer));
+}
+
+double PowerWindow::coverage(int x, int y) const {
+    if (windowShape == kWindowNone) {
+        return 1.0;
+    }
+    double c = shapeCoverage(x + 0.5, y + 0.5);
+    return inverted ? 1.0 - c : c;
+}
+
+void PowerWindow::coverageSpan(int x, int y, int count, float* out) const {
+    for (int i = 0; i < count; i++) {
+        out[i] = (float)coverage(x + i, y);
+    }
+}
+
+WindowCoverage PowerWindow::classifyShape(double x1, double y1, double x2, double y2) const {
+    // Arguments are the extreme pixel centers of the block
+    if (windowShape == kWindowPolygon) {
+        double cx = 0.5 * (x1 + x2), cy = 0.5 * (y1 + y2);
+        double radius = 0.5 * std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+        double d = signedDistance(cx, cy);
+        if (d + radius <= 0.0) {
+            return kCoverageInside;
+        }
+        if (d - radius >= feather && d - radius > 0.0) {
+            return kCoverageOutside;
+        }
+        return kCoverageEdge;
+    }
+
+    // Ellipses and rectangles are convex, so the block is inside if its corners are
+    double xs[2] = { x1, x2 }, ys[2] = { y1, y2 };
+    bool allInside = true;
+    for (int i = 0; i < 2 && allInside; i++) {
+        for (int j = 0; j < 2 && allInside; j++) {
+            allInside = shapeCoverage(xs[i], ys[j]) >= 1.0;
+        }
+    }
+    if (allInside) {
+        return kCoverageInside;
+    }
+
+    // Nearest point of the block to the center, per axis
+    double nx = std::min(std::max(centerX, x1), x2) - centerX;
+    double ny = std::min(std::max(centerY, y1), y2) - centerY;
+    if (windowShape == kWindowEllipse) {
+        double outerWidth = halfWidth + feather, outerHeight = halfHeight + feather;
+        double outer = (nx / outerWidth) * (nx / outerWidth) + (ny / outerHeight) * (ny / outerHeight);
+        return outer > 1.0 ? kCoverageOutside : kCoverageEdge;
+    }
+    double dx = std::max(std::fabs(nx) - halfWidth, 0.0);
+    double dy = std::max(std::fabs(ny) - halfHeight, 0.0);
+    double distance = std::sqrt(dx * dx + dy * dy);
+    return distance >= feather && distance > 0.0 ? kCoverageOutside : kCoverageEdge;
+}
+
+WindowCoverage PowerWindow::classify(const OfxRectI& rect) const {
+    if (windowShape == kWindowNone) {
+        return kCoverageInside;
+    }
+    if (rect.x2 <= rect.x1 || rect.y2 <= rect.y1) {
+        return inverted ? kCoverageInside : kCoverageOutside;
+    }
+    WindowCoverage coverage = classifyShape(rect.x1 + 0.5, rect.y1 + 0.5, rect.x2 - 0.5, rect.y2 - 0.5);
+    return inverted ? flip(coverage) : coverage;
+}
+
+void PowerWindow::spans(const OfxRectI& rect, int tileWidth, std::vector<WindowSpan>& out) const {
+    out.clear();
+    tileWidth = std::max(tileWidth, 1);
+    for (int x = rect.x1; x < rect.x2; x += tileWidth) {
+        OfxRectI tile = rect;
+        tile.x1 = x;
+        tile.x2 = std::min(x + tileWidth, rect.x2);
+        WindowCoverage coverage = classify(tile);
+        if (!out.empty() && out.back().coverage == coverage) {
+            out.back().count += tile.x2 - tile.x1;
+        } else {
+            WindowSpan span = { x - rect.x1, tile.x2 - tile.x1, coverage };
+            out.push_back(span);
+        }
+    }
+}
+
+void PowerWindow::appendKey(std::vector<double>& key) const {
+    key.push_back((double)windowShape);
+    key.push_back(centerX);
+    key.push_back(centerY);
+    key.push_back(halfWidth);
+    key.push_back(halfHeight);
+    key.push_back(feather);
+    key.push_back(inverted ? 1.0 : 0.0);
+    for (size_t i = 0; i < points.size(); i++) {
+        key.push_back(points[i].x);
+        key.push_back(points[i].y);
+    }
+}
+
+} // namespace ofx
@@ -0,0 +1,131 @@
+#ifndef _ofxPowerWindow_h_
+#define _ofxPowerWindow_h_
+
+#include "ofxImageEffect.h"
+
+#include <vector>
+
+/**
+ * @file ofxPowerWindow.h
+ * @brief Shape masks (power windows) with analytic feathered coverage
+ */
+
+namespace ofx {
+
+/**
+ * @brief Window shapes, in the order of the plugin's choice options
+ */
+enum WindowShape {
+    kWindowNone = 0,
+    kWindowEllipse,
+    kWindowRectangle,
+    kWindowPolygon,
+    kWindowShapeCount
+};
+
+/**
+ * @brief Display name of a window shape
+ */
+const char* windowShapeLabel(WindowShape shape);
+
+/**
+ * @brief How a block of pixels relates to a window
+ */
+enum WindowCoverage {
+    kCoverageOutside,   ///< Every pixel has coverage 0
+    kCoverageInside,    ///< Every pixel has coverage 1
+    kCoverageEdge       ///< Coverage has to be evaluated per pixel
+};
+
+/**
+ * @brief Run of pixels in a row sharing one classification
+ */
+struct WindowSpan {
+    int start;    ///< Offset from the first pixel of the row passed to spans()
+    int count;
+    WindowCoverage coverage;
+};
+
+/**
+ * @brief Point of a polygon window
+ */
+struct WindowPoint {
+    double x, y;
+};
+
+/**
+ * @brief Parse polygon points serialized as "x0 y0 x1 y1 ...", in order
+ *
+ * Separators are as for curve points; a trailing odd value is ignored.
+ */
+std::vector<WindowPoint> parseWindowPoints(const char* text);
+
+/**
+ * @brief Ellipse, rectangle or polygon in pixel coordinates, feathered outwards
+ *
+ * Coverage is 1 inside the shape and falls to 0 with a smoothstep across a
+ * band feather pixels wide outside it. It is evaluated at pixel centers
+ * (x + 0.5, y + 0.5). classify() is exact or conservative, so blocks it
+ * calls inside or outside really have coverage 1 or 0 at every center, and
+ * only blocks along the edge need coverage().
+ */
+class PowerWindow {
+private:
+    WindowShape windowShape;
+    double centerX, centerY;
+    double halfWidth, halfHeight;
+    double feather;
+    bool inverted;
+    std::vector<WindowPoint> points;
+
+    double signedDistance(double x, double y) const;
+    double shapeCoverage(double x, double y) const;
+    WindowCoverage classifyShape(double x1, double y1, double x2, double y2) const;
+
+public:
+    /**
+     * @brief No window: everything is inside
+     */
+    PowerWindow();
+
+    static PowerWindow ellipse(double centerX, double centerY, double width, double height, double feather);
+    static PowerWindow rectangle(double centerX, double centerY, double width, double height, double feather);
+    static PowerWindow polygon(const std::vector<WindowPoint>& points, double feather);
+
+    /**
+     * @brief Swap inside and outside
+     */
+    void setInverted(bool invert) { inverted = invert; }
+
+    WindowShape shape() const { return windowShape; }
+    bool isActive() const { return windowShape != kWindowNone; }
+
+    /**
+     * @brief Coverage of the pixel whose lower left corner is (x, y)
+     */
+    double coverage(int x, int y) const;
+
+    /**
+     * @brief Coverage of count pixels of row y starting at x
+     */
+    void coverageSpan(int x, int y, int count, float* out) const;
+
+    /**
+     * @brief Classify every pixel of a rectangle at once
+     */
+    WindowCoverage classify(const OfxRectI& rect) const;
+
+    /**
+     * @brief Split the columns of rect into runs, classifying blocks tileWidth wide
+     *
+     * Adjacent blocks of the same class merge, so a row costs one run per
+     * change of class plus per-pixel coverage only in edge runs.
+     */
+    void spans(const OfxRectI& rect, int tileWidth, std::vector<WindowSpan>& out) const;
+
+    void appendKey(std::vector<double>& key) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxPowerWindow_h_
@@ -0,0 +1,155 @@
+#include "ofxQualifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ofx {
+
+namespace {
+
+// Stands in for 1 / softness when the softness is 0, making the falloff a step
+const double kHardEdge = 1e20;
+
+// A range limit at the end of its slider is open, so float values beyond 0..1 stay selected
+const double kOpen = 1e30;
+
+template<typename F>
+inline F smoothstep(F x, F edge, F inverseSoftness) {
+    F t = (x - edge) * inverseSoftness;
+    t = t > F(0) ? (t < F(1) ? t : F(1)) : F(0);
+    return t * t * (F(3) - F(2) * t);
+}
+
+/**
+ * @brief Falloff coefficients of a qualifier, shared by both precisions
+ */
+struct Edges {
+    double hueCenter, hueHalfWidth, hueInverse;
+    double satLow, satHigh, satInverse;
+    double lumLow, lumHigh, lumInverse;
+    bool hueAll;
+
+    explicit Edges(const Qualifier& q) {
+        hueCenter = q.hue[0] - std::floor(q.hue[0]);
+        hueHalfWidth = 0.5 * q.hue[1];
+        hueInverse = q.hue[2] > 0.0 ? 1.0 / q.hue[2] : kHardEdge;
+        hueAll = q.hue[1] >= 1.0;
+        satLow = q.saturation[0] > 0.0 ? q.saturation[0] - q.saturation[2] : -kOpen;
+        satHigh = q.saturation[1] < 1.0 ? q.saturation[1] : kOpen;
+        satInverse = q.saturation[2] > 0.0 ? 1.0 / q.saturation[2] : kHardEdge;
+        lumLow = q.luma[0] > 0.0 ? q.luma[0] - q.luma[2] : -kOpen;
+        lumHigh = q.luma[1] < 1.0 ? q.luma[1] : kOpen;
+        lumInverse = q.luma[2] > 0.0 ? 1.0 / q.luma[2] : kHardEdge;
+    }
+};
+
+} // namespace
+
+Qualifier::Qualifier() : invert(false) {
+    hue[0] = 0.0;
+    hue[1] = 1.0;
+    hue[2] = 0.0;
+    saturation[0] = 0.0;
+    saturation[1] = 1.0;
+    saturation[2] = 0.0;
+    luma[0] = 0.0;
+    luma[1] = 1.0;
+    luma[2] = 0.0;
+}
+
+bool Qualifier::selectsEverything() const {
+    return !invert && hue[1] >= 1.0
+        && saturation[0] <= 0.0 && saturation[1] >= 1.0
+        && luma[0] <= 0.0 && luma[1] >= 1.0;
+}
+
+double Qualifier::matte(double r, double g, double b) const {
+    Edges e(*this);
+
+    double mx = std::max(r, std::max(g, b));
+    double mn = std::min(r, std::min(g, b));
+    double delta = mx - mn;
+    double l = 0.5 * (mx + mn);
+    double denominator = 1.0 - std::fabs(mx + mn - 1.0);
+    double s = denominator > 1e-12 ? std::min(delta / denominator, 1.0) : 0.0;
+
+    double m = smoothstep(l, e.lumLow, e.lumInverse) * (1.0 - smoothstep(l, e.lumHigh, e.lumInverse));
+    m *= smoothstep(s, e.satLow, e.satInverse) * (1.0 - smoothstep(s, e.satHigh, e.satInverse));
+
+    if (!e.hueAll) {
+        double h = 0.0;
+        if (delta > 0.0) {
+            if (mx == r) {
+                h = (g - b) / delta;
+            } else if (mx == g) {
+                h = (b - r) / delta + 2.0;
+            } else {
+                h = (r - g) / delta + 4.0;
+            }
+            h /= 6.0;
+            h = h < 0.0 ? h + 1.0 : h;
+        }
+        double distance = std::fabs(h - e.hueCenter);
+        distance = std::min(distance, 1.0 - distance);
+        m *= 1.0 - smoothstep(distance, e.hueHalfWidth, e.hueInverse);
+    }
+    return invert ? 1.0 - m : m;
+}
+
+void Qualifier::matteRow(const float* r, const float* g, const float* b, float* matte, int n) const {
+    Edges e(*this);
+    const float lumLow = (float)e.lumLow, lumHigh = (float)e.lumHigh, lumInverse = (float)e.lumInverse;
+    const float satLow = (float)e.satLow, satHigh = (float)e.satHigh, satInverse = (float)e.satInverse;
+    const float hueCenter = (float)e.hueCenter, hueHalfWidth = (float)e.hueHalfWidth;
+    const float hueInverse = (float)e.hueInverse;
+    const float flip = invert ? 1.0f : 0.0f;
+    const float sign = invert ? -1.0f : 1.0f;
+
+    if (e.hueAll) {
+        for (int x = 0; x < n; x++) {
+            float mx = std::max(r[x], std::max(g[x], b[x]));
+            float mn = std::min(r[x], std::min(g[x], b[x]));
+            float l = 0.5f * (mx + mn);
+            float denominator = 1.0f - std::fabs(mx + mn - 1.0f);
+            float s = denominator > 1e-6f ? std::min((mx - mn) / denominator, 1.0f) : 0.0f;
+            float m = smoothstep(l, lumLow, lumInverse) * (1.0f - smoothstep(l, lumHigh, lumInverse))
+                    * smoothstep(s, satLow, satInverse) * (1.0f - smoothstep(s, satHigh, satInverse));
+            matte[x] = flip + sign * m;
+        }
+        return;
+    }
+
+    for (int x = 0; x < n; x++) {
+        float vr = r[x], vg = g[x], vb = b[x];
+        float mx = std::max(vr, std::max(vg, vb));
+        float mn = std::min(vr, std::min(vg, vb));
+        float delta = mx - mn;
+        float l = 0.5f * (mx + mn);
+        float denominator = 1.0f - std::fabs(mx + mn - 1.0f);
+        float s = denominator > 1e-6f ? std::min(delta / denominator, 1.0f) : 0.0f;
+
+        // Hue sector chosen by selects, so every lane runs the same instructions
+        float inverse = delta > 0.0f ? 1.0f / delta : 0.0f;
+        float h = mx == vr ? (vg - vb) * inverse
+                : mx == vg ? (vb - vr) * inverse + 2.0f
+                : (vr - vg) * inverse + 4.0f;
+        h *= 1.0f / 6.0f;
+        h = h < 0.0f ? h + 1.0f : h;
+        float distance = std::fabs(h - hueCenter);
+        distance = std::min(distance, 1.0f - distance);
+
+        float m = smoothstep(l, lumLow, lumInverse) * (1.0f - smoothstep(l, lumHigh, lumInverse))
+                * smoothstep(s, satLow, satInverse) * (1.0f - smoothstep(s, satHigh, satInverse))
+                * (1.0f - smoothstep(distance, hueHalfWidth, hueInverse));
+        matte[x] = flip + sign * m;
+    }
+}
+
+void Qualifier::appendKey(std::vector<double>& key) const {
+    key.insert(key.end(), hue, hue + 3);
+    key.insert(key.end(), saturation, saturation + 3);
+    key.insert(key.end(), luma, luma + 3);
+    key.push_back(invert ? 1.0 : 0.0);
+}
+
+} // namespace ofx
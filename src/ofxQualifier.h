@@ -0,0 +1,54 @@
+#ifndef _ofxQualifier_h_
+#define _ofxQualifier_h_
+
+#include <vector>
+
+/**
+ * @file ofxQualifier.h
+ * @brief HSL qualifier: a soft matte selecting a hue, saturation and luma range
+ */
+
+namespace ofx {
+
+/**
+ * @brief Soft matte over HSL ranges
+ *
+ * Hue is in turns (0 red, 1/3 green, 2/3 blue) and wraps; saturation and
+ * lightness are HSL's, so 0..1 for in-range values. Each range is widened by
+ * its softness with a smoothstep falloff, and the three mattes multiply.
+ * Saturation and luma limits of 0 or 1 leave that side open, so float values
+ * past the end stay selected. The default selects everything.
+ */
+class Qualifier {
+public:
+    double hue[3];          ///< Center, width and softness
+    double saturation[3];   ///< Low, high and softness
+    double luma[3];         ///< Low, high and softness
+    bool invert;
+
+    Qualifier();
+
+    /**
+     * @brief True if the matte is 1 for every pixel, so qualifying changes nothing
+     */
+    bool selectsEverything() const;
+
+    /**
+     * @brief Double-precision matte of one pixel, the reference for matteRow
+     */
+    double matte(double r, double g, double b) const;
+
+    /**
+     * @brief Matte of a row of planar pixels
+     *
+     * Written without branches, as selects and min/max over the row, so the
+     * compiler vectorizes the RGB to HSL conversion and the falloffs.
+     */
+    void matteRow(const float* r, const float* g, const float* b, float* matte, int n) const;
+
+    void appendKey(std::vector<double>& key) const;
+};
+
+} // namespace ofx
+
+#endif // _ofxQualifier_h_
@@ -0,0 +1,459 @@
+#include "ofxRenderCache.h"
+#include "ofxCacheFiles.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace ofx {
+
+namespace {
+
+const uint32_t kEntryMagic = 0x4358464f;   // "OFXC"
+const uint32_t kEntryVersion = 1;
+const char* const kEntryExtension = ".ofxr";
+
+// Pixels copied for writing but not yet written; stores past this are dropped
+const uint64_t kMaxPendingBytes = 512ull << 20;
+
+const uint64_t kDefaultCapacityMB = 4096;
+
+// Pixel data starts on a cache line
+const uint32_t kDataAlignment = 64;
+
+/**
+ * @brief Fixed part of an entry file; the identifier follows, then the rows at dataOffset
+ */
+struct EntryHeader {
+    uint32_t magic;
+    uint32_t version;
+    double time;
+    double renderScale;
+    int32_t x1, y1, x2, y2;
+    uint32_t sourceDepth;
+    uint32_t outputDepth;
+    uint64_t paramHash;
+    uint32_t idLength;
+    uint32_t dataOffset;
+};
+
+EntryHeader headerFor(const RenderCache::Key& key) {
+    EntryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kEntryMagic;
+    header.version = kEntryVersion;
+    // Adding zero turns -0 into +0, so both hash alike
+    header.time = key.time + 0.0;
+    header.renderScale = key.renderScale + 0.0;
+    header.x1 = key.window.x1;
+    header.y1 = key.window.y1;
+    header.x2 = key.window.x2;
+    header.y2 = key.window.y2;
+    header.sourceDepth = (uint32_t)key.sourceDepth;
+    header.outputDepth = (uint32_t)key.outputDepth;
+    header.paramHash = key.paramHash;
+    header.idLength = (uint32_t)key.identifier.size();
+    header.dataOffset = (uint32_t)((sizeof(EntryHeader) + key.identifier.size() + kDataAlignment - 1)
+                                   & ~(uint64_t)(kDataAlignment - 1));
+    return header;
+}
+
+uint64_t hashKey(const RenderCache::Key& key) {
+    EntryHeader header = headerFor(key);
+    uint64_t h = cachefiles::hashBytes(key.identifier.data(), key.identifier.size());
+    return cachefiles::hashBytes(&header, sizeof(header), h);
+}
+
+bool sameKey(const RenderCache::Key& a, const RenderCache::Key& b) {
+    EntryHeader ha = headerFor(a), hb = headerFor(b);
+    return memcmp(&ha, &hb, sizeof(ha)) == 0 && a.identifier == b.identifier;
+}
+
+void copyRows(const char* src, int srcRowBytes, char* dst, int dstRowBytes, int rowBytes, int rows) {
+    for (int y = 0; y < rows; y++) {
+        memcpy(dst + (ptrdiff_t)y * dstRowBytes, src + (ptrdiff_t)y * srcRowBytes, (size_t)rowBytes);
+    }
+}
+
+void touch(const std::string& path) {
+#ifdef _WIN32
+    _utime(path.c_str(), nullptr);
+#else
+    utime(path.c_str(), nullptr);
+#endif
+}
+
+// Key hash of an entry file name, false for other files
+bool parseEntryName(const char* name, uint64_t& hash) {
+    if (strlen(name) != 16 + strlen(kEntryExtension) || strcmp(name + 16, kEntryExtension) != 0) {
+        return false;
+    }
+    char digits[17];
+    memcpy(digits, name, 16);
+    digits[16] = '\0';
+    char* end = nullptr;
+    hash = strtoull(digits, &end, 16);
+    return end == digits + 16;
+}
+
+/**
+ * @brief Entry file mapped read-only for one load
+ */
+class MappedEntry {
+private:
+    const char* base;
+    uint64_t bytes;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int descriptor;
+#endif
+
+    MappedEntry(const MappedEntry&);
+    MappedEntry& operator=(const MappedEntry&);
+
+public:
+    explicit MappedEntry(const std::string& path);
+    ~MappedEntry();
+
+    const char* data() const { return base; }
+    uint64_t size() const { return bytes; }
+};
+
+#ifdef _WIN32
+
+MappedEntry::MappedEntry(const std::string& path)
+    : base(nullptr), bytes(0), mapping(nullptr)
+{
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    base = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    bytes = base ? (uint64_t)size.QuadPart : 0;
+}
+
+MappedEntry::~MappedEntry() {
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+}
+
+#else
+
+MappedEntry::MappedEntry(const std::string& path)
+    : base(nullptr), bytes(0)
+{
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        return;
+    }
+    void* address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (address == MAP_FAILED) {
+        return;
+    }
+    base = (const char*)address;
+    bytes = (uint64_t)status.st_size;
+    // Read once, front to back
+    madvise(address, (size_t)bytes, MADV_SEQUENTIAL);
+}
+
+MappedEntry::~MappedEntry() {
+    if (base) {
+        munmap((void*)base, (size_t)bytes);
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+}
+
+#endif
+
+} // namespace
+
+RenderCache::Key::Key()
+    : time(0.0), renderScale(1.0), sourceDepth(kBitDepthNone), outputDepth(kBitDepthNone), paramHash(0)
+{
+    window.x1 = window.y1 = window.x2 = window.y2 = 0;
+}
+
+int RenderCache::Key::rowBytes() const {
+    return (window.x2 - window.x1) * 4 * (int)outputDepth;
+}
+
+uint64_t RenderCache::Key::imageBytes() const {
+    int rows = window.y2 - window.y1;
+    return rows > 0 && rowBytes() > 0 ? (uint64_t)rowBytes() * rows : 0;
+}
+
+RenderCache::RenderCache(const std::string& cacheDirectory, uint64_t capacityBytes)
+    : directory(cacheDirectory), capacity(capacityBytes), totalBytes(0), pendingBytes(0), stopping(false)
+{
+    scan();
+}
+
+RenderCache::~RenderCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+std::string RenderCache::defaultDirectory() {
+    return cachefiles::directoryFromEnvironment("OFX_RENDER_CACHE", "ofx-render-cache");
+}
+
+uint64_t RenderCache::defaultCapacity() {
+    const char* megabytes = getenv("OFX_RENDER_CACHE_MB");
+    uint64_t value = megabytes && *megabytes ? strtoull(megabytes, nullptr, 10) : 0;
+    return (value > 0 ? value : kDefaultCapacityMB) << 20;
+}
+
+RenderCache& RenderCache::shared() {
+    static RenderCache cache(defaultDirectory(), defaultCapacity());
+    return cache;
+}
+
+std::string RenderCache::pathFor(uint64_t hash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx%s", (unsigned long long)hash, kEntryExtension);
+    return directory + name;
+}
+
+void RenderCache::scan() {
+    struct Found {
+        uint64_t hash;
+        uint64_t bytes;
+        int64_t modified;
+    };
+    std::vector<Found> found;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &entry);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            Found file;
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && parseEntryName(entry.cFileName, file.hash)) {
+                file.bytes = ((uint64_t)entry.nFileSizeHigh << 32) | entry.nFileSizeLow;
+                file.modified = (int64_t)(((uint64_t)entry.ftLastWriteTime.dwHighDateTime << 32)
+                                          | entry.ftLastWriteTime.dwLowDateTime);
+                found.push_back(file);
+            }
+        } while (FindNextFileA(search, &entry));
+        FindClose(search);
+    }
+#else
+    if (DIR* dir = opendir(directory.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            Found file;
+            struct stat status;
+            if (parseEntryName(entry->d_name, file.hash)
+                && stat((directory + "/" + entry->d_name).c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+                file.bytes = (uint64_t)status.st_size;
+                file.modified = (int64_t)status.st_mtime;
+                found.push_back(file);
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.modified > b.modified; });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < found.size(); i++) {
+        Entry entry = { found[i].hash, found[i].bytes };
+        index[entry.hash] = recent.insert(recent.end(), entry);
+        totalBytes += entry.bytes;
+    }
+    evict();
+}
+
+void RenderCache::evict() {
+    while (totalBytes > capacity && !recent.empty()) {
+        const Entry& oldest = recent.back();
+        remove(pathFor(oldest.hash).c_str());
+        totalBytes -= oldest.bytes;
+        index.erase(oldest.hash);
+        recent.pop_back();
+    }
+}
+
+bool RenderCache::load(const Key& key, void* dst, int dstRowBytes) const {
+    const uint64_t imageBytes = key.imageBytes();
+    if (key.identifier.empty() || imageBytes == 0) {
+        return false;
+    }
+    const uint64_t hash = hashKey(key);
+    const int rowBytes = key.rowBytes();
+    const int rows = key.window.y2 - key.window.y1;
+
+    // An entry still waiting to be written is served from its buffer
+    std::shared_ptr<const Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < queue.size() && !pending; i++) {
+            if (queue[i]->hash == hash && sameKey(queue[i]->key, key)) {
+                pending = queue[i];
+            }
+        }
+        if (!pending) {
+            std::unordered_map<uint64_t, std::list<Entry>::iterator>::const_iterator it = index.find(hash);
+            if (it == index.end()) {
+                return false;
+            }
+            recent.splice(recent.begin(), recent, it->second);
+        }
+    }
+    if (pending) {
+        copyRows(&pending->pixels[0], rowBytes, (char*)dst, dstRowBytes, rowBytes, rows);
+        return true;
+    }
+
+    std::string path = pathFor(hash);
+    MappedEntry file(path);
+    EntryHeader expected = headerFor(key);
+    EntryHeader header;
+    bool valid = file.size() >= sizeof(EntryHeader);
+    if (valid) {
+        memcpy(&header, file.data(), sizeof(header));
+        valid = memcmp(&header, &expected, sizeof(header)) == 0
+             && file.size() >= header.dataOffset + imageBytes
+             && memcmp(file.data() + sizeof(EntryHeader), key.identifier.data(), key.identifier.size()) == 0;
+    }
+    if (!valid) {
+        // A missing or unreadable file leaves the index; a colliding key keeps its entry
+        if (!file.data()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(hash);
+            if (it != index.end()) {
+                totalBytes -= it->second->bytes;
+                recent.erase(it->second);
+                index.erase(it);
+            }
+        }
+        return false;
+    }
+    copyRows(file.data() + header.dataOffset, rowBytes, (char*)dst, dstRowBytes, rowBytes, rows);
+    touch(path);
+    return true;
+}
+
+bool RenderCache::store(const Key& key, const void* src, int srcRowBytes) {
+    const uint64_t imageBytes = key.imageBytes();
+    if (key.identifier.empty() || imageBytes == 0 || imageBytes > capacity) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || pendingBytes + imageBytes > kMaxPendingBytes) {
+            return false;
+        }
+    }
+
+    std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+    pending->key = key;
+    pending->hash = hashKey(key);
+    pending->pixels.resize((size_t)imageBytes);
+    const int rowBytes = key.rowBytes();
+    copyRows((const char*)src, srcRowBytes, &pending->pixels[0], rowBytes, rowBytes, key.window.y2 - key.window.y1);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || pendingBytes + imageBytes > kMaxPendingBytes) {
+            return false;
+        }
+        queue.push_back(pending);
+        pendingBytes += imageBytes;
+        if (!writer.joinable()) {
+            writer = std::thread(&RenderCache::writerLoop, this);
+        }
+    }
+    wake.notify_one();
+    return true;
+}
+
+void RenderCache::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        // The entry stays queued while it is written, so loads keep finding it
+        std::shared_ptr<const Pending> pending = queue.front();
+        lock.unlock();
+        bool written = write(*pending);
+        lock.lock();
+
+        queue.pop_front();
+        pendingBytes -= pending->pixels.size();
+        if (written) {
+            std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(pending->hash);
+            if (it != index.end()) {
+                totalBytes -= it->second->bytes;
+                recent.erase(it->second);
+                index.erase(it);
+            }
+            Entry entry = { pending->hash, headerFor(pending->key).dataOffset + (uint64_t)pending->pixels.size() };
+            index[entry.hash] = recent.insert(recent.begin(), entry);
+            totalBytes += entry.bytes;
+            evict();
+        }
+        if (queue.empty()) {
+            idle.notify_all();
+        }
+    }
+}
+
+bool RenderCache::write(const Pending& pending) const {
+    cachefiles::makeDirectory(directory);
+
+    EntryHeader header = headerFor(pending.key);
+    std::vector<char> padding(header.dataOffset - sizeof(header) - header.idLength, 0);
+    return cachefiles::writeAtomically(pathFor(pending.hash), [&](FILE* file) {
+        return fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(pending.key.identifier.data(), 1, header.idLength, file) == header.idLength
+            && (padding.empty() || fwrite(&padding[0], 1, padding.size(), file) == padding.size())
+            && fwrite(&pending.pixels[0], 1, pending.pixels.size(), file) == pending.pixels.size();
+    });
+}
+
+void RenderCache::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty(); });
+}
+
+uint64_t RenderCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalBytes;
+}
+
+} // namespace ofx
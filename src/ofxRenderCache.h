@@ -0,0 +1,154 @@
+#ifndef _ofxRenderCache_h_
+#define _ofxRenderCache_h_
+
+#include "ofxCore.h"
+#include "ofxUtilities.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file ofxRenderCache.h
+ * @brief Persistent cache of rendered frames on local disk
+ */
+
+namespace ofx {
+
+/**
+ * @brief Rendered windows kept as files, one per frame, under a size bound
+ *
+ * An entry is keyed by everything that decides its pixels: the source
+ * image's unique identifier, the time, the render window and scale, both
+ * bit depths, and a hash of the parameter values. The file name is a hash
+ * of the key, and the key is stored in the file and checked on load, so a
+ * name collision reads as a miss.
+ *
+ * load() maps the file and copies its rows straight into the output image.
+ * store() copies the rows into a buffer and returns; a background thread
+ * writes the file, through a temporary renamed into place so readers never
+ * see it half written. Stores that would put more than a bounded amount of
+ * pixels in flight are dropped rather than waited for.
+ *
+ * When the files pass the capacity the least recently used are deleted.
+ * Recency survives restarts through the files' modification times, which a
+ * hit refreshes. Several processes may share a directory; each keeps its
+ * own index and bound, so the bound is per process.
+ */
+class RenderCache {
+public:
+    struct Key {
+        std::string identifier;     // kOfxImagePropUniqueIdentifier of the source image
+        double time;
+        OfxRectI window;
+        double renderScale;
+        BitDepth sourceDepth;
+        BitDepth outputDepth;
+        uint64_t paramHash;         // ParamReader::hash of every parameter the render reads
+
+        Key();
+
+        /**
+         * @brief Bytes in one row of the window at the output depth
+         */
+        int rowBytes() const;
+        uint64_t imageBytes() const;
+    };
+
+private:
+    struct Pending {
+        Key key;
+        uint64_t hash;
+        std::vector<char> pixels;
+    };
+
+    struct Entry {
+        uint64_t hash;
+        uint64_t bytes;
+    };
+
+    std::string directory;
+    uint64_t capacity;
+
+    // Guarded by mutex: entries in use order, most recent first, indexed by key hash
+    mutable std::mutex mutex;
+    mutable std::list<Entry> recent;
+    mutable std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    mutable uint64_t totalBytes;
+    std::deque<std::shared_ptr<const Pending> > queue;
+    uint64_t pendingBytes;
+    bool stopping;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::thread writer;
+
+    std::string pathFor(uint64_t hash) const;
+    void scan();
+    void writerLoop();
+    bool write(const Pending& pending) const;
+    // Delete least recently used files until the total fits; mutex held
+    void evict();
+
+    RenderCache(const RenderCache&);
+    RenderCache& operator=(const RenderCache&);
+
+public:
+    /**
+     * @param cacheDirectory Folder holding the entries, created on the first store
+     * @param capacityBytes Bound on the entries' total size
+     */
+    RenderCache(const std::string& cacheDirectory, uint64_t capacityBytes);
+
+    /**
+     * @brief Finishes the queued writes
+     */
+    ~RenderCache();
+
+    /**
+     * @brief $OFX_RENDER_CACHE, or an ofx-render-cache folder in the temp directory
+     */
+    static std::string defaultDirectory();
+
+    /**
+     * @brief $OFX_RENDER_CACHE_MB megabytes, or 4 GB
+     */
+    static uint64_t defaultCapacity();
+
+    /**
+     * @brief Process-wide cache in the default directory, created on first use
+     */
+    static RenderCache& shared();
+
+    /**
+     * @brief Copy the entry for key into dst, rows dstRowBytes apart
+     * @return false on a miss; dst is untouched
+     */
+    bool load(const Key& key, void* dst, int dstRowBytes) const;
+
+    /**
+     * @brief Queue the window in src, rows srcRowBytes apart, to be written as key's entry
+     * @return false if the entry was dropped
+     */
+    bool store(const Key& key, const void* src, int srcRowBytes);
+
+    /**
+     * @brief Wait until every queued entry is written
+     */
+    void flush();
+
+    /**
+     * @brief Total size of the entries on disk
+     */
+    uint64_t size() const;
+};
+
+} // namespace ofx
+
+#endif // _ofxRenderCache_h_
@@ -0,0 +1,101 @@
+#ifndef _ofxRows_h_
+#define _ofxRows_h_
+
+#include <algorithm>
+#include <limits>
+
+/**
+ * @file ofxRows.h
+ * @brief Edge-repeating row loads and sample stores shared by the blur, detail and temporal kernels
+ *
+ * Internal to ofxUtilities; the plugins do not include it.
+ */
+
+namespace ofx {
+namespace rows {
+
+inline int clampIndex(int i, int count) {
+    return std::min(std::max(i, 0), count - 1);
+}
+
+/**
+ * @brief Split of count pixels from position start against a line of length pixels
+ *
+ * The first before pixels repeat the line's first pixel, the next inside
+ * are read from pixel first on, and the rest repeat its last pixel.
+ */
+struct EdgeRun {
+    int before;
+    int inside;
+    int first;
+
+    EdgeRun(int length, int start, int count)
+        : before(std::min(std::max(-start, 0), count)),
+          inside(std::max(std::min(length - std::max(start, 0), count - before), 0)),
+          first(std::max(std::min(start, length - 1), 0))
+    {
+    }
+};
+
+/**
+ * @brief Convert count RGBA pixels from position start, repeating the edge pixels, interleaved into out
+ */
+template<typename In>
+void loadPixels(const In* line, int length, int start, int count, float scale, float* out) {
+    EdgeRun run(length, start, count);
+    const In* first = line + run.first * 4;
+    const In* last = line + (length - 1) * 4;
+
+    for (int k = 0; k < run.before; k++) {
+        for (int c = 0; c < 4; c++) {
+            out[k * 4 + c] = (float)line[c] * scale;
+        }
+    }
+    const int n = run.inside * 4;
+    float* middle = out + run.before * 4;
+    for (int i = 0; i < n; i++) {
+        middle[i] = (float)first[i] * scale;
+    }
+    for (int k = run.before + run.inside; k < count; k++) {
+        for (int c = 0; c < 4; c++) {
+            out[k * 4 + c] = (float)last[c] * scale;
+        }
+    }
+}
+
+/**
+ * @brief As loadPixels, but the first channels channels each into their own plane
+ */
+template<typename In>
+void loadPlanes(const In* line, int length, int start, int count, float scale, float* const* planes, int channels) {
+    EdgeRun run(length, start, count);
+    const In* first = line + run.first * 4;
+    const In* last = line + (length - 1) * 4;
+
+    for (int c = 0; c < channels; c++) {
+        float* plane = planes[c];
+        std::fill(plane, plane + run.before, (float)line[c] * scale);
+        float* middle = plane + run.before;
+        const In* pixel = first + c;
+        for (int i = 0; i < run.inside; i++) {
+            middle[i] = (float)pixel[i * 4] * scale;
+        }
+        std::fill(plane + run.before + run.inside, plane + count, (float)last[c] * scale);
+    }
+}
+
+/**
+ * @brief Normalized value as an Out sample; integer samples are clamped and rounded
+ */
+template<typename Out>
+inline Out store(float value, float scale) {
+    if (std::numeric_limits<Out>::is_integer) {
+        return (Out)(std::min(std::max(value, 0.0f), 1.0f) * scale + 0.5f);
+    }
+    return (Out)(value * scale);
+}
+
+} // namespace rows
+} // namespace ofx
+
+#endif // _ofxRows_h_
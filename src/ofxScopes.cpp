@@ -0,0 +1,358 @@
+#include "ofxScopes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ofx {
+
+namespace {
+
+// Rec.709 luma, and the divisors taking B - Y and R - Y to Cb and Cr in [-0.5, 0.5]
+const float kLumaRed = 0.2126f;
+const float kLumaGreen = 0.7152f;
+const float kLumaBlue = 0.0722f;
+const float kCbScale = 1.0f / 1.8556f;
+const float kCrScale = 1.0f / 1.5748f;
+
+// Rows per accumulation band scale with width so a band is roughly this many pixels
+const int kBandPixels = 65536;
+
+// Cells per merge and tone-map task
+const int kCellChunk = 16384;
+
+// Graticule brightness, under the trace
+const float kGraticuleLevel = 0.2f;
+
+/**
+ * @brief Cell index for a normalized value; NaN lands in cell 0
+ */
+inline int quantize(float v, float lastCell) {
+    v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+    return (int)(v * lastCell + 0.5f);
+}
+
+template<typename T>
+void waveformRow(const T* row, int width, const int* columns, float scale,
+                 int traceWidth, float lastLevel, uint32_t* bins) {
+    for (int x = 0; x < width; x++) {
+        const T* pixel = row + x * 4;
+        float y = (kLumaRed * pixel[0] + kLumaGreen * pixel[1] + kLumaBlue * pixel[2]) * scale;
+        bins[quantize(y, lastLevel) * traceWidth + columns[x]]++;
+    }
+}
+
+template<typename T>
+void paradeRow(const T* row, int width, const int* columns, float scale,
+               int traceWidth, int sectionWidth, float lastLevel, uint32_t* bins) {
+    for (int x = 0; x < width; x++) {
+        const T* pixel = row + x * 4;
+        int column = columns[x];
+        bins[quantize(pixel[0] * scale, lastLevel) * traceWidth + column]++;
+        bins[quantize(pixel[1] * scale, lastLevel) * traceWidth + column + sectionWidth]++;
+        bins[quantize(pixel[2] * scale, lastLevel) * traceWidth + column + 2 * sectionWidth]++;
+    }
+}
+
+template<typename T>
+void vectorscopeRow(const T* row, int width, float scale, int side, uint32_t* bins) {
+    const float lastCell = (float)(side - 1);
+    for (int x = 0; x < width; x++) {
+        const T* pixel = row + x * 4;
+        float r = pixel[0] * scale;
+        float b = pixel[2] * scale;
+        float y = kLumaRed * r + kLumaGreen * pixel[1] * scale + kLumaBlue * b;
+        int cb = quantize((b - y) * kCbScale + 0.5f, lastCell);
+        int cr = quantize((r - y) * kCrScale + 0.5f, lastCell);
+        bins[cr * side + cb]++;
+    }
+}
+
+template<typename T>
+void accumulateRow(const ScopeTrace& trace, const T* row, int width, const int* columns,
+                   float scale, uint32_t* bins) {
+    const float lastLevel = (float)(trace.height - 1);
+    switch (trace.mode) {
+        case kScopeWaveform:
+            waveformRow<T>(row, width, columns, scale, trace.width, lastLevel, bins);
+            break;
+        case kScopeParade:
+            paradeRow<T>(row, width, columns, scale, trace.width, trace.width / 3, lastLevel, bins);
+            break;
+        default:
+            vectorscopeRow<T>(row, width, scale, trace.width, bins);
+            break;
+    }
+}
+
+bool runBands(ThreadPool& pool, int count, const ThreadPool::Task& task,
+              const std::function<bool()>& cancelled) {
+    if (cancelled) {
+        return pool.parallelFor(count, task, cancelled);
+    }
+    pool.parallelFor(count, task);
+    return true;
+}
+
+/**
+ * @brief Graticule cells: level lines for the waveforms, axes and rings for the vectorscope
+ */
+bool isGraticule(const ScopeTrace& trace, int x, int y) {
+    if (trace.mode == kScopeVectorscope) {
+        float center = 0.5f * (float)(trace.width - 1);
+        float dx = (float)x - center;
+        float dy = (float)y - center;
+        if (std::fabs(dx) < 0.5f || std::fabs(dy) < 0.5f) {
+            return true;
+        }
+        // Rings at 75% and 100% of the Cb/Cr range
+        float radius = std::sqrt(dx * dx + dy * dy) / center;
+        return std::fabs(radius - 0.75f) * center < 0.5f || std::fabs(radius - 1.0f) * center < 0.5f;
+    }
+
+    // 0, 25, 50, 75 and 100% levels
+    float lastLevel = (float)(trace.height - 1);
+    for (int i = 0; i <= 4; i++) {
+        if (y == (int)(0.25f * i * lastLevel + 0.5f)) {
+            return true;
+        }
+    }
+    if (trace.mode == kScopeParade) {
+        int section = trace.width / 3;
+        return x == section || x == 2 * section;
+    }
+    return false;
+}
+
+template<typename T>
+void writeRow(T* row, const float* const* cells, int width, float maxValue) {
+    for (int x = 0; x < width; x++) {
+        T* pixel = row + x * 4;
+        const float* cell = cells[x];
+        if (!cell) {
+            pixel[0] = pixel[1] = pixel[2] = 0;
+        } else if (maxValue > 0.0f) {
+            pixel[0] = (T)(cell[0] * maxValue + 0.5f);
+            pixel[1] = (T)(cell[1] * maxValue + 0.5f);
+            pixel[2] = (T)(cell[2] * maxValue + 0.5f);
+        } else {
+            pixel[0] = (T)cell[0];
+            pixel[1] = (T)cell[1];
+            pixel[2] = (T)cell[2];
+        }
+        pixel[3] = (T)(maxValue > 0.0f ? maxValue : 1.0f);
+    }
+}
+
+} // namespace
+
+const char* scopeModeLabel(ScopeMode mode) {
+    switch (mode) {
+        case kScopeWaveform:    return "Waveform";
+        case kScopeParade:      return "RGB Parade";
+        case kScopeVectorscope: return "Vectorscope";
+        default:                return "";
+    }
+}
+
+ScopeAccumulator::ScopeAccumulator(ThreadPool& pool)
+    : pool(pool), partials(pool.maxParticipants()), touched(pool.maxParticipants(), 0)
+{
+}
+
+bool ScopeAccumulator::accumulate(ScopeMode mode, int width, int height,
+                                  const void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                                  const std::function<bool()>& cancelled) {
+    // The vectorscope is square, and parade columns split evenly in three
+    if (mode == kScopeVectorscope) {
+        width = height = std::max(std::min(width, height), 1);
+    } else if (mode == kScopeParade) {
+        width = std::max(width - width % 3, 3);
+    }
+    height = std::max(height, 1);
+    width = std::max(width, 1);
+
+    const size_t cells = (size_t)width * height;
+    result.mode = mode;
+    result.width = width;
+    result.height = height;
+    result.samples = 0;
+    result.columnSamples = 0;
+    result.counts.assign(cells, 0);
+
+    const int sourceWidth = bounds.x2 - bounds.x1;
+    const int rows = bounds.y2 - bounds.y1;
+    if (!data || depth == kBitDepthNone || sourceWidth <= 0 || rows <= 0) {
+        return true;
+    }
+
+    // Trace column of each source column, within a parade section
+    int columnCount = mode == kScopeParade ? width / 3 : width;
+    std::vector<int> columns(sourceWidth);
+    for (int x = 0; x < sourceWidth; x++) {
+        columns[x] = (int)((int64_t)x * columnCount / sourceWidth);
+    }
+
+    result.samples = (uint64_t)sourceWidth * (uint64_t)rows;
+    result.columnSamples = mode == kScopeVectorscope ? result.samples
+        : (uint64_t)rows * (uint64_t)((sourceWidth + columnCount - 1) / columnCount);
+
+    const int bandRows = std::max(1, kBandPixels / sourceWidth);
+    const int bands = (rows + bandRows - 1) / bandRows;
+    const float scale = depth == kBitDepthByte ? 1.0f / 255.0f : depth == kBitDepthShort ? 1.0f / 65535.0f : 1.0f;
+    std::fill(touched.begin(), touched.end(), 0);
+
+    bool completed = runBands(pool, bands, [&](int band, int slot) {
+        std::vector<uint32_t>& bins = partials[slot];
+        if (!touched[slot]) {
+            bins.assign(cells, 0);
+            touched[slot] = 1;
+        }
+
+        int y1 = band * bandRows;
+        int y2 = std::min(y1 + bandRows, rows);
+        for (int y = y1; y < y2; y++) {
+            const char* row = (const char*)data + (ptrdiff_t)y * rowBytes;
+            switch (depth) {
+                case kBitDepthByte:
+                    accumulateRow(result, (const unsigned char*)row, sourceWidth, &columns[0], scale, &bins[0]);
+                    break;
+                case kBitDepthShort:
+                    accumulateRow(result, (const unsigned short*)row, sourceWidth, &columns[0], scale, &bins[0]);
+                    break;
+                default:
+                    accumulateRow(result, (const float*)row, sourceWidth, &columns[0], scale, &bins[0]);
+                    break;
+            }
+        }
+    }, cancelled);
+    if (!completed) {
+        return false;
+    }
+
+    // Every band has joined; each merge task sums one run of cells across the slots
+    const int chunks = (int)((cells + kCellChunk - 1) / kCellChunk);
+    pool.parallelFor(chunks, [&](int chunk, int) {
+        size_t begin = (size_t)chunk * kCellChunk;
+        size_t end = std::min(begin + kCellChunk, cells);
+        uint32_t* counts = &result.counts[0];
+        for (size_t slot = 0; slot < partials.size(); slot++) {
+            if (!touched[slot]) {
+                continue;
+            }
+            const uint32_t* bins = &partials[slot][0];
+            for (size_t i = begin; i < end; i++) {
+                counts[i] += bins[i];
+            }
+        }
+    });
+    return true;
+}
+
+bool renderScope(const ScopeTrace& trace, const ScopeDisplay& display,
+                 void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                 const OfxRectI& frame, const OfxRectI& window,
+                 ThreadPool& pool, const std::function<bool()>& cancelled) {
+    OfxRectI clipped;
+    clipped.x1 = std::max(window.x1, bounds.x1);
+    clipped.y1 = std::max(window.y1, bounds.y1);
+    clipped.x2 = std::min(window.x2, bounds.x2);
+    clipped.y2 = std::min(window.y2, bounds.y2);
+    const int width = clipped.x2 - clipped.x1;
+    const int rows = clipped.y2 - clipped.y1;
+    if (!data || depth == kBitDepthNone || width <= 0 || rows <= 0) {
+        return true;
+    }
+
+    // Tone-map every cell to RGB once; output pixels then just pick a cell
+    const size_t cells = trace.counts.size();
+    std::vector<float> colors(cells * 3, 0.0f);
+    if (cells) {
+        const float scale = (float)display.intensity
+                          / std::log1p((float)std::max<uint64_t>(trace.columnSamples, 1));
+        const int chunks = (int)((cells + kCellChunk - 1) / kCellChunk);
+        bool completed = runBands(pool, chunks, [&](int chunk, int) {
+            size_t begin = (size_t)chunk * kCellChunk;
+            size_t end = std::min(begin + kCellChunk, cells);
+            for (size_t i = begin; i < end; i++) {
+                int x = (int)(i % trace.width);
+                int y = (int)(i / trace.width);
+                float level = std::min(std::log1p((float)trace.counts[i]) * scale, 1.0f);
+                float grid = display.graticule && isGraticule(trace, x, y) ? kGraticuleLevel : 0.0f;
+                float* color = &colors[i * 3];
+                for (int c = 0; c < 3; c++) {
+                    // Parade sections are drawn in their channel's color
+                    bool lit = trace.mode != kScopeParade || x / (trace.width / 3) == c;
+                    color[c] = std::max(lit ? level : 0.0f, grid);
+                }
+            }
+        }, cancelled);
+        if (!completed) {
+            return false;
+        }
+    }
+
+    // The area the trace covers: the whole frame, or its centered square for the vectorscope
+    OfxRectI area = frame;
+    if (trace.mode == kScopeVectorscope) {
+        int side = std::min(frame.x2 - frame.x1, frame.y2 - frame.y1);
+        area.x1 = frame.x1 + (frame.x2 - frame.x1 - side) / 2;
+        area.y1 = frame.y1 + (frame.y2 - frame.y1 - side) / 2;
+        area.x2 = area.x1 + side;
+        area.y2 = area.y1 + side;
+    }
+    const int areaWidth = area.x2 - area.x1;
+    const int areaHeight = area.y2 - area.y1;
+
+    // Cell column of each output column, null outside the area
+    std::vector<int> columnIndex(width, -1);
+    for (int x = 0; x < width; x++) {
+        int px = clipped.x1 + x;
+        if (cells && px >= area.x1 && px < area.x2) {
+            columnIndex[x] = (int)((int64_t)(px - area.x1) * trace.width / areaWidth);
+        }
+    }
+
+    const int bandRows = std::max(1, kBandPixels / width);
+    const int bands = (rows + bandRows - 1) / bandRows;
+    const float maxValue = depth == kBitDepthByte ? 255.0f : depth == kBitDepthShort ? 65535.0f : 0.0f;
+    const ptrdiff_t pixelBytes = (ptrdiff_t)depth * 4;
+
+    return runBands(pool, bands, [&](int band, int) {
+        std::vector<const float*> rowCells(width, nullptr);
+        int y1 = clipped.y1 + band * bandRows;
+        int y2 = std::min(y1 + bandRows, clipped.y2);
+        int previousRow = -2;
+        for (int y = y1; y < y2; y++) {
+            bool inside = cells && y >= area.y1 && y < area.y2;
+            int cellRow = inside ? (int)((int64_t)(y - area.y1) * trace.height / areaHeight) : -1;
+            char* row = (char*)data + (ptrdiff_t)(y - bounds.y1) * rowBytes
+                      + (ptrdiff_t)(clipped.x1 - bounds.x1) * pixelBytes;
+
+            // Output rows sharing a cell row are identical, so repeat the one above
+            if (cellRow == previousRow) {
+                memcpy(row, row - rowBytes, (size_t)width * pixelBytes);
+                continue;
+            }
+            previousRow = cellRow;
+            for (int x = 0; x < width; x++) {
+                rowCells[x] = inside && columnIndex[x] >= 0
+                    ? &colors[((size_t)cellRow * trace.width + columnIndex[x]) * 3] : nullptr;
+            }
+
+            switch (depth) {
+                case kBitDepthByte:
+                    writeRow((unsigned char*)row, &rowCells[0], width, maxValue);
+                    break;
+                case kBitDepthShort:
+                    writeRow((unsigned short*)row, &rowCells[0], width, maxValue);
+                    break;
+                default:
+                    writeRow((float*)row, &rowCells[0], width, maxValue);
+                    break;
+            }
+        }
+    }, cancelled);
+}
+
+} // namespace ofx
@@ -0,0 +1,109 @@
+#ifndef _ofxScopes_h_
+#define _ofxScopes_h_
+
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @file ofxScopes.h
+ * @brief Waveform, RGB parade and vectorscope traces, and their display
+ */
+
+namespace ofx {
+
+/**
+ * @brief Scope kinds, in the order of the plugin's choice options
+ */
+enum ScopeMode {
+    kScopeWaveform = 0,   ///< Rec.709 luma against image column
+    kScopeParade,         ///< Red, green and blue waveforms side by side
+    kScopeVectorscope,    ///< Rec.709 Cb against Cr
+    kScopeModeCount
+};
+
+/**
+ * @brief Display name of a scope mode
+ */
+const char* scopeModeLabel(ScopeMode mode);
+
+/**
+ * @brief Hit counts on the scope's own grid
+ *
+ * Cell (x, y) is counts[y * width + x], with y = 0 at the bottom like OFX
+ * images. Waveform and parade rows are levels 0..1; parade columns are split
+ * in thirds, red first. Vectorscope cells span Cb and Cr from -0.5 to 0.5.
+ */
+struct ScopeTrace {
+    ScopeMode mode;
+    int width;
+    int height;
+    uint64_t samples;         ///< Source pixels accumulated
+    uint64_t columnSamples;   ///< Largest number of source pixels feeding one trace column
+    std::vector<uint32_t> counts;
+
+    ScopeTrace() : mode(kScopeWaveform), width(0), height(0), samples(0), columnSamples(0) {}
+};
+
+/**
+ * @brief Builds traces from RGBA buffers, reusing its per-thread bins between frames
+ *
+ * Row bands run on the pool and each participant counts into its own bins,
+ * so the hot loop has no atomics and no shared cache lines. The bins are
+ * summed once the bands have joined, also split across the pool. One
+ * accumulator serves one render at a time.
+ */
+class ScopeAccumulator {
+private:
+    ThreadPool& pool;
+    ScopeTrace result;
+    std::vector<std::vector<uint32_t> > partials;
+    std::vector<char> touched;
+
+public:
+    explicit ScopeAccumulator(ThreadPool& pool = ThreadPool::shared());
+
+    /**
+     * @brief Accumulate a whole buffer into a width x height trace
+     * @param cancelled Polled between bands; may be empty
+     * @return false if cancelled, leaving the trace incomplete
+     */
+    bool accumulate(ScopeMode mode, int width, int height,
+                    const void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                    const std::function<bool()>& cancelled = std::function<bool()>());
+
+    const ScopeTrace& trace() const { return result; }
+};
+
+/**
+ * @brief How a trace is drawn
+ */
+struct ScopeDisplay {
+    double intensity;   ///< Trace brightness; 1 puts a full column in one cell at white
+    bool graticule;     ///< Draw level lines, or the vectorscope's axes and rings
+
+    ScopeDisplay() : intensity(1.0), graticule(true) {}
+};
+
+/**
+ * @brief Tone-map a trace into the window of an RGBA buffer
+ *
+ * Counts are shown on a log scale against the trace's column size, so single
+ * stray pixels stay visible without flat areas clipping. The trace fills
+ * frame (the vectorscope as the largest centered square); pixels outside it
+ * are black. Alpha is written opaque.
+ *
+ * @return false if cancelled before every band was written
+ */
+bool renderScope(const ScopeTrace& trace, const ScopeDisplay& display,
+                 void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                 const OfxRectI& frame, const OfxRectI& window,
+                 ThreadPool& pool = ThreadPool::shared(),
+                 const std::function<bool()>& cancelled = std::function<bool()>());
+
+} // namespace ofx
+
+#endif // _ofxScopes_h_
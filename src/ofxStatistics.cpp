@@ -0,0 +1,268 @@
+#include "ofxStatistics.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <limits>
+
+namespace ofx {
+
+namespace {
+
+const int kChannels = ImageStatistics::kChannels;
+
+/**
+ * @brief Accumulators owned by one participant slot
+ *
+ * Min, max and sum are kept normalized so integer and float rows merge the
+ * same way. Histograms are channel-major, kChannels * bins.
+ */
+struct Partial {
+    double min[kChannels];
+    double max[kChannels];
+    double sum[kChannels];
+    uint64_t samples[kChannels];
+    uint64_t nonFinite[kChannels];
+    std::vector<uint32_t> histogram;
+
+    Partial() {
+        for (int c = 0; c < kChannels; c++) {
+            min[c] = std::numeric_limits<double>::max();
+            max[c] = -std::numeric_limits<double>::max();
+            sum[c] = 0.0;
+            samples[c] = 0;
+            nonFinite[c] = 0;
+        }
+    }
+};
+
+// The channel loops below are written lane-wise over one RGBA pixel so the
+// compiler keeps the four accumulators in a single vector register.
+
+template<typename T, int Bits>
+void accumulateIntegerRow(const T* row, int width, int bins, Partial& partial) {
+    uint32_t lo[kChannels], hi[kChannels];
+    uint64_t sum[kChannels];
+    for (int c = 0; c < kChannels; c++) {
+        lo[c] = (1u << Bits) - 1;
+        hi[c] = 0;
+        sum[c] = 0;
+    }
+
+    for (int x = 0; x < width; x++) {
+        const T* pixel = row + x * kChannels;
+        for (int c = 0; c < kChannels; c++) {
+            uint32_t v = pixel[c];
+            lo[c] = v < lo[c] ? v : lo[c];
+            hi[c] = v > hi[c] ? v : hi[c];
+            sum[c] += v;
+        }
+    }
+
+    // Scatter pass; the row is still in cache from the pass above
+    uint32_t* histogram = &partial.histogram[0];
+    for (int x = 0; x < width; x++) {
+        const T* pixel = row + x * kChannels;
+        for (int c = 0; c < kChannels; c++) {
+            histogram[c * bins + (((uint32_t)pixel[c] * (uint32_t)bins) >> Bits)]++;
+        }
+    }
+
+    const double scale = 1.0 / (double)((1u << Bits) - 1);
+    for (int c = 0; c < kChannels; c++) {
+        partial.min[c] = std::min(partial.min[c], lo[c] * scale);
+        partial.max[c] = std::max(partial.max[c], hi[c] * scale);
+        partial.sum[c] += (double)sum[c] * scale;
+        partial.samples[c] += (uint64_t)width;
+    }
+}
+
+void accumulateFloatRow(const float* row, int width, int bins, float rangeMin, float binScale,
+                        Partial& partial) {
+    float lo[kChannels], hi[kChannels];
+    double sum[kChannels];
+    uint32_t finite[kChannels];
+    for (int c = 0; c < kChannels; c++) {
+        lo[c] = FLT_MAX;
+        hi[c] = -FLT_MAX;
+        sum[c] = 0.0;
+        finite[c] = 0;
+    }
+
+    for (int x = 0; x < width; x++) {
+        const float* pixel = row + x * kChannels;
+        for (int c = 0; c < kChannels; c++) {
+            float v = pixel[c];
+            // v - v is NaN for both NaN and infinity
+            bool ok = (v - v) == 0.0f;
+            lo[c] = (ok && v < lo[c]) ? v : lo[c];
+            hi[c] = (ok && v > hi[c]) ? v : hi[c];
+            sum[c] += ok ? v : 0.0f;
+            finite[c] += ok ? 1u : 0u;
+        }
+    }
+
+    const float lastBin = (float)(bins - 1);
+    uint32_t* histogram = &partial.histogram[0];
+    for (int x = 0; x < width; x++) {
+        const float* pixel = row + x * kChannels;
+        for (int c = 0; c < kChannels; c++) {
+            float v = pixel[c];
+            if ((v - v) != 0.0f) {
+                continue;
+            }
+            float bin = std::min(std::max((v - rangeMin) * binScale, 0.0f), lastBin);
+            histogram[c * bins + (int)bin]++;
+        }
+    }
+
+    for (int c = 0; c < kChannels; c++) {
+        if (finite[c]) {
+            partial.min[c] = std::min(partial.min[c], (double)lo[c]);
+            partial.max[c] = std::max(partial.max[c], (double)hi[c]);
+        }
+        partial.sum[c] += sum[c];
+        partial.samples[c] += finite[c];
+        partial.nonFinite[c] += (uint64_t)width - finite[c];
+    }
+}
+
+} // namespace
+
+ImageStatistics::ImageStatistics()
+    : pixelCount(0), histogramMin(0.0), histogramMax(1.0)
+{
+    for (int c = 0; c < kChannels; c++) {
+        channels[c].min = 0.0;
+        channels[c].max = 0.0;
+        channels[c].mean = 0.0;
+        channels[c].samples = 0;
+        channels[c].nonFinite = 0;
+    }
+}
+
+double ImageStatistics::percentile(int channel, double p) const {
+    const ChannelStatistics& stats = channels[channel];
+    if (!stats.samples || stats.histogram.empty()) {
+        return 0.0;
+    }
+
+    double target = std::min(std::max(p, 0.0), 1.0) * (double)stats.samples;
+    double binWidth = (histogramMax - histogramMin) / (double)stats.histogram.size();
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < stats.histogram.size(); b++) {
+        uint64_t count = stats.histogram[b];
+        if (count && (double)(cumulative + count) >= target) {
+            double fraction = (target - (double)cumulative) / (double)count;
+            double value = histogramMin + ((double)b + fraction) * binWidth;
+            return std::min(std::max(value, stats.min), stats.max);
+        }
+        cumulative += count;
+    }
+    return stats.max;
+}
+
+ImageStatistics computeStatistics(const void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                                  const OfxRectI& region, const StatisticsOptions& options,
+                                  ThreadPool& pool) {
+    ImageStatistics result;
+    const int bins = std::min(std::max(options.bins, 1), 65536);
+
+    OfxRectI clipped;
+    clipped.x1 = std::max(region.x1, bounds.x1);
+    clipped.y1 = std::max(region.y1, bounds.y1);
+    clipped.x2 = std::min(region.x2, bounds.x2);
+    clipped.y2 = std::min(region.y2, bounds.y2);
+    const int width = clipped.x2 - clipped.x1;
+    const int rows = clipped.y2 - clipped.y1;
+
+    float rangeMin = (float)options.rangeMin;
+    float rangeMax = options.rangeMax > options.rangeMin ? (float)options.rangeMax : rangeMin + 1.0f;
+    if (depth == kBitDepthFloat) {
+        result.histogramMin = rangeMin;
+        result.histogramMax = rangeMax;
+    } else if (depth != kBitDepthNone) {
+        // Integer bins split the code range evenly, so the last edge sits one code past max
+        double maxCode = depth == kBitDepthByte ? 255.0 : 65535.0;
+        result.histogramMin = 0.0;
+        result.histogramMax = (maxCode + 1.0) / maxCode;
+    }
+
+    for (int c = 0; c < kChannels; c++) {
+        result.channels[c].histogram.assign(bins, 0);
+    }
+    if (!data || depth == kBitDepthNone || width <= 0 || rows <= 0) {
+        return result;
+    }
+    result.pixelCount = (uint64_t)width * (uint64_t)rows;
+
+    // A few bands per participant so uneven thread start-up evens out
+    int tasks = std::min(rows, pool.maxParticipants() * 4);
+    const int bandRows = (rows + tasks - 1) / tasks;
+    tasks = (rows + bandRows - 1) / bandRows;
+
+    std::vector<Partial> partials(pool.maxParticipants());
+    const float binScale = (float)bins / (rangeMax - rangeMin);
+    const ptrdiff_t pixelBytes = (ptrdiff_t)depth * kChannels;
+
+    pool.parallelFor(tasks, [&](int task, int slot) {
+        Partial& partial = partials[slot];
+        if (partial.histogram.empty()) {
+            partial.histogram.assign((size_t)kChannels * bins, 0);
+        }
+
+        int y1 = clipped.y1 + task * bandRows;
+        int y2 = std::min(y1 + bandRows, clipped.y2);
+        for (int y = y1; y < y2; y++) {
+            const char* row = (const char*)data + (ptrdiff_t)(y - bounds.y1) * rowBytes
+                            + (ptrdiff_t)(clipped.x1 - bounds.x1) * pixelBytes;
+            switch (depth) {
+                case kBitDepthByte:
+                    accumulateIntegerRow<unsigned char, 8>((const unsigned char*)row, width, bins, partial);
+                    break;
+                case kBitDepthShort:
+                    accumulateIntegerRow<unsigned short, 16>((const unsigned short*)row, width, bins, partial);
+                    break;
+                default:
+                    accumulateFloatRow((const float*)row, width, bins, rangeMin, binScale, partial);
+                    break;
+            }
+        }
+    });
+
+    // Every band has joined, so the partials are read without synchronization
+    for (int c = 0; c < kChannels; c++) {
+        ChannelStatistics& stats = result.channels[c];
+        double lo = std::numeric_limits<double>::max();
+        double hi = -std::numeric_limits<double>::max();
+        double sum = 0.0;
+        for (size_t i = 0; i < partials.size(); i++) {
+            const Partial& partial = partials[i];
+            if (partial.histogram.empty()) {
+                continue;
+            }
+            lo = std::min(lo, partial.min[c]);
+            hi = std::max(hi, partial.max[c]);
+            sum += partial.sum[c];
+            stats.samples += partial.samples[c];
+            stats.nonFinite += partial.nonFinite[c];
+            const uint32_t* histogram = &partial.histogram[(size_t)c * bins];
+            for (int b = 0; b < bins; b++) {
+                stats.histogram[b] += histogram[b];
+            }
+        }
+        if (stats.samples) {
+            stats.min = lo;
+            stats.max = hi;
+            stats.mean = sum / (double)stats.samples;
+        }
+    }
+    return result;
+}
+
+ImageStatistics computeStatistics(const Image& image, const OfxRectI& region,
+                                  const StatisticsOptions& options, ThreadPool& pool) {
+    return computeStatistics(image.data(), image.getBounds(), image.getRowBytes(),
+                             (BitDepth)image.getPixelDepth(), region, options, pool);
+}
+
+} // namespace ofx
@@ -0,0 +1,90 @@
+#ifndef _ofxStatistics_h_
+#define _ofxStatistics_h_
+
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @file ofxStatistics.h
+ * @brief Per-channel image statistics: min/max/mean, histograms, percentiles
+ */
+
+namespace ofx {
+
+/**
+ * @brief What to measure and how finely
+ */
+struct StatisticsOptions {
+    int bins;            ///< Histogram bins per channel, 1 to 65536
+    double rangeMin;     ///< Float images: value of the first bin's lower edge
+    double rangeMax;     ///< Float images: value of the last bin's upper edge
+
+    StatisticsOptions() : bins(256), rangeMin(0.0), rangeMax(1.0) {}
+};
+
+/**
+ * @brief Statistics of one channel
+ *
+ * Values are normalized, so integer depths report 0..1 like float images.
+ * Float samples outside the histogram range land in the end bins but still
+ * count towards min, max and mean.
+ */
+struct ChannelStatistics {
+    double min;
+    double max;
+    double mean;
+    uint64_t samples;      ///< Finite samples measured
+    uint64_t nonFinite;    ///< NaN and infinite samples skipped
+    std::vector<uint64_t> histogram;
+};
+
+/**
+ * @brief RGBA statistics of an image region
+ */
+class ImageStatistics {
+public:
+    static const int kChannels = 4;
+
+    ChannelStatistics channels[kChannels];
+    uint64_t pixelCount;
+    double histogramMin;   ///< Normalized value of bin 0's lower edge
+    double histogramMax;   ///< Normalized value of the last bin's upper edge
+
+    ImageStatistics();
+
+    /**
+     * @brief Value below which fraction p (0..1) of the channel's samples fall
+     *
+     * Interpolated within the histogram bin and clamped to the channel's
+     * exact min and max.
+     */
+    double percentile(int channel, double p) const;
+};
+
+/**
+ * @brief Measure a region of an RGBA buffer
+ *
+ * Rows are split into bands run on the pool. Each participating thread
+ * accumulates into its own partial, and the partials are merged once the
+ * bands have joined, so the hot loop takes no locks.
+ *
+ * @param region Clipped to bounds; an empty region gives zero counts
+ */
+ImageStatistics computeStatistics(const void* data, const OfxRectI& bounds, int rowBytes, BitDepth depth,
+                                  const OfxRectI& region,
+                                  const StatisticsOptions& options = StatisticsOptions(),
+                                  ThreadPool& pool = ThreadPool::shared());
+
+/**
+ * @brief Measure a region of a fetched image
+ */
+ImageStatistics computeStatistics(const Image& image, const OfxRectI& region,
+                                  const StatisticsOptions& options = StatisticsOptions(),
+                                  ThreadPool& pool = ThreadPool::shared());
+
+} // namespace ofx
+
+#endif // _ofxStatistics_h_
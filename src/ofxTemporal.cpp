@@ -0,0 +1,258 @@
+#include "ofxTemporal.h"
+#include "ofxRows.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace ofx {
+
+namespace {
+
+using rows::clampIndex;
+using rows::loadPlanes;
+using rows::store;
+
+// Rows per task
+const int kBandRows = 16;
+
+/**
+ * @brief Convert n pixels of row y from x into planes, repeating the edge pixels
+ *
+ * planes[3] receives alpha unless it is null.
+ */
+template<typename In>
+void loadRow(const FrameView& view, int x, int y, int n, float scale, float* const planes[4]) {
+    int length = view.bounds.x2 - view.bounds.x1;
+    int row = clampIndex(y - view.bounds.y1, view.bounds.y2 - view.bounds.y1);
+    const In* line = (const In*)((const char*)view.data + (ptrdiff_t)row * view.rowBytes);
+
+    loadPlanes(line, length, x - view.bounds.x1, n, scale, planes, planes[3] ? 4 : 3);
+}
+
+template<typename T>
+bool blendFrames(const FrameView& current, const std::vector<FrameView>& neighbors, float maxValue, float threshold,
+                 T* dst, const OfxRectI& window, int dstRowBytes,
+                 ScratchLease& threads, ThreadPool& pool, const std::function<bool()>& cancelled)
+{
+    const int width = window.x2 - window.x1;
+    const int height = window.y2 - window.y1;
+    const float scale = 1.0f / maxValue;
+    const float inverse = threshold > 0.0f ? 1.0f / threshold : std::numeric_limits<float>::max();
+    const int bands = (height + kBandRows - 1) / kBandRows;
+
+    // Rows are loaded with one pixel either side, so that smoothing the difference
+    // reads the same pixels whatever the window
+    const int span = width + 2;
+    ThreadPool::Task task = [&](int index, int slot) {
+        ScratchArena& arena = threads[slot];
+        ScratchArena::Scope scope(arena);
+        float* base[4];
+        float* sum[3];
+        float* other[4];
+        for (int c = 0; c < 4; c++) {
+            base[c] = arena.allocate<float>(span);
+        }
+        for (int c = 0; c < 3; c++) {
+            sum[c] = arena.allocate<float>(width);
+            other[c] = arena.allocate<float>(span);
+        }
+        other[3] = nullptr;
+        float* difference = arena.allocate<float>(span);
+        float* weight = arena.allocate<float>(width);
+        float* total = arena.allocate<float>(width);
+
+        int last = std::min((index + 1) * kBandRows, height);
+        for (int row = index * kBandRows; row < last; row++) {
+            int y = window.y1 + row;
+            loadRow<T>(current, window.x1 - 1, y, span, scale, base);
+            for (int c = 0; c < 3; c++) {
+                std::copy(base[c] + 1, base[c] + 1 + width, sum[c]);
+            }
+            std::fill(total, total + width, 1.0f);
+
+            for (size_t k = 0; k < neighbors.size(); k++) {
+                loadRow<T>(neighbors[k], window.x1 - 1, y, span, scale, other);
+                for (int i = 0; i < span; i++) {
+                    difference[i] = (std::fabs(other[0][i] - base[0][i]) + std::fabs(other[1][i] - base[1][i])
+                                     + std::fabs(other[2][i] - base[2][i])) * (1.0f / 3.0f);
+                }
+
+                // Smooth the difference along the row, then map it to a weight
+                for (int i = 0; i < width; i++) {
+                    float d = 0.5f * difference[i + 1] + 0.25f * (difference[i] + difference[i + 2]);
+                    float w = std::max(1.0f - d * inverse, 0.0f);
+                    weight[i] = w * w;
+                    total[i] += weight[i];
+                }
+                for (int c = 0; c < 3; c++) {
+                    float* s = sum[c];
+                    const float* v = other[c] + 1;
+                    for (int i = 0; i < width; i++) {
+                        s[i] += weight[i] * v[i];
+                    }
+                }
+            }
+
+            T* out = (T*)((char*)dst + (ptrdiff_t)row * dstRowBytes);
+            for (int i = 0; i < width; i++) {
+                total[i] = 1.0f / total[i];
+            }
+            for (int c = 0; c < 3; c++) {
+                const float* s = sum[c];
+                for (int i = 0; i < width; i++) {
+                    out[i * 4 + c] = store<T>(s[i] * total[i], maxValue);
+                }
+            }
+            for (int i = 0; i < width; i++) {
+                out[i * 4 + 3] = store<T>(base[3][i + 1], maxValue);
+            }
+        }
+    };
+
+    if (cancelled) {
+        return pool.parallelFor(bands, task, cancelled);
+    }
+    pool.parallelFor(bands, task);
+    return true;
+}
+
+bool contains(const OfxRectI& outer, const OfxRectI& inner) {
+    return inner.x1 >= outer.x1 && inner.y1 >= outer.y1 && inner.x2 <= outer.x2 && inner.y2 <= outer.y2;
+}
+
+} // namespace
+
+TemporalDenoiser::TemporalDenoiser(double threshold)
+    : motionThreshold(std::max(threshold, 0.0))
+{
+}
+
+bool TemporalDenoiser::apply(const FrameView& current, const std::vector<FrameView>& neighbors, BitDepth depth,
+                             void* dst, const OfxRectI& window, int dstRowBytes,
+                             ScratchLease& threads, ThreadPool& pool, const std::function<bool()>& cancelled) const
+{
+    if (window.x2 <= window.x1 || window.y2 <= window.y1
+        || current.bounds.x2 <= current.bounds.x1 || current.bounds.y2 <= current.bounds.y1) {
+        return true;
+    }
+    const float threshold = (float)motionThreshold;
+    switch (depth) {
+        case kBitDepthByte:
+            return blendFrames<unsigned char>(current, neighbors, 255.0f, threshold,
+                                              (unsigned char*)dst, window, dstRowBytes, threads, pool, cancelled);
+        case kBitDepthShort:
+            return blendFrames<unsigned short>(current, neighbors, 65535.0f, threshold,
+                                               (unsigned short*)dst, window, dstRowBytes, threads, pool, cancelled);
+        case kBitDepthFloat:
+            return blendFrames<float>(current, neighbors, 1.0f, threshold,
+                                      (float*)dst, window, dstRowBytes, threads, pool, cancelled);
+        default:
+            return true;
+    }
+}
+
+FrameView FrameCache::Frame::view() const {
+    FrameView image = { pixels.empty() ? nullptr : &pixels[0], bounds, rowBytes };
+    return image;
+}
+
+FrameCache::FrameCache(size_t capacity)
+    : slots(capacity), clock(0)
+{
+}
+
+void FrameCache::setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity < slots.size()) {
+        // Keep the most recently used frames
+        std::sort(slots.begin(), slots.end(), [](const Slot& a, const Slot& b) { return a.used > b.used; });
+    }
+    slots.resize(capacity);
+}
+
+size_t FrameCache::capacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.size();
+}
+
+std::shared_ptr<const FrameCache::Frame> FrameCache::find(double time, double renderScale, const OfxRectI& region,
+                                                          BitDepth depth)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < slots.size(); i++) {
+        const std::shared_ptr<const Frame>& frame = slots[i].frame;
+        if (frame && frame->time == time && frame->renderScale == renderScale && frame->depth == depth
+            && contains(frame->bounds, region)) {
+            slots[i].used = ++clock;
+            return frame;
+        }
+    }
+    return std::shared_ptr<const Frame>();
+}
+
+std::shared_ptr<const FrameCache::Frame> FrameCache::insert(double time, double renderScale,
+                                                            const std::string& identifier,
+                                                            const FrameView& image, BitDepth depth)
+{
+    int width = image.bounds.x2 - image.bounds.x1;
+    int height = image.bounds.y2 - image.bounds.y1;
+    if (identifier.empty() || width <= 0 || height <= 0 || depth == kBitDepthNone || capacity() == 0) {
+        return std::shared_ptr<const Frame>();
+    }
+
+    // Copy outside the lock; renders of other tiles keep using the cache meanwhile
+    std::shared_ptr<Frame> frame(new Frame());
+    frame->time = time;
+    frame->renderScale = renderScale;
+    frame->identifier = identifier;
+    frame->depth = depth;
+    frame->bounds = image.bounds;
+    frame->rowBytes = width * 4 * (int)depth;
+    frame->pixels.resize((size_t)frame->rowBytes * height);
+    for (int y = 0; y < height; y++) {
+        std::memcpy(&frame->pixels[(size_t)y * frame->rowBytes],
+                    (const char*)image.data + (ptrdiff_t)y * image.rowBytes, frame->rowBytes);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slots.empty()) {
+        return frame;
+    }
+    size_t target = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].frame && slots[i].frame->time == time && slots[i].frame->renderScale == renderScale) {
+            target = i;
+            break;
+        }
+        if (!slots[i].frame || (slots[target].frame && slots[i].used < slots[target].used)) {
+            target = i;
+        }
+    }
+    slots[target].frame = frame;
+    slots[target].used = ++clock;
+    return frame;
+}
+
+void FrameCache::validate(double time, double renderScale, const std::string& identifier) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < slots.size(); i++) {
+        const std::shared_ptr<const Frame>& frame = slots[i].frame;
+        if (frame && frame->time == time && frame->renderScale == renderScale && frame->identifier != identifier) {
+            for (size_t j = 0; j < slots.size(); j++) {
+                slots[j].frame.reset();
+            }
+            return;
+        }
+    }
+}
+
+void FrameCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i].frame.reset();
+    }
+}
+
+} // namespace ofx
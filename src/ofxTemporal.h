@@ -0,0 +1,140 @@
+#ifndef _ofxTemporal_h_
+#define _ofxTemporal_h_
+
+#include "ofxUtilities.h"
+#include "ofxThreadPool.h"
+#include "ofxArena.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file ofxTemporal.h
+ * @brief Temporal noise reduction and the cache of neighbor frames it reads
+ */
+
+namespace ofx {
+
+/**
+ * @brief Read-only RGBA pixels and where they sit
+ */
+struct FrameView {
+    const void* data;
+    OfxRectI bounds;
+    int rowBytes;
+};
+
+/**
+ * @brief Motion-adaptive average of a frame with its neighbors in time
+ *
+ * Every neighbor pixel is weighted by (1 - d / threshold)^2, or 0 past the
+ * threshold, where d is the mean absolute RGB difference from the current
+ * frame, smoothed with [1 2 1] / 4 along the row so that a single noisy
+ * pixel does not read as motion. Still areas average over all the frames;
+ * moving ones fall back to the current frame, which always has weight 1.
+ * Alpha is the current frame's.
+ */
+class TemporalDenoiser {
+private:
+    double motionThreshold;
+
+public:
+    /**
+     * @param threshold Difference, as a fraction of full scale, at which a neighbor pixel is ignored
+     */
+    explicit TemporalDenoiser(double threshold);
+
+    double threshold() const { return motionThreshold; }
+
+    /**
+     * @brief Blend neighbors into current over window, written to dst
+     *
+     * All frames share depth and have non-empty bounds; pixels outside a
+     * frame's bounds repeat its nearest edge pixel. Rows are split across the
+     * pool, each thread's row buffers taken from its arena in threads.
+     *
+     * @param threads At least pool.maxParticipants() arenas
+     * @return false if cancelled before every row was written
+     */
+    bool apply(const FrameView& current, const std::vector<FrameView>& neighbors, BitDepth depth,
+               void* dst, const OfxRectI& window, int dstRowBytes,
+               ScratchLease& threads, ThreadPool& pool = ThreadPool::shared(),
+               const std::function<bool()>& cancelled = std::function<bool()>()) const;
+};
+
+/**
+ * @brief Ring of source frames copied out of the host, keyed by time, render scale and unique identifier
+ *
+ * A temporal effect rendering frame after frame needs mostly the frames it
+ * needed last time. Keeping copies lets each frame be fetched from the host
+ * once as it enters the range instead of once per render that reads it.
+ * Frames are matched on render scale as well as time, so a full resolution
+ * copy is never blended into a proxy render or the other way round.
+ * When the ring is full the least recently used slot is reused. Frames are
+ * shared, so one evicted during a render stays valid for that render.
+ *
+ * The cache cannot see an upstream change to a frame it holds; validate()
+ * with the identifier of a freshly fetched frame drops everything when the
+ * copy of that frame is stale. Frames without an identifier are not cached.
+ */
+class FrameCache {
+public:
+    struct Frame {
+        double time;
+        double renderScale;
+        std::string identifier;
+        BitDepth depth;
+        OfxRectI bounds;
+        int rowBytes;
+        std::vector<char> pixels;
+
+        FrameView view() const;
+    };
+
+private:
+    struct Slot {
+        std::shared_ptr<const Frame> frame;
+        unsigned long used;
+
+        Slot() : used(0) {}
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Slot> slots;
+    unsigned long clock;
+
+public:
+    explicit FrameCache(size_t capacity = 0);
+
+    /**
+     * @brief Number of frames kept; shrinking drops the least recently used
+     */
+    void setCapacity(size_t capacity);
+    size_t capacity() const;
+
+    /**
+     * @brief Frame at time and renderScale with depth whose bounds contain region, or null
+     */
+    std::shared_ptr<const Frame> find(double time, double renderScale, const OfxRectI& region, BitDepth depth);
+
+    /**
+     * @brief Copy image in as the frame at time and renderScale, replacing any older copy of it
+     * @return The stored frame, or null if identifier is empty or capacity is 0
+     */
+    std::shared_ptr<const Frame> insert(double time, double renderScale, const std::string& identifier,
+                                        const FrameView& image, BitDepth depth);
+
+    /**
+     * @brief Drop every frame if the one at time and renderScale has another identifier
+     */
+    void validate(double time, double renderScale, const std::string& identifier);
+
+    void clear();
+};
+
+} // namespace ofx
+
+#endif // _ofxTemporal_h_
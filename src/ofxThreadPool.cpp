@@ -0,0 +1,130 @@
+#include "ofxThreadPool.h"
+
+#include <algorithm>
+
+namespace ofx {
+
+ThreadPool::ThreadPool(int threads)
+    : stopping(false)
+{
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+int ThreadPool::work(Job& job, int slot) {
+    int ran = 0;
+    for (;;) {
+        int index = job.next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= job.count) {
+            break;
+        }
+        (*job.task)(index, slot);
+        ran++;
+    }
+    return ran;
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        Job* job = jobs.front();
+        if (job->next.load(std::memory_order_relaxed) >= job->count) {
+            // Fully claimed; the owner is only waiting for running indices
+            jobs.pop_front();
+            continue;
+        }
+        int slot = job->participants++;
+        job->active++;
+
+        lock.unlock();
+        int ran = work(*job, slot);
+        lock.lock();
+
+        job->finished += ran;
+        job->active--;
+        if (job->finished == job->count && job->active == 0) {
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int count, const Task& task) {
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1 || workers.empty()) {
+        for (int i = 0; i < count; i++) {
+            task(i, 0);
+        }
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.count = count;
+    job.next.store(0);
+    job.finished = 0;
+    job.active = 0;
+    job.participants = 1;   // slot 0 is the caller
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(&job);
+    }
+    wake.notify_all();
+
+    int ran = work(job, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job.finished += ran;
+    done.wait(lock, [&job] { return job.finished == job.count && job.active == 0; });
+
+    // Workers may not have popped it yet; it must not outlive this frame
+    std::deque<Job*>::iterator it = std::find(jobs.begin(), jobs.end(), &job);
+    if (it != jobs.end()) {
+        jobs.erase(it);
+    }
+}
+
+bool ThreadPool::parallelFor(int count, const Task& task, const std::function<bool()>& cancelled) {
+    std::atomic<bool> stopped(false);
+    parallelFor(count, [&](int index, int slot) {
+        // Remaining indices are still claimed, but only to be skipped
+        if (stopped.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (cancelled()) {
+            stopped.store(true, std::memory_order_relaxed);
+            return;
+        }
+        task(index, slot);
+    });
+    return !stopped.load();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+} // namespace ofx
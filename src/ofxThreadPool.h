@@ -0,0 +1,95 @@
+#ifndef _ofxThreadPool_h_
+#define _ofxThreadPool_h_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @file ofxThreadPool.h
+ * @brief Persistent worker pool for splitting a frame into bands
+ */
+
+namespace ofx {
+
+/**
+ * @brief Fixed set of worker threads running parallel-for jobs
+ *
+ * The calling thread always works on its own job, so a job completes even
+ * when every worker is busy with another render. Several jobs may be in
+ * flight at once (hosts render tiles concurrently); workers pick whichever
+ * has indices left.
+ */
+class ThreadPool {
+public:
+    /**
+     * @brief Task callback: index in [0, count), and a participant slot in
+     * [0, maxParticipants()) unique among the threads running this job
+     */
+    typedef std::function<void(int index, int slot)> Task;
+
+private:
+    struct Job {
+        const Task* task;
+        int count;
+        std::atomic<int> next;
+        // Guarded by mutex; the owner returns once every index finished and no worker still holds the job
+        int finished;
+        int active;
+        int participants;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job*> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping;
+
+    void workerLoop();
+
+    // Claim and run indices until none are left; returns how many ran
+    static int work(Job& job, int slot);
+
+public:
+    /**
+     * @param threads Worker threads to start, 0 for one less than the hardware concurrency
+     */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    int workerCount() const { return (int)workers.size(); }
+
+    /**
+     * @brief Upper bound on distinct slots passed to a task, for sizing per-thread partials
+     */
+    int maxParticipants() const { return (int)workers.size() + 1; }
+
+    /**
+     * @brief Run task for every index in [0, count) and wait for all of them
+     */
+    void parallelFor(int count, const Task& task);
+
+    /**
+     * @brief parallelFor that stops starting indices once cancelled() returns true
+     *
+     * cancelled() is called before every index, from whichever thread runs
+     * it, so it should be cheap or rate-limited itself.
+     *
+     * @return false if some indices were skipped
+     */
+    bool parallelFor(int count, const Task& task, const std::function<bool()>& cancelled);
+
+    /**
+     * @brief Process-wide pool shared by all plugin instances
+     */
+    static ThreadPool& shared();
+};
+
+} // namespace ofx
+
+#endif // _ofxThreadPool_h_
@@ -0,0 +1,134 @@
+#include "ofxToneCurve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace ofx {
+
+namespace {
+
+bool lessX(const CurvePoint& a, const CurvePoint& b) {
+    return a.x < b.x;
+}
+
+bool sameX(const CurvePoint& a, const CurvePoint& b) {
+    return a.x == b.x;
+}
+
+} // namespace
+
+std::vector<CurvePoint> parseCurvePoints(const char* text) {
+    std::vector<double> values;
+    const char* p = text ? text : "";
+    while (*p) {
+        char* end = nullptr;
+        double value = strtod(p, &end);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        values.push_back(value);
+        p = end;
+    }
+
+    std::vector<CurvePoint> points;
+    for (size_t i = 0; i + 1 < values.size(); i += 2) {
+        CurvePoint point = { values[i], values[i + 1] };
+        points.push_back(point);
+    }
+
+    std::stable_sort(points.begin(), points.end(), lessX);
+    points.erase(std::unique(points.begin(), points.end(), sameX), points.end());
+    return points;
+}
+
+bool isIdentityCurve(const std::vector<CurvePoint>& points) {
+    if (points.size() < 2) {
+        return points.empty();
+    }
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i].x != points[i].y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MonotoneSpline::MonotoneSpline(const std::vector<CurvePoint>& controlPoints)
+    : points(controlPoints)
+{
+    size_t n = points.size();
+    tangents.assign(n, 0.0);
+    if (n < 2) {
+        return;
+    }
+
+    std::vector<double> secants(n - 1);
+    for (size_t k = 0; k + 1 < n; k++) {
+        secants[k] = (points[k + 1].y - points[k].y) / (points[k + 1].x - points[k].x);
+    }
+
+    tangents[0] = secants[0];
+    tangents[n - 1] = secants[n - 2];
+    for (size_t k = 1; k + 1 < n; k++) {
+        tangents[k] = (secants[k - 1] * secants[k] <= 0.0) ? 0.0 : 0.5 * (secants[k - 1] + secants[k]);
+    }
+
+    // Limit the tangents so each segment stays monotone
+    for (size_t k = 0; k + 1 < n; k++) {
+        if (secants[k] == 0.0) {
+            tangents[k] = 0.0;
+            tangents[k + 1] = 0.0;
+            continue;
+        }
+        double a = tangents[k] / secants[k];
+        double b = tangents[k + 1] / secants[k];
+        double length = a * a + b * b;
+        if (length > 9.0) {
+            double t = 3.0 / std::sqrt(length);
+            tangents[k] = t * a * secants[k];
+            tangents[k + 1] = t * b * secants[k];
+        }
+    }
+}
+
+double MonotoneSpline::evaluate(double x) const {
+    if (points.empty()) {
+        return x;
+    }
+    if (points.size() == 1 || x <= points.front().x) {
+        return points.front().y;
+    }
+    if (x >= points.back().x) {
+        return points.back().y;
+    }
+
+    CurvePoint key = { x, 0.0 };
+    size_t k = (size_t)(std::upper_bound(points.begin(), points.end(), key, lessX) - points.begin()) - 1;
+
+    double h = points[k + 1].x - points[k].x;
+    double t = (x - points[k].x) / h;
+    double t2 = t * t;
+    double t3 = t2 * t;
+
+    // Cubic Hermite basis
+    double h00 = 2.0 * t3 - 3.0 * t2 + 1.0;
+    double h10 = t3 - 2.0 * t2 + t;
+    double h01 = -2.0 * t3 + 3.0 * t2;
+    double h11 = t3 - t2;
+
+    return h00 * points[k].y + h10 * h * tangents[k] + h01 * points[k + 1].y + h11 * h * tangents[k + 1];
+}
+
+std::shared_ptr<const std::vector<float> > bakeToneCurve(const std::vector<CurvePoint>& points, int samples) {
+    MonotoneSpline spline(points);
+    std::shared_ptr<std::vector<float> > table = std::make_shared<std::vector<float> >(std::max(samples, 2));
+    double last = (double)(table->size() - 1);
+    for (size_t i = 0; i < table->size(); i++) {
+        (*table)[i] = (float)spline.evaluate((double)i / last);
+    }
+    return table;
+}
+
+} // namespace ofx
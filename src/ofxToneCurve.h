@@ -0,0 +1,69 @@
+#ifndef _ofxToneCurve_h_
+#define _ofxToneCurve_h_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @file ofxToneCurve.h
+ * @brief Tone curves: control point parsing, monotone cubic spline, LUT baking
+ */
+
+namespace ofx {
+
+/**
+ * @brief Curve control point
+ */
+struct CurvePoint {
+    double x, y;
+};
+
+/**
+ * @brief Parse control points serialized as "x0 y0 x1 y1 ..."
+ *
+ * Commas, semicolons and whitespace all separate values. A trailing odd value
+ * is ignored. Points are returned sorted by x with duplicate x removed.
+ */
+std::vector<CurvePoint> parseCurvePoints(const char* text);
+
+/**
+ * @brief True if the points describe y = x (or there are none)
+ */
+bool isIdentityCurve(const std::vector<CurvePoint>& points);
+
+/**
+ * @brief Monotone cubic Hermite spline (Fritsch-Carlson)
+ *
+ * Preserves monotonicity between control points, so a curve built from
+ * increasing points never overshoots or inverts. Outside the control point
+ * range the end values are held.
+ */
+class MonotoneSpline {
+private:
+    std::vector<CurvePoint> points;
+    std::vector<double> tangents;
+
+public:
+    explicit MonotoneSpline(const std::vector<CurvePoint>& controlPoints);
+
+    double evaluate(double x) const;
+};
+
+/**
+ * @brief Number of samples a tone curve is baked into
+ */
+const int kToneCurveSamples = 4096;
+
+/**
+ * @brief Bake a spline through the points into samples over [0, 1]
+ *
+ * The result plugs straight into CurveFunction::lookup, where it is
+ * linearly interpolated.
+ */
+std::shared_ptr<const std::vector<float> > bakeToneCurve(const std::vector<CurvePoint>& points,
+                                                         int samples = kToneCurveSamples);
+
+} // namespace ofx
+
+#endif // _ofxToneCurve_h_
@@ -1,5 +1,15 @@
 #include "ofxUtilities.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+
+#ifdef OFX_ENABLE_PROFILING
+#include <cstdio>
+#include <sstream>
+#endif
+
 namespace ofx {
 
 // Global suite pointers - initialized in setHost
@@ -8,4 +18,525 @@ OfxPropertySuiteV1 *gPropertySuite = nullptr;
 OfxImageEffectSuiteV1 *gImageEffectSuite = nullptr;
 OfxParameterSuiteV1 *gParameterSuite = nullptr;
 
+namespace {
+
+/**
+ * @brief Maps a fixed set of strings to their index in a name table
+ *
+ * Index 0 is reserved for unknown strings. The hash seed is searched at
+ * construction so that every name lands in its own slot, which makes the
+ * string path a hash plus one verifying strcmp.
+ */
+template<int N>
+class StringInterner {
+private:
+    static const int kSlots = 128;
+
+    const char* const* names;
+    uint32_t seed;
+    unsigned char table[kSlots];
+
+    // Last host pointer seen for each name, and a pointer-hashed index into it
+    std::atomic<const char*> lastPointer[N];
+    std::atomic<int> pointerSlots[kSlots];
+
+    static uint32_t hash(const char* s, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for (; *s; s++) {
+            h = (h ^ (unsigned char)*s) * 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    static int pointerSlot(const char* s) {
+        return (int)(((uintptr_t)s >> 3) & (kSlots - 1));
+    }
+
+public:
+    explicit StringInterner(const char* const* nameTable) : names(nameTable), seed(0) {
+        for (int i = 0; i < N; i++) {
+            lastPointer[i].store(nullptr);
+        }
+        for (int i = 0; i < kSlots; i++) {
+            pointerSlots[i].store(0);
+        }
+
+        for (;; seed++) {
+            memset(table, 0, sizeof(table));
+            bool collision = false;
+            for (int i = 1; i < N && !collision; i++) {
+                unsigned char& slot = table[hash(names[i], seed) & (kSlots - 1)];
+                collision = slot != 0;
+                slot = (unsigned char)i;
+            }
+            if (!collision) {
+                break;
+            }
+        }
+    }
+
+    int lookup(const char* s) {
+        if (!s) {
+            return 0;
+        }
+
+        // Host string constants: pointer equality skips the hash. The strcmp stays, as a string held
+        // in a property set can be freed and its address reused for a different name
+        int slot = pointerSlot(s);
+        int index = pointerSlots[slot].load(std::memory_order_relaxed);
+        if (index && lastPointer[index].load(std::memory_order_acquire) == s && strcmp(s, names[index]) == 0) {
+            return index;
+        }
+
+        index = table[hash(s, seed) & (kSlots - 1)];
+        if (!index || strcmp(s, names[index]) != 0) {
+            return 0;
+        }
+
+        lastPointer[index].store(s, std::memory_order_release);
+        pointerSlots[slot].store(index, std::memory_order_relaxed);
+        return index;
+    }
+};
+
+// Indexed by Action
+const char* const kActionNames[kActionCount] = {
+    nullptr,
+    kOfxActionLoad,
+    kOfxActionUnload,
+    kOfxActionDescribe,
+    kOfxActionDescribeInContext,
+    kOfxActionCreateInstance,
+    kOfxActionDestroyInstance,
+    kOfxImageEffectActionRender,
+    kOfxImageEffectActionGetRegionOfDefinition,
+    kOfxImageEffectActionGetRegionsOfInterest,
+    kOfxImageEffectActionGetFramesNeeded,
+    kOfxImageEffectActionGetClipPreferences,
+    kOfxImageEffectActionIsIdentity,
+    kOfxImageEffectActionGetTimeDomain,
+    kOfxImageEffectActionBeginSequenceRender,
+    kOfxImageEffectActionEndSequenceRender,
+    kOfxActionBeginInstanceChanged,
+    kOfxActionInstanceChanged,
+    kOfxActionEndInstanceChanged,
+    kOfxActionPurgeCaches,
+    kOfxActionSyncPrivateData,
+    kOfxActionBeginInstanceEdit,
+    kOfxActionEndInstanceEdit
+};
+
+const char* const kBitDepthNames[] = {
+    nullptr,
+    kOfxBitDepthByte,
+    kOfxBitDepthShort,
+    kOfxBitDepthFloat,
+    kOfxBitDepthNone
+};
+
+const BitDepth kBitDepthValues[] = {
+    kBitDepthNone,
+    kBitDepthByte,
+    kBitDepthShort,
+    kBitDepthFloat,
+    kBitDepthNone
+};
+
+} // namespace
+
+Action internAction(const char* action) {
+    static StringInterner<kActionCount> interner(kActionNames);
+    return (Action)interner.lookup(action);
+}
+
+BitDepth internBitDepth(const char* depth) {
+    static StringInterner<5> interner(kBitDepthNames);
+    return kBitDepthValues[interner.lookup(depth)];
+}
+
+namespace {
+
+// Values per sample of a numeric parameter type, 0 for the rest; integer is set for int-valued types
+int paramDimension(const char* type, bool& integer) {
+    integer = false;
+    if (!type) {
+        return 0;
+    }
+    if (strcmp(type, kOfxParamTypeInteger) == 0 || strcmp(type, kOfxParamTypeBoolean) == 0
+        || strcmp(type, kOfxParamTypeChoice) == 0) {
+        integer = true;
+        return 1;
+    }
+    if (strcmp(type, kOfxParamTypeDouble) == 0) {
+        return 1;
+    }
+    if (strcmp(type, kOfxParamTypeDouble2D) == 0) {
+        return 2;
+    }
+    if (strcmp(type, kOfxParamTypeDouble3D) == 0 || strcmp(type, kOfxParamTypeRGB) == 0) {
+        return 3;
+    }
+    return 0;
+}
+
+void readParam(Param& param, double time, bool integer, int dimension, double* out) {
+    if (integer) {
+        int value = 0;
+        param.getValueAtTime(time, value);
+        out[0] = value;
+    } else if (dimension == 1) {
+        param.getValueAtTime(time, out[0]);
+    } else if (dimension == 2) {
+        param.getValueAtTime(time, out[0], out[1]);
+    } else {
+        param.getValueAtTime(time, out[0], out[1], out[2]);
+    }
+}
+
+} // namespace
+
+ParamSampler::ParamSampler()
+    : firstFrame(0.0), frameCount(0)
+{
+}
+
+ParamSampler::ParamSampler(OfxParamSetHandle paramSet, const char* const* names, int count,
+                           double firstFrame, double lastFrame)
+    : firstFrame(firstFrame), frameCount(std::max((int)std::floor(lastFrame - firstFrame) + 1, 0))
+{
+    for (int i = 0; i < count; i++) {
+        OfxParamHandle handle = nullptr;
+        OfxPropertySetHandle props = nullptr;
+        if (gParameterSuite->paramGetHandle(paramSet, names[i], &handle, &props) != kOfxStatOK || !handle) {
+            continue;
+        }
+        const char* type = PropertySet(props).getString(kOfxParamPropType);
+        bool integer = false;
+        int dimension = paramDimension(type, integer);
+        bool text = type && (strcmp(type, kOfxParamTypeString) == 0 || strcmp(type, kOfxParamTypeCustom) == 0);
+        if (dimension == 0 && !text) {
+            continue;
+        }
+
+        unsigned int keys = 0;
+        gParameterSuite->paramGetNumKeys(handle, &keys);
+        Entry entry;
+        entry.name = names[i];
+        entry.dimension = dimension;
+        entry.animated = keys > 0 && frameCount > 0;
+
+        Param param(handle);
+        if (text) {
+            // Strings are kept only while constant; animated custom values are interpolated by the plugin
+            if (keys > 0) {
+                continue;
+            }
+            char* value = nullptr;
+            param.getValue(&value);
+            entry.text = value ? value : "";
+            entries.push_back(entry);
+            continue;
+        }
+        int samples = entry.animated ? frameCount : 1;
+        entry.values.resize((size_t)samples * dimension);
+        for (int frame = 0; frame < samples; frame++) {
+            readParam(param, firstFrame + frame, integer, dimension, &entry.values[(size_t)frame * dimension]);
+        }
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+}
+
+bool ParamSampler::lookup(const char* name, double time, double* values, int count) const {
+    std::vector<Entry>::const_iterator it = std::lower_bound(entries.begin(), entries.end(), name,
+        [](const Entry& entry, const char* key) { return strcmp(entry.name.c_str(), key) < 0; });
+    if (it == entries.end() || it->name != name || count == 0 || count != it->dimension) {
+        return false;
+    }
+
+    size_t offset = 0;
+    if (it->animated) {
+        double position = time - firstFrame;
+        double frame = std::floor(position + 0.5);
+        if (std::fabs(position - frame) > 1e-6 || frame < 0.0 || frame >= frameCount) {
+            return false;
+        }
+        offset = (size_t)frame * it->dimension;
+    }
+    std::copy(it->values.begin() + offset, it->values.begin() + offset + count, values);
+    return true;
+}
+
+const char* ParamSampler::lookupText(const char* name) const {
+    std::vector<Entry>::const_iterator it = std::lower_bound(entries.begin(), entries.end(), name,
+        [](const Entry& entry, const char* key) { return strcmp(entry.name.c_str(), key) < 0; });
+    if (it == entries.end() || it->name != name || it->dimension != 0) {
+        return nullptr;
+    }
+    return it->text.c_str();
+}
+
+int ParamSampler::animatedCount() const {
+    int count = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        count += entries[i].animated ? 1 : 0;
+    }
+    return count;
+}
+
+OfxParamHandle ParamReader::handle(const char* name) const {
+    OfxParamHandle param = nullptr;
+    gParameterSuite->paramGetHandle(params, name, &param, nullptr);
+    return param;
+}
+
+void ParamReader::get(const char* name, int& value) const {
+    double sample = 0.0;
+    if (samples && samples->lookup(name, readTime, &sample, 1)) {
+        value = (int)sample;
+        return;
+    }
+    Param(handle(name)).getValueAtTime(readTime, value);
+}
+
+void ParamReader::get(const char* name, double& value) const {
+    if (samples && samples->lookup(name, readTime, &value, 1)) {
+        return;
+    }
+    Param(handle(name)).getValueAtTime(readTime, value);
+}
+
+void ParamReader::get(const char* name, double& x, double& y) const {
+    double sample[2];
+    if (samples && samples->lookup(name, readTime, sample, 2)) {
+        x = sample[0];
+        y = sample[1];
+        return;
+    }
+    Param(handle(name)).getValueAtTime(readTime, x, y);
+}
+
+void ParamReader::get(const char* name, double& r, double& g, double& b) const {
+    double sample[3];
+    if (samples && samples->lookup(name, readTime, sample, 3)) {
+        r = sample[0];
+        g = sample[1];
+        b = sample[2];
+        return;
+    }
+    Param(handle(name)).getValueAtTime(readTime, r, g, b);
+}
+
+void ParamReader::get(const char* name, char** value) const {
+    // Like the host's, the string stays valid while its owner, here the sampler, does
+    const char* text = samples ? samples->lookupText(name) : nullptr;
+    if (text) {
+        *value = const_cast<char*>(text);
+        return;
+    }
+    Param(handle(name)).getValue(value);
+}
+
+uint64_t ParamReader::hash(const char* const* names, int count, uint64_t seed) const {
+    uint64_t h = seed;
+    const auto add = [&h](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    for (int i = 0; i < count; i++) {
+        // The terminator keeps one name's end from running into the next value
+        add(names[i], strlen(names[i]) + 1);
+        OfxParamHandle param = nullptr;
+        OfxPropertySetHandle props = nullptr;
+        if (gParameterSuite->paramGetHandle(params, names[i], &param, &props) != kOfxStatOK || !param) {
+            continue;
+        }
+        const char* type = PropertySet(props).getString(kOfxParamPropType);
+        bool integer = false;
+        int dimension = paramDimension(type, integer);
+        if (dimension > 0) {
+            double values[3];
+            if (!samples || !samples->lookup(names[i], readTime, values, dimension)) {
+                Param p(param);
+                readParam(p, readTime, integer, dimension, values);
+            }
+            for (int c = 0; c < dimension; c++) {
+                values[c] += 0.0;
+            }
+            add(values, sizeof(double) * dimension);
+        } else if (type && (strcmp(type, kOfxParamTypeString) == 0 || strcmp(type, kOfxParamTypeCustom) == 0)) {
+            char* text = nullptr;
+            get(names[i], &text);
+            add(text ? text : "", text ? strlen(text) + 1 : 1);
+        }
+    }
+    return h;
+}
+
+#ifdef OFX_ENABLE_PROFILING
+
+namespace profiler {
+
+namespace {
+
+// Render windows are bucketed by floor(log2(pixel count))
+const int kWindowBuckets = 32;
+
+const char* const kProbeNames[kProbeCount - kActionCount] = {
+    "clipGetImage",
+    "clipReleaseImage",
+    "paramGetValue",
+    "kernel.compile",
+    "kernel.render",
+    "kernel.reference",
+    "kernel.blur",
+    "kernel.detail",
+    "kernel.temporal",
+    "cache.load",
+    "cache.store"
+};
+
+/**
+ * @brief Counters owned by one thread
+ *
+ * Only the owning thread writes, with relaxed load/store pairs rather than
+ * read-modify-write, so recording is a couple of plain memory operations.
+ */
+struct ThreadCounters {
+    std::atomic<uint64_t> calls[kProbeCount];
+    std::atomic<uint64_t> nanoseconds[kProbeCount];
+    std::atomic<uint64_t> maxNanoseconds[kProbeCount];
+    std::atomic<uint64_t> windows[kWindowBuckets];
+    ThreadCounters* next;
+
+    ThreadCounters() : next(nullptr) {
+        for (int i = 0; i < kProbeCount; i++) {
+            calls[i].store(0, std::memory_order_relaxed);
+            nanoseconds[i].store(0, std::memory_order_relaxed);
+            maxNanoseconds[i].store(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < kWindowBuckets; i++) {
+            windows[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+std::atomic<ThreadCounters*> gCounterList(nullptr);
+
+void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Blocks outlive their threads so reports still see them; they are never freed
+ThreadCounters& threadCounters() {
+    static thread_local ThreadCounters* counters = nullptr;
+    if (!counters) {
+        counters = new ThreadCounters();
+        ThreadCounters* head = gCounterList.load(std::memory_order_relaxed);
+        do {
+            counters->next = head;
+        } while (!gCounterList.compare_exchange_weak(head, counters, std::memory_order_release,
+                                                     std::memory_order_relaxed));
+    }
+    return *counters;
+}
+
+const char* probeName(int probe) {
+    if (probe < kActionCount) {
+        static const char* const kActionLabels[kActionCount] = {
+            "action.unknown", "action.load", "action.unload", "action.describe",
+            "action.describeInContext", "action.createInstance", "action.destroyInstance",
+            "action.render", "action.getRegionOfDefinition", "action.getRegionsOfInterest",
+            "action.getFramesNeeded", "action.getClipPreferences", "action.isIdentity",
+            "action.getTimeDomain", "action.beginSequenceRender", "action.endSequenceRender",
+            "action.beginInstanceChanged", "action.instanceChanged", "action.endInstanceChanged",
+            "action.purgeCaches", "action.syncPrivateData", "action.beginInstanceEdit",
+            "action.endInstanceEdit"
+        };
+        return kActionLabels[probe];
+    }
+    return kProbeNames[probe - kActionCount];
+}
+
+} // namespace
+
+void record(ProfileProbe probe, uint64_t nanoseconds) {
+    ThreadCounters& counters = threadCounters();
+    add(counters.calls[probe], 1);
+    add(counters.nanoseconds[probe], nanoseconds);
+    if (nanoseconds > counters.maxNanoseconds[probe].load(std::memory_order_relaxed)) {
+        counters.maxNanoseconds[probe].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void recordRenderWindow(int width, int height) {
+    uint64_t pixels = (uint64_t)std::max(width, 0) * (uint64_t)std::max(height, 0);
+    int bucket = 0;
+    while (pixels > 1 && bucket < kWindowBuckets - 1) {
+        pixels >>= 1;
+        bucket++;
+    }
+    add(threadCounters().windows[bucket], 1);
+}
+
+std::string report() {
+    uint64_t calls[kProbeCount] = { 0 };
+    uint64_t nanoseconds[kProbeCount] = { 0 };
+    uint64_t maxNanoseconds[kProbeCount] = { 0 };
+    uint64_t windows[kWindowBuckets] = { 0 };
+    int threads = 0;
+
+    for (ThreadCounters* counters = gCounterList.load(std::memory_order_acquire); counters; counters = counters->next) {
+        threads++;
+        for (int i = 0; i < kProbeCount; i++) {
+            calls[i] += counters->calls[i].load(std::memory_order_relaxed);
+            nanoseconds[i] += counters->nanoseconds[i].load(std::memory_order_relaxed);
+            maxNanoseconds[i] = std::max(maxNanoseconds[i], counters->maxNanoseconds[i].load(std::memory_order_relaxed));
+        }
+        for (int i = 0; i < kWindowBuckets; i++) {
+            windows[i] += counters->windows[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    std::ostringstream out;
+    out << "# ofx profile, " << threads << " threads\n";
+    out << "# probe calls total_ms mean_us max_us\n";
+    for (int i = 0; i < kProbeCount; i++) {
+        if (!calls[i]) {
+            continue;
+        }
+        out << probeName(i) << ' ' << calls[i] << ' '
+            << (double)nanoseconds[i] * 1e-6 << ' '
+            << (double)nanoseconds[i] * 1e-3 / (double)calls[i] << ' '
+            << (double)maxNanoseconds[i] * 1e-3 << '\n';
+    }
+    out << "# render window pixels (>= 2^bucket) count\n";
+    for (int i = 0; i < kWindowBuckets; i++) {
+        if (windows[i]) {
+            out << "window.2^" << i << ' ' << windows[i] << '\n';
+        }
+    }
+    return out.str();
+}
+
+void dump() {
+    const char* path = getenv("OFX_PROFILE_LOG");
+    if (!path || !*path) {
+        return;
+    }
+    FILE* file = fopen(path, "a");
+    if (!file) {
+        return;
+    }
+    std::string text = report();
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+}
+
+} // namespace profiler
+
+#endif // OFX_ENABLE_PROFILING
+
 } // namespace ofx
@@ -7,8 +7,12 @@
 #include "ofxParam.h"
 
 #include <string>
+#include <vector>
 #include <cstring>
 #include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 
 /**
  * @file ofxUtilities.h
@@ -34,6 +38,215 @@ inline void initializeSuites(OfxHost *host) {
     gParameterSuite = (OfxParameterSuiteV1*)host->fetchSuite(host->host, kOfxParameterSuite, 1);
 }
 
+/**
+ * @brief Interned OFX action strings
+ */
+enum Action {
+    kActionUnknown = 0,
+    kActionLoad,
+    kActionUnload,
+    kActionDescribe,
+    kActionDescribeInContext,
+    kActionCreateInstance,
+    kActionDestroyInstance,
+    kActionRender,
+    kActionGetRegionOfDefinition,
+    kActionGetRegionsOfInterest,
+    kActionGetFramesNeeded,
+    kActionGetClipPreferences,
+    kActionIsIdentity,
+    kActionGetTimeDomain,
+    kActionBeginSequenceRender,
+    kActionEndSequenceRender,
+    kActionBeginInstanceChanged,
+    kActionInstanceChanged,
+    kActionEndInstanceChanged,
+    kActionPurgeCaches,
+    kActionSyncPrivateData,
+    kActionBeginInstanceEdit,
+    kActionEndInstanceEdit,
+    kActionCount
+};
+
+/**
+ * @brief Interned pixel depth strings; the value is the bytes per component
+ */
+enum BitDepth {
+    kBitDepthNone = 0,
+    kBitDepthByte = 1,
+    kBitDepthShort = 2,
+    kBitDepthFloat = 4
+};
+
+/**
+ * @brief Resolve an action string to its enum
+ *
+ * Hosts pass their own string constants, so the pointer seen last for each
+ * action is remembered and checked first, skipping the hash. Other pointers
+ * fall back to a perfect hash of the string. Either way one strcmp verifies
+ * the match, since a pointer may be reused for a different string.
+ */
+Action internAction(const char* action);
+
+/**
+ * @brief Resolve a kOfxBitDepth* string, with the same fast paths as internAction
+ */
+BitDepth internBitDepth(const char* depth);
+
+/**
+ * @brief Instrumentation probes: one per action, then host calls and kernel stages
+ */
+enum ProfileProbe {
+    kProbeActionFirst = 0,
+    kProbeClipGetImage = kProbeActionFirst + kActionCount,
+    kProbeClipReleaseImage,
+    kProbeParamGetValue,
+    kProbeKernelCompile,
+    kProbeKernelRender,
+    kProbeKernelReference,
+    kProbeKernelBlur,
+    kProbeKernelDetail,
+    kProbeKernelTemporal,
+    kProbeCacheLoad,
+    kProbeCacheStore,
+    kProbeCount
+};
+
+#ifdef OFX_ENABLE_PROFILING
+
+/**
+ * @brief Low overhead timing statistics, built only with OFX_ENABLE_PROFILING
+ *
+ * Every thread accumulates into its own counter block, registered once in a
+ * lock-free list, so recording never contends. Reports merge the blocks.
+ */
+namespace profiler {
+
+void record(ProfileProbe probe, uint64_t nanoseconds);
+void recordRenderWindow(int width, int height);
+
+/**
+ * @brief Merged per-probe counts, times and the render window size histogram
+ */
+std::string report();
+
+/**
+ * @brief Append report() to the file named by the OFX_PROFILE_LOG environment variable
+ */
+void dump();
+
+/**
+ * @brief Times the enclosing scope into a probe
+ */
+class ScopedTimer {
+private:
+    ProfileProbe probe;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(ProfileProbe p) : probe(p), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        record(probe, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+} // namespace profiler
+
+#define OFX_PROFILE_CONCAT2(a, b) a##b
+#define OFX_PROFILE_CONCAT(a, b) OFX_PROFILE_CONCAT2(a, b)
+#define OFX_PROFILE_SCOPE(probe) ofx::profiler::ScopedTimer OFX_PROFILE_CONCAT(ofxProfileTimer, __LINE__)(probe)
+#define OFX_PROFILE_RENDER_WINDOW(width, height) ofx::profiler::recordRenderWindow(width, height)
+#define OFX_PROFILE_DUMP() ofx::profiler::dump()
+
+#else
+
+#define OFX_PROFILE_SCOPE(probe) ((void)0)
+#define OFX_PROFILE_RENDER_WINDOW(width, height) ((void)0)
+#define OFX_PROFILE_DUMP() ((void)0)
+
+#endif // OFX_ENABLE_PROFILING
+
+/**
+ * @brief Handler signature used by ActionDispatcher
+ */
+typedef OfxStatus (*ActionHandler)(OfxImageEffectHandle effect,
+                                   OfxPropertySetHandle inArgs,
+                                   OfxPropertySetHandle outArgs);
+
+/**
+ * @brief Table driven replacement for a strcmp chain in mainEntry
+ *
+ * Each action either has a handler or a fixed reply status; actions that
+ * were never registered reply kOfxStatReplyDefault.
+ */
+class ActionDispatcher {
+private:
+    ActionHandler handlers[kActionCount];
+    OfxStatus replies[kActionCount];
+
+public:
+    ActionDispatcher() {
+        for (int i = 0; i < kActionCount; i++) {
+            handlers[i] = nullptr;
+            replies[i] = kOfxStatReplyDefault;
+        }
+    }
+
+    void setHandler(Action action, ActionHandler handler) {
+        handlers[action] = handler;
+    }
+
+    void setReply(Action action, OfxStatus status) {
+        handlers[action] = nullptr;
+        replies[action] = status;
+    }
+
+    OfxStatus dispatch(const char* action, const void* handle,
+                       OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs) const {
+        Action id = internAction(action);
+        OfxStatus status;
+        {
+            OFX_PROFILE_SCOPE((ProfileProbe)(kProbeActionFirst + id));
+            status = handlers[id] ? handlers[id]((OfxImageEffectHandle)handle, inArgs, outArgs) : replies[id];
+        }
+        if (id == kActionUnload) {
+            OFX_PROFILE_DUMP();
+        }
+        return status;
+    }
+};
+
+/**
+ * @brief Name, value type and dimension of a property, known at compile time
+ *
+ * PropertySet::get() with a descriptor reads every dimension in one N-variant
+ * suite call, and a value of the wrong type or count fails to compile.
+ */
+template<typename T, int N>
+struct PropertyDescriptor {
+    const char* name;
+};
+
+/**
+ * @brief Descriptors of the properties read on the render path
+ */
+namespace prop {
+
+constexpr PropertyDescriptor<double, 1> kTime = { kOfxPropTime };
+constexpr PropertyDescriptor<double, 2> kRenderScale = { kOfxImageEffectPropRenderScale };
+constexpr PropertyDescriptor<double, 2> kFrameRange = { kOfxImageEffectPropFrameRange };
+constexpr PropertyDescriptor<double, 4> kRegionOfInterest = { kOfxImageEffectPropRegionOfInterest };
+constexpr PropertyDescriptor<int, 4> kRenderWindow = { kOfxImageEffectPropRenderWindow };
+constexpr PropertyDescriptor<int, 4> kImageBounds = { kOfxImagePropBounds };
+constexpr PropertyDescriptor<int, 4> kImageRegionOfDefinition = { kOfxImagePropRegionOfDefinition };
+constexpr PropertyDescriptor<int, 1> kImageRowBytes = { kOfxImagePropRowBytes };
+constexpr PropertyDescriptor<void*, 1> kImageData = { kOfxImagePropData };
+constexpr PropertyDescriptor<const char*, 1> kPixelDepth = { kOfxImageEffectPropPixelDepth };
+constexpr PropertyDescriptor<const char*, 1> kImageUniqueIdentifier = { kOfxImagePropUniqueIdentifier };
+
+} // namespace prop
+
 /**
  * @brief Property helper class for easier property manipulation
  */
@@ -69,6 +282,39 @@ public:
         return value;
     }
 
+    // Multi-value getters, one host call for all the values; values are left as they are if the property is missing
+    void getIntN(const char* name, int count, int* values) {
+        gPropertySuite->propGetIntN(propHandle, name, count, values);
+    }
+
+    void getDoubleN(const char* name, int count, double* values) {
+        gPropertySuite->propGetDoubleN(propHandle, name, count, values);
+    }
+
+    OfxRectI getRect(const char* name) {
+        OfxRectI rect = { 0, 0, 0, 0 };
+        getIntN(name, 4, &rect.x1);
+        return rect;
+    }
+
+    // Getters by descriptor
+    int get(const PropertyDescriptor<int, 1>& property) { return getInt(property.name); }
+    double get(const PropertyDescriptor<double, 1>& property) { return getDouble(property.name); }
+    const char* get(const PropertyDescriptor<const char*, 1>& property) { return getString(property.name); }
+    void* get(const PropertyDescriptor<void*, 1>& property) { return getPointer(property.name); }
+
+    template<int N>
+    void get(const PropertyDescriptor<int, N>& property, int (&values)[N]) {
+        getIntN(property.name, N, values);
+    }
+
+    template<int N>
+    void get(const PropertyDescriptor<double, N>& property, double (&values)[N]) {
+        getDoubleN(property.name, N, values);
+    }
+
+    OfxRectI getRect(const PropertyDescriptor<int, 4>& property) { return getRect(property.name); }
+
     // Setters
     void setInt(const char* name, int value, int index = 0) {
         gPropertySuite->propSetInt(propHandle, name, index, value);
@@ -118,26 +364,16 @@ public:
         PropertySet props(imageHandle);
 
         // Get pixel data pointer
-        pixelData = props.getPointer(kOfxImagePropData);
+        pixelData = props.get(prop::kImageData);
 
         // Get bounds
-        bounds.x1 = props.getInt(kOfxImagePropBounds, 0);
-        bounds.y1 = props.getInt(kOfxImagePropBounds, 1);
-        bounds.x2 = props.getInt(kOfxImagePropBounds, 2);
-        bounds.y2 = props.getInt(kOfxImagePropBounds, 3);
+        bounds = props.getRect(prop::kImageBounds);
 
         // Get row bytes
-        rowBytes = props.getInt(kOfxImagePropRowBytes);
+        rowBytes = props.get(prop::kImageRowBytes);
 
         // Determine pixel depth
-        const char* bitDepth = props.getString(kOfxImageEffectPropPixelDepth);
-        if (strcmp(bitDepth, kOfxBitDepthByte) == 0) {
-            pixelDepth = 1;
-        } else if (strcmp(bitDepth, kOfxBitDepthShort) == 0) {
-            pixelDepth = 2;
-        } else if (strcmp(bitDepth, kOfxBitDepthFloat) == 0) {
-            pixelDepth = 4;
-        }
+        pixelDepth = internBitDepth(props.get(prop::kPixelDepth));
     }
 
     void* data() const { return pixelData; }
@@ -168,45 +404,207 @@ public:
 
     // Get values
     void getValue(int& value) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValue(paramHandle, &value);
     }
 
     void getValue(double& value) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValue(paramHandle, &value);
     }
 
+    void getValue(double& x, double& y) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
+        gParameterSuite->paramGetValue(paramHandle, &x, &y);
+    }
+
     void getValue(double& r, double& g, double& b) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValue(paramHandle, &r, &g, &b);
     }
 
     void getValue(double& r, double& g, double& b, double& a) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValue(paramHandle, &r, &g, &b, &a);
     }
 
     void getValue(char** value) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValue(paramHandle, value);
     }
 
     // Get values at time
     void getValueAtTime(double time, double& value) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValueAtTime(paramHandle, time, &value);
     }
 
     void getValueAtTime(double time, int& value) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValueAtTime(paramHandle, time, &value);
     }
 
+    void getValueAtTime(double time, double& x, double& y) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
+        gParameterSuite->paramGetValueAtTime(paramHandle, time, &x, &y);
+    }
+
     void getValueAtTime(double time, double& r, double& g, double& b) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValueAtTime(paramHandle, time, &r, &g, &b);
     }
 
     void getValueAtTime(double time, double& r, double& g, double& b, double& a) {
+        OFX_PROFILE_SCOPE(kProbeParamGetValue);
         gParameterSuite->paramGetValueAtTime(paramHandle, time, &r, &g, &b, &a);
     }
 
+    // Set keyframes
+    void setValueAtTime(double time, double value) {
+        gParameterSuite->paramSetValueAtTime(paramHandle, time, value);
+    }
+
+    void setValueAtTime(double time, double r, double g, double b) {
+        gParameterSuite->paramSetValueAtTime(paramHandle, time, r, g, b);
+    }
+
     OfxParamHandle handle() const { return paramHandle; }
 };
 
+/**
+ * @brief Numeric parameter values over a frame range, read from the host in one pass
+ *
+ * Built when a sequence render starts. A parameter without keyframes is read
+ * once; an animated one at every frame of the range. A lookup is then a
+ * binary search of the names and an array read. Integer, boolean and choice
+ * values are stored as doubles, which hold them exactly. String and custom
+ * parameters are kept only when they have no keyframes.
+ */
+class ParamSampler {
+private:
+    struct Entry {
+        std::string name;
+        int dimension;                // 0 for a string
+        bool animated;
+        std::vector<double> values;   // dimension values, for each frame when animated
+        std::string text;
+    };
+
+    std::vector<Entry> entries;       // Sorted by name
+    double firstFrame;
+    int frameCount;
+
+public:
+    ParamSampler();
+
+    /**
+     * @param names Parameters to sample; unknown ones and those of other types are left to the host
+     */
+    ParamSampler(OfxParamSetHandle paramSet, const char* const* names, int count,
+                 double firstFrame, double lastFrame);
+
+    /**
+     * @brief Values of a parameter at time
+     * @return false if the parameter was not sampled or, when animated, time is not a frame of the range
+     */
+    bool lookup(const char* name, double time, double* values, int count) const;
+
+    /**
+     * @brief Value of a constant string or custom parameter, or null if it was not sampled
+     */
+    const char* lookupText(const char* name) const;
+
+    /**
+     * @brief Number of parameters with keyframes, sampled per frame
+     */
+    int animatedCount() const;
+};
+
+/**
+ * @brief Parameter reads at one time, from a ParamSampler where it has them and the host otherwise
+ */
+class ParamReader {
+private:
+    OfxParamSetHandle params;
+    double readTime;
+    const ParamSampler* samples;
+
+    OfxParamHandle handle(const char* name) const;
+
+public:
+    /**
+     * @param samples Sampled values, or null to read everything from the host
+     */
+    ParamReader(OfxParamSetHandle paramSet, double time, const ParamSampler* samples = nullptr)
+        : params(paramSet), readTime(time), samples(samples) {}
+
+    OfxParamSetHandle paramSet() const { return params; }
+    double time() const { return readTime; }
+
+    void get(const char* name, int& value) const;
+    void get(const char* name, double& value) const;
+    void get(const char* name, double& x, double& y) const;
+    void get(const char* name, double& r, double& g, double& b) const;
+
+    /**
+     * @brief String and custom parameters; a sampled value lives as long as the sampler
+     */
+    void get(const char* name, char** value) const;
+
+    /**
+     * @brief FNV-1a hash of the named parameters' values, in the order given
+     *
+     * Numbers hash by value, with -0 as 0, and strings by content; names
+     * without a parameter still count. seed chains one call onto another.
+     */
+    uint64_t hash(const char* const* names, int count, uint64_t seed = 14695981039346656037ull) const;
+};
+
+/**
+ * @brief Rate-limited wrapper around the suite's abort callback
+ *
+ * Safe to poll from every band of a parallel render: the host is asked at
+ * most once per interval across all threads, and once it has reported an
+ * abort every later poll returns true without calling back.
+ */
+class AbortPoller {
+private:
+    OfxImageEffectHandle effect;
+    int64_t interval;
+    std::atomic<int64_t> nextPoll;
+    std::atomic<bool> aborted;
+
+    static int64_t now() {
+        return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    /**
+     * @param intervalMicroseconds Minimum time between host calls
+     */
+    explicit AbortPoller(OfxImageEffectHandle instance, int intervalMicroseconds = 1000)
+        : effect(instance), interval((int64_t)intervalMicroseconds * 1000), nextPoll(0), aborted(false) {}
+
+    bool poll() {
+        if (aborted.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        int64_t time = now();
+        int64_t next = nextPoll.load(std::memory_order_relaxed);
+        if (time < next || !nextPoll.compare_exchange_strong(next, time + interval, std::memory_order_relaxed)) {
+            return false;
+        }
+        if (gImageEffectSuite->abort(effect)) {
+            aborted.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    bool wasAborted() const { return aborted.load(std::memory_order_relaxed); }
+};
+
 } // namespace ofx
 
 #endif // _ofxUtilities_h_
@@ -0,0 +1,603 @@
+/*
+ * ofxBatch.cpp
+ *
+ * Grades a directory of frames through a plugin in the mock host, with a
+ * parameter set from a JSON file. Decoding runs ahead of the render and
+ * encoding behind it, each on its own thread, joined by bounded queues, so
+ * the plugin's pool keeps the cores busy while files are read and written.
+ * Raw frame sequences are read and written in place through memory maps.
+ */
+
+#include "ofxMockHost.h"
+#include "ofxImageIO.h"
+#include "ofxRawFrames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef OFX_BATCH_PLUGIN
+#define OFX_BATCH_PLUGIN ""
+#endif
+
+using namespace ofx;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double milliseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/**
+ * @brief FIFO between two threads; push blocks while it is full, pop while it is empty
+ *
+ * After close() push drops its item and pop drains what is left, then
+ * returns false.
+ */
+template<typename T>
+class BoundedQueue {
+private:
+    std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max(capacity, (size_t)1)), closed(false) {}
+
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+};
+
+/**
+ * @brief Frame buffers handed back after use, so steady state allocates nothing
+ */
+class BufferPool {
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<io::FrameBuffer> > spare;
+
+public:
+    std::unique_ptr<io::FrameBuffer> acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (spare.empty()) {
+            return std::unique_ptr<io::FrameBuffer>(new io::FrameBuffer());
+        }
+        std::unique_ptr<io::FrameBuffer> buffer = std::move(spare.back());
+        spare.pop_back();
+        return buffer;
+    }
+
+    void release(std::unique_ptr<io::FrameBuffer> buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(std::move(buffer));
+    }
+};
+
+/**
+ * @brief One frame on its way through the pipeline
+ *
+ * image is the frame's pixels: in frame, or in a raw sequence's mapping
+ * when frame is empty.
+ */
+struct Job {
+    int index;
+    mock::HostImage image;
+    std::unique_ptr<io::FrameBuffer> frame;
+    std::string error;
+};
+
+/**
+ * @brief Value from the parameter file: up to four numbers, or text
+ */
+struct ParamValue {
+    std::string name;
+    int count;              // Numbers given; 0 for text
+    double values[4];
+    std::string text;
+};
+
+/**
+ * @brief Reader for the parameter file's flat JSON object
+ *
+ * Each member is a parameter: a number, true or false, an array of up to
+ * four numbers, or a string for string and custom parameters.
+ */
+class ParamFileReader {
+private:
+    const char* p;
+    std::string error;
+
+    void skipSpace() {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            p++;
+        }
+    }
+
+    bool expect(char c) {
+        skipSpace();
+        if (*p != c) {
+            error = std::string("expected '") + c + "'";
+            return false;
+        }
+        p++;
+        return true;
+    }
+
+    bool readString(std::string& out) {
+        if (!expect('"')) {
+            return false;
+        }
+        out.clear();
+        for (; *p && *p != '"'; p++) {
+            if (*p == '\\') {
+                p++;
+                switch (*p) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case '"': case '\\': case '/': out += *p; break;
+                    default: error = "unsupported escape in string"; return false;
+                }
+            } else {
+                out += *p;
+            }
+        }
+        return expect('"');
+    }
+
+    bool readNumber(double& out) {
+        skipSpace();
+        if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+            out = *p == 't' ? 1.0 : 0.0;
+            p += *p == 't' ? 4 : 5;
+            return true;
+        }
+        char* end = nullptr;
+        out = strtod(p, &end);
+        if (end == p) {
+            error = "expected a number";
+            return false;
+        }
+        p = end;
+        return true;
+    }
+
+    bool readValue(ParamValue& value) {
+        skipSpace();
+        value.count = 0;
+        if (*p == '"') {
+            return readString(value.text);
+        }
+        if (*p != '[') {
+            value.count = 1;
+            return readNumber(value.values[0]);
+        }
+        p++;
+        skipSpace();
+        while (*p != ']') {
+            if (value.count == 4) {
+                error = "more than four values";
+                return false;
+            }
+            if (!readNumber(value.values[value.count++])) {
+                return false;
+            }
+            skipSpace();
+            if (*p == ',') {
+                p++;
+            } else if (*p != ']') {
+                error = "expected ',' or ']'";
+                return false;
+            }
+            skipSpace();
+        }
+        p++;
+        return value.count > 0 || (error = "empty array", false);
+    }
+
+public:
+    bool parse(const std::string& text, std::vector<ParamValue>& params, std::string& message) {
+        p = text.c_str();
+        params.clear();
+        bool ok = expect('{');
+        skipSpace();
+        if (ok && *p == '}') {
+            p++;
+        } else {
+            while (ok) {
+                ParamValue value;
+                std::fill(value.values, value.values + 4, 0.0);
+                ok = readString(value.name) && expect(':') && readValue(value);
+                if (!ok) {
+                    break;
+                }
+                params.push_back(value);
+                skipSpace();
+                if (*p == '}') {
+                    p++;
+                    break;
+                }
+                ok = expect(',');
+            }
+        }
+        skipSpace();
+        if (ok && *p) {
+            error = "trailing text";
+            ok = false;
+        }
+        if (!ok) {
+            message = error + " at offset " + std::to_string(p - text.c_str());
+        }
+        return ok;
+    }
+};
+
+bool readTextFile(const std::string& path, std::string& text) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    char buffer[4096];
+    size_t n;
+    text.clear();
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(f);
+    return true;
+}
+
+struct Options {
+    std::string plugin;
+    std::string params;
+    std::string input;
+    std::string output;
+    int queue;
+
+    Options() : plugin(OFX_BATCH_PLUGIN), queue(4) {}
+};
+
+void usage() {
+    fprintf(stderr,
+        "usage: ofxBatch [--plugin PATH] [--params FILE.json] [--queue N] INPUT OUTPUT\n"
+        "       INPUT and OUTPUT are directories of frames or %s sequences\n", io::kRawExtension);
+}
+
+bool parseArguments(int argc, char** argv, Options& options) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--plugin") {
+            options.plugin = value;
+        } else if (arg == "--params") {
+            options.params = value;
+        } else if (arg == "--queue") {
+            options.queue = atoi(value);
+        } else {
+            return false;
+        }
+    }
+    if (positional.size() != 2) {
+        return false;
+    }
+    options.input = positional[0];
+    options.output = positional[1];
+    return !options.plugin.empty() && options.queue > 0;
+}
+
+std::string joinPath(const std::string& directory, const std::string& name) {
+    if (directory.empty() || directory[directory.size() - 1] == '/' || directory[directory.size() - 1] == '\\') {
+        return directory + name;
+    }
+    return directory + "/" + name;
+}
+
+std::string outputName(const std::string& input, BitDepth depth) {
+    size_t dot = input.find_last_of('.');
+    return input.substr(0, dot) + io::frameExtension(depth);
+}
+
+const char* depthName(BitDepth depth) {
+    return depth == kBitDepthByte ? "byte" : depth == kBitDepthShort ? "short" : "float";
+}
+
+/**
+ * @brief Frames the plugin reads to render time, from its frames needed action
+ */
+void framesNeeded(mock::Host& host, double time, int& first, int& last) {
+    double range[2] = { time, time };
+    host.action(kOfxImageEffectActionGetFramesNeeded,
+        [time](PropertySet& inArgs) { inArgs.setDouble(kOfxPropTime, time); },
+        [&range](PropertySet& outArgs) {
+            outArgs.getDoubleN(kOfxImageClipPropFrameRange kOfxImageEffectSimpleSourceClipName, 2, range);
+        });
+    first = (int)std::floor(std::min(range[0], time));
+    last = (int)std::ceil(std::max(range[1], time));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    // Frame names, from the directory or numbered for a raw sequence
+    std::vector<std::string> names;
+    std::string error;
+    const bool rawInput = io::isRawSequence(options.input);
+    const bool rawOutput = io::isRawSequence(options.output);
+    io::RawSequenceReader reader(options.queue);
+    io::RawSequenceWriter writer;
+    if (rawInput) {
+        if (!reader.open(options.input, error)) {
+            fprintf(stderr, "ofxBatch: %s\n", error.c_str());
+            return 1;
+        }
+        for (int i = 0; i < reader.frameCount(); i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "frame_%06d.raw", i);
+            names.push_back(name);
+        }
+    } else if (!io::listFrames(options.input, names, error)) {
+        fprintf(stderr, "ofxBatch: %s\n", error.c_str());
+        return 1;
+    }
+    if (names.empty()) {
+        fprintf(stderr, "ofxBatch: no .ppm, .pgm or .pfm frames in %s\n", options.input.c_str());
+        return 1;
+    }
+
+    std::vector<ParamValue> params;
+    if (!options.params.empty()) {
+        std::string text;
+        if (!readTextFile(options.params, text)) {
+            fprintf(stderr, "ofxBatch: cannot read %s\n", options.params.c_str());
+            return 1;
+        }
+        if (!ParamFileReader().parse(text, params, error)) {
+            fprintf(stderr, "ofxBatch: %s: %s\n", options.params.c_str(), error.c_str());
+            return 2;
+        }
+    }
+
+    mock::Host host;
+    if (!host.load(options.plugin, error)) {
+        fprintf(stderr, "ofxBatch: %s\n", error.c_str());
+        return 1;
+    }
+    for (size_t i = 0; i < params.size(); i++) {
+        const ParamValue& param = params[i];
+        bool set = param.count > 0
+            ? host.setValue(param.name, param.values[0], param.values[1], param.values[2], param.values[3])
+            : host.setString(param.name, param.text);
+        if (!set) {
+            fprintf(stderr, "ofxBatch: no %s parameter named %s\n", param.count > 0 ? "numeric" : "string",
+                    param.name.c_str());
+            return 2;
+        }
+    }
+
+    const int frameCount = (int)names.size();
+    const size_t depth = (size_t)options.queue;
+    BoundedQueue<Job> decoded(depth), rendered(depth);
+    BufferPool sourceBuffers, outputBuffers;
+    double decodeTime = 0.0, encodeTime = 0.0, renderTime = 0.0;
+
+    // Decode runs ahead of the render by up to the queue depth
+    std::thread decoder([&] {
+        for (int i = 0; i < frameCount; i++) {
+            Clock::time_point start = Clock::now();
+            Job job;
+            job.index = i;
+            if (rawInput) {
+                job.image = reader.frame(i);
+            } else {
+                job.frame = sourceBuffers.acquire();
+                std::string path = joinPath(options.input, names[i]);
+                if (io::readFrame(path, *job.frame, job.error)) {
+                    job.frame->image.uniqueIdentifier = io::fileIdentifier(path);
+                    job.image = job.frame->image;
+                }
+            }
+            decodeTime += milliseconds(Clock::now() - start);
+            bool failed = !job.error.empty();
+            if (!decoded.push(std::move(job)) || failed) {
+                break;
+            }
+        }
+        decoded.close();
+    });
+
+    // Encode runs behind it; the first failure is kept and stops the batch
+    std::mutex encodeMutex;
+    std::string encodeError;
+    std::thread encoder([&] {
+        Job job;
+        while (rendered.pop(job)) {
+            Clock::time_point start = Clock::now();
+            std::string message;
+            bool written;
+            if (rawOutput) {
+                written = writer.finish(job.index, message);
+            } else {
+                std::string path = joinPath(options.output, outputName(names[job.index], job.image.depth));
+                written = io::writeFrame(path, job.image, message);
+                outputBuffers.release(std::move(job.frame));
+            }
+            encodeTime += milliseconds(Clock::now() - start);
+            if (!written) {
+                std::lock_guard<std::mutex> lock(encodeMutex);
+                encodeError = message;
+                rendered.close();
+                break;
+            }
+        }
+    });
+
+    // Decoded frames the plugin may still read, by index. The provider runs on this thread.
+    std::map<int, Job> window;
+    host.setSource([&window](double time, mock::HostImage& image) {
+        std::map<int, Job>::iterator it = window.find((int)std::floor(time + 0.5));
+        if (it == window.end()) {
+            return false;
+        }
+        image = it->second.image;
+        return true;
+    }, 0.0, frameCount - 1);
+
+    int nextDecoded = 0;
+    std::string failure;
+    auto decodeThrough = [&](int last) {
+        Job job;
+        while (nextDecoded <= last && decoded.pop(job)) {
+            if (!job.error.empty()) {
+                failure = job.error;
+                return false;
+            }
+            nextDecoded = job.index + 1;
+            window[job.index] = std::move(job);
+        }
+        return nextDecoded > last || (failure = "decoder stopped early", false);
+    };
+
+    Clock::time_point batchStart = Clock::now();
+    BitDepth sourceDepth = kBitDepthNone, outputDepth = kBitDepthNone;
+    int completed = 0;
+    bool sequenceStarted = false;
+    for (int i = 0; i < frameCount && failure.empty(); i++) {
+        int first = i, last = i;
+        framesNeeded(host, i, first, last);
+        if (!decodeThrough(std::min(last, frameCount - 1))) {
+            break;
+        }
+        while (!window.empty() && window.begin()->first < first) {
+            if (window.begin()->second.frame) {
+                sourceBuffers.release(std::move(window.begin()->second.frame));
+            } else {
+                reader.release(window.begin()->first, window.begin()->first);
+            }
+            window.erase(window.begin());
+        }
+
+        const mock::HostImage& source = window[i].image;
+        const int width = source.bounds.x2 - source.bounds.x1;
+        const int height = source.bounds.y2 - source.bounds.y1;
+        if (i == 0) {
+            sourceDepth = source.depth;
+            outputDepth = host.clipPreferences(sourceDepth);
+            if (rawOutput && !writer.create(options.output, width, height, outputDepth, frameCount, failure)) {
+                break;
+            }
+            host.beginSequenceRender(0.0, frameCount - 1, sourceDepth);
+            sequenceStarted = true;
+        }
+
+        // Render straight into the output sequence's mapping, or into a buffer for the encoder
+        Job job;
+        job.index = i;
+        if (rawOutput) {
+            job.image = writer.frame(i);
+            if (job.image.bounds.x2 != width || job.image.bounds.y2 != height) {
+                failure = names[i] + ": frame size differs from the first frame's";
+                break;
+            }
+        } else {
+            job.frame = outputBuffers.acquire();
+            job.frame->allocate(width, height, outputDepth);
+            job.image = job.frame->image;
+        }
+
+        Clock::time_point start = Clock::now();
+        OfxStatus status = host.render(i, source.bounds, job.image);
+        renderTime += milliseconds(Clock::now() - start);
+        if (status != kOfxStatOK) {
+            failure = names[i] + ": render failed";
+            break;
+        }
+        if (!rendered.push(std::move(job))) {
+            break;
+        }
+        completed++;
+    }
+    // Only a begun sequence is ended, so the plugin's count of open sequences stays balanced
+    if (sequenceStarted) {
+        host.endSequenceRender(0.0, frameCount - 1);
+    }
+
+    // Unblock the decoder if the batch stopped early, then let the encoder drain
+    decoded.close();
+    rendered.close();
+    decoder.join();
+    encoder.join();
+    double total = milliseconds(Clock::now() - batchStart);
+    window.clear();
+    writer.close();
+    host.unload();
+
+    if (failure.empty() && !encodeError.empty()) {
+        failure = encodeError;
+    }
+    if (!failure.empty()) {
+        fprintf(stderr, "ofxBatch: %s\n", failure.c_str());
+        return 1;
+    }
+
+    printf("frames  %d, %s to %s\n", completed, depthName(sourceDepth), depthName(outputDepth));
+    printf("stages  decode %.3f ms/frame, render %.3f ms/frame, encode %.3f ms/frame\n",
+           decodeTime / completed, renderTime / completed, encodeTime / completed);
+    printf("total   %.3f s, %.2f frames/s, render busy %.0f%% of the time\n",
+           total / 1e3, completed / (total / 1e3), 100.0 * renderTime / total);
+    return 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * ofxBenchmark.cpp
+ *
+ * Renders synthetic frames through a plugin in the mock host and reports
+ * first-frame latency with and without the sequence render actions,
+ * throughput, parameter reads per frame and how quickly a render returns
+ * after the host aborts it. Frames may instead come from a raw frame
+ * sequence, read in place through a memory map.
+ */
+
+#include "ofxMockHost.h"
+#include "ofxRawFrames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef OFX_BENCHMARK_PLUGIN
+#define OFX_BENCHMARK_PLUGIN ""
+#endif
+
+using namespace ofx;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double milliseconds(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/**
+ * @brief Parameter value given on the command line, up to four components
+ */
+struct ParamValue {
+    std::string name;
+    double values[4];
+};
+
+struct Options {
+    std::string plugin;
+    int width;
+    int height;
+    BitDepth depth;
+    int frames;
+    int cancelTrials;
+    int tiles;
+    std::string source;
+    std::vector<ParamValue> params;
+
+    Options() : plugin(OFX_BENCHMARK_PLUGIN), width(3840), height(2160), depth(kBitDepthFloat),
+                frames(20), cancelTrials(10), tiles(1) {}
+};
+
+void usage() {
+    fprintf(stderr,
+        "usage: ofxBenchmark [--plugin PATH] [--width N] [--height N]\n"
+        "                    [--depth byte|short|float] [--frames N] [--cancel-trials N]\n"
+        "                    [--tiles N] [--source FILE%s] [--param NAME=V[,V...]]...\n",
+        io::kRawExtension);
+}
+
+bool parseArguments(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--plugin") {
+            options.plugin = value;
+        } else if (arg == "--width") {
+            options.width = atoi(value);
+        } else if (arg == "--height") {
+            options.height = atoi(value);
+        } else if (arg == "--frames") {
+            options.frames = atoi(value);
+        } else if (arg == "--cancel-trials") {
+            options.cancelTrials = atoi(value);
+        } else if (arg == "--tiles") {
+            options.tiles = atoi(value);
+        } else if (arg == "--source") {
+            options.source = value;
+        } else if (arg == "--param") {
+            const char* equals = strchr(value, '=');
+            if (!equals) {
+                return false;
+            }
+            ParamValue param = { std::string(value, equals - value), { 0.0, 0.0, 0.0, 0.0 } };
+            const char* p = equals + 1;
+            for (int k = 0; k < 4 && *p; k++) {
+                char* end = nullptr;
+                param.values[k] = strtod(p, &end);
+                p = *end == ',' ? end + 1 : end;
+            }
+            options.params.push_back(param);
+        } else if (arg == "--depth") {
+            std::string depth = value;
+            options.depth = depth == "byte" ? kBitDepthByte : depth == "short" ? kBitDepthShort
+                          : depth == "float" ? kBitDepthFloat : kBitDepthNone;
+        } else {
+            return false;
+        }
+    }
+    return !options.plugin.empty() && options.width > 0 && options.height > 0
+        && options.depth != kBitDepthNone && options.frames > 0 && options.cancelTrials >= 0
+        && options.tiles > 0 && options.tiles <= std::min(options.width, options.height);
+}
+
+/**
+ * @brief RGBA frame buffer owned by the benchmark
+ */
+struct Frame {
+    std::vector<unsigned char> storage;
+    mock::HostImage image;
+
+    Frame(int width, int height, BitDepth depth) {
+        image.rowBytes = width * 4 * (int)depth;
+        storage.resize((size_t)image.rowBytes * height);
+        image.data = &storage[0];
+        image.bounds.x1 = 0;
+        image.bounds.y1 = 0;
+        image.bounds.x2 = width;
+        image.bounds.y2 = height;
+        image.depth = depth;
+    }
+
+    // Gradient with a little noise so LUT lookups do not all hit one line
+    void fill() {
+        uint32_t seed = 12345;
+        int width = image.bounds.x2;
+        int height = image.bounds.y2;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width * 4; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                double noise = (double)(seed >> 8) / 16777216.0 - 0.5;
+                double v = std::min(std::max((double)(x / 4 + y) / (width + height) + 0.05 * noise, 0.0), 1.0);
+                size_t index = (size_t)y * width * 4 + x;
+                switch (image.depth) {
+                    case kBitDepthByte:  storage[index] = (unsigned char)(v * 255.0); break;
+                    case kBitDepthShort: ((unsigned short*)&storage[0])[index] = (unsigned short)(v * 65535.0); break;
+                    default:             ((float*)&storage[0])[index] = (float)v; break;
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief Render the frame at time as tiles x tiles windows, as a host splitting the frame would
+ */
+OfxStatus renderTiled(mock::Host& host, double time, const OfxRectI& frame, int tiles, mock::HostImage& output) {
+    int width = frame.x2 - frame.x1;
+    int height = frame.y2 - frame.y1;
+    for (int j = 0; j < tiles; j++) {
+        for (int i = 0; i < tiles; i++) {
+            OfxRectI window;
+            window.x1 = frame.x1 + width * i / tiles;
+            window.x2 = frame.x1 + width * (i + 1) / tiles;
+            window.y1 = frame.y1 + height * j / tiles;
+            window.y2 = frame.y1 + height * (j + 1) / tiles;
+            OfxStatus status = host.render(time, window, output);
+            if (status != kOfxStatOK) {
+                return status;
+            }
+        }
+    }
+    return kOfxStatOK;
+}
+
+const char* depthName(BitDepth depth) {
+    return depth == kBitDepthByte ? "byte" : depth == kBitDepthShort ? "short" : "float";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    mock::Host host;
+    std::string error;
+    if (!host.load(options.plugin, error)) {
+        fprintf(stderr, "ofxBenchmark: %s\n", error.c_str());
+        return 1;
+    }
+
+    // A raw sequence sets the frame size and depth; throughput renders its frames in turn
+    io::RawSequenceReader sequence;
+    if (!options.source.empty()) {
+        if (!sequence.open(options.source, error)) {
+            fprintf(stderr, "ofxBenchmark: %s\n", error.c_str());
+            return 1;
+        }
+        options.width = sequence.width();
+        options.height = sequence.height();
+        options.depth = sequence.depth();
+        options.tiles = std::min(options.tiles, std::min(options.width, options.height));
+    }
+
+    Frame output(options.width, options.height, options.depth);
+    std::unique_ptr<Frame> synthetic;
+    if (options.source.empty()) {
+        synthetic.reset(new Frame(options.width, options.height, options.depth));
+        synthetic->fill();
+        const Frame* source = synthetic.get();
+        host.setSource([source](double, mock::HostImage& image) {
+            image = source->image;
+            return true;
+        }, 0.0, options.frames - 1);
+    } else {
+        // Noise reduction reads at most 4 frames back; older ones are done with
+        host.setSource([&sequence](double time, mock::HostImage& image) {
+            const int behind = 5;
+            int index = (int)time % sequence.frameCount();
+            sequence.release(index - behind, index - behind);
+            image = sequence.frame(index);
+            return true;
+        }, 0.0, options.frames - 1);
+    }
+
+    // A representative grade, so every stage kind is in the pipeline
+    host.setValue("gain", 1.1);
+    host.setValue("gamma", 0.9);
+    host.setValue("saturation", 1.2);
+    host.setValue("rgbGain", 1.05, 1.0, 0.95);
+    for (size_t i = 0; i < options.params.size(); i++) {
+        const ParamValue& param = options.params[i];
+        if (!host.setValue(param.name, param.values[0], param.values[1], param.values[2], param.values[3])) {
+            fprintf(stderr, "ofxBenchmark: no numeric parameter named %s\n", param.name.c_str());
+            return 2;
+        }
+    }
+
+    OfxRectI window = output.image.bounds;
+    double pixels = (double)options.width * options.height;
+    printf("plugin  %s\n", options.plugin.c_str());
+    if (!options.source.empty()) {
+        printf("source  %s, %d frames mapped\n", options.source.c_str(), sequence.frameCount());
+    }
+    printf("frame   %dx%d %s, %u hardware threads\n", options.width, options.height,
+           depthName(options.depth), std::thread::hardware_concurrency());
+
+    // First frame of an export, while the plugin holds no state from earlier renders: once
+    // after the begin sequence render action, once without it. Gain is nudged for the second
+    // run so its grade is not already compiled.
+    double lastFrame = options.frames - 1;
+    Clock::time_point start = Clock::now();
+    host.beginSequenceRender(0.0, lastFrame, options.depth);
+    double begin = milliseconds(Clock::now() - start);
+    start = Clock::now();
+    if (host.render(0.0, window, output.image) != kOfxStatOK) {
+        fprintf(stderr, "ofxBenchmark: render failed\n");
+        return 1;
+    }
+    double warmFirst = milliseconds(Clock::now() - start);
+    host.endSequenceRender(0.0, lastFrame);
+
+    double gain = 1.0;
+    bool nudged = host.getValueAtTime("gain", 0.0, &gain, 1) == 1 && host.setValue("gain", gain + 1e-4);
+    start = Clock::now();
+    host.render(0.0, window, output.image);
+    double coldFirst = milliseconds(Clock::now() - start);
+    if (nudged) {
+        host.setValue("gain", gain);
+    }
+    printf("first   %.3f ms after %.3f ms of begin sequence render, %.3f ms without\n",
+           warmFirst, begin, coldFirst);
+
+    // Throughput, inside a sequence render as an export would be, one frame after another
+    host.beginSequenceRender(0.0, lastFrame, options.depth);
+    renderTiled(host, 0.0, window, options.tiles, output.image);
+    long pollsBefore = host.abortCalls();
+    long readsBefore = host.paramReads();
+    double total = 0.0, best = 1e30;
+    for (int i = 0; i < options.frames; i++) {
+        Clock::time_point start = Clock::now();
+        renderTiled(host, i, window, options.tiles, output.image);
+        double elapsed = milliseconds(Clock::now() - start);
+        total += elapsed;
+        best = std::min(best, elapsed);
+    }
+    double mean = total / options.frames;
+    printf("render  %.3f ms/frame (best %.3f), %.1f Mpixel/s, %.1f abort polls/frame\n",
+           mean, best, pixels / (mean * 1e3),
+           (double)(host.abortCalls() - pollsBefore) / options.frames);
+    printf("params  %.1f host reads/frame over %d tile%s\n",
+           (double)(host.paramReads() - readsBefore) / options.frames,
+           options.tiles * options.tiles, options.tiles > 1 ? "s" : "");
+    host.endSequenceRender(0.0, lastFrame);
+
+    // Cancel latency: abort part way through a frame and time until render returns
+    if (options.cancelTrials > 0) {
+        std::atomic<bool> aborted(false);
+        host.setAbort([&aborted] { return aborted.load(); });
+
+        int cancelled = 0;
+        double latencyTotal = 0.0, latencyMax = 0.0;
+        for (int trial = 0; trial < options.cancelTrials; trial++) {
+            aborted.store(false);
+            OfxStatus status = kOfxStatOK;
+            Clock::time_point finished;
+            std::thread render([&] {
+                status = host.render(0.0, window, output.image);
+                finished = Clock::now();
+            });
+
+            // Spread the cancel points over the middle of the frame
+            double fraction = 0.25 + 0.5 * trial / std::max(options.cancelTrials - 1, 1);
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(mean * fraction));
+            Clock::time_point requested = Clock::now();
+            aborted.store(true);
+            render.join();
+
+            if (status == kOfxStatFailed) {
+                double latency = std::max(milliseconds(finished - requested), 0.0);
+                cancelled++;
+                latencyTotal += latency;
+                latencyMax = std::max(latencyMax, latency);
+            }
+        }
+        host.setAbort(std::function<bool()>());
+
+        if (cancelled) {
+            printf("cancel  %d/%d renders aborted, latency mean %.3f ms, max %.3f ms\n",
+                   cancelled, options.cancelTrials, latencyTotal / cancelled, latencyMax);
+        } else {
+            printf("cancel  0/%d renders aborted (frames finished before the abort)\n", options.cancelTrials);
+        }
+    }
+
+    host.unload();
+    return 0;
+}
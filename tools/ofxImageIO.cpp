@@ -0,0 +1,317 @@
+#include "ofxImageIO.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+namespace ofx {
+namespace io {
+
+namespace {
+
+struct File {
+    FILE* handle;
+    explicit File(FILE* f) : handle(f) {}
+    ~File() { if (handle) fclose(handle); }
+};
+
+std::string extensionOf(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return std::string();
+    }
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
+}
+
+bool littleEndian() {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+// Next whitespace-separated header token, skipping # comments
+bool headerToken(FILE* f, std::string& token) {
+    token.clear();
+    int c = fgetc(f);
+    for (;;) {
+        while (c != EOF && isspace(c)) {
+            c = fgetc(f);
+        }
+        if (c != '#') {
+            break;
+        }
+        while (c != EOF && c != '\n') {
+            c = fgetc(f);
+        }
+    }
+    while (c != EOF && !isspace(c)) {
+        token += (char)c;
+        c = fgetc(f);
+    }
+    // The single whitespace character after the last token is consumed with it
+    return !token.empty();
+}
+
+bool headerInt(FILE* f, int& value) {
+    std::string token;
+    if (!headerToken(f, token)) {
+        return false;
+    }
+    char* end = nullptr;
+    long parsed = strtol(token.c_str(), &end, 10);
+    if (*end || parsed <= 0 || parsed > (1 << 20)) {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+bool readPPM(FILE* f, const std::string& magic, FrameBuffer& frame, std::string& error) {
+    int width = 0, height = 0, maxValue = 0;
+    if (!headerInt(f, width) || !headerInt(f, height) || !headerInt(f, maxValue) || maxValue > 65535) {
+        error = "bad PPM header";
+        return false;
+    }
+    const int channels = magic == "P6" ? 3 : 1;
+    const int sampleBytes = maxValue > 255 ? 2 : 1;
+    const BitDepth depth = maxValue > 255 ? kBitDepthShort : kBitDepthByte;
+    const double fullRange = depth == kBitDepthShort ? 65535.0 : 255.0;
+    const bool rescale = maxValue != (int)fullRange;
+    frame.allocate(width, height, depth);
+
+    std::vector<unsigned char> line((size_t)width * channels * sampleBytes);
+    for (int y = height - 1; y >= 0; y--) {
+        if (fread(&line[0], 1, line.size(), f) != line.size()) {
+            error = "truncated PPM data";
+            return false;
+        }
+        for (int x = 0; x < width; x++) {
+            unsigned int rgba[4];
+            for (int c = 0; c < 3; c++) {
+                const unsigned char* sample = &line[((size_t)x * channels + (channels == 3 ? c : 0)) * sampleBytes];
+                unsigned int value = sampleBytes == 2 ? (sample[0] << 8) | sample[1] : sample[0];
+                if (rescale) {
+                    value = (unsigned int)(std::min(value, (unsigned int)maxValue) * fullRange / maxValue + 0.5);
+                }
+                rgba[c] = value;
+            }
+            rgba[3] = (unsigned int)fullRange;
+            for (int c = 0; c < 4; c++) {
+                if (depth == kBitDepthShort) {
+                    ((unsigned short*)frame.row(y))[x * 4 + c] = (unsigned short)rgba[c];
+                } else {
+                    ((unsigned char*)frame.row(y))[x * 4 + c] = (unsigned char)rgba[c];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool readPFM(FILE* f, const std::string& magic, FrameBuffer& frame, std::string& error) {
+    int width = 0, height = 0;
+    std::string scaleToken;
+    if (!headerInt(f, width) || !headerInt(f, height) || !headerToken(f, scaleToken)) {
+        error = "bad PFM header";
+        return false;
+    }
+    const int channels = magic == "PF" ? 3 : 1;
+    const bool swap = (strtod(scaleToken.c_str(), nullptr) < 0.0) != littleEndian();
+    frame.allocate(width, height, kBitDepthFloat);
+
+    // PFM stores rows bottom to top, as OFX does
+    std::vector<float> line((size_t)width * channels);
+    for (int y = 0; y < height; y++) {
+        if (fread(&line[0], sizeof(float), line.size(), f) != line.size()) {
+            error = "truncated PFM data";
+            return false;
+        }
+        if (swap) {
+            for (size_t i = 0; i < line.size(); i++) {
+                unsigned char* bytes = (unsigned char*)&line[i];
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+            }
+        }
+        float* row = (float*)frame.row(y);
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                row[x * 4 + c] = line[(size_t)x * channels + (channels == 3 ? c : 0)];
+            }
+            row[x * 4 + 3] = 1.0f;
+        }
+    }
+    return true;
+}
+
+bool writePPM(FILE* f, const mock::HostImage& image, std::string& error) {
+    const int width = image.bounds.x2 - image.bounds.x1;
+    const int height = image.bounds.y2 - image.bounds.y1;
+    const bool wide = image.depth == kBitDepthShort;
+    fprintf(f, "P6\n%d %d\n%d\n", width, height, wide ? 65535 : 255);
+
+    std::vector<unsigned char> line((size_t)width * 3 * (wide ? 2 : 1));
+    for (int y = height - 1; y >= 0; y--) {
+        const char* row = (const char*)image.data + (size_t)y * image.rowBytes;
+        unsigned char* out = &line[0];
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                if (wide) {
+                    unsigned short value = ((const unsigned short*)row)[x * 4 + c];
+                    *out++ = (unsigned char)(value >> 8);
+                    *out++ = (unsigned char)(value & 0xff);
+                } else {
+                    *out++ = ((const unsigned char*)row)[x * 4 + c];
+                }
+            }
+        }
+        if (fwrite(&line[0], 1, line.size(), f) != line.size()) {
+            error = "write failed";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool writePFM(FILE* f, const mock::HostImage& image, std::string& error) {
+    const int width = image.bounds.x2 - image.bounds.x1;
+    const int height = image.bounds.y2 - image.bounds.y1;
+    fprintf(f, "PF\n%d %d\n%s\n", width, height, littleEndian() ? "-1.0" : "1.0");
+
+    std::vector<float> line((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        const float* row = (const float*)((const char*)image.data + (size_t)y * image.rowBytes);
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                line[(size_t)x * 3 + c] = row[x * 4 + c];
+            }
+        }
+        if (fwrite(&line[0], sizeof(float), line.size(), f) != line.size()) {
+            error = "write failed";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isFrameFile(const std::string& name) {
+    std::string extension = extensionOf(name);
+    return extension == ".ppm" || extension == ".pgm" || extension == ".pfm";
+}
+
+} // namespace
+
+void FrameBuffer::allocate(int width, int height, BitDepth depth) {
+    image.rowBytes = width * 4 * (int)depth;
+    storage.resize((size_t)image.rowBytes * height);
+    image.data = storage.empty() ? nullptr : &storage[0];
+    image.bounds.x1 = 0;
+    image.bounds.y1 = 0;
+    image.bounds.x2 = width;
+    image.bounds.y2 = height;
+    image.depth = depth;
+}
+
+bool readFrame(const std::string& path, FrameBuffer& frame, std::string& error) {
+    File file(fopen(path.c_str(), "rb"));
+    if (!file.handle) {
+        error = path + ": cannot open";
+        return false;
+    }
+    std::string magic;
+    headerToken(file.handle, magic);
+    bool read = false;
+    if (magic == "P6" || magic == "P5") {
+        read = readPPM(file.handle, magic, frame, error);
+    } else if (magic == "PF" || magic == "Pf") {
+        read = readPFM(file.handle, magic, frame, error);
+    } else {
+        error = "not a binary PPM, PGM or PFM file";
+    }
+    if (!read) {
+        error = path + ": " + error;
+    }
+    return read;
+}
+
+bool writeFrame(const std::string& path, const mock::HostImage& image, std::string& error) {
+    std::string extension = extensionOf(path);
+    bool floatFile = extension == ".pfm";
+    if ((extension != ".ppm" && !floatFile) || floatFile != (image.depth == kBitDepthFloat)) {
+        error = path + ": " + frameExtension(image.depth) + " is needed for this depth";
+        return false;
+    }
+    File file(fopen(path.c_str(), "wb"));
+    if (!file.handle) {
+        error = path + ": cannot create";
+        return false;
+    }
+    bool written = floatFile ? writePFM(file.handle, image, error) : writePPM(file.handle, image, error);
+    if (written && fflush(file.handle) != 0) {
+        error = "write failed";
+        written = false;
+    }
+    if (!written) {
+        error = path + ": " + error;
+    }
+    return written;
+}
+
+const char* frameExtension(BitDepth depth) {
+    return depth == kBitDepthFloat ? ".pfm" : ".ppm";
+}
+
+std::string fileIdentifier(const std::string& path) {
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) {
+        return path;
+    }
+    return path + "@" + std::to_string((long long)status.st_size) + "@" + std::to_string((long long)status.st_mtime);
+}
+
+bool listFrames(const std::string& directory, std::vector<std::string>& names, std::string& error) {
+    names.clear();
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((directory + "\\*").c_str(), &entry);
+    if (search == INVALID_HANDLE_VALUE) {
+        error = directory + ": cannot list";
+        return false;
+    }
+    do {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && isFrameFile(entry.cFileName)) {
+            names.push_back(entry.cFileName);
+        }
+    } while (FindNextFileA(search, &entry));
+    FindClose(search);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        error = directory + ": cannot list";
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.' && isFrameFile(entry->d_name)) {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+    std::sort(names.begin(), names.end());
+    return true;
+}
+
+} // namespace io
+} // namespace ofx
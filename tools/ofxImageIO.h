@@ -0,0 +1,75 @@
+#ifndef _ofxImageIO_h_
+#define _ofxImageIO_h_
+
+#include "ofxMockHost.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * @file ofxImageIO.h
+ * @brief Frame files for the host tools: reading, writing and listing image sequences
+ */
+
+namespace ofx {
+namespace io {
+
+/**
+ * @brief RGBA frame in host memory, lent to the mock host as a clip image
+ *
+ * Rows are stored bottom to top, as OFX addresses them.
+ */
+struct FrameBuffer {
+    std::vector<unsigned char> storage;
+    mock::HostImage image;
+
+    FrameBuffer() {}
+    FrameBuffer(int width, int height, BitDepth depth) { allocate(width, height, depth); }
+
+    void allocate(int width, int height, BitDepth depth);
+
+    int width() const { return image.bounds.x2 - image.bounds.x1; }
+    int height() const { return image.bounds.y2 - image.bounds.y1; }
+
+    // Row y counted from the bottom
+    void* row(int y) { return (char*)image.data + (size_t)y * image.rowBytes; }
+    const void* row(int y) const { return (const char*)image.data + (size_t)y * image.rowBytes; }
+};
+
+/**
+ * @brief Read a frame, choosing the format by extension
+ *
+ * .ppm and .pgm (binary P6 and P5) give 8-bit frames for a maximum value
+ * up to 255 and 16-bit frames above, scaled so the maximum is full range;
+ * .pfm (PF and Pf) gives float frames. Alpha is opaque.
+ */
+bool readFrame(const std::string& path, FrameBuffer& frame, std::string& error);
+
+/**
+ * @brief Write a frame, choosing the format by extension
+ *
+ * .ppm takes 8-bit and 16-bit frames, .pfm float frames; alpha is dropped.
+ */
+bool writeFrame(const std::string& path, const mock::HostImage& image, std::string& error);
+
+/**
+ * @brief File extension that writeFrame() uses for a depth, with the dot
+ */
+const char* frameExtension(BitDepth depth);
+
+/**
+ * @brief Unique identifier for images read from a file: its path, size and modification time
+ *
+ * Changes when the file is rewritten, so the plugin's caches keyed by it do not serve stale frames.
+ */
+std::string fileIdentifier(const std::string& path);
+
+/**
+ * @brief Frame files in a directory that readFrame() understands, sorted by name
+ */
+bool listFrames(const std::string& directory, std::vector<std::string>& names, std::string& error);
+
+} // namespace io
+} // namespace ofx
+
+#endif // _ofxImageIO_h_
@@ -0,0 +1,1125 @@
+#include "ofxMockHost.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// The OFX handles are blind structs; the mock host gives them their bodies
+
+struct OfxPropertySetStruct {
+    struct Value {
+        std::vector<int> ints;
+        std::vector<double> doubles;
+        std::vector<std::string> strings;
+        std::vector<void*> pointers;
+    };
+    std::map<std::string, Value> values;
+};
+
+struct OfxParamStruct {
+    std::string type;
+    std::string name;
+    OfxPropertySetStruct props;
+    int dimension;        // number of numeric values, 0 for strings and buttons
+    bool integer;         // passed as int rather than double
+    bool text;            // string and custom parameters
+    double value[4];
+    std::string string;
+    std::map<double, std::vector<double> > keys;
+    std::atomic<long>* reads;   // the host's value read count, for instance parameters
+};
+
+struct OfxParamSetStruct {
+    std::map<std::string, std::unique_ptr<OfxParamStruct> > params;
+    std::vector<std::string> order;
+};
+
+struct OfxImageClipStruct {
+    std::string name;
+    OfxPropertySetStruct props;
+    ofx::mock::Host::Impl* host;
+};
+
+struct OfxImageEffectStruct {
+    OfxPropertySetStruct props;
+    OfxParamSetStruct params;
+    std::map<std::string, std::unique_ptr<OfxImageClipStruct> > clips;
+    ofx::mock::Host::Impl* host;
+};
+
+struct OfxImageMemoryStruct {
+    void* data;
+};
+
+namespace ofx {
+namespace mock {
+
+struct Host::Impl {
+#ifdef _WIN32
+    HMODULE library;
+#else
+    void* library;
+#endif
+    OfxPlugin* plugin;
+    OfxHost ofxHost;
+    OfxPropertySetStruct hostProps;
+    OfxImageEffectStruct descriptor;
+    std::unique_ptr<OfxImageEffectStruct> instance;
+
+    FrameProvider source;
+    HostImage* output;
+    std::function<bool()> abort;
+    std::atomic<long> abortCalls;
+    std::atomic<long> paramReads;
+
+    Impl() : library(nullptr), plugin(nullptr), output(nullptr), abortCalls(0), paramReads(0) {
+        descriptor.host = this;
+    }
+
+    OfxStatus call(const char* action, const void* handle, OfxPropertySetHandle inArgs, OfxPropertySetHandle outArgs) {
+        return plugin ? plugin->mainEntry(action, handle, inArgs, outArgs) : kOfxStatErrBadHandle;
+    }
+};
+
+namespace {
+
+typedef OfxPropertySetStruct::Value Value;
+
+// Property suite
+
+template<typename T, std::vector<T> Value::*Member>
+OfxStatus propSet(OfxPropertySetHandle props, const char* name, int index, const T& value) {
+    if (!props || !name || index < 0) {
+        return kOfxStatErrBadHandle;
+    }
+    std::vector<T>& values = props->values[name].*Member;
+    if ((int)values.size() <= index) {
+        values.resize(index + 1);
+    }
+    values[index] = value;
+    return kOfxStatOK;
+}
+
+template<typename T, std::vector<T> Value::*Member>
+OfxStatus propGet(OfxPropertySetHandle props, const char* name, int index, T& value) {
+    if (!props || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, Value>::const_iterator it = props->values.find(name);
+    if (it == props->values.end()) {
+        return kOfxStatErrUnknown;
+    }
+    const std::vector<T>& values = it->second.*Member;
+    if (index < 0 || index >= (int)values.size()) {
+        return kOfxStatErrBadIndex;
+    }
+    value = values[index];
+    return kOfxStatOK;
+}
+
+OfxStatus propSetPointer(OfxPropertySetHandle props, const char* name, int index, void* value) {
+    return propSet<void*, &Value::pointers>(props, name, index, value);
+}
+
+OfxStatus propSetString(OfxPropertySetHandle props, const char* name, int index, const char* value) {
+    return propSet<std::string, &Value::strings>(props, name, index, std::string(value ? value : ""));
+}
+
+OfxStatus propSetDouble(OfxPropertySetHandle props, const char* name, int index, double value) {
+    return propSet<double, &Value::doubles>(props, name, index, value);
+}
+
+OfxStatus propSetInt(OfxPropertySetHandle props, const char* name, int index, int value) {
+    return propSet<int, &Value::ints>(props, name, index, value);
+}
+
+OfxStatus propSetPointerN(OfxPropertySetHandle props, const char* name, int count, void* const* values) {
+    for (int i = 0; i < count; i++) {
+        propSetPointer(props, name, i, values[i]);
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propSetStringN(OfxPropertySetHandle props, const char* name, int count, const char* const* values) {
+    for (int i = 0; i < count; i++) {
+        propSetString(props, name, i, values[i]);
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propSetDoubleN(OfxPropertySetHandle props, const char* name, int count, const double* values) {
+    for (int i = 0; i < count; i++) {
+        propSetDouble(props, name, i, values[i]);
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propSetIntN(OfxPropertySetHandle props, const char* name, int count, const int* values) {
+    for (int i = 0; i < count; i++) {
+        propSetInt(props, name, i, values[i]);
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propGetPointer(OfxPropertySetHandle props, const char* name, int index, void** value) {
+    return propGet<void*, &Value::pointers>(props, name, index, *value);
+}
+
+OfxStatus propGetString(OfxPropertySetHandle props, const char* name, int index, char** value) {
+    if (!props || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, Value>::const_iterator it = props->values.find(name);
+    if (it == props->values.end()) {
+        return kOfxStatErrUnknown;
+    }
+    if (index < 0 || index >= (int)it->second.strings.size()) {
+        return kOfxStatErrBadIndex;
+    }
+    *value = const_cast<char*>(it->second.strings[index].c_str());
+    return kOfxStatOK;
+}
+
+OfxStatus propGetDouble(OfxPropertySetHandle props, const char* name, int index, double* value) {
+    return propGet<double, &Value::doubles>(props, name, index, *value);
+}
+
+OfxStatus propGetInt(OfxPropertySetHandle props, const char* name, int index, int* value) {
+    return propGet<int, &Value::ints>(props, name, index, *value);
+}
+
+OfxStatus propGetPointerN(OfxPropertySetHandle props, const char* name, int count, void** values) {
+    for (int i = 0; i < count; i++) {
+        OfxStatus status = propGetPointer(props, name, i, &values[i]);
+        if (status != kOfxStatOK) {
+            return status;
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propGetStringN(OfxPropertySetHandle props, const char* name, int count, char** values) {
+    for (int i = 0; i < count; i++) {
+        OfxStatus status = propGetString(props, name, i, &values[i]);
+        if (status != kOfxStatOK) {
+            return status;
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propGetDoubleN(OfxPropertySetHandle props, const char* name, int count, double* values) {
+    for (int i = 0; i < count; i++) {
+        OfxStatus status = propGetDouble(props, name, i, &values[i]);
+        if (status != kOfxStatOK) {
+            return status;
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propGetIntN(OfxPropertySetHandle props, const char* name, int count, int* values) {
+    for (int i = 0; i < count; i++) {
+        OfxStatus status = propGetInt(props, name, i, &values[i]);
+        if (status != kOfxStatOK) {
+            return status;
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus propReset(OfxPropertySetHandle props, const char* name) {
+    if (!props || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    props->values.erase(name);
+    return kOfxStatOK;
+}
+
+OfxStatus propGetDimension(OfxPropertySetHandle props, const char* name, int* count) {
+    if (!props || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, Value>::const_iterator it = props->values.find(name);
+    if (it == props->values.end()) {
+        return kOfxStatErrUnknown;
+    }
+    const Value& value = it->second;
+    *count = (int)std::max(std::max(value.ints.size(), value.doubles.size()),
+                           std::max(value.strings.size(), value.pointers.size()));
+    return kOfxStatOK;
+}
+
+OfxPropertySuiteV1 gMockPropertySuite = {
+    propSetPointer, propSetString, propSetDouble, propSetInt,
+    propSetPointerN, propSetStringN, propSetDoubleN, propSetIntN,
+    propGetPointer, propGetString, propGetDouble, propGetInt,
+    propGetPointerN, propGetStringN, propGetDoubleN, propGetIntN,
+    propReset, propGetDimension
+};
+
+// Parameter suite
+
+void classifyParam(OfxParamStruct& param) {
+    const std::string& type = param.type;
+    param.dimension = 1;
+    param.integer = false;
+    param.text = false;
+    if (type == kOfxParamTypeInteger || type == kOfxParamTypeBoolean || type == kOfxParamTypeChoice) {
+        param.integer = true;
+    } else if (type == kOfxParamTypeDouble2D) {
+        param.dimension = 2;
+    } else if (type == kOfxParamTypeInteger2D) {
+        param.dimension = 2;
+        param.integer = true;
+    } else if (type == kOfxParamTypeDouble3D || type == kOfxParamTypeRGB) {
+        param.dimension = 3;
+    } else if (type == kOfxParamTypeInteger3D) {
+        param.dimension = 3;
+        param.integer = true;
+    } else if (type == kOfxParamTypeRGBA) {
+        param.dimension = 4;
+    } else if (type == kOfxParamTypeString || type == kOfxParamTypeCustom) {
+        param.dimension = 0;
+        param.text = true;
+    } else if (type != kOfxParamTypeDouble) {
+        param.dimension = 0;   // groups, pages, buttons
+    }
+}
+
+// Current value, or the keyframes linearly interpolated and held past the ends
+void evaluateParam(const OfxParamStruct& param, double time, double* values) {
+    for (int i = 0; i < 4; i++) {
+        values[i] = param.value[i];
+    }
+    if (param.keys.empty()) {
+        return;
+    }
+
+    std::map<double, std::vector<double> >::const_iterator next = param.keys.lower_bound(time);
+    if (next == param.keys.end()) {
+        --next;
+        std::copy(next->second.begin(), next->second.end(), values);
+    } else if (next == param.keys.begin() || next->first == time) {
+        std::copy(next->second.begin(), next->second.end(), values);
+    } else {
+        std::map<double, std::vector<double> >::const_iterator previous = next;
+        --previous;
+        double t = (time - previous->first) / (next->first - previous->first);
+        for (int i = 0; i < 4; i++) {
+            values[i] = previous->second[i] + t * (next->second[i] - previous->second[i]);
+        }
+    }
+    if (param.integer) {
+        for (int i = 0; i < 4; i++) {
+            values[i] = std::floor(values[i] + 0.5);
+        }
+    }
+}
+
+OfxStatus writeValues(const OfxParamStruct& param, double time, va_list args) {
+    if (param.text) {
+        char** value = va_arg(args, char**);
+        *value = const_cast<char*>(param.string.c_str());
+        return kOfxStatOK;
+    }
+    if (param.dimension == 0) {
+        return kOfxStatErrUnsupported;
+    }
+    double values[4];
+    evaluateParam(param, time, values);
+    for (int i = 0; i < param.dimension; i++) {
+        if (param.integer) {
+            *va_arg(args, int*) = (int)values[i];
+        } else {
+            *va_arg(args, double*) = values[i];
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus readValues(OfxParamStruct& param, double* values, va_list args) {
+    if (param.text) {
+        const char* value = va_arg(args, const char*);
+        param.string = value ? value : "";
+        return kOfxStatOK;
+    }
+    if (param.dimension == 0) {
+        return kOfxStatErrUnsupported;
+    }
+    for (int i = 0; i < param.dimension; i++) {
+        values[i] = param.integer ? (double)va_arg(args, int) : va_arg(args, double);
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus paramDefine(OfxParamSetHandle paramSet, const char* type, const char* name, OfxPropertySetHandle* props) {
+    if (!paramSet || !type || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    if (paramSet->params.count(name)) {
+        return kOfxStatErrExists;
+    }
+    std::unique_ptr<OfxParamStruct> param(new OfxParamStruct());
+    param->type = type;
+    param->name = name;
+    param->reads = nullptr;
+    classifyParam(*param);
+    for (int i = 0; i < 4; i++) {
+        param->value[i] = 0.0;
+    }
+    propSetString(&param->props, kOfxPropType, 0, type);
+    propSetString(&param->props, kOfxParamPropType, 0, type);
+    propSetString(&param->props, kOfxPropName, 0, name);
+    if (props) {
+        *props = &param->props;
+    }
+    paramSet->order.push_back(name);
+    paramSet->params[name] = std::move(param);
+    return kOfxStatOK;
+}
+
+OfxStatus paramGetHandle(OfxParamSetHandle paramSet, const char* name, OfxParamHandle* param, OfxPropertySetHandle* props) {
+    if (!paramSet || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, std::unique_ptr<OfxParamStruct> >::iterator it = paramSet->params.find(name);
+    if (it == paramSet->params.end()) {
+        return kOfxStatErrUnknown;
+    }
+    if (param) {
+        *param = it->second.get();
+    }
+    if (props) {
+        *props = &it->second->props;
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus paramSetValue(OfxParamHandle param, ...) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    va_list args;
+    va_start(args, param);
+    OfxStatus status = readValues(*param, param->value, args);
+    va_end(args);
+    return status;
+}
+
+OfxStatus paramSetValueAtTime(OfxParamHandle param, double time, ...) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    if (param->text) {
+        return kOfxStatErrUnsupported;
+    }
+    std::vector<double> values(param->value, param->value + 4);
+    va_list args;
+    va_start(args, time);
+    OfxStatus status = readValues(*param, &values[0], args);
+    va_end(args);
+    if (status == kOfxStatOK) {
+        param->keys[time] = values;
+    }
+    return status;
+}
+
+OfxStatus paramGetValue(OfxParamHandle param, ...) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    if (param->reads) {
+        param->reads->fetch_add(1, std::memory_order_relaxed);
+    }
+    va_list args;
+    va_start(args, param);
+    // Without a time, keyed parameters report their first key
+    double time = param->keys.empty() ? 0.0 : param->keys.begin()->first;
+    OfxStatus status = writeValues(*param, time, args);
+    va_end(args);
+    return status;
+}
+
+OfxStatus paramGetValueAtTime(OfxParamHandle param, double time, ...) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    if (param->reads) {
+        param->reads->fetch_add(1, std::memory_order_relaxed);
+    }
+    va_list args;
+    va_start(args, time);
+    OfxStatus status = writeValues(*param, time, args);
+    va_end(args);
+    return status;
+}
+
+OfxStatus paramGetDerivative(OfxParamHandle, double, ...) {
+    return kOfxStatErrUnsupported;
+}
+
+OfxStatus paramGetIntegral(OfxParamHandle, double, double, ...) {
+    return kOfxStatErrUnsupported;
+}
+
+OfxStatus paramSetToDefault(OfxParamHandle param) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    param->keys.clear();
+    if (param->text) {
+        char* value = nullptr;
+        propGetString(&param->props, kOfxParamPropDefault, 0, &value);
+        param->string = value ? value : "";
+        return kOfxStatOK;
+    }
+    for (int i = 0; i < param->dimension; i++) {
+        int intValue = 0;
+        double doubleValue = 0.0;
+        if (propGetDouble(&param->props, kOfxParamPropDefault, i, &doubleValue) == kOfxStatOK) {
+            param->value[i] = doubleValue;
+        } else if (propGetInt(&param->props, kOfxParamPropDefault, i, &intValue) == kOfxStatOK) {
+            param->value[i] = (double)intValue;
+        }
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus paramGetNumKeys(OfxParamHandle param, unsigned int* count) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    *count = (unsigned int)param->keys.size();
+    return kOfxStatOK;
+}
+
+OfxStatus paramGetKeyTime(OfxParamHandle param, unsigned int nth, double* time) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    if (nth >= param->keys.size()) {
+        return kOfxStatErrBadIndex;
+    }
+    std::map<double, std::vector<double> >::const_iterator it = param->keys.begin();
+    std::advance(it, nth);
+    *time = it->first;
+    return kOfxStatOK;
+}
+
+OfxStatus paramGetKeyIndex(OfxParamHandle param, double time, int direction, int* index) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    int i = 0;
+    for (std::map<double, std::vector<double> >::const_iterator it = param->keys.begin(); it != param->keys.end(); ++it, ++i) {
+        if ((direction == 0 && it->first == time) || (direction > 0 && it->first > time)) {
+            *index = i;
+            return kOfxStatOK;
+        }
+        if (direction < 0 && it->first >= time) {
+            if (i == 0) {
+                break;
+            }
+            *index = i - 1;
+            return kOfxStatOK;
+        }
+    }
+    if (direction < 0 && !param->keys.empty() && param->keys.rbegin()->first < time) {
+        *index = (int)param->keys.size() - 1;
+        return kOfxStatOK;
+    }
+    return kOfxStatFailed;
+}
+
+OfxStatus paramDeleteKey(OfxParamHandle param, double time) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    return param->keys.erase(time) ? kOfxStatOK : kOfxStatErrBadIndex;
+}
+
+OfxStatus paramDeleteAllKeys(OfxParamHandle param) {
+    if (!param) {
+        return kOfxStatErrBadHandle;
+    }
+    param->keys.clear();
+    return kOfxStatOK;
+}
+
+OfxStatus paramCopy(OfxParamHandle, OfxParamHandle, double, const OfxRangeD*) {
+    return kOfxStatErrUnsupported;
+}
+
+OfxStatus paramEditBegin(OfxParamSetHandle, const char*) {
+    return kOfxStatOK;
+}
+
+OfxStatus paramEditEnd(OfxParamSetHandle) {
+    return kOfxStatOK;
+}
+
+OfxParameterSuiteV1 gMockParameterSuite = {
+    paramDefine, paramGetHandle,
+    paramSetValue, paramSetValueAtTime, paramGetValue, paramGetValueAtTime,
+    paramGetDerivative, paramGetIntegral, paramSetToDefault,
+    paramGetNumKeys, paramGetKeyTime, paramGetKeyIndex, paramDeleteKey, paramDeleteAllKeys,
+    paramCopy, paramEditBegin, paramEditEnd
+};
+
+// Image effect suite
+
+const char* depthString(BitDepth depth) {
+    switch (depth) {
+        case kBitDepthByte:  return kOfxBitDepthByte;
+        case kBitDepthShort: return kOfxBitDepthShort;
+        case kBitDepthFloat: return kOfxBitDepthFloat;
+        default:             return kOfxBitDepthNone;
+    }
+}
+
+// The plugin's reply lives in a transient property set, so no interning by pointer
+BitDepth parseDepth(const char* depth) {
+    const BitDepth depths[] = { kBitDepthByte, kBitDepthShort, kBitDepthFloat };
+    for (int i = 0; i < 3; i++) {
+        if (depth && strcmp(depth, depthString(depths[i])) == 0) {
+            return depths[i];
+        }
+    }
+    return kBitDepthNone;
+}
+
+OfxPropertySetHandle makeImage(const HostImage& image) {
+    OfxPropertySetHandle props = new OfxPropertySetStruct();
+    int bounds[4] = { image.bounds.x1, image.bounds.y1, image.bounds.x2, image.bounds.y2 };
+    double scale[2] = { 1.0, 1.0 };
+    propSetPointer(props, kOfxImagePropData, 0, image.data);
+    propSetIntN(props, kOfxImagePropBounds, 4, bounds);
+    propSetIntN(props, kOfxImagePropRegionOfDefinition, 4, bounds);
+    propSetInt(props, kOfxImagePropRowBytes, 0, image.rowBytes);
+    propSetString(props, kOfxImageEffectPropPixelDepth, 0, depthString(image.depth));
+    propSetString(props, kOfxImageEffectPropComponents, 0, kOfxImageComponentRGBA);
+    propSetString(props, kOfxImagePropUniqueIdentifier, 0, image.uniqueIdentifier.c_str());
+    propSetDouble(props, kOfxImagePropPixelAspectRatio, 0, 1.0);
+    propSetDoubleN(props, kOfxImageEffectPropRenderScale, 2, scale);
+    return props;
+}
+
+OfxStatus getPropertySet(OfxImageEffectHandle effect, OfxPropertySetHandle* props) {
+    if (!effect) {
+        return kOfxStatErrBadHandle;
+    }
+    *props = &effect->props;
+    return kOfxStatOK;
+}
+
+OfxStatus getParamSet(OfxImageEffectHandle effect, OfxParamSetHandle* paramSet) {
+    if (!effect) {
+        return kOfxStatErrBadHandle;
+    }
+    *paramSet = &effect->params;
+    return kOfxStatOK;
+}
+
+OfxStatus clipDefine(OfxImageEffectHandle effect, const char* name, OfxPropertySetHandle* props) {
+    if (!effect || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::unique_ptr<OfxImageClipStruct>& clip = effect->clips[name];
+    if (!clip) {
+        clip.reset(new OfxImageClipStruct());
+        clip->name = name;
+        clip->host = effect->host;
+        propSetString(&clip->props, kOfxPropName, 0, name);
+    }
+    if (props) {
+        *props = &clip->props;
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus clipGetHandle(OfxImageEffectHandle effect, const char* name, OfxImageClipHandle* clip, OfxPropertySetHandle* props) {
+    if (!effect || !name) {
+        return kOfxStatErrBadHandle;
+    }
+    std::map<std::string, std::unique_ptr<OfxImageClipStruct> >::iterator it = effect->clips.find(name);
+    if (it == effect->clips.end()) {
+        return kOfxStatErrUnknown;
+    }
+    if (clip) {
+        *clip = it->second.get();
+    }
+    if (props) {
+        *props = &it->second->props;
+    }
+    return kOfxStatOK;
+}
+
+OfxStatus clipGetPropertySet(OfxImageClipHandle clip, OfxPropertySetHandle* props) {
+    if (!clip) {
+        return kOfxStatErrBadHandle;
+    }
+    *props = &clip->props;
+    return kOfxStatOK;
+}
+
+OfxStatus clipGetImage(OfxImageClipHandle clip, double time, const OfxRectD*, OfxPropertySetHandle* image) {
+    if (!clip || !image) {
+        return kOfxStatErrBadHandle;
+    }
+    Host::Impl* host = clip->host;
+    if (clip->name == kOfxImageEffectOutputClipName) {
+        if (!host->output) {
+            return kOfxStatFailed;
+        }
+        *image = makeImage(*host->output);
+        return kOfxStatOK;
+    }
+
+    HostImage source;
+    if (!host->source || !host->source(time, source)) {
+        return kOfxStatFailed;
+    }
+    *image = makeImage(source);
+    return kOfxStatOK;
+}
+
+OfxStatus clipReleaseImage(OfxPropertySetHandle image) {
+    delete image;
+    return kOfxStatOK;
+}
+
+OfxStatus clipGetRegionOfDefinition(OfxImageClipHandle clip, double time, OfxRectD* bounds) {
+    if (!clip || !bounds) {
+        return kOfxStatErrBadHandle;
+    }
+    Host::Impl* host = clip->host;
+    HostImage image;
+    if (clip->name == kOfxImageEffectOutputClipName && host->output) {
+        image = *host->output;
+    } else if (!host->source || !host->source(time, image)) {
+        return kOfxStatFailed;
+    }
+    bounds->x1 = image.bounds.x1;
+    bounds->y1 = image.bounds.y1;
+    bounds->x2 = image.bounds.x2;
+    bounds->y2 = image.bounds.y2;
+    return kOfxStatOK;
+}
+
+int abortEffect(OfxImageEffectHandle effect) {
+    if (!effect || !effect->host) {
+        return 0;
+    }
+    Host::Impl* host = effect->host;
+    host->abortCalls.fetch_add(1, std::memory_order_relaxed);
+    return host->abort && host->abort() ? 1 : 0;
+}
+
+OfxStatus imageMemoryAlloc(OfxImageEffectHandle, size_t bytes, OfxImageMemoryHandle* memory) {
+    void* data = malloc(bytes);
+    if (!data) {
+        return kOfxStatErrMemory;
+    }
+    *memory = new OfxImageMemoryStruct();
+    (*memory)->data = data;
+    return kOfxStatOK;
+}
+
+OfxStatus imageMemoryLock(OfxImageMemoryHandle memory, void** data) {
+    if (!memory) {
+        return kOfxStatErrBadHandle;
+    }
+    *data = memory->data;
+    return kOfxStatOK;
+}
+
+OfxStatus imageMemoryUnlock(OfxImageMemoryHandle memory) {
+    return memory ? kOfxStatOK : kOfxStatErrBadHandle;
+}
+
+OfxStatus imageMemoryFree(OfxImageMemoryHandle memory) {
+    if (!memory) {
+        return kOfxStatErrBadHandle;
+    }
+    free(memory->data);
+    delete memory;
+    return kOfxStatOK;
+}
+
+OfxImageEffectSuiteV1 gMockImageEffectSuite = {
+    getPropertySet, getParamSet, clipDefine, clipGetHandle, clipGetPropertySet,
+    clipGetImage, clipReleaseImage, clipGetRegionOfDefinition, abortEffect,
+    imageMemoryAlloc, imageMemoryLock, imageMemoryUnlock, imageMemoryFree
+};
+
+const void* fetchSuite(OfxPropertySetHandle, const char* name, int version) {
+    if (!name || version != 1) {
+        return nullptr;
+    }
+    if (strcmp(name, kOfxPropertySuite) == 0) {
+        return &gMockPropertySuite;
+    }
+    if (strcmp(name, kOfxImageEffectSuite) == 0) {
+        return &gMockImageEffectSuite;
+    }
+    if (strcmp(name, kOfxParameterSuite) == 0) {
+        return &gMockParameterSuite;
+    }
+    return nullptr;
+}
+
+// Resolve "Name.ofx.bundle" to the binary inside it
+std::string binaryPath(const std::string& path) {
+    const std::string suffix = ".ofx.bundle";
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && (trimmed[trimmed.size() - 1] == '/' || trimmed[trimmed.size() - 1] == '\\')) {
+        trimmed.erase(trimmed.size() - 1);
+    }
+    if (trimmed.size() <= suffix.size() || trimmed.compare(trimmed.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return path;
+    }
+    size_t slash = trimmed.find_last_of("/\\");
+    std::string name = trimmed.substr(slash == std::string::npos ? 0 : slash + 1);
+    name.erase(name.size() - suffix.size());
+#if defined(_WIN32)
+    const char* arch = "Win64";
+#elif defined(__APPLE__)
+    const char* arch = "MacOS";
+#else
+    const char* arch = "Linux-x86-64";
+#endif
+    return trimmed + "/Contents/" + arch + "/" + name + ".ofx";
+}
+
+OfxParamHandle findParam(Host::Impl& host, const std::string& name) {
+    if (!host.instance) {
+        return nullptr;
+    }
+    std::map<std::string, std::unique_ptr<OfxParamStruct> >::iterator it = host.instance->params.params.find(name);
+    return it == host.instance->params.params.end() ? nullptr : it->second.get();
+}
+
+} // namespace
+
+Host::Host()
+    : impl(new Impl())
+{
+    impl->ofxHost.host = &impl->hostProps;
+    impl->ofxHost.fetchSuite = fetchSuite;
+    propSetString(&impl->hostProps, kOfxPropName, 0, "ofx.mock.host");
+    propSetString(&impl->hostProps, kOfxPropLabel, 0, "Mock Host");
+
+    // Host-side helpers (PropertySet) use this process's copy of the suite pointers
+    gPropertySuite = &gMockPropertySuite;
+    gImageEffectSuite = &gMockImageEffectSuite;
+    gParameterSuite = &gMockParameterSuite;
+}
+
+Host::~Host() {
+    unload();
+}
+
+bool Host::load(const std::string& path, std::string& error, int index) {
+    unload();
+    std::string binary = binaryPath(path);
+
+    typedef OfxPlugin* (*GetPluginFunc)(int);
+    GetPluginFunc getPlugin = nullptr;
+#ifdef _WIN32
+    impl->library = LoadLibraryA(binary.c_str());
+    if (impl->library) {
+        getPlugin = (GetPluginFunc)GetProcAddress(impl->library, "OfxGetPlugin");
+    }
+#else
+    impl->library = dlopen(binary.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (impl->library) {
+        getPlugin = (GetPluginFunc)dlsym(impl->library, "OfxGetPlugin");
+    }
+#endif
+    if (!impl->library) {
+        error = "cannot load " + binary;
+        return false;
+    }
+    if (!getPlugin || !(impl->plugin = getPlugin(index))) {
+        error = "no OfxGetPlugin entry point in " + binary;
+        unload();
+        return false;
+    }
+
+    impl->plugin->setHost(&impl->ofxHost);
+    if (impl->call(kOfxActionLoad, nullptr, nullptr, nullptr) != kOfxStatOK) {
+        error = "load action failed";
+        unload();
+        return false;
+    }
+
+    OfxStatus status = impl->call(kOfxActionDescribe, &impl->descriptor, nullptr, nullptr);
+    OfxPropertySetStruct contextArgs;
+    propSetString(&contextArgs, kOfxImageEffectPropContext, 0, kOfxImageEffectContextFilter);
+    if (status == kOfxStatOK) {
+        status = impl->call(kOfxActionDescribeInContext, &impl->descriptor, &contextArgs, nullptr);
+    }
+    if (status != kOfxStatOK) {
+        error = "describe failed";
+        unload();
+        return false;
+    }
+
+    // The instance starts as a copy of the descriptor, with parameters at their defaults
+    std::unique_ptr<OfxImageEffectStruct> instance(new OfxImageEffectStruct());
+    instance->host = impl.get();
+    instance->props = impl->descriptor.props;
+    propSetString(&instance->props, kOfxImageEffectPropContext, 0, kOfxImageEffectContextFilter);
+    for (std::map<std::string, std::unique_ptr<OfxImageClipStruct> >::iterator it = impl->descriptor.clips.begin();
+         it != impl->descriptor.clips.end(); ++it) {
+        std::unique_ptr<OfxImageClipStruct> clip(new OfxImageClipStruct(*it->second));
+        clip->host = impl.get();
+        propSetInt(&clip->props, kOfxImageClipPropConnected, 0, 1);
+        instance->clips[it->first] = std::move(clip);
+    }
+    instance->params.order = impl->descriptor.params.order;
+    for (std::map<std::string, std::unique_ptr<OfxParamStruct> >::iterator it = impl->descriptor.params.params.begin();
+         it != impl->descriptor.params.params.end(); ++it) {
+        std::unique_ptr<OfxParamStruct> param(new OfxParamStruct(*it->second));
+        paramSetToDefault(param.get());
+        param->reads = &impl->paramReads;
+        instance->params.params[it->first] = std::move(param);
+    }
+    impl->instance = std::move(instance);
+
+    if (impl->call(kOfxActionCreateInstance, impl->instance.get(), nullptr, nullptr) != kOfxStatOK) {
+        error = "create instance failed";
+        impl->instance.reset();
+        unload();
+        return false;
+    }
+    return true;
+}
+
+void Host::unload() {
+    if (impl->instance) {
+        impl->call(kOfxActionDestroyInstance, impl->instance.get(), nullptr, nullptr);
+        impl->instance.reset();
+    }
+    if (impl->plugin) {
+        impl->call(kOfxActionUnload, nullptr, nullptr, nullptr);
+        impl->plugin = nullptr;
+    }
+    if (impl->library) {
+#ifdef _WIN32
+        FreeLibrary(impl->library);
+#else
+        dlclose(impl->library);
+#endif
+        impl->library = nullptr;
+    }
+    impl->descriptor.props.values.clear();
+    impl->descriptor.params.params.clear();
+    impl->descriptor.params.order.clear();
+    impl->descriptor.clips.clear();
+}
+
+bool Host::setValue(const std::string& name, double v0, double v1, double v2, double v3) {
+    OfxParamHandle param = findParam(*impl, name);
+    if (!param || param->dimension == 0) {
+        return false;
+    }
+    double values[4] = { v0, v1, v2, v3 };
+    for (int i = 0; i < param->dimension; i++) {
+        param->value[i] = values[i];
+    }
+    return true;
+}
+
+bool Host::setString(const std::string& name, const std::string& value) {
+    OfxParamHandle param = findParam(*impl, name);
+    if (!param || !param->text) {
+        return false;
+    }
+    param->string = value;
+    return true;
+}
+
+bool Host::setValueAtTime(const std::string& name, double time, double v0, double v1, double v2, double v3) {
+    OfxParamHandle param = findParam(*impl, name);
+    if (!param || param->dimension == 0) {
+        return false;
+    }
+    double values[4] = { v0, v1, v2, v3 };
+    std::vector<double> key(param->value, param->value + 4);
+    for (int i = 0; i < param->dimension; i++) {
+        key[i] = values[i];
+    }
+    param->keys[time] = key;
+    return true;
+}
+
+int Host::getValueAtTime(const std::string& name, double time, double* values, int count) const {
+    OfxParamHandle param = findParam(*impl, name);
+    if (!param || param->dimension == 0) {
+        return 0;
+    }
+    double all[4];
+    evaluateParam(*param, time, all);
+    int n = std::min(count, param->dimension);
+    for (int i = 0; i < n; i++) {
+        values[i] = all[i];
+    }
+    return n;
+}
+
+void Host::setSource(const FrameProvider& provider, double firstFrame, double lastFrame) {
+    impl->source = provider;
+    if (!impl->instance) {
+        return;
+    }
+    double range[2] = { firstFrame, lastFrame };
+    for (std::map<std::string, std::unique_ptr<OfxImageClipStruct> >::iterator it = impl->instance->clips.begin();
+         it != impl->instance->clips.end(); ++it) {
+        propSetDoubleN(&it->second->props, kOfxImageEffectPropFrameRange, 2, range);
+    }
+    propSetDoubleN(&impl->instance->props, kOfxImageEffectPropFrameRange, 2, range);
+}
+
+void Host::setAbort(const std::function<bool()>& abort) {
+    impl->abort = abort;
+}
+
+long Host::abortCalls() const {
+    return impl->abortCalls.load();
+}
+
+long Host::paramReads() const {
+    return impl->paramReads.load();
+}
+
+OfxStatus Host::render(double time, const OfxRectI& window, HostImage& output) {
+    if (!impl->instance) {
+        return kOfxStatErrBadHandle;
+    }
+    OfxImageClipStruct* outputClip = impl->instance->clips[kOfxImageEffectOutputClipName].get();
+    if (outputClip) {
+        propSetString(&outputClip->props, kOfxImageEffectPropPixelDepth, 0, depthString(output.depth));
+    }
+
+    OfxPropertySetStruct inArgs;
+    int renderWindow[4] = { window.x1, window.y1, window.x2, window.y2 };
+    double scale[2] = { 1.0, 1.0 };
+    propSetDouble(&inArgs, kOfxPropTime, 0, time);
+    propSetIntN(&inArgs, kOfxImageEffectPropRenderWindow, 4, renderWindow);
+    propSetDoubleN(&inArgs, kOfxImageEffectPropRenderScale, 2, scale);
+
+    impl->output = &output;
+    OfxStatus status = impl->call(kOfxImageEffectActionRender, impl->instance.get(), &inArgs, nullptr);
+    impl->output = nullptr;
+    return status;
+}
+
+BitDepth Host::clipPreferences(BitDepth sourceDepth) {
+    if (!impl->instance) {
+        return sourceDepth;
+    }
+    OfxImageClipStruct* sourceClip = impl->instance->clips[kOfxImageEffectSimpleSourceClipName].get();
+    if (sourceClip) {
+        propSetString(&sourceClip->props, kOfxImageEffectPropPixelDepth, 0, depthString(sourceDepth));
+    }
+
+    OfxPropertySetStruct inArgs, outArgs;
+    OfxStatus status = impl->call(kOfxImageEffectActionGetClipPreferences, impl->instance.get(), &inArgs, &outArgs);
+    char* depth = nullptr;
+    if (status != kOfxStatOK
+        || propGetString(&outArgs, kOfxImageClipPropDepth kOfxImageEffectOutputClipName, 0, &depth) != kOfxStatOK) {
+        return sourceDepth;
+    }
+    BitDepth outputDepth = parseDepth(depth);
+    return outputDepth != kBitDepthNone ? outputDepth : sourceDepth;
+}
+
+OfxStatus Host::beginSequenceRender(double firstFrame, double lastFrame, BitDepth depth) {
+    if (!impl->instance) {
+        return kOfxStatErrBadHandle;
+    }
+    BitDepth outputDepth = clipPreferences(depth);
+    for (std::map<std::string, std::unique_ptr<OfxImageClipStruct> >::iterator it = impl->instance->clips.begin();
+         it != impl->instance->clips.end(); ++it) {
+        BitDepth clipDepth = it->first == kOfxImageEffectOutputClipName ? outputDepth : depth;
+        propSetString(&it->second->props, kOfxImageEffectPropPixelDepth, 0, depthString(clipDepth));
+    }
+
+    OfxPropertySetStruct inArgs;
+    double range[2] = { firstFrame, lastFrame };
+    double scale[2] = { 1.0, 1.0 };
+    propSetDoubleN(&inArgs, kOfxImageEffectPropFrameRange, 2, range);
+    propSetDoubleN(&inArgs, kOfxImageEffectPropRenderScale, 2, scale);
+    return impl->call(kOfxImageEffectActionBeginSequenceRender, impl->instance.get(), &inArgs, nullptr);
+}
+
+OfxStatus Host::endSequenceRender(double firstFrame, double lastFrame) {
+    if (!impl->instance) {
+        return kOfxStatErrBadHandle;
+    }
+    OfxPropertySetStruct inArgs;
+    double range[2] = { firstFrame, lastFrame };
+    double scale[2] = { 1.0, 1.0 };
+    propSetDoubleN(&inArgs, kOfxImageEffectPropFrameRange, 2, range);
+    propSetDoubleN(&inArgs, kOfxImageEffectPropRenderScale, 2, scale);
+    return impl->call(kOfxImageEffectActionEndSequenceRender, impl->instance.get(), &inArgs, nullptr);
+}
+
+OfxStatus Host::paramChanged(const std::string& name, double time) {
+    if (!impl->instance) {
+        return kOfxStatErrBadHandle;
+    }
+    OfxPropertySetStruct reason;
+    propSetString(&reason, kOfxPropChangeReason, 0, kOfxChangeUserEdited);
+
+    OfxPropertySetStruct inArgs = reason;
+    double scale[2] = { 1.0, 1.0 };
+    propSetString(&inArgs, kOfxPropType, 0, kOfxTypeParameter);
+    propSetString(&inArgs, kOfxPropName, 0, name.c_str());
+    propSetDouble(&inArgs, kOfxPropTime, 0, time);
+    propSetDoubleN(&inArgs, kOfxImageEffectPropRenderScale, 2, scale);
+
+    impl->call(kOfxActionBeginInstanceChanged, impl->instance.get(), &reason, nullptr);
+    OfxStatus status = impl->call(kOfxActionInstanceChanged, impl->instance.get(), &inArgs, nullptr);
+    impl->call(kOfxActionEndInstanceChanged, impl->instance.get(), &reason, nullptr);
+    return status;
+}
+
+OfxStatus Host::action(const char* action) {
+    return this->action(action, std::function<void(PropertySet&)>());
+}
+
+OfxStatus Host::action(const char* action,
+                       const std::function<void(PropertySet&)>& fill,
+                       const std::function<void(PropertySet&)>& inspect) {
+    if (!impl->instance) {
+        return kOfxStatErrBadHandle;
+    }
+    OfxPropertySetStruct inArgs, outArgs;
+    if (fill) {
+        PropertySet props(&inArgs);
+        fill(props);
+    }
+    OfxStatus status = impl->call(action, impl->instance.get(), &inArgs, &outArgs);
+    if (inspect) {
+        PropertySet props(&outArgs);
+        inspect(props);
+    }
+    return status;
+}
+
+} // namespace mock
+} // namespace ofx
@@ -0,0 +1,157 @@
+#ifndef _ofxMockHost_h_
+#define _ofxMockHost_h_
+
+#include "ofxCore.h"
+#include "ofxImageEffect.h"
+#include "ofxProperty.h"
+#include "ofxParam.h"
+#include "ofxUtilities.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * @file ofxMockHost.h
+ * @brief Minimal in-process OFX host for driving plugin binaries from tools
+ */
+
+namespace ofx {
+namespace mock {
+
+/**
+ * @brief Pixel buffer owned by the caller and lent to the plugin as a clip image
+ */
+struct HostImage {
+    void* data;
+    OfxRectI bounds;
+    int rowBytes;
+    BitDepth depth;
+    std::string uniqueIdentifier;
+
+    HostImage() : data(nullptr), rowBytes(0), depth(kBitDepthNone) {
+        bounds.x1 = bounds.y1 = bounds.x2 = bounds.y2 = 0;
+    }
+};
+
+/**
+ * @brief Supplies the source image for a frame; returns false if there is none
+ */
+typedef std::function<bool(double time, HostImage& image)> FrameProvider;
+
+/**
+ * @brief Loads one filter plugin and hosts a single instance of it
+ *
+ * Implements the property, image effect and parameter suites closely enough
+ * for the plugins in this repository: typed properties, parameters with
+ * linear keyframes, a source and an output clip, and a settable abort
+ * callback. Parameter edits and renders are expected from one thread at a
+ * time; the plugin itself may use as many threads as it likes.
+ */
+class Host {
+public:
+    struct Impl;
+
+private:
+    std::unique_ptr<Impl> impl;
+
+public:
+    Host();
+    ~Host();
+
+    /**
+     * @brief Load a plugin binary, describe it in the filter context and create an instance
+     * @param index Plugin index within the binary
+     */
+    bool load(const std::string& path, std::string& error, int index = 0);
+
+    /**
+     * @brief Destroy the instance and unload the plugin
+     */
+    void unload();
+
+    /**
+     * @brief Set a parameter's value (no keyframes); values beyond the parameter's dimension are ignored
+     */
+    bool setValue(const std::string& name, double v0, double v1 = 0.0, double v2 = 0.0, double v3 = 0.0);
+    bool setString(const std::string& name, const std::string& value);
+
+    /**
+     * @brief Add a keyframe; values between keys are interpolated linearly
+     */
+    bool setValueAtTime(const std::string& name, double time, double v0, double v1 = 0.0, double v2 = 0.0, double v3 = 0.0);
+
+    /**
+     * @brief Read a parameter back, for example keys written by the plugin
+     * @return Number of values written to values, 0 if there is no such parameter
+     */
+    int getValueAtTime(const std::string& name, double time, double* values, int count) const;
+
+    /**
+     * @brief Source frames; the provider is called for every clipGetImage on the source clip
+     */
+    void setSource(const FrameProvider& provider, double firstFrame, double lastFrame);
+
+    /**
+     * @brief Abort callback returned to the plugin through OfxImageEffectSuiteV1::abort
+     */
+    void setAbort(const std::function<bool()>& abort);
+
+    /**
+     * @brief Number of times the plugin has called abort
+     */
+    long abortCalls() const;
+
+    /**
+     * @brief Number of parameter values the plugin has read from the host
+     */
+    long paramReads() const;
+
+    /**
+     * @brief Run the render action for one window into output
+     */
+    OfxStatus render(double time, const OfxRectI& window, HostImage& output);
+
+    /**
+     * @brief Run the clip preferences action with the source clip at sourceDepth
+     *
+     * @return The output depth the plugin asks for, sourceDepth if it leaves the default
+     */
+    BitDepth clipPreferences(BitDepth sourceDepth);
+
+    /**
+     * @brief Send the begin sequence render action for frames first to last
+     *
+     * The source clip takes depth and the output clip the depth from
+     * clipPreferences() first, as a host settles clip preferences before an
+     * export.
+     */
+    OfxStatus beginSequenceRender(double firstFrame, double lastFrame, BitDepth depth);
+    OfxStatus endSequenceRender(double firstFrame, double lastFrame);
+
+    /**
+     * @brief Send the instance changed action for a user edit of a parameter
+     */
+    OfxStatus paramChanged(const std::string& name, double time);
+
+    /**
+     * @brief Send an action with no arguments to the instance
+     */
+    OfxStatus action(const char* action);
+
+    /**
+     * @brief Send an action with property arguments built by the caller
+     *
+     * fill receives the in-args set, already holding nothing; the plugin's
+     * reply is left in the out-args set passed to inspect, if given.
+     */
+    OfxStatus action(const char* action,
+                     const std::function<void(PropertySet&)>& fill,
+                     const std::function<void(PropertySet&)>& inspect = std::function<void(PropertySet&)>());
+};
+
+} // namespace mock
+} // namespace ofx
+
+#endif // _ofxMockHost_h_
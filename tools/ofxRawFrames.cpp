@@ -0,0 +1,287 @@
+#include "ofxRawFrames.h"
+#include "ofxImageIO.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ofx {
+namespace io {
+
+const char* const kRawExtension = ".ofxraw";
+
+namespace {
+
+const char kMagic[8] = { 'O', 'F', 'X', 'R', 'G', 'B', 'A', '1' };
+
+uint64_t alignUp(uint64_t value) {
+    return (value + kRawAlignment - 1) & ~(kRawAlignment - 1);
+}
+
+mock::HostImage frameImage(const RawHeader& header, char* base, int index) {
+    mock::HostImage image;
+    image.data = base + header.dataOffset + (uint64_t)index * header.frameStride;
+    image.bounds.x2 = (int)header.width;
+    image.bounds.y2 = (int)header.height;
+    image.rowBytes = (int)header.rowBytes;
+    image.depth = (BitDepth)header.depth;
+    return image;
+}
+
+} // namespace
+
+bool isRawSequence(const std::string& path) {
+    size_t length = strlen(kRawExtension);
+    return path.size() > length && path.compare(path.size() - length, length, kRawExtension) == 0;
+}
+
+MappedFile::MappedFile()
+    : base(nullptr), bytes(0), writable(false)
+#ifdef _WIN32
+    , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#else
+    , descriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        error = path + ": cannot open";
+        close();
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    base = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!base) {
+        error = path + ": cannot map";
+        close();
+        return false;
+    }
+    bytes = (uint64_t)size.QuadPart;
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, uint64_t size, std::string& error) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = path + ": cannot create";
+        return false;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+    base = mapping ? (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0) : nullptr;
+    if (!base) {
+        error = path + ": cannot map";
+        close();
+        return false;
+    }
+    bytes = size;
+    writable = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) {
+        if (writable) {
+            FlushViewOfFile(base, 0);
+        }
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    base = nullptr;
+    bytes = 0;
+    writable = false;
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+}
+
+void MappedFile::willNeed(uint64_t, uint64_t) const {
+}
+
+bool MappedFile::release(uint64_t offset, uint64_t length) const {
+    return !writable || FlushViewOfFile(base + offset, (SIZE_T)length);
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, std::string& error) {
+    close();
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        error = path + ": cannot open";
+        close();
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (address == MAP_FAILED) {
+        error = path + ": cannot map";
+        close();
+        return false;
+    }
+    base = (char*)address;
+    bytes = (uint64_t)status.st_size;
+    madvise(base, (size_t)bytes, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, uint64_t size, std::string& error) {
+    close();
+    descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0 || ftruncate(descriptor, (off_t)size) != 0) {
+        error = path + ": cannot create";
+        close();
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (address == MAP_FAILED) {
+        error = path + ": cannot map";
+        close();
+        return false;
+    }
+    base = (char*)address;
+    bytes = size;
+    writable = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (base) {
+        munmap(base, (size_t)bytes);
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+    base = nullptr;
+    bytes = 0;
+    writable = false;
+    descriptor = -1;
+}
+
+void MappedFile::willNeed(uint64_t offset, uint64_t length) const {
+    if (base && offset < bytes) {
+        madvise(base + offset, (size_t)std::min(length, bytes - offset), MADV_WILLNEED);
+    }
+}
+
+bool MappedFile::release(uint64_t offset, uint64_t length) const {
+    if (!base || offset >= bytes) {
+        return true;
+    }
+    length = std::min(length, bytes - offset);
+    if (writable && msync(base + offset, (size_t)length, MS_SYNC) != 0) {
+        return false;
+    }
+    madvise(base + offset, (size_t)length, MADV_DONTNEED);
+    return true;
+}
+
+#endif
+
+bool RawSequenceReader::open(const std::string& path, std::string& error) {
+    identifier = fileIdentifier(path);
+    if (!file.open(path, error)) {
+        return false;
+    }
+    if (file.size() < sizeof(RawHeader)) {
+        error = path + ": not a raw frame sequence";
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    bool valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+        && (header.depth == 1 || header.depth == 2 || header.depth == 4)
+        && header.width > 0 && header.height > 0 && header.frameCount > 0
+        && header.rowBytes >= header.width * 4 * header.depth
+        && header.frameStride >= (uint64_t)header.rowBytes * header.height
+        && header.dataOffset % kRawAlignment == 0 && header.frameStride % kRawAlignment == 0
+        && header.dataOffset + header.frameStride * header.frameCount <= file.size();
+    if (!valid) {
+        error = path + ": not a raw frame sequence, or truncated";
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+mock::HostImage RawSequenceReader::frame(int index) const {
+    prefetch(index + 1, index + lookahead);
+    mock::HostImage image = frameImage(header, file.data(), index);
+    image.uniqueIdentifier = identifier + ":" + std::to_string(index);
+    return image;
+}
+
+void RawSequenceReader::prefetch(int first, int last) const {
+    first = std::max(first, 0);
+    last = std::min(last, frameCount() - 1);
+    if (first <= last) {
+        file.willNeed(header.dataOffset + (uint64_t)first * header.frameStride,
+                      (uint64_t)(last - first + 1) * header.frameStride);
+    }
+}
+
+void RawSequenceReader::release(int first, int last) const {
+    first = std::max(first, 0);
+    last = std::min(last, frameCount() - 1);
+    if (first <= last) {
+        file.release(header.dataOffset + (uint64_t)first * header.frameStride,
+                     (uint64_t)(last - first + 1) * header.frameStride);
+    }
+}
+
+bool RawSequenceWriter::create(const std::string& path, int width, int height, BitDepth depth, int frameCount,
+                               std::string& error) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.depth = (uint32_t)depth;
+    header.rowBytes = (uint32_t)(width * 4 * (int)depth);
+    header.frameCount = (uint32_t)frameCount;
+    header.frameStride = alignUp((uint64_t)header.rowBytes * height);
+    header.dataOffset = alignUp(sizeof(RawHeader));
+    if (!file.create(path, header.dataOffset + header.frameStride * frameCount, error)) {
+        return false;
+    }
+    memcpy(file.data(), &header, sizeof(header));
+    return true;
+}
+
+mock::HostImage RawSequenceWriter::frame(int index) const {
+    return frameImage(header, file.data(), index);
+}
+
+bool RawSequenceWriter::finish(int index, std::string& error) const {
+    if (!file.release(header.dataOffset + (uint64_t)index * header.frameStride, header.frameStride)) {
+        error = "write back of frame " + std::to_string(index) + " failed";
+        return false;
+    }
+    return true;
+}
+
+} // namespace io
+} // namespace ofx
@@ -0,0 +1,162 @@
+#ifndef _ofxRawFrames_h_
+#define _ofxRawFrames_h_
+
+#include "ofxMockHost.h"
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * @file ofxRawFrames.h
+ * @brief Memory-mapped raw RGBA frame sequences for the host tools
+ */
+
+namespace ofx {
+namespace io {
+
+/**
+ * @brief File extension of a raw frame sequence, with the dot
+ */
+extern const char* const kRawExtension;
+
+/**
+ * @brief True if path names a raw frame sequence
+ */
+bool isRawSequence(const std::string& path);
+
+/**
+ * @brief Header at the start of a raw frame sequence, in the machine's byte order
+ *
+ * Frames follow at dataOffset, frameStride bytes apart. Both are multiples
+ * of kRawAlignment, so every frame starts on a page boundary and can be
+ * handed to a plugin in place, rows bottom to top as OFX addresses them.
+ */
+struct RawHeader {
+    char magic[8];          // "OFXRGBA" and the format version
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;         // Bytes per component: 1, 2 or 4 (float)
+    uint32_t rowBytes;
+    uint32_t frameCount;
+    uint32_t reserved;
+    uint64_t frameStride;
+    uint64_t dataOffset;
+};
+
+/**
+ * @brief Alignment of the pixel data; covers 4 KB and 16 KB pages and the Windows mapping granularity
+ */
+static const uint64_t kRawAlignment = 65536;
+
+/**
+ * @brief File mapped into memory whole, read-only or read-write
+ */
+class MappedFile {
+private:
+    char* base;
+    uint64_t bytes;
+    bool writable;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int descriptor;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * @brief Map an existing file for reading
+     */
+    bool open(const std::string& path, std::string& error);
+
+    /**
+     * @brief Create or replace a file of size bytes and map it for writing
+     */
+    bool create(const std::string& path, uint64_t size, std::string& error);
+
+    void close();
+
+    char* data() const { return base; }
+    uint64_t size() const { return bytes; }
+
+    /**
+     * @brief Hint that the range will be read soon; the kernel starts reading it in
+     */
+    void willNeed(uint64_t offset, uint64_t length) const;
+
+    /**
+     * @brief Drop the range's pages from this mapping; written pages are flushed first
+     *
+     * Reading the range again faults it back in from the file.
+     */
+    bool release(uint64_t offset, uint64_t length) const;
+};
+
+/**
+ * @brief Frames of a raw sequence, read straight from the mapping
+ *
+ * Opening advises the kernel of sequential access. frame() returns images
+ * pointing into the mapping, which stay valid until the reader closes, and
+ * asks for the next frames to be read ahead; release() lets go of frames
+ * that are done with, so long sequences stream in bounded memory.
+ */
+class RawSequenceReader {
+private:
+    MappedFile file;
+    RawHeader header;
+    std::string identifier;     // fileIdentifier() of the sequence, which frame identifiers extend
+    int lookahead;
+
+public:
+    explicit RawSequenceReader(int lookahead = 2) : lookahead(lookahead) {}
+
+    bool open(const std::string& path, std::string& error);
+
+    int frameCount() const { return (int)header.frameCount; }
+    int width() const { return (int)header.width; }
+    int height() const { return (int)header.height; }
+    BitDepth depth() const { return (BitDepth)header.depth; }
+
+    /**
+     * @brief Frame index, prefetching the lookahead frames after it
+     */
+    mock::HostImage frame(int index) const;
+
+    void prefetch(int first, int last) const;
+    void release(int first, int last) const;
+};
+
+/**
+ * @brief Raw sequence written through a shared mapping
+ *
+ * frame() returns an image to render into directly. finish() writes a
+ * frame's pages back to the file and drops them, so dirty pages do not pile
+ * up in memory.
+ */
+class RawSequenceWriter {
+private:
+    MappedFile file;
+    RawHeader header;
+
+public:
+    bool create(const std::string& path, int width, int height, BitDepth depth, int frameCount, std::string& error);
+
+    int frameCount() const { return (int)header.frameCount; }
+
+    mock::HostImage frame(int index) const;
+
+    bool finish(int index, std::string& error) const;
+
+    void close() { file.close(); }
+};
+
+} // namespace io
+} // namespace ofx
+
+#endif // _ofxRawFrames_h_
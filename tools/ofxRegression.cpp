@@ -0,0 +1,574 @@
+/*
+ * ofxRegression.cpp
+ *
+ * Renders synthetic charts through every kernel variant of the plugin at
+ * every pair of source and output depths, and compares the fast path with
+ * the double-precision reference path. Each channel's largest and mean
+ * error must stay within tolerances given in output codes. Float renders are
+ * also redone in tiles and compared with the whole frame, and Soften's
+ * recursive blur, which both paths share, with an exact Gaussian. Exits
+ * non-zero if any comparison fails, so performance work can be gated on it.
+ */
+
+#include "ofxBlur.h"
+#include "ofxMockHost.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef OFX_REGRESSION_PLUGIN
+#define OFX_REGRESSION_PLUGIN ""
+#endif
+
+using namespace ofx;
+
+namespace {
+
+const int kChartWidth = 256;
+const int kChartHeight = 64;
+
+// Frames on each side of frame 0, which the temporal variant averages with
+const int kNeighborFrames = 2;
+
+// Largest difference between a tiled and a whole-frame float render, what the recursive blur's margin promises
+const double kTileTolerance = 1e-4;
+
+// Largest difference between the recursive blur and an exact Gaussian; Young and van Vliet's fit is good to
+// about half a percent
+const double kRecursiveBlurTolerance = 1e-2;
+
+/**
+ * @brief Parameter value for a variant: up to four numbers, or text when text is set
+ */
+struct Setting {
+    const char* name;
+    double values[4];
+    const char* text;
+};
+
+/**
+ * @brief One kernel variant: the parameters that steer the plugin into it
+ */
+struct Variant {
+    const char* name;
+    std::vector<Setting> settings;
+    double wideMaxCodes;    // Largest error allowed at 16-bit and float output, 0 for the default
+};
+
+Setting value(const char* name, double v0, double v1 = 0.0, double v2 = 0.0, double v3 = 0.0) {
+    Setting setting = { name, { v0, v1, v2, v3 }, nullptr };
+    return setting;
+}
+
+Setting text(const char* name, const char* text) {
+    Setting setting = { name, { 0.0, 0.0, 0.0, 0.0 }, text };
+    return setting;
+}
+
+std::vector<Variant> variants() {
+    std::vector<Variant> list;
+    list.push_back({ "identity", {}, 0.0 });
+    list.push_back({ "primary", { value("gain", 1.15), value("gamma", 0.8), value("saturation", 1.3),
+                                  value("rgbGain", 1.05, 1.0, 0.92) }, 0.0 });
+    list.push_back({ "wheels", { value("liftWheel", 0.02, -0.01, 0.03), value("gammaWheel", 1.1, 0.95, 1.0),
+                                 value("gainWheel", 1.05, 1.0, 0.95), value("liftMaster", 0.02),
+                                 value("gammaMaster", 1.1), value("gainMaster", 0.95) }, 0.0 });
+    list.push_back({ "curves", { text("curveMaster", "0 0 0.25 0.2 0.75 0.85 1 1"),
+                                 text("curveRed", "0 0.05 1 0.95"), value("saturation", 1.2) }, 0.0 });
+    list.push_back({ "color space", { value("inputColorSpace", 3), value("outputColorSpace", 0),
+                                      value("gain", 1.1) }, 0.0 });
+    list.push_back({ "qualifier", { value("qualifierEnable", 1), value("qualifierHue", 0.0, 0.2, 0.05),
+                                    value("qualifierLuma", 0.2, 0.9, 0.1), value("gain", 1.3),
+                                    value("saturation", 0.5) }, 0.0 });
+    list.push_back({ "window", { value("windowShape", 1), value("windowCenter", 0.5, 0.5),
+                                 value("windowSize", 0.6, 0.6), value("windowFeather", 0.1),
+                                 value("gain", 1.2), value("gamma", 0.9) }, 0.0 });
+    list.push_back({ "rectangle", { value("windowShape", 2), value("windowCenter", 0.4, 0.55),
+                                    value("windowSize", 0.5, 0.7), value("windowFeather", 0.15),
+                                    value("gain", 0.9), value("saturation", 1.3) }, 0.0 });
+    // Concave, so the polygon's bounds test cannot settle every tile
+    list.push_back({ "polygon", { value("windowShape", 3), text("windowPoints", "0.1 0.1 0.9 0.2 0.5 0.5 0.8 0.9 0.2 0.8"),
+                                  value("windowSize", 0.8, 0.9), value("windowFeather", 0.05),
+                                  value("windowInvert", 1), value("gamma", 1.2) }, 0.0 });
+    list.push_back({ "detail", { value("sharpen", 0.8), value("midtoneDetail", 0.5), value("gain", 1.05) }, 0.0 });
+    list.push_back({ "soften", { value("soften", 2.0), value("saturation", 1.1) }, 0.0 });
+    // Past the recursive filter's threshold
+    list.push_back({ "soften wide", { value("soften", 8.0), value("gain", 1.1) }, 0.0 });
+    list.push_back({ "temporal", { value("temporalFrames", kNeighborFrames), value("temporalThreshold", 0.1),
+                                   value("gamma", 0.9) }, 0.0 });
+    list.push_back({ "dither", { value("outputDither", 2), value("gamma", 0.7) }, 0.0 });
+
+    // Unclamped float output; gamma alone is odd and takes the magnitude table path, lift and a log encode need
+    // the negative tables
+    list.push_back({ "extended", { value("extendedRange", 1), value("gamma", 0.8), value("saturation", 1.4),
+                                   value("gain", 1.2) }, 0.0 });
+    list.push_back({ "extended log", { value("extendedRange", 1), value("outputColorSpace", 3),
+                                       value("liftWheel", -0.03, 0.0, 0.02), value("gammaWheel", 1.1, 1.0, 0.9),
+                                       value("saturation", 1.2) }, 0.0 });
+    return list;
+}
+
+/**
+ * @brief Synthetic chart: RGBA at a pixel, in normalized units
+ */
+struct Chart {
+    const char* name;
+    bool floatOnly;     // Values integer sources cannot hold
+    std::function<void(int x, int y, double rgba[4])> pixel;
+};
+
+uint32_t hash(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    return v ^ (v >> 16);
+}
+
+double unit(uint32_t v) {
+    return (double)(hash(v) >> 8) / 16777216.0;
+}
+
+std::vector<Chart> charts() {
+    std::vector<Chart> list;
+
+    // Gray, red, green and blue ramps in bands, the last with an alpha ramp
+    list.push_back({ "ramps", false, [](int x, int y, double rgba[4]) {
+        double t = (double)x / (kChartWidth - 1);
+        int band = y * 4 / kChartHeight;
+        for (int c = 0; c < 3; c++) {
+            rgba[c] = band == 0 || band == c + 1 ? t : 0.0;
+        }
+        rgba[3] = band == 3 ? 1.0 - t : 1.0;
+    } });
+
+    // 75% bars over 100% bars
+    list.push_back({ "bars", false, [](int x, int y, double rgba[4]) {
+        static const int kBars[8][3] = {
+            { 1, 1, 1 }, { 1, 1, 0 }, { 0, 1, 1 }, { 0, 1, 0 }, { 1, 0, 1 }, { 1, 0, 0 }, { 0, 0, 1 }, { 0, 0, 0 }
+        };
+        const int* bar = kBars[x * 8 / kChartWidth];
+        double level = y < kChartHeight / 2 ? 0.75 : 1.0;
+        for (int c = 0; c < 3; c++) {
+            rgba[c] = bar[c] * level;
+        }
+        rgba[3] = 1.0;
+    } });
+
+    list.push_back({ "noise", false, [](int x, int y, double rgba[4]) {
+        uint32_t seed = (uint32_t)(y * kChartWidth + x) * 4u;
+        for (int c = 0; c < 4; c++) {
+            rgba[c] = unit(seed + c);
+        }
+    } });
+
+    // Ramp from -0.5 to 4, with a row of noise scaled to 8
+    list.push_back({ "hdr", true, [](int x, int y, double rgba[4]) {
+        double t = -0.5 + 4.5 * x / (kChartWidth - 1);
+        uint32_t seed = (uint32_t)(y * kChartWidth + x) * 3u;
+        for (int c = 0; c < 3; c++) {
+            rgba[c] = y < kChartHeight / 2 ? t * (1.0 - 0.2 * c) : 8.0 * unit(seed + c);
+        }
+        rgba[3] = 1.0;
+    } });
+
+    // A ramp with NaN, infinities, huge and denormal values scattered through it
+    list.push_back({ "non-finite", true, [](int x, int y, double rgba[4]) {
+        const double specials[] = {
+            std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity(), 1e30, -1e30, std::numeric_limits<float>::denorm_min()
+        };
+        uint32_t seed = (uint32_t)(y * kChartWidth + x) * 4u;
+        for (int c = 0; c < 4; c++) {
+            uint32_t h = hash(seed + c);
+            rgba[c] = h % 7 == 0 ? specials[(h >> 8) % 6] : (double)x / (kChartWidth - 1);
+        }
+    } });
+
+    return list;
+}
+
+/**
+ * @brief RGBA image at one depth
+ */
+struct ChartImage {
+    std::vector<unsigned char> storage;
+    mock::HostImage image;
+
+    explicit ChartImage(BitDepth depth) {
+        image.rowBytes = kChartWidth * 4 * (int)depth;
+        storage.resize((size_t)image.rowBytes * kChartHeight);
+        image.data = &storage[0];
+        image.bounds.x2 = kChartWidth;
+        image.bounds.y2 = kChartHeight;
+        image.depth = depth;
+    }
+
+    // Integer samples as their exact codes, float samples in units of 2^-16
+    double code(size_t i) const {
+        switch (image.depth) {
+            case kBitDepthByte:  return storage[i];
+            case kBitDepthShort: return ((const unsigned short*)&storage[0])[i];
+            default:             return ((const float*)&storage[0])[i] * 65536.0;
+        }
+    }
+
+    void set(size_t i, double v) {
+        switch (image.depth) {
+            case kBitDepthByte:  storage[i] = (unsigned char)(std::min(std::max(v, 0.0), 1.0) * 255.0 + 0.5); break;
+            case kBitDepthShort: ((unsigned short*)&storage[0])[i] = (unsigned short)(std::min(std::max(v, 0.0), 1.0) * 65535.0 + 0.5); break;
+            default:             ((float*)&storage[0])[i] = (float)v; break;
+        }
+    }
+};
+
+/**
+ * @brief Draw chart at a frame; frames other than 0 add a little noise, so temporal averaging has work to do
+ */
+void drawChart(const Chart& chart, int frame, ChartImage& image) {
+    for (int y = 0; y < kChartHeight; y++) {
+        for (int x = 0; x < kChartWidth; x++) {
+            double rgba[4];
+            chart.pixel(x, y, rgba);
+            uint32_t seed = ((uint32_t)(y * kChartWidth + x) * 4u) ^ hash((uint32_t)(frame + kNeighborFrames));
+            for (int c = 0; c < 4; c++) {
+                if (frame != 0 && c < 3) {
+                    rgba[c] += 0.06 * (unit(seed + c) - 0.5);
+                }
+                image.set(((size_t)y * kChartWidth + x) * 4 + c, rgba[c]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Largest difference between two float images; past a magnitude of 1 it is relative
+ *
+ * Infinite if only one of a pair of samples is finite.
+ */
+double floatDifference(const ChartImage& a, const ChartImage& b) {
+    const float* pa = (const float*)&a.storage[0];
+    const float* pb = (const float*)&b.storage[0];
+    double worst = 0.0;
+    size_t samples = (size_t)kChartWidth * kChartHeight * 4;
+    for (size_t i = 0; i < samples; i++) {
+        if (!std::isfinite(pa[i]) || !std::isfinite(pb[i])) {
+            bool same = std::isnan(pa[i]) ? std::isnan(pb[i]) : pa[i] == pb[i];
+            worst = same ? worst : std::numeric_limits<double>::infinity();
+            continue;
+        }
+        worst = std::max(worst, std::fabs((double)pa[i] - pb[i]) / std::max(1.0, std::fabs((double)pb[i])));
+    }
+    return worst;
+}
+
+/**
+ * @brief Render frame 0 in uneven tiles into output; false if any tile fails
+ */
+bool renderTiles(mock::Host& host, ChartImage& output) {
+    const int columns[] = { 0, 37, 150, kChartWidth };
+    const int rows[] = { 0, 21, kChartHeight };
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 3; i++) {
+            OfxRectI tile = { columns[i], rows[j], columns[i + 1], rows[j + 1] };
+            if (host.render(0.0, tile, output.image) != kOfxStatOK) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief The recursive blur on a float chart against a double-precision direct Gaussian
+ *
+ * The direct kernel runs to 8 sigma, so its truncation is far below the
+ * recursive filter's approximation error. Edges repeat, as in the blur.
+ * @return Largest difference
+ */
+double recursiveBlurError(const Chart& chart, double sigma) {
+    ChartImage source(kBitDepthFloat), blurred(kBitDepthFloat);
+    drawChart(chart, 0, source);
+    GaussianBlur blur(sigma);
+    blur.apply(source.image.data, source.image.bounds, source.image.rowBytes,
+               blurred.image.data, blurred.image.bounds, blurred.image.rowBytes, kBitDepthFloat);
+
+    int radius = (int)std::ceil(8.0 * sigma);
+    std::vector<double> weights(2 * radius + 1);
+    double sum = 0.0;
+    for (int k = -radius; k <= radius; k++) {
+        weights[k + radius] = std::exp(-0.5 * k * k / (sigma * sigma));
+        sum += weights[k + radius];
+    }
+    for (size_t k = 0; k < weights.size(); k++) {
+        weights[k] /= sum;
+    }
+
+    const float* in = (const float*)&source.storage[0];
+    std::vector<double> rows((size_t)kChartWidth * kChartHeight * 4, 0.0);
+    for (int y = 0; y < kChartHeight; y++) {
+        for (int x = 0; x < kChartWidth; x++) {
+            for (int k = -radius; k <= radius; k++) {
+                int sx = std::min(std::max(x + k, 0), kChartWidth - 1);
+                for (int c = 0; c < 4; c++) {
+                    rows[((size_t)y * kChartWidth + x) * 4 + c] += weights[k + radius] * in[((size_t)y * kChartWidth + sx) * 4 + c];
+                }
+            }
+        }
+    }
+    ChartImage expected(kBitDepthFloat);
+    for (int y = 0; y < kChartHeight; y++) {
+        for (int x = 0; x < kChartWidth; x++) {
+            for (int c = 0; c < 4; c++) {
+                double v = 0.0;
+                for (int k = -radius; k <= radius; k++) {
+                    int sy = std::min(std::max(y + k, 0), kChartHeight - 1);
+                    v += weights[k + radius] * rows[((size_t)sy * kChartWidth + x) * 4 + c];
+                }
+                expected.set(((size_t)y * kChartWidth + x) * 4 + c, v);
+            }
+        }
+    }
+    return floatDifference(blurred, expected);
+}
+
+/**
+ * @brief Largest and mean error allowed, in codes of the output depth
+ *
+ * Float output counts 2^-16 as a code, the precision of the fast path's
+ * single-precision lookup tables. Past a magnitude of 1, which only extended
+ * range writes, the error is relative instead: a code is 2^-16 of the
+ * reference value. The largest error allows one code of rounding at 8-bit
+ * and two at 16-bit and float, unless the variant allows more; mean error
+ * must stay a small fraction of a code.
+ */
+struct Tolerance {
+    double maxCodes;
+    double meanCodes;
+};
+
+Tolerance tolerance(BitDepth depth, const Variant& variant) {
+    Tolerance t = { 1.0, 0.05 };
+    if (depth != kBitDepthByte) {
+        t.maxCodes = variant.wideMaxCodes > 0.0 ? variant.wideMaxCodes : 2.0;
+        t.meanCodes = 0.1;
+    }
+    return t;
+}
+
+/**
+ * @brief Per-channel comparison of the fast path with the reference
+ */
+struct Comparison {
+    double maxError[4];
+    double meanError[4];
+    long nonFinite;      // Samples where only one path is finite, or they are different non-finite values
+    bool renderFailed;
+
+    Comparison() : nonFinite(0), renderFailed(false) {
+        std::fill(maxError, maxError + 4, 0.0);
+        std::fill(meanError, meanError + 4, 0.0);
+    }
+
+    bool passes(const Tolerance& t) const {
+        if (renderFailed || nonFinite > 0) {
+            return false;
+        }
+        for (int c = 0; c < 4; c++) {
+            if (maxError[c] > t.maxCodes || meanError[c] > t.meanCodes) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+Comparison compare(const ChartImage& fast, const ChartImage& reference) {
+    Comparison result;
+    long counts[4] = { 0, 0, 0, 0 };
+    size_t samples = (size_t)kChartWidth * kChartHeight * 4;
+    for (size_t i = 0; i < samples; i++) {
+        int c = (int)(i % 4);
+        double a = fast.code(i), b = reference.code(i);
+        if (!std::isfinite(a) || !std::isfinite(b)) {
+            bool same = std::isnan(a) ? std::isnan(b) : a == b;
+            result.nonFinite += same ? 0 : 1;
+            continue;
+        }
+        // Float values past 1, which extended range writes, are compared relative to the reference
+        double error = std::fabs(a - b);
+        if (fast.image.depth == kBitDepthFloat) {
+            error /= std::max(1.0, std::fabs(b) / 65536.0);
+        }
+        result.maxError[c] = std::max(result.maxError[c], error);
+        result.meanError[c] += error;
+        counts[c]++;
+    }
+    for (int c = 0; c < 4; c++) {
+        result.meanError[c] /= std::max(counts[c], 1L);
+    }
+    return result;
+}
+
+const char* depthName(BitDepth depth) {
+    return depth == kBitDepthByte ? "8-bit" : depth == kBitDepthShort ? "16-bit" : "float";
+}
+
+void usage() {
+    fprintf(stderr, "usage: ofxRegression [--plugin PATH] [--verbose]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string plugin = OFX_REGRESSION_PLUGIN;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--plugin") == 0 && i + 1 < argc) {
+            plugin = argv[++i];
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (plugin.empty()) {
+        usage();
+        return 2;
+    }
+
+    const BitDepth depths[] = { kBitDepthByte, kBitDepthShort, kBitDepthFloat };
+    const std::vector<Chart> chartList = charts();
+    const std::vector<Variant> variantList = variants();
+    int comparisons = 0, failures = 0;
+    double worst[3] = { 0.0, 0.0, 0.0 };
+
+    for (size_t v = 0; v < variantList.size(); v++) {
+        const Variant& variant = variantList[v];
+
+        // A fresh instance per variant, so no setting carries over
+        mock::Host host;
+        std::string error;
+        if (!host.load(plugin, error)) {
+            fprintf(stderr, "ofxRegression: %s\n", error.c_str());
+            return 1;
+        }
+        for (size_t s = 0; s < variant.settings.size(); s++) {
+            const Setting& setting = variant.settings[s];
+            bool set = setting.text
+                ? host.setString(setting.name, setting.text)
+                : host.setValue(setting.name, setting.values[0], setting.values[1], setting.values[2], setting.values[3]);
+            if (!set) {
+                fprintf(stderr, "ofxRegression: variant %s: no parameter %s\n", variant.name, setting.name);
+                return 1;
+            }
+        }
+
+        for (size_t k = 0; k < chartList.size(); k++) {
+            const Chart& chart = chartList[k];
+            for (int s = 0; s < 3; s++) {
+                if (chart.floatOnly && depths[s] != kBitDepthFloat) {
+                    continue;
+                }
+                // Frame 0 is the chart; the temporal variant also reads its neighbors
+                std::vector<std::unique_ptr<ChartImage> > frames(2 * kNeighborFrames + 1);
+                for (int f = 0; f < (int)frames.size(); f++) {
+                    frames[f].reset(new ChartImage(depths[s]));
+                    drawChart(chart, f - kNeighborFrames, *frames[f]);
+                }
+                const ChartImage& source = *frames[kNeighborFrames];
+                host.setSource([&frames](double time, mock::HostImage& image) {
+                    int f = (int)time + kNeighborFrames;
+                    if (f < 0 || f >= (int)frames.size()) {
+                        return false;
+                    }
+                    image = frames[f]->image;
+                    return true;
+                }, -kNeighborFrames, kNeighborFrames);
+
+                for (int d = 0; d < 3; d++) {
+                    ChartImage fast(depths[d]), reference(depths[d]);
+                    host.setValue("outputDepth", d + 1);
+                    host.setValue("referenceRender", 0);
+                    OfxStatus fastStatus = host.render(0.0, source.image.bounds, fast.image);
+                    host.setValue("referenceRender", 1);
+                    OfxStatus referenceStatus = host.render(0.0, source.image.bounds, reference.image);
+                    host.setValue("referenceRender", 0);
+
+                    Comparison result = compare(fast, reference);
+                    result.renderFailed = fastStatus != kOfxStatOK || referenceStatus != kOfxStatOK;
+                    Tolerance limit = tolerance(depths[d], variant);
+                    bool passed = result.passes(limit);
+                    comparisons++;
+                    failures += passed ? 0 : 1;
+                    for (int c = 0; c < 4; c++) {
+                        worst[d] = std::max(worst[d], result.maxError[c] / limit.maxCodes);
+                    }
+
+                    if (verbose || !passed) {
+                        printf("%-4s %-12s %-10s %6s -> %-6s max %7.3f %7.3f %7.3f %7.3f  mean %6.3f %6.3f %6.3f %6.3f",
+                               passed ? "ok" : "FAIL", variant.name, chart.name,
+                               depthName(depths[s]), depthName(depths[d]),
+                               result.maxError[0], result.maxError[1], result.maxError[2], result.maxError[3],
+                               result.meanError[0], result.meanError[1], result.meanError[2], result.meanError[3]);
+                        if (result.nonFinite) {
+                            printf("  %ld non-finite mismatches", result.nonFinite);
+                        }
+                        if (result.renderFailed) {
+                            printf("  render failed");
+                        }
+                        printf("\n");
+                    }
+
+                    // Tiles need the same margins as the whole frame, so they must join without seams
+                    if (depths[s] == kBitDepthFloat && depths[d] == kBitDepthFloat) {
+                        ChartImage tiled(kBitDepthFloat);
+                        bool tilesRendered = renderTiles(host, tiled);
+                        double difference = floatDifference(tiled, fast);
+                        bool tilesPassed = tilesRendered && fastStatus == kOfxStatOK && difference <= kTileTolerance;
+                        comparisons++;
+                        failures += tilesPassed ? 0 : 1;
+                        if (verbose || !tilesPassed) {
+                            printf("%-4s %-12s %-10s tiles            max %9.3g%s\n", tilesPassed ? "ok" : "FAIL",
+                                   variant.name, chart.name, difference, tilesRendered ? "" : "  render failed");
+                        }
+                    }
+                }
+            }
+        }
+        host.unload();
+    }
+
+    // Soften's recursive filter, which the reference render shares, against the exact blur
+    const Chart* noise = &chartList[0];
+    for (size_t k = 0; k < chartList.size(); k++) {
+        noise = strcmp(chartList[k].name, "noise") == 0 ? &chartList[k] : noise;
+    }
+    const double sigmas[] = { 5.0, 12.0 };
+    for (int i = 0; i < 2; i++) {
+        double error = recursiveBlurError(*noise, sigmas[i]);
+        bool passed = error <= kRecursiveBlurTolerance;
+        comparisons++;
+        failures += passed ? 0 : 1;
+        if (verbose || !passed) {
+            printf("%-4s recursive blur sigma %-4g against direct     max %9.3g\n",
+                   passed ? "ok" : "FAIL", sigmas[i], error);
+        }
+    }
+
+    printf("%d comparisons over %zu variants and %zu charts, %d failed\n",
+           comparisons, variantList.size(), chartList.size(), failures);
+    for (int d = 0; d < 3; d++) {
+        printf("%-6s output: worst error %.0f%% of its limit\n", depthName(depths[d]), 100.0 * worst[d]);
+    }
+    return failures ? 1 : 0;
+}